@@ -0,0 +1,161 @@
+#!/usr/bin/python
+# -*- coding: utf-8 -*-
+
+################################################################
+#
+#   Copyright notice
+#
+#   Control software for a Room Ventilation System
+#   https://github.com/svenjust/room-ventilation-system
+#
+#   Copyright (C) 2019  Sven Just (sven@familie-just.de)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#
+#   This copyright notice MUST APPEAR in all copies of the script!
+#
+################################################################
+import argparse
+import json
+####################################################################
+# WAS MACHT DIESES SCRIPT?
+# Dieses Script gehört zum Projekt Room Ventilation System,
+# https://github.com/svenjust/room-ventilation-system
+####################################################################
+# Dieses Python Script liest einen Trace der Scheduler-Ereignisse
+# (Start/Ende der Tasks, Polling, Interrupts, mqtt Nachrichten) ein
+# und schreibt ihn im Chrome Trace Format (JSON). Die Datei kann
+# mit chrome://tracing oder https://ui.perfetto.dev angezeigt werden.
+# So ist genau zu sehen, welche Task die Hauptschleife blockiert hat.
+#
+# Trace starten:
+#   mosquitto_pub -t d15/debugset/kwl/scheduler/trace -m on
+#
+# Nach dem Problem den Trace per mqtt senden lassen (stoppt den Trace):
+#   mosquitto_pub -t d15/debugset/kwl/scheduler/trace -m dump
+# oder auf der seriellen Schnittstelle ausgeben lassen:
+#   mosquitto_pub -t d15/debugset/kwl/scheduler/trace -m serial
+#
+# Die per mqtt übertragenen Werte können mit der folgenden Zeile in
+# einer Datei "/tmp/debug.log" protokolliert werden:
+#   mosquitto_sub -v -h localhost -t "d15/debugstate/#" > /tmp/debug.log
+# Bei Ausgabe auf der seriellen Schnittstelle wird die Ausgabe des
+# seriellen Monitors in eine Datei gespeichert (Zeilen "trace ...").
+#
+# Enthält die Datei mehrere Traces, wird der letzte konvertiert.
+#
+# AUFRUF: python <Pfad zu Script>/trace2json.py --infile /tmp/debug.log --out /tmp/trace.json
+#
+####################################################################
+
+# Thread IDs for the timeline
+TID_TIMED = 1
+TID_POLL = 2
+
+def ReadChunks(filename):
+	"""Read trace chunks (index, events) of the last dump from the log file."""
+	chunks = []
+	with open(filename, 'r') as logfile:
+		for line in logfile:
+			line = line.strip()
+			pos = line.find('scheduler/trace ')
+			if pos >= 0:
+				payload = line[pos + len('scheduler/trace '):]
+			elif line.startswith('trace '):
+				payload = line[len('trace '):]
+			else:
+				continue
+			items = payload.split()
+			if not items or not items[0].isdigit():
+				continue
+			index = int(items[0])
+			if index == 0:
+				chunks = []   # new dump
+			chunks.append((index, items[1:]))
+	return chunks
+
+def ConvertTrace(chunks):
+	"""Convert trace chunks to a list of Chrome trace events."""
+	events = [
+		{'name': 'thread_name', 'ph': 'M', 'pid': 1, 'tid': TID_TIMED, 'args': {'name': 'timed tasks'}},
+		{'name': 'thread_name', 'ph': 'M', 'pid': 1, 'tid': TID_POLL, 'args': {'name': 'poll tasks'}},
+	]
+	time = 0
+	high = 0
+	first = True
+	expected = 0
+	open_tasks = {TID_TIMED: [], TID_POLL: []}
+	current_tid = TID_TIMED
+	for index, items in chunks:
+		if index != expected:
+			print("Warning: missing events %d..%d, timeline may be off" % (expected, index - 1))
+		expected = index + len(items)
+		for item in items:
+			kind = item[0]
+			if kind == 'T':
+				high = int(item[1:]) << 16
+				continue
+			delta, _, arg = item[1:].partition(':')
+			if first:
+				first = False   # delta of the first event refers to an event not in the buffer anymore
+			else:
+				time += high + int(delta)
+			high = 0
+			if kind in 'BbEe':
+				tid = TID_TIMED if kind in 'BE' else TID_POLL
+				if kind in 'Bb':
+					open_tasks[tid].append(arg)
+					events.append({'name': arg, 'cat': 'task' if tid == TID_TIMED else 'poll', 'ph': 'B', 'ts': time, 'pid': 1, 'tid': tid})
+					current_tid = tid
+				elif open_tasks[tid]:
+					open_tasks[tid].pop()
+					events.append({'name': arg, 'ph': 'E', 'ts': time, 'pid': 1, 'tid': tid})
+				# else end of a task started before the first recorded event, ignore
+			elif kind == 'I':
+				events.append({'name': 'interrupts', 'ph': 'C', 'ts': time, 'pid': 1, 'args': {'count': int(arg)}})
+			elif kind == 'P':
+				name = 'publish' if arg == '1' else 'publish failed'
+				events.append({'name': name, 'cat': 'mqtt', 'ph': 'i', 's': 't', 'ts': time, 'pid': 1, 'tid': current_tid})
+			else:
+				print("Warning: unknown event " + item)
+	# close tasks still running at the end of the trace
+	for tid in open_tasks:
+		for name in reversed(open_tasks[tid]):
+			events.append({'name': name, 'ph': 'E', 'ts': time, 'pid': 1, 'tid': tid})
+	return events
+
+################################################## MAIN ##################################################
+
+inTraceLogfile = 'debug.log'
+outfile = 'trace.json'
+
+# Define and parse command line arguments
+parser = argparse.ArgumentParser(description="trace2json.py converts scheduler trace to Chrome trace format.")
+parser.add_argument("--infile", help="File to read the trace from (default: '" + inTraceLogfile + "')")
+parser.add_argument("--out", help="File to write the JSON trace to (default: '" + outfile + "')")
+
+args = parser.parse_args()
+if args.infile:
+	inTraceLogfile = args.infile
+if args.out:
+	outfile = args.out
+
+chunks = ReadChunks(inTraceLogfile)
+if not chunks:
+	print("No trace found in " + inTraceLogfile)
+else:
+	events = ConvertTrace(chunks)
+	with open(outfile, 'w') as out:
+		json.dump({'traceEvents': events, 'displayTimeUnit': 'ms'}, out, indent=1)
+	print("Write trace with " + str(len(events)) + " events to: " + outfile)
@@ -20,13 +20,12 @@
 
 #include "AdditionalSensors.h"
 #include "KWLConfig.h"
-#include "MessageHandler.h"
 #include "MQTTTopic.hpp"
 
 #include <DHT.h>
 #include <DHT_U.h>
 
-// Definitionen für das Scheduling
+// Definitionen für das Scheduling (Standardwerte, zur Laufzeit änderbar)
 
 /// Interval between two DHT sensor readings (10s).
 static constexpr unsigned long INTERVAL_DHT_READ              = 10000000;
@@ -35,18 +34,30 @@ static constexpr unsigned long INTERVAL_MHZ14_READ            = 10000000;
 /// Time between VOC sensor readings (1s).
 static constexpr unsigned long INTERVAL_TGS2600_READ          =  1000000;
 
-/// Minimum time between communicating DHT values.
-static constexpr unsigned long INTERVAL_MQTT_DHT              =  5000000;
-/// Maximum time between communicating DHT values.
-static constexpr unsigned long INTERVAL_MQTT_DHT_FORCE        = 300000000; // 5 * 60 * 1000; 5 Minuten
-/// Minimum time between communicating CO2 values.
-static constexpr unsigned long INTERVAL_MQTT_MHZ14            = 60000000;
-/// Maximum time between communicating CO2 values.
-static constexpr unsigned long INTERVAL_MQTT_MHZ14_FORCE      = 300000000; // 5 * 60 * 1000; 5 Minuten
-/// Minimum time between communicating VOC values.
-static constexpr unsigned long INTERVAL_MQTT_TGS2600          =  5000000;
-/// Maximum time between communicating VOC values.
-static constexpr unsigned long INTERVAL_MQTT_TGS2600_FORCE    = 30000000;
+/// Minimum time between communicating DHT values in seconds.
+static constexpr uint16_t INTERVAL_MQTT_DHT                   = 5;
+/// Maximum time between communicating DHT values in seconds.
+static constexpr uint16_t INTERVAL_MQTT_DHT_FORCE             = 300;  // 5 Minuten
+/// Minimum time between communicating CO2 values in seconds.
+static constexpr uint16_t INTERVAL_MQTT_MHZ14                 = 60;
+/// Maximum time between communicating CO2 values in seconds.
+static constexpr uint16_t INTERVAL_MQTT_MHZ14_FORCE           = 300;  // 5 Minuten
+/// Minimum time between communicating VOC values in seconds.
+static constexpr uint16_t INTERVAL_MQTT_TGS2600               = 5;
+/// Maximum time between communicating VOC values in seconds.
+static constexpr uint16_t INTERVAL_MQTT_TGS2600_FORCE         = 30;
+
+/// Minimum change of DHT temperature to communicate it before the maximum time.
+static constexpr float DEADBAND_DHT_TEMP                      = 0.1f;
+/// Minimum change of DHT humidity to communicate it before the maximum time.
+static constexpr float DEADBAND_DHT_HUM                       = 1.0f;
+/// Minimum change of CO2 value to communicate it before the maximum time.
+static constexpr int DEADBAND_MHZ14                           = 20;
+/// Minimum change of VOC value to communicate it before the maximum time.
+static constexpr int DEADBAND_TGS2600                         = 20;
+
+/// Execution budget of one sensor task run (50ms, DHT and CO2 reading block).
+static constexpr unsigned long BUDGET_SENSOR_TASK             = 50000;
 
 // DHT Sensoren
 static DHT_Unified dht1(KWLConfig::PinDHTSensor1, DHT22);
@@ -125,18 +136,56 @@ static int calcSensor_VOC(int valr)
 
 
 AdditionalSensors::AdditionalSensors() :
-  stats_(F("AdditionalSensors")),
-  dht1_read_(stats_, &AdditionalSensors::readDHT1, *this),
-  dht2_read_(stats_, &AdditionalSensors::readDHT2, *this),
-  mhz14_read_(stats_, &AdditionalSensors::readMHZ14, *this),
-  voc_read_(stats_, &AdditionalSensors::readVOC, *this),
-  dht_send_task_(stats_, &AdditionalSensors::sendDHT, *this, false),
-  dht_send_oversample_task_(stats_, &AdditionalSensors::sendDHT, *this, true),
-  co2_send_task_(stats_, &AdditionalSensors::sendCO2, *this, false),
-  co2_send_oversample_task_(stats_, &AdditionalSensors::sendCO2, *this, true),
-  voc_send_task_(stats_, &AdditionalSensors::sendVOC, *this, false),
-  voc_send_oversample_task_(stats_, &AdditionalSensors::sendVOC, *this, true)
-{}
+  stats_(F("AdditionalSensors"), BUDGET_SENSOR_TASK),
+  dht1_read_(Scheduler::TaskPriority::SENSING, stats_, &AdditionalSensors::readDHT1, *this),
+  dht2_read_(Scheduler::TaskPriority::SENSING, stats_, &AdditionalSensors::readDHT2, *this),
+  mhz14_read_(Scheduler::TaskPriority::SENSING, stats_, &AdditionalSensors::readMHZ14, *this),
+  voc_read_(Scheduler::TaskPriority::SENSING, stats_, &AdditionalSensors::readVOC, *this),
+  dht1_read_interval_(F("DHT1Read"), dht1_read_, INTERVAL_DHT_READ),
+  dht2_read_interval_(F("DHT2Read"), dht2_read_, INTERVAL_DHT_READ),
+  mhz14_read_interval_(F("CO2Read"), mhz14_read_, INTERVAL_MHZ14_READ),
+  voc_read_interval_(F("VOCRead"), voc_read_, INTERVAL_TGS2600_READ),
+  dht1_temp_channel_(MQTTTopic::KwlDHT1Temperatur, DEADBAND_DHT_TEMP, INTERVAL_MQTT_DHT, INTERVAL_MQTT_DHT_FORCE, KWLConfig::RetainAdditionalSensors, 1),
+  dht1_hum_channel_(MQTTTopic::KwlDHT1Humidity, DEADBAND_DHT_HUM, INTERVAL_MQTT_DHT, INTERVAL_MQTT_DHT_FORCE, KWLConfig::RetainAdditionalSensors, 1),
+  dht2_temp_channel_(MQTTTopic::KwlDHT2Temperatur, DEADBAND_DHT_TEMP, INTERVAL_MQTT_DHT, INTERVAL_MQTT_DHT_FORCE, KWLConfig::RetainAdditionalSensors, 1),
+  dht2_hum_channel_(MQTTTopic::KwlDHT2Humidity, DEADBAND_DHT_HUM, INTERVAL_MQTT_DHT, INTERVAL_MQTT_DHT_FORCE, KWLConfig::RetainAdditionalSensors, 1),
+  co2_channel_(MQTTTopic::KwlCO2Abluft, DEADBAND_MHZ14, INTERVAL_MQTT_MHZ14, INTERVAL_MQTT_MHZ14_FORCE, KWLConfig::RetainAdditionalSensors),
+  voc_channel_(MQTTTopic::KwlVOCAbluft, DEADBAND_TGS2600, INTERVAL_MQTT_TGS2600, INTERVAL_MQTT_TGS2600_FORCE, KWLConfig::RetainAdditionalSensors),
+  dht_send_interval_(F("DHTSend"), INTERVAL_MQTT_DHT * 1000000UL, &AdditionalSensors::applyDHTSendInterval, this),
+  co2_send_interval_(F("CO2Send"), INTERVAL_MQTT_MHZ14 * 1000000UL, &AdditionalSensors::applyCO2SendInterval, this),
+  voc_send_interval_(F("VOCSend"), INTERVAL_MQTT_TGS2600 * 1000000UL, &AdditionalSensors::applyVOCSendInterval, this)
+{
+  // CO2 sensor reports -1 on read error
+  if (!KWLConfig::SendErroneousMeasurement)
+    co2_channel_.setErrorLimit(-1);
+}
+
+/// Convert tunable interval in microseconds to send interval of a channel in seconds.
+static uint16_t toSendInterval(unsigned long interval)
+{
+  auto seconds = (interval + 500000) / 1000000;
+  return seconds ? uint16_t(seconds) : 1;
+}
+
+void AdditionalSensors::applyDHTSendInterval(void* self, unsigned long, unsigned long interval) noexcept
+{
+  auto& sensors = *static_cast<AdditionalSensors*>(self);
+  auto seconds = toSendInterval(interval);
+  sensors.dht1_temp_channel_.setMinInterval(seconds);
+  sensors.dht1_hum_channel_.setMinInterval(seconds);
+  sensors.dht2_temp_channel_.setMinInterval(seconds);
+  sensors.dht2_hum_channel_.setMinInterval(seconds);
+}
+
+void AdditionalSensors::applyCO2SendInterval(void* self, unsigned long, unsigned long interval) noexcept
+{
+  static_cast<AdditionalSensors*>(self)->co2_channel_.setMinInterval(toSendInterval(interval));
+}
+
+void AdditionalSensors::applyVOCSendInterval(void* self, unsigned long, unsigned long interval) noexcept
+{
+  static_cast<AdditionalSensors*>(self)->voc_channel_.setMinInterval(toSendInterval(interval));
+}
 
 bool AdditionalSensors::setupMHZ14()
 {
@@ -160,7 +209,7 @@ bool AdditionalSensors::setupMHZ14()
       Serial.println(ppm);
     }
     if (ppm > 0) {
-      mhz14_read_.runRepeated(INTERVAL_MHZ14_READ);
+      mhz14_read_.runRepeated(mhz14_read_interval_.get());
       MHZ14_available_ = true;
     }
   }
@@ -174,7 +223,7 @@ bool AdditionalSensors::setupTGS2600()
   int analogVal = analogRead(KWLConfig::PinVocSensor);
   if (KWLConfig::serialDebugSensor) Serial.println(analogVal);
   if (analogVal < 1020 /* some reserve for not exact analog read of empty pin */) {
-    voc_read_.runRepeated(INTERVAL_TGS2600_READ, INTERVAL_TGS2600_READ);
+    voc_read_.runRepeated(voc_read_interval_.get());
     TGS2600_available_ = true;
   } else {
     TGS2600_available_ = false;
@@ -211,6 +260,9 @@ void AdditionalSensors::readDHT1()
       Serial.println(dht1_hum_);
     }
   }
+
+  dht1_temp_channel_.update(dht1_temp_);
+  dht1_hum_channel_.update(dht1_hum_);
 }
 
 void AdditionalSensors::readDHT2()
@@ -242,6 +294,9 @@ void AdditionalSensors::readDHT2()
       Serial.println(dht2_hum_);
     }
   }
+
+  dht2_temp_channel_.update(dht2_temp_);
+  dht2_hum_channel_.update(dht2_hum_);
 }
 
 void AdditionalSensors::readMHZ14()
@@ -263,8 +318,9 @@ void AdditionalSensors::readMHZ14()
 
     co2_ppm_ = ppm;
   } else {
-    co2_ppm_ = -1000;
+    co2_ppm_ = -1;
   }
+  co2_channel_.update(co2_ppm_);
 }
 
 void AdditionalSensors::readVOC()
@@ -278,6 +334,7 @@ void AdditionalSensors::readVOC()
     Serial.print(F(", ppm="));
     Serial.println(voc_);
   }
+  voc_channel_.update(voc_);
 }
 
 void AdditionalSensors::begin(Print& initTracer)
@@ -292,32 +349,28 @@ void AdditionalSensors::begin(Print& initTracer)
   if (!isnan(event.temperature)) {
     DHT1_available_ = true;
     initTracer.print(F(" DHT1"));
-    dht1_read_.runRepeated(INTERVAL_DHT_READ);
+    dht1_read_.runRepeated(dht1_read_interval_.get());
   }
+  dht1_temp_channel_.setEnabled(DHT1_available_);
+  dht1_hum_channel_.setEnabled(DHT1_available_);
   dht2.temperature().getEvent(&event);
   if (!isnan(event.temperature)) {
     DHT2_available_ = true;
     initTracer.print(F(" DHT2"));
-    dht2_read_.runRepeated(INTERVAL_DHT_READ);
-  }
-  if (DHT1_available_ || DHT2_available_) {
-    dht_send_task_.runRepeated(INTERVAL_DHT_READ + 1000000, INTERVAL_MQTT_DHT);
-    dht_send_oversample_task_.runRepeated(INTERVAL_DHT_READ + 1000000, INTERVAL_MQTT_DHT_FORCE);
+    dht2_read_.runRepeated(dht2_read_interval_.get());
   }
+  dht2_temp_channel_.setEnabled(DHT2_available_);
+  dht2_hum_channel_.setEnabled(DHT2_available_);
 
-  // MH-Z14 CO2 Sensor
-  if (setupMHZ14()) {
+  // MH-Z14 CO2 Sensor, values are sent after the first reading
+  if (setupMHZ14())
     initTracer.print(F(" CO2"));
-    co2_send_task_.runRepeated(INTERVAL_MHZ14_READ + 1000000, INTERVAL_MQTT_MHZ14);
-    co2_send_oversample_task_.runRepeated(INTERVAL_MHZ14_READ + 1000000, INTERVAL_MQTT_MHZ14_FORCE);
-  }
+  co2_channel_.setEnabled(MHZ14_available_);
 
   // TGS2600 VOC Sensor
-  if (setupTGS2600()) {
+  if (setupTGS2600())
     initTracer.print(F(" VOC"));
-    voc_send_task_.runRepeated(INTERVAL_MQTT_TGS2600 + 1000000, INTERVAL_MQTT_TGS2600);
-    voc_send_oversample_task_.runRepeated(INTERVAL_MQTT_TGS2600 + 1000000, INTERVAL_MQTT_TGS2600_FORCE);
-  }
+  voc_channel_.setEnabled(TGS2600_available_);
 
   if (!DHT1_available_ && !DHT2_available_ && !MHZ14_available_ && !TGS2600_available_) {
     initTracer.println(F(" keine Sensoren"));
@@ -328,72 +381,10 @@ void AdditionalSensors::begin(Print& initTracer)
 
 void AdditionalSensors::forceSend() noexcept
 {
-  if (DHT1_available_ || DHT2_available_)
-    sendDHT(true);
-  if (MHZ14_available_)
-    sendCO2(true);
-  if (TGS2600_available_)
-    sendVOC(true);
-}
-
-void AdditionalSensors::sendDHT(bool force) noexcept
-{
-  if (!force
-      && (abs(dht1_temp_ - dht1_last_sent_temp_) < 0.1f) && (abs(dht2_temp_ - dht2_last_sent_temp_) < 0.1f)
-      && (abs(dht1_hum_ - dht2_last_sent_hum_) < 1) && (abs(dht2_hum_ - dht2_last_sent_hum_) < 1)) {
-    // not enough change, no point to send
-    return;
-  }
-  dht1_last_sent_temp_ = dht1_temp_;
-  dht1_last_sent_hum_  = dht1_hum_;
-  dht2_last_sent_temp_ = dht2_temp_;
-  dht2_last_sent_hum_  = dht2_hum_;
-  uint8_t bitmap = (DHT1_available_ ? 0x3 : 0) | (DHT2_available_ ? 0xc: 0);
-  publish_dht_.publish([this, bitmap]() mutable {
-    uint8_t bit = 1;
-    while (bit < 16) {
-      if (bitmap & bit) {
-        bool res = true;
-        switch (bit) {
-          case 1: res = isnanf(dht1_temp_) || MessageHandler::publish(MQTTTopic::KwlDHT1Temperatur, dht1_temp_, 1, KWLConfig::RetainAdditionalSensors); break;
-          case 2: res = isnanf(dht1_hum_)  || MessageHandler::publish(MQTTTopic::KwlDHT1Humidity, dht1_hum_, 1, KWLConfig::RetainAdditionalSensors); break;
-          case 4: res = isnanf(dht2_temp_) || MessageHandler::publish(MQTTTopic::KwlDHT2Temperatur, dht2_temp_, 1, KWLConfig::RetainAdditionalSensors); break;
-          case 8: res = isnanf(dht2_hum_)  || MessageHandler::publish(MQTTTopic::KwlDHT2Humidity, dht2_hum_, 1, KWLConfig::RetainAdditionalSensors); break;
-          default: return true; // paranoia
-        }
-        if (!res)
-          return false; // will retry later
-        bitmap &= ~bit;
-      }
-      bit <<= 1;
-    }
-    return true;  // all sent
-  });
-  dht_send_task_.runRepeated(INTERVAL_MQTT_DHT);
-  dht_send_oversample_task_.runRepeated(INTERVAL_MQTT_DHT_FORCE);
-}
-
-void AdditionalSensors::sendCO2(bool force) noexcept
-{
-  if (!force && (abs(co2_ppm_ - co2_last_sent_ppm_) < 20)) {
-    // not enough change
-    return;
-  }
-  if (co2_ppm_ >= 0)
-    publish_co2_.publish(MQTTTopic::KwlCO2Abluft, co2_ppm_, KWLConfig::RetainAdditionalSensors);
-  else if (KWLConfig::SendErroneousMeasurement)
-    publish_co2_.publish(MQTTTopic::KwlCO2Abluft, -1, KWLConfig::RetainAdditionalSensors);
-  co2_send_task_.runRepeated(INTERVAL_MQTT_MHZ14);
-  co2_send_oversample_task_.runRepeated(INTERVAL_MQTT_MHZ14_FORCE);
-}
-
-void AdditionalSensors::sendVOC(bool force) noexcept
-{
-  if (!force && (abs(voc_ - voc_last_sent_) < 20)) {
-    // not enough change
-    return;
-  }
-  publish_voc_.publish(MQTTTopic::KwlVOCAbluft, voc_, 1, KWLConfig::RetainAdditionalSensors);
-  voc_send_task_.runRepeated(INTERVAL_MQTT_TGS2600);
-  voc_send_oversample_task_.runRepeated(INTERVAL_MQTT_TGS2600_FORCE);
+  dht1_temp_channel_.forceSend();
+  dht1_hum_channel_.forceSend();
+  dht2_temp_channel_.forceSend();
+  dht2_hum_channel_.forceSend();
+  co2_channel_.forceSend();
+  voc_channel_.forceSend();
 }
@@ -25,7 +25,7 @@
 #pragma once
 
 #include "TimeScheduler.h"
-#include "MessageHandler.h"
+#include "TelemetryChannel.h"
 
 #include <math.h>
 
@@ -45,7 +45,7 @@ public:
   /// Initialize sensors.
   void begin(Print& initTracer);
 
-  /// Force sending values via MQTT on the next MQTT run.
+  /// Force sending values via MQTT on the next telemetry run.
   void forceSend() noexcept;
 
   /// Check if DHT1 sensor is present.
@@ -93,12 +93,12 @@ private:
   /// Read value of air quality sensor.
   void readVOC();
 
-  /// Schedule sending DHT values now.
-  void sendDHT(bool force) noexcept;
-  /// Schedule sending CO2 values now.
-  void sendCO2(bool force) noexcept;
-  /// Schedule sending CO2 values now.
-  void sendVOC(bool force) noexcept;
+  /// Apply tunable minimum send interval to DHT channels.
+  static void applyDHTSendInterval(void* self, unsigned long prev_interval, unsigned long interval) noexcept;
+  /// Apply tunable minimum send interval to CO2 channel.
+  static void applyCO2SendInterval(void* self, unsigned long prev_interval, unsigned long interval) noexcept;
+  /// Apply tunable minimum send interval to VOC channel.
+  static void applyVOCSendInterval(void* self, unsigned long prev_interval, unsigned long interval) noexcept;
 
   // sensor availability
   bool DHT1_available_ = false;
@@ -111,33 +111,32 @@ private:
   float dht2_temp_ = NAN;
   float dht1_hum_ = NAN;
   float dht2_hum_ = NAN;
-  int co2_ppm_ = -1000;
+  int co2_ppm_ = -1;
   int voc_ = -1;
 
-  // last sent values per MQTT
-  float dht1_last_sent_temp_ = 0;
-  float dht2_last_sent_temp_ = 0;
-  float dht1_last_sent_hum_ = 0;
-  float dht2_last_sent_hum_ = 0;
-  int co2_last_sent_ppm_ = -1;
-  int voc_last_sent_ = -1;
-
   // Tasks running on timeout
-  Scheduler::TaskTimingStats stats_;
+  Scheduler::TimedTaskStats stats_;
   Scheduler::TimedTask<AdditionalSensors> dht1_read_;
   Scheduler::TimedTask<AdditionalSensors> dht2_read_;
   Scheduler::TimedTask<AdditionalSensors> mhz14_read_;
   Scheduler::TimedTask<AdditionalSensors> voc_read_;
 
-  Scheduler::TimedTask<AdditionalSensors, bool> dht_send_task_;
-  Scheduler::TimedTask<AdditionalSensors, bool> dht_send_oversample_task_;
-  Scheduler::TimedTask<AdditionalSensors, bool> co2_send_task_;
-  Scheduler::TimedTask<AdditionalSensors, bool> co2_send_oversample_task_;
-  Scheduler::TimedTask<AdditionalSensors, bool> voc_send_task_;
-  Scheduler::TimedTask<AdditionalSensors, bool> voc_send_oversample_task_;
-
-  // Tasks publishing MQTT values
-  PublishTask publish_dht_;
-  PublishTask publish_co2_;
-  PublishTask publish_voc_;
+  // Tunable intervals of reading
+  Scheduler::TaskInterval dht1_read_interval_;
+  Scheduler::TaskInterval dht2_read_interval_;
+  Scheduler::TaskInterval mhz14_read_interval_;
+  Scheduler::TaskInterval voc_read_interval_;
+
+  // Channels publishing MQTT values
+  TelemetryChannel<float> dht1_temp_channel_;
+  TelemetryChannel<float> dht1_hum_channel_;
+  TelemetryChannel<float> dht2_temp_channel_;
+  TelemetryChannel<float> dht2_hum_channel_;
+  TelemetryChannel<int> co2_channel_;
+  TelemetryChannel<int> voc_channel_;
+
+  // Tunable minimum intervals of sending
+  Scheduler::TaskInterval dht_send_interval_;
+  Scheduler::TaskInterval co2_send_interval_;
+  Scheduler::TaskInterval voc_send_interval_;
 };
@@ -27,7 +27,7 @@
 
 #include <Wire.h>
 
-/// Run the check every minute.
+/// Run the check every minute by default.
 static constexpr unsigned long INTERVAL_ANTIFREEZE_CHECK = 60000000;
 
 /// Check if preheater increased the temperature after 10 minutes.
@@ -37,6 +37,9 @@ static constexpr unsigned long INTERVAL_ANTIFREEZE_ALARM_CHECK = 600000;
 /// Time to turn off fans when antifreeze is used in combination with heating appliance (4h).
 static constexpr unsigned long INTERVAL_HEATING_APP_COMB_USE_ANTIFREEZE = 14400000;   // 4 Stunden = 4 *60 * 60 * 1000
 
+/// Execution budget of one check (10ms).
+static constexpr unsigned long BUDGET_ANTIFREEZE_CHECK = 10000;
+
 /// Threshold exhaust air temperature under which to do antifreeze processing.
 static constexpr double EXHAUST_ANTIFREEZE_TEMP_THRESHOLD = 1.5;     // Nach kaltem Wetter im Feb 2018 gemäß Messwerte
 
@@ -54,8 +57,11 @@ Antifreeze::Antifreeze(FanControl& fan, TempSensors& temp, KWLPersistentConfig&
   hysteresis_temp_delta_(KWLConfig::StandardAntifreezeHystereseTemp),
   pid_preheater_(&temp_.get_t4_exhaust(), &tech_setpoint_preheater_, &antifreeze_temp_upper_limit_, heaterKp, heaterKi, heaterKd, P_ON_M, DIRECT),
   heating_app_comb_use_(KWLConfig::StandardHeatingAppCombUse != 0),
-  stats_(F("Antifreeze")),
-  timer_task_(stats_, &Antifreeze::run, *this)
+  mqtt_publish_(F("Antifreeze")),
+  stats_(F("Antifreeze"), BUDGET_ANTIFREEZE_CHECK),
+  timer_task_(stats_, &Antifreeze::run, *this),
+  interval_(stats_, timer_task_, INTERVAL_ANTIFREEZE_CHECK),
+  temp_listener_(timer_task_)
 {}
 
 void Antifreeze::begin(Print& /*initTracer*/)
@@ -70,7 +76,8 @@ void Antifreeze::begin(Print& /*initTracer*/)
 
   heating_app_comb_use_ = config_.getHeatingAppCombUse();
 
-  timer_task_.runRepeated(INTERVAL_ANTIFREEZE_CHECK);
+  timer_task_.runRepeated(interval_.get());
+  temp_listener_.connect(temp_.getUpdateSignal());
   sendMQTT();
 }
 
@@ -293,22 +300,29 @@ void Antifreeze::doActionAntiFreezeState()
 
 bool Antifreeze::mqttReceiveMsg(const StringView& topic, const StringView& s)
 {
-  if (topic == MQTTTopic::CmdAntiFreezeHyst) {
-    auto i = s.toInt();
-    if (i < 0)
-      i = 0;
-    if (i > MAX_TEMP_HYSTERESIS)
-      i = MAX_TEMP_HYSTERESIS;
-    hysteresis_temp_delta_ = unsigned(i);
-    antifreeze_temp_upper_limit_ = EXHAUST_ANTIFREEZE_TEMP_THRESHOLD + hysteresis_temp_delta_;
-    config_.setAntifreezeHystereseTemp(hysteresis_temp_delta_);
-  } else if (topic == MQTTTopic::CmdHeatingAppCombUse) {
+  switch (topicHash()) {
+  case MQTTTopic::CmdAntiFreezeHyst.hash():
+    if (topic != MQTTTopic::CmdAntiFreezeHyst)
+      break;
+    {
+      auto i = s.toInt();
+      if (i < 0)
+        i = 0;
+      if (i > MAX_TEMP_HYSTERESIS)
+        i = MAX_TEMP_HYSTERESIS;
+      hysteresis_temp_delta_ = unsigned(i);
+      antifreeze_temp_upper_limit_ = EXHAUST_ANTIFREEZE_TEMP_THRESHOLD + hysteresis_temp_delta_;
+      config_.setAntifreezeHystereseTemp(hysteresis_temp_delta_);
+    }
+    return true;
+  case MQTTTopic::CmdHeatingAppCombUse.hash():
+    if (topic != MQTTTopic::CmdHeatingAppCombUse)
+      break;
     if (s == F("YES"))
       setHeatingAppCombUse(true);
     else if (s == F("NO"))
       setHeatingAppCombUse(false);
-  } else {
-    return false;
+    return true;
   }
-  return true;
+  return false;
 }
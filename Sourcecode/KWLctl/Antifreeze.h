@@ -104,7 +104,9 @@ private:
   PID pid_preheater_;
   bool heating_app_comb_use_; ///< Flag whether we are using the ventilation system combined with heating appliance.
   PublishTask mqtt_publish_;
-  Scheduler::TaskTimingStats stats_;
+  Scheduler::TimedTaskStats stats_;
   Scheduler::TimedTask<Antifreeze> timer_task_;
+  Scheduler::TaskInterval interval_;          ///< Tunable interval of antifreeze checks.
+  Scheduler::SignalListener temp_listener_;   ///< Check antifreeze as soon as new temperatures are available.
 };
 
@@ -23,6 +23,7 @@
 #include "KWLConfig.h"
 
 #include <StringView.h>
+#include <NumberFormat.h>
 
 #include <Arduino.h>
 #include <Wire.h>
@@ -32,17 +33,24 @@ static FanControl* instance_ = nullptr;
 
 // MQTT timing:
 
-/// Interval for scheduling fan regulation (1s)
+/// Default interval for scheduling fan regulation (1s)
 static constexpr unsigned long FAN_INTERVAL = 1000000;
-/// Interval for sending fan information (5s), if speed changed.
-static constexpr unsigned long FAN_MQTT_INTERVAL = 5000000;
-/// Interval for sending fan information unconditionally (2min).
-static constexpr unsigned long FAN_MQTT_INTERVAL_OVERSAMPLING = 120000000;
-/// Interval for sending mode information unconditionally (5min).
-static constexpr unsigned long MODE_MQTT_INTERVAL = 300000000;
+/// Execution budget of one fan regulation step (20ms).
+static constexpr unsigned long FAN_BUDGET = 20000;
+/// Execution budget of storing PWM calibration in EEPROM (150ms, ~3.3ms per byte).
+static constexpr unsigned long BUDGET_STORE_PWM = 150000;
+/// Interval for sending fan information in seconds (5s), if speed changed.
+static constexpr uint16_t FAN_MQTT_INTERVAL = 5;
+/// Interval for sending fan information unconditionally in seconds (2min).
+static constexpr uint16_t FAN_MQTT_INTERVAL_OVERSAMPLING = 120;
+/// Interval for sending mode information unconditionally in seconds (5min).
+static constexpr uint16_t MODE_MQTT_INTERVAL = 300;
 /// Only send fan speed if changed by at least 50rpm.
 static constexpr int MIN_SPEED_DIFF = 50;
 
+/// Speed under which the fan is considered stalled.
+static constexpr unsigned STALL_SPEED = 10;
+
 // Calibration timing:
 
 /// Timeout for the entire calibration (10 minutes). If the calibration doesn't
@@ -226,13 +234,21 @@ void Fan::sendMQTTDebug(int id, unsigned long ts, MessageHandler& h)
   if (!mqtt_send_debug_)
     return;
 
-  char buffer[100];
-  static constexpr auto FORMAT = makeFlashStringLiteral("Fan%d - M: %lu, gap: %ld, tsf: %ld, ssf: %ld, rpm: %ld");
-  snprintf(buffer, sizeof(buffer), FORMAT.load(),
-           id, ts,
-           long(current_speed_ - speed_setpoint_),
-           long(tech_setpoint_), long(speed_setpoint_), long(current_speed_));
-  h.publish((id == 1) ? MQTTTopic::KwlDebugstateFan1 : MQTTTopic::KwlDebugstateFan2, buffer, false);
+  // stream the message without formatting it into a buffer first
+  h.publishStream((id == 1) ? MQTTTopic::KwlDebugstateFan1 : MQTTTopic::KwlDebugstateFan2, [&](Print& out) {
+    out.print(F("Fan"));
+    NumberFormat::printInteger(out, id);
+    out.print(F(" - M: "));
+    NumberFormat::printUnsigned(out, ts);
+    out.print(F(", gap: "));
+    NumberFormat::printInteger(out, long(current_speed_ - speed_setpoint_));
+    out.print(F(", tsf: "));
+    NumberFormat::printInteger(out, long(tech_setpoint_));
+    out.print(F(", ssf: "));
+    NumberFormat::printInteger(out, long(speed_setpoint_));
+    out.print(F(", rpm: "));
+    NumberFormat::printInteger(out, long(current_speed_));
+  });
 }
 
 
@@ -243,8 +259,12 @@ FanControl::FanControl(KWLPersistentConfig& config, SetSpeedCallback *speedCallb
   speed_callback_(speedCallback),
   ventilation_mode_(KWLConfig::StandardKwlMode),
   persistent_config_(config),
-  stats_(F("FanControl")),
-  timer_task_(stats_, &FanControl::run, *this)
+  mode_channel_(MQTTTopic::StateKwlMode, 0, 0, MODE_MQTT_INTERVAL, KWLConfig::RetainFanMode),
+  fan1_channel_(MQTTTopic::Fan1Speed, MIN_SPEED_DIFF, FAN_MQTT_INTERVAL, FAN_MQTT_INTERVAL_OVERSAMPLING, KWLConfig::RetainFanSpeed),
+  fan2_channel_(MQTTTopic::Fan2Speed, MIN_SPEED_DIFF, FAN_MQTT_INTERVAL, FAN_MQTT_INTERVAL_OVERSAMPLING, KWLConfig::RetainFanSpeed),
+  stats_(F("FanControl"), FAN_BUDGET),
+  timer_task_(stats_, &FanControl::run, *this),
+  interval_(stats_, timer_task_, FAN_INTERVAL)
 {}
 
 void FanControl::begin(Print& initTrace)
@@ -259,7 +279,8 @@ void FanControl::begin(Print& initTrace)
   fan1_.begin(countUpFan1, persistent_config_.getSpeedSetpointFan1(), persistent_config_.getFan1ImpulsesPerRotation());
   fan2_.begin(countUpFan2, persistent_config_.getSpeedSetpointFan2(), persistent_config_.getFan2ImpulsesPerRotation());
 
-  timer_task_.runRepeated(FAN_INTERVAL);
+  mode_channel_.update(ventilation_mode_);
+  timer_task_.runRepeated(interval_.get(), interval_.get(), Scheduler::TimedTaskBase::AUTO_PHASE);
 }
 
 void FanControl::setVentilationMode(int mode)
@@ -269,9 +290,9 @@ void FanControl::setVentilationMode(int mode)
   forceSendMode();
 }
 
-void FanControl::countUpFan1() { instance_->fan1_.interrupt(); }
+void FanControl::countUpFan1() { instance_->fan1_.interrupt(); Scheduler::SchedulerTrace::interrupt(); }
 
-void FanControl::countUpFan2() { instance_->fan2_.interrupt(); }
+void FanControl::countUpFan2() { instance_->fan2_.interrupt(); Scheduler::SchedulerTrace::interrupt(); }
 
 void FanControl::run()
 {
@@ -281,6 +302,13 @@ void FanControl::run()
   fan1_.updateSpeed();
   fan2_.updateSpeed();
 
+  // let dependent tasks react to stalled fans right away
+  uint8_t stalled = (fan1_.getSpeed() < STALL_SPEED ? 1 : 0) | (fan2_.getSpeed() < STALL_SPEED ? 2 : 0);
+  if (stalled != stalled_fans_) {
+    stalled_fans_ = stalled;
+    stall_signal_.notify();
+  }
+
   if (KWLConfig::serialDebugFan) {
     Serial.print(F("Speed fan1: "));
     Serial.print(fan1_.getSpeed());
@@ -297,34 +325,9 @@ void FanControl::run()
     speedCalibrationStep();
   }
 
-  // publish any measurements, if necessary
-  bool send_mqtt = false;
-  if (--send_mode_countdown_ <= 0) {
-    send_mode_countdown_ = int(MODE_MQTT_INTERVAL / FAN_INTERVAL);
-    mqtt_send_flags_ |= MQTT_SEND_MODE;
-    send_mqtt = true;
-  }
-  if (--send_fan_oversampling_countdown_ <= 0) {
-    send_fan_oversampling_countdown_ = int(FAN_MQTT_INTERVAL_OVERSAMPLING / FAN_INTERVAL);
-    send_fan_countdown_ = int(FAN_MQTT_INTERVAL / FAN_INTERVAL);
-    mqtt_send_flags_ |= MQTT_SEND_FAN1 | MQTT_SEND_FAN2;
-    send_mqtt = true;
-  }
-  if (--send_fan_countdown_ <= 0) {
-    int fan1 = int(fan1_.getSpeed());
-    int fan2 = int(fan2_.getSpeed());
-    // check whether we need to send data
-    if (abs(fan1 - last_sent_fan1_speed_) >= MIN_SPEED_DIFF ||
-        abs(fan2 - last_sent_fan2_speed_) >= MIN_SPEED_DIFF) {
-      send_fan_oversampling_countdown_ = int(FAN_MQTT_INTERVAL_OVERSAMPLING / FAN_INTERVAL);
-      send_fan_countdown_ = int(FAN_MQTT_INTERVAL / FAN_INTERVAL);
-      mqtt_send_flags_ |= MQTT_SEND_FAN1 | MQTT_SEND_FAN2;
-      send_mqtt = true;
-    }
-  }
-
-  if (send_mqtt)
-    sendMQTT();
+  // telemetry channels publish measurements, if necessary
+  fan1_channel_.update(int(fan1_.getSpeed()));
+  fan2_channel_.update(int(fan2_.getSpeed()));
 }
 
 void FanControl::speedUpdate()
@@ -443,78 +446,106 @@ void FanControl::storePWMSettingsToEEPROM()
 
 bool FanControl::mqttReceiveMsg(const StringView& topic, const StringView& s)
 {
-  if (topic == MQTTTopic::CmdFan1Speed) {
-    // Drehzahl Lüfter 1
-    unsigned i = unsigned(s.toInt());
-    getFan1().setStandardSpeed(i);
-    persistent_config_.setSpeedSetpointFan1(i);
-  } else if (topic == MQTTTopic::CmdFan2Speed) {
-    // Drehzahl Lüfter 2
-    unsigned i = unsigned(s.toInt());
-    getFan2().setStandardSpeed(i);
-    persistent_config_.setSpeedSetpointFan2(i);
-  } else if (topic == MQTTTopic::CmdMode) {
+  switch (topicHash()) {
+  case MQTTTopic::CmdFan1Speed.hash():
+    if (topic != MQTTTopic::CmdFan1Speed)
+      break;
+    {
+      // Drehzahl Lüfter 1
+      unsigned i = unsigned(s.toInt());
+      getFan1().setStandardSpeed(i);
+      persistent_config_.setSpeedSetpointFan1(i);
+    }
+    return true;
+  case MQTTTopic::CmdFan2Speed.hash():
+    if (topic != MQTTTopic::CmdFan2Speed)
+      break;
+    {
+      // Drehzahl Lüfter 2
+      unsigned i = unsigned(s.toInt());
+      getFan2().setStandardSpeed(i);
+      persistent_config_.setSpeedSetpointFan2(i);
+    }
+    return true;
+  case MQTTTopic::CmdMode.hash():
+    if (topic != MQTTTopic::CmdMode)
+      break;
     // KWL Stufe
     setVentilationMode(int(s.toInt()));
-  } else if (topic == MQTTTopic::CmdFansCalculateSpeedMode) {
+    return true;
+  case MQTTTopic::CmdFansCalculateSpeedMode.hash():
+    if (topic != MQTTTopic::CmdFansCalculateSpeedMode)
+      break;
     if (s == F("PROP"))
       setCalculateSpeedMode(FanCalculateSpeedMode::PROP);
     else if (s == F("PID"))
       setCalculateSpeedMode(FanCalculateSpeedMode::PID);
-  } else if (topic == MQTTTopic::CmdCalibrateFans) {
+    return true;
+  case MQTTTopic::CmdCalibrateFans.hash():
+    if (topic != MQTTTopic::CmdCalibrateFans)
+      break;
     if (s == F("YES"))
       speedCalibrationStart();
-  } else if (topic == MQTTTopic::CmdGetSpeed) {
+    return true;
+  case MQTTTopic::CmdGetSpeed.hash():
+    if (topic != MQTTTopic::CmdGetSpeed)
+      break;
     forceSend();
+    return true;
 #ifdef DEBUG
-  } else if (topic == MQTTTopic::KwlDebugsetFan1Getvalues) {
+  case MQTTTopic::KwlDebugsetFan1Getvalues.hash():
+    if (topic != MQTTTopic::KwlDebugsetFan1Getvalues)
+      break;
     if (s == F("on"))
       fan1_.debug(true);
     else if (s == F("off"))
       fan1_.debug(false);
-  } else if (topic == MQTTTopic::KwlDebugsetFan2Getvalues) {
+    return true;
+  case MQTTTopic::KwlDebugsetFan2Getvalues.hash():
+    if (topic != MQTTTopic::KwlDebugsetFan2Getvalues)
+      break;
     if (s == F("on"))
       fan2_.debug(true);
     else if (s == F("off"))
       fan2_.debug(false);
-  } else if (topic == MQTTTopic::KwlDebugsetFan1PWM) {
+    return true;
+  case MQTTTopic::KwlDebugsetFan1PWM.hash():
+    if (topic != MQTTTopic::KwlDebugsetFan1PWM)
+      break;
     // update PWM value for the current state
     if (ventilation_mode_ != 0) {
       int value = int(s.toInt());
       fan1_.debugSet(ventilation_mode_, value);
       speedUpdate();
     }
-  } else if (topic == MQTTTopic::KwlDebugsetFan2PWM) {
+    return true;
+  case MQTTTopic::KwlDebugsetFan2PWM.hash():
+    if (topic != MQTTTopic::KwlDebugsetFan2PWM)
+      break;
     // update PWM value for the current state
     if (ventilation_mode_ != 0) {
       int value = int(s.toInt());
       fan2_.debugSet(ventilation_mode_, value);
       speedUpdate();
     }
-  } else if (topic == MQTTTopic::KwlDebugsetFanPWMStore) {
+    return true;
+  case MQTTTopic::KwlDebugsetFanPWMStore.hash():
+    if (topic != MQTTTopic::KwlDebugsetFanPWMStore)
+      break;
     // store calibration data in EEPROM
+    MessageHandler::setCommandBudget(BUDGET_STORE_PWM);
     storePWMSettingsToEEPROM();
+    return true;
 #endif
-  } else {
-    return false;
   }
-  return true;
+  return false;
 }
 
-void FanControl::sendMQTT()
+void FanControl::forceSend() noexcept
 {
-  int fan1 = int(fan1_.getSpeed());
-  int fan2 = int(fan2_.getSpeed());
-  last_sent_fan1_speed_ = fan1;
-  last_sent_fan2_speed_ = fan2;
-  auto mode = ventilation_mode_;
-  mqtt_publish_.publish([this, fan1, fan2, mode]() {
-    if (!publish_if(mqtt_send_flags_, MQTT_SEND_MODE, MQTTTopic::StateKwlMode, mode, KWLConfig::RetainFanMode))
-      return false;
-    if (!publish_if(mqtt_send_flags_, MQTT_SEND_FAN1, MQTTTopic::Fan1Speed, fan1, KWLConfig::RetainFanSpeed))
-      return false;
-    if (!publish_if(mqtt_send_flags_, MQTT_SEND_FAN2, MQTTTopic::Fan2Speed, fan2, KWLConfig::RetainFanSpeed))
-      return false;
-    return true;  // all done
-  });
+  forceSendMode();
+  fan1_channel_.update(int(fan1_.getSpeed()));
+  fan2_channel_.update(int(fan2_.getSpeed()));
+  fan1_channel_.forceSend();
+  fan2_channel_.forceSend();
 }
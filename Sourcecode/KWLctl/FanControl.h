@@ -29,7 +29,7 @@
 
 #include <FanRPM.h>
 #include <TimeScheduler.h>
-#include <MessageHandler.h>
+#include <TelemetryChannel.h>
 
 #include <PID_v1.h>
 
@@ -211,11 +211,14 @@ public:
   /// Get interface of fan 2 (exhaust)
   inline Fan& getFan2() { return fan2_; }
 
+  /// Get signal notified when a fan stops rotating or starts rotating again.
+  const Scheduler::TaskSignal& getStallSignal() const { return stall_signal_; }
+
   /// Force sending mode message via MQTT independent of timing.
-  inline void forceSendMode() { mqtt_send_flags_ |= MQTT_SEND_MODE; sendMQTT(); }
+  inline void forceSendMode() { mode_channel_.update(ventilation_mode_); mode_channel_.forceSend(); }
 
   /// Force sending speed message via MQTT independent of timing.
-  inline void forceSend() { mqtt_send_flags_ |= MQTT_SEND_MODE | MQTT_SEND_FAN1 | MQTT_SEND_FAN2; sendMQTT(); }
+  void forceSend() noexcept;
 
   /// Starts speed calibration.
   void speedCalibrationStart();
@@ -249,9 +252,6 @@ private:
 
   virtual bool mqttReceiveMsg(const StringView& topic, const StringView& s) override;
 
-  /// Send requested messages, if any.
-  void sendMQTT();
-
   Fan fan1_;   ///< Control for fan 1 (intake).
   Fan fan2_;   ///< Control for fan 2 (exhaust).
 
@@ -268,17 +268,12 @@ private:
 
   KWLPersistentConfig& persistent_config_;      ///< Configuration.
 
-  static constexpr uint8_t MQTT_SEND_MODE = 1;
-  static constexpr uint8_t MQTT_SEND_FAN1 = 2;
-  static constexpr uint8_t MQTT_SEND_FAN2 = 4;
-
-  int send_mode_countdown_ = 0;     ///< Countdown until sending mode (in run intervals).
-  int send_fan_countdown_ = 0;      ///< Countdown until sending fan state (in run intervals).
-  int send_fan_oversampling_countdown_ = 0; ///< Countdown until sending fan state unconditionally.
-  int last_sent_fan1_speed_ = 0;    ///< Last reported fan 1 speed.
-  int last_sent_fan2_speed_ = 0;    ///< Last reported fan 2 speed.
-  PublishTask mqtt_publish_;        ///< Task to reliably send values.
-  uint8_t mqtt_send_flags_ = 0;     ///< Pending stuff to send.
-  Scheduler::TaskTimingStats stats_;            ///< Runtime statistics.
+  TelemetryChannel<int> mode_channel_;  ///< Channel publishing ventilation mode.
+  TelemetryChannel<int> fan1_channel_;  ///< Channel publishing fan 1 speed.
+  TelemetryChannel<int> fan2_channel_;  ///< Channel publishing fan 2 speed.
+  uint8_t stalled_fans_ = 0;        ///< Bitmask of fans not rotating (1 = fan 1, 2 = fan 2).
+  Scheduler::TaskSignal stall_signal_;          ///< Signal for tasks depending on fan state.
+  Scheduler::TimedTaskStats stats_;             ///< Runtime statistics.
   Scheduler::TimedTask<FanControl> timer_task_; ///< Timer for updating state repeatedly.
+  Scheduler::TaskInterval interval_;            ///< Tunable interval of timer_task_.
 };
@@ -20,6 +20,7 @@
 #include "KWLConfig.h"
 
 #include <IPAddress.h>
+#include <TaskInterval.h>
 
 IPAddressLiteral::IPAddressLiteral(const IPAddress& a) noexcept {
   memcpy(ip, &a, 4);
@@ -32,7 +33,7 @@ IPAddressLiteral::operator IPAddress() const noexcept
 
 #define KWL_COPY(name) name##_ = KWLConfig::Standard##name
 
-static_assert(sizeof(KWLPersistentConfig) == 298, "Persistent config size changed, ensure compatibility or increment version");
+static_assert(sizeof(KWLPersistentConfig) == 362, "Persistent config size changed, ensure compatibility or increment version");
 static constexpr auto PrefixMQTT = KWLConfig::PrefixMQTT;
 
 void KWLPersistentConfig::loadDefaults()
@@ -89,6 +90,28 @@ void KWLPersistentConfig::loadNetworkDefaults()
   mac_ = mac;
 }
 
+/// Compute hash of a task interval name to identify its slot (never 0 or 0xffff).
+static uint16_t taskIntervalHash(const __FlashStringHelper* name)
+{
+  // same hash as for MQTT topics
+  auto hash = FlashStringImpl::HASH_BASIS;
+  auto p = reinterpret_cast<const char*>(name);
+  while (char c = char(pgm_read_byte(p++)))
+    hash = FlashStringImpl::hashStep(hash, c);
+  if (hash == 0 || hash == 0xffff)
+    hash = 1;
+  return hash;
+}
+
+/// Check whether a task interval with given name hash is registered.
+static bool isKnownTaskInterval(uint16_t hash)
+{
+  for (auto i = Scheduler::TaskInterval::begin(); i != Scheduler::TaskInterval::end(); ++i)
+    if (taskIntervalHash(i->getName()) == hash)
+      return true;
+  return false;
+}
+
 void KWLPersistentConfig::migrate()
 {
   // "upgrade" existing config, if possible (all initialized to -1/0xff)
@@ -148,6 +171,24 @@ void KWLPersistentConfig::migrate()
     update(Fan1ImpulsesPerRotation_);
     update(Fan2ImpulsesPerRotation_);
   }
+  bool intervals_cleared = false;
+  for (auto& slot : task_intervals_) {
+    // hash 0xffff is never used, so such slot is from erased EEPROM
+    if (slot.name_hash == 0xffff) {
+      if (!intervals_cleared)
+        Serial.println(F("Config migration: clearing task intervals"));
+      intervals_cleared = true;
+      slot.name_hash = 0;
+      slot.interval = 0;
+      update(slot);
+    } else if (slot.name_hash && !isKnownTaskInterval(slot.name_hash)) {
+      // interval was removed or renamed, free the slot
+      Serial.println(F("Config migration: dropping unknown task interval"));
+      slot.name_hash = 0;
+      slot.interval = 0;
+      update(slot);
+    }
+  }
 }
 
 bool KWLPersistentConfig::hasCrash() const
@@ -200,3 +241,37 @@ bool KWLPersistentConfig::setMQTTPrefix(const char* prefix)
   update(mqtt_prefix_);
   return true;
 }
+
+uint16_t KWLPersistentConfig::getTaskInterval(const __FlashStringHelper* name) const
+{
+  auto hash = taskIntervalHash(name);
+  for (auto& slot : task_intervals_)
+    if (slot.name_hash == hash)
+      return slot.interval;
+  return 0;
+}
+
+bool KWLPersistentConfig::setTaskInterval(const __FlashStringHelper* name, uint16_t interval)
+{
+  auto hash = taskIntervalHash(name);
+  TaskIntervalData* free_slot = nullptr;
+  for (auto& slot : task_intervals_) {
+    if (slot.name_hash == hash) {
+      if (!interval)
+        slot.name_hash = 0;
+      slot.interval = interval;
+      update(slot);
+      return true;
+    }
+    if (!slot.name_hash && !free_slot)
+      free_slot = &slot;
+  }
+  if (!interval)
+    return true;  // nothing stored
+  if (!free_slot)
+    return false;
+  free_slot->name_hash = hash;
+  free_slot->interval = interval;
+  update(*free_slot);
+  return true;
+}
@@ -171,6 +171,12 @@ public:
   /// Prefix for all messages to and from the controller.
   static constexpr auto PrefixMQTT = makeFlashStringLiteral("d15");
 
+  /// Poll interval of network processing after network or serial activity, in microseconds.
+  static constexpr unsigned long NetworkPollIntervalMin = 1000;
+
+  /// Poll interval of network processing when idle (maximum reaction delay), in microseconds.
+  static constexpr unsigned long NetworkPollIntervalMax = 5000;
+
   // *******************************************E N D E ***  N E T Z W E R K E I N S T E L L U N G E N **************************************************
 
 
@@ -185,6 +191,12 @@ public:
   /// Orientation of the TFT display.
   static constexpr uint8_t TFTOrientation = 3;    //PORTRAIT
 
+  /// Poll interval of the touch screen while touched, in microseconds.
+  static constexpr unsigned long TouchPollIntervalMin = 5000;
+
+  /// Poll interval of the touch screen when idle (maximum reaction delay), in microseconds.
+  static constexpr unsigned long TouchPollIntervalMax = 20000;
+
   // *******************************************E N D E ***  T F T / T O U C H   E I N S T E L L U N G E N **********************************************
 
 
@@ -246,6 +258,9 @@ public:
   /// Maximum number of crash reports.
   static constexpr uint8_t MaxCrashReportCount = 4;
 
+  /// Maximum number of task intervals stored in EEPROM (see Scheduler::TaskInterval).
+  static constexpr uint8_t MaxTaskIntervalCount = 16;
+
   /*!
    * @brief Perform "factory reset" *at each startup*.
    *
@@ -262,6 +277,9 @@ public:
   /// EEPROM configuration version to expect/write.
   static constexpr unsigned KWL_EEPROM_VERSION = 49;
 
+  /// Put the MCU into idle sleep mode, while no task has work to do.
+  static constexpr bool IdleSleep = true;
+
   // **************************************E N D E *** W E R K S E I N S T E L L U N G E N **************************************************************
 
 
@@ -346,12 +364,21 @@ public:
   /// Send timestamp as heartbeat.
   static constexpr bool HeartbeatTimestamp = false;
 
+  /// Append CPU load averages (1s, 1min, 15min in %) to heartbeat message.
+  static constexpr bool HeartbeatLoad = false;
+
   /// At most how often to send temperature messages via MQTT, in seconds.
   static constexpr uint8_t MinIntervalMqttTemp = 5;
   /// At least how often to send temperature messages via MQTT, in seconds.
   static constexpr uint8_t MaxIntervalMqttTemp = 60;
-  /// Minimum change in temperature to report per MQTT.
+  /// Minimum change in temperature to report per MQTT (the change must exceed it).
   static constexpr double MinDiffMqttTemp = 0.1;
+  /// At most how often to send efficiency messages via MQTT, in seconds.
+  static constexpr uint8_t MinIntervalMqttEfficiency = 5;
+  /// At least how often to send efficiency messages via MQTT, in seconds.
+  static constexpr uint8_t MaxIntervalMqttEfficiency = 60;
+  /// Minimum change in efficiency to report per MQTT, in % (1 reports any change).
+  static constexpr int MinDiffMqttEfficiency = 1;
 
   /// Default for retain last measurements reading in the MQTT broker.
   static constexpr bool RetainMeasurements = true;
@@ -383,9 +410,28 @@ public:
   /// Retain last status bits readings in the MQTT broker.
   static const bool RetainStatusBits;
 
+  /// Retain last measurement snapshot in the MQTT broker.
+  static const bool RetainSnapshot;
+
   /// If set, also erroneous measurements (like -127C for temperature) will be sent.
   static constexpr bool SendErroneousMeasurement = false;
 
+  /// Sustained rate of outgoing MQTT messages per second. Set to 0 to not limit the rate.
+  static constexpr uint16_t MqttRateMessages = 10;
+  /// Sustained rate of outgoing MQTT bytes (topic and payload) per second. Set to 0 to not limit.
+  static constexpr uint16_t MqttRateBytes = 1000;
+  /// Count of MQTT messages which can be sent in a burst after idle time.
+  static constexpr uint16_t MqttBurstMessages = 8;
+  /// Count of MQTT bytes which can be sent in a burst after idle time (W5100 socket buffer is 2KB).
+  static constexpr uint16_t MqttBurstBytes = 1024;
+
+  /// How often to send all measurements as one JSON document to state/kwl/snapshot, in seconds. Set to 0 to not send snapshots.
+  static constexpr uint16_t SnapshotInterval = 0;
+  /// If set and snapshots are sent, measurements are not sent as individual messages anymore.
+  static constexpr bool SnapshotOnly = false;
+  /// If set, measurements and snapshots are sent CBOR encoded (RFC 8949) instead of as text.
+  static constexpr bool MqttCbor = false;
+
   // ************************************** E N D E   M Q T T   R E P O R T I N G ***********************************************************************
 
   // ***************************************************  D E B U G E I N S T E L L U N G E N ********************************************************
@@ -441,6 +487,8 @@ template<typename FinalConfig>
 const bool KWLDefaultConfig<FinalConfig>::RetainProgram = FinalConfig::RetainMeasurements;
 template<typename FinalConfig>
 const bool KWLDefaultConfig<FinalConfig>::RetainStatusBits = FinalConfig::RetainMeasurements;
+template<typename FinalConfig>
+const bool KWLDefaultConfig<FinalConfig>::RetainSnapshot = FinalConfig::RetainMeasurements;
 
 /// Helper template to convert user-defined configuration objects.
 template<typename T> struct UserConfig {
@@ -512,6 +560,13 @@ struct CrashData
   uint32_t crash_sp:14;   ///< SP at the time of crash.
 };
 
+/// Structure used to store tuned task intervals in EEPROM.
+struct TaskIntervalData
+{
+  uint16_t name_hash;     ///< Hash of the interval name (0 if slot unused).
+  uint16_t interval;      ///< Interval in 100ms units.
+};
+
 /// Touchscreen calibration settings.
 struct TouchCalibration
 {
@@ -580,7 +635,10 @@ private:
   // Fan RPM adjustment configuration
   float Fan1ImpulsesPerRotation_;              // 290
   float Fan2ImpulsesPerRotation_;              // 294
-  // 298
+
+  // Tuned task intervals
+  TaskIntervalData task_intervals_[KWLConfig::MaxTaskIntervalCount];  // 298..362
+  // 362
 
   /// Initialize with defaults, if version doesn't fit.
   void loadDefaults();
@@ -658,6 +716,23 @@ public:
 
   /// Set new TFT calibration.
   void setTouchCalibration(const TouchCalibration& touch) { touch_ = touch; update(touch_); }
+
+  /*!
+   * @brief Get stored interval of a task.
+   *
+   * @param name name of the interval.
+   * @return interval in 100ms units or 0, if none stored.
+   */
+  uint16_t getTaskInterval(const __FlashStringHelper* name) const;
+
+  /*!
+   * @brief Store interval of a task.
+   *
+   * @param name name of the interval.
+   * @param interval interval in 100ms units or 0 to remove it.
+   * @return @c true, if stored, @c false if there is no free slot.
+   */
+  bool setTaskInterval(const __FlashStringHelper* name, uint16_t interval);
 };
 
 #undef KWL_GETSET
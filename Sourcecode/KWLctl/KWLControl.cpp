@@ -21,27 +21,79 @@
 #include "KWLControl.hpp"
 #include "KWLConfig.h"
 #include "MQTTTopic.hpp"
-#ifdef USE_TFT
-#include "ScreenshotService.h"
-#endif
 
 #include <EthernetUdp.h>
 #include <Wire.h>
+#include <CborWriter.h>
 #include <DeadlockWatchdog.h>
+#include <JsonWriter.h>
+#include <NumberFormat.h>
 #include <avr/wdt.h>
+#include <avr/sleep.h>
+
+/// Execution budget of storing task intervals in EEPROM (250ms, ~3.3ms per byte).
+static constexpr unsigned long BUDGET_STORE_INTERVALS = 250000;
+
+namespace
+{
+  /// Build topic for scheduler data of a task with given name.
+  template<typename Prefix>
+  void storeStatsTopic(char (&tbuffer)[40], const Prefix& prefix, const __FlashStringHelper* name)
+  {
+    prefix.store(tbuffer);
+    char* p = tbuffer + prefix.length();
+    const size_t rsize = sizeof(tbuffer) - prefix.length() - 1;
+    strncpy_P(p, reinterpret_cast<const char*>(name), rsize);
+    p[rsize] = 0;
+  }
+
+  /// Publish current value of a task interval in ms.
+  bool publishInterval(const Scheduler::TaskInterval& interval)
+  {
+    char tbuffer[40];
+    storeStatsTopic(tbuffer, MQTTTopic::KwlSchedulerInterval, interval.getName());
+    return MessageHandler::publish(tbuffer, interval.get() / 1000, false);
+  }
+}
 
 KWLControl::KWLControl() :
   MessageHandler(F("KWLControl")),
+  scheduler_(KWLConfig::IdleSleep ? &KWLControl::idleSleep : nullptr),
   ntp_(udp_),
   network_client_(persistent_config_, ntp_),
   fan_control_(persistent_config_, this),
   bypass_(persistent_config_, temp_sensors_),
   antifreeze_(fan_control_, temp_sensors_, persistent_config_),
   program_manager_(persistent_config_, fan_control_, ntp_),
+  scheduler_publish_(F("Scheduler"), PublishPriority::DEBUG),
+  error_publish_(F("Status"), PublishPriority::STATUS),
+  interval_publish_(F("Interval")),
+  overrun_publish_(F("Overrun"), PublishPriority::STATUS),
+  snapshot_publish_(F("Snapshot")),
   control_stats_(F("KWLControl")),
-  control_timer_(control_stats_, &KWLControl::run, *this)
+  control_timer_(control_stats_, &KWLControl::run, *this),
+  temp_listener_(control_timer_),
+  fan_listener_(control_timer_),
+  snapshot_stats_(F("Snapshot")),
+  snapshot_timer_(Scheduler::TaskPriority::TELEMETRY, snapshot_stats_, &KWLControl::mqttSendSnapshot, *this),
+  eeprom_dump_stats_(F("EEPROMDump")),
+  eeprom_dump_task_(Scheduler::TaskPriority::TELEMETRY, eeprom_dump_stats_, &KWLControl::eepromDumpStep, *this)
+#ifdef USE_TFT
+  , screenshot_stats_(F("Screenshot")),
+  screenshot_task_(Scheduler::TaskPriority::UI, screenshot_stats_, &KWLControl::screenshotStep, *this)
+#endif
 {}
 
+void KWLControl::idleSleep(unsigned long /*us*/)
+{
+  // Idle mode keeps timers, UARTs and external interrupts running, so fan
+  // PWM and tacho measurement continue. Any interrupt, at the latest
+  // the millis() timer overflow each ~1ms, wakes up the MCU again and
+  // the scheduler decides whether to continue sleeping.
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  sleep_mode();
+}
+
 void KWLControl::begin(Print& initTracer)
 {
   if (KWLConfig::ControlFansDAC) {
@@ -51,6 +103,14 @@ void KWLControl::begin(Print& initTracer)
   }
 
   persistent_config_.begin(initTracer, KWLConfig::FACTORY_RESET_EEPROM);
+
+  // apply tuned task intervals before modules schedule their tasks
+  for (auto i = Scheduler::TaskInterval::begin(); i != Scheduler::TaskInterval::end(); ++i) {
+    auto interval = persistent_config_.getTaskInterval(i->getName());
+    if (interval)
+      i->set(interval * 100000UL);
+  }
+
   network_client_.begin(initTracer);
   temp_sensors_.begin(initTracer);
   fan_control_.begin(initTracer);
@@ -61,7 +121,17 @@ void KWLControl::begin(Print& initTracer)
   program_manager_.begin();
 
   // run error check loop every second, but give some time to initialize first
-  control_timer_.runRepeated(8000000, 1000000);
+  control_timer_.runRepeated(8000000, 1000000, Scheduler::TimedTaskBase::AUTO_PHASE);
+
+  if (KWLConfig::SnapshotInterval) {
+    // send aggregated measurements, optionally instead of individual messages
+    const auto interval = KWLConfig::SnapshotInterval * 1000000UL;
+    snapshot_timer_.runRepeated(interval, interval, Scheduler::TimedTaskBase::AUTO_PHASE);
+    if (KWLConfig::SnapshotOnly)
+      TelemetryChannelBase::setPublishing(false);
+  }
+  if (KWLConfig::MqttCbor)
+    TelemetryChannelBase::setCbor(true);
 
   if (persistent_config_.hasCrash()) {
     initTracer.println(F("*** NOTE *** Crash reports recorded in EEPROM"));
@@ -97,7 +167,7 @@ void KWLControl::begin(Print& initTracer)
 
 void KWLControl::errorsToString(char* buffer, size_t size)
 {
-  if ((errors_ & ~(ERROR_BIT_CRASH | ERROR_BIT_NTP)) == 0) {
+  if ((errors_ & ~(ERROR_BIT_CRASH | ERROR_BIT_NTP | ERROR_BIT_OVERRUN)) == 0) {
     // do not report crash report presence as error string
     buffer[0] = 0;
     return;
@@ -118,8 +188,8 @@ void KWLControl::infosToString(char* buffer, size_t size)
   switch (info_ & INFO_TYPE_MASK) {
   case INFO_CALIBRATION:
   {
-    char tmp[6];
-    itoa(int(value), tmp, 10);
+    char tmp[NumberFormat::MAX_LENGTH];
+    NumberFormat::formatUnsigned(tmp, value);
     strlcpy_P(buffer, PSTR("Luefter werden kalibriert fuer Stufe "), size);
     strlcat(buffer, tmp, size);
     strlcat_P(buffer, PSTR(". Bitte warten..."), size);
@@ -128,8 +198,8 @@ void KWLControl::infosToString(char* buffer, size_t size)
 
   case INFO_PREHEATER:
   {
-    char tmp[6];
-    snprintf(tmp, sizeof(tmp), "%u%%", value);
+    char tmp[NumberFormat::MAX_LENGTH + 1];
+    strcpy_P(NumberFormat::formatUnsigned(tmp, value), PSTR("%"));
     strlcpy_P(buffer, PSTR("Defroster: Vorheizregister eingeschaltet "), size);
     strlcat(buffer, tmp, size);
     break;
@@ -160,6 +230,50 @@ void KWLControl::loop()
   DeadlockWatchdog::reset();
 }
 
+void KWLControl::eepromDumpStep()
+{
+  // dump only as much as fits into serial buffer to prevent blocking
+  static constexpr int ROW_LENGTH = 4 + 16 * 3 + 2;
+  if (Serial.availableForWrite() < ROW_LENGTH) {
+    eeprom_dump_task_.continueNextLoop();
+    return;
+  }
+  eeprom_dump_addr_ = KWLPersistentConfig::dumpRawRows(Serial, eeprom_dump_addr_, 1);
+  if (!eeprom_dump_addr_)
+    eeprom_dump_task_.finish();
+}
+
+#ifdef USE_TFT
+void KWLControl::screenshotStep()
+{
+  if (screenshot_connect_) {
+    // first step, connect outside of command handling
+    screenshot_connect_ = false;
+    if (!screenshot_client_.connect(screenshot_ip_, screenshot_port_)) {
+      if (KWLConfig::serialDebug)
+        Serial.println(F("Screenshot: cannot connect"));
+      screenshot_task_.finish();
+      return;
+    }
+    tft_.prepareForScreenshot();
+    if (KWLConfig::serialDebug)
+      Serial.println(F("Screenshot: connected"));
+    screenshot_.begin(tft_.getTFT(), screenshot_client_);
+    return;
+  }
+  if (screenshot_.step() && screenshot_client_.connected())
+    return;
+  screenshot_client_.flush();
+  screenshot_client_.stop();
+  screenshot_task_.finish();
+  tft_.finishScreenshot();
+  if (KWLConfig::serialDebug) {
+    Serial.print(F("Screenshot: done at "));
+    Serial.println(millis());
+  }
+}
+#endif
+
 void KWLControl::fanSpeedSet()
 {
   // this callback is called after computing new PWM tech points
@@ -169,8 +283,11 @@ void KWLControl::fanSpeedSet()
 
 bool KWLControl::mqttReceiveMsg(const StringView& topic, const StringView& s)
 {
+  switch (topicHash()) {
   // Set Values
-  if (topic == MQTTTopic::CmdResetAll) {
+  case MQTTTopic::CmdResetAll.hash():
+    if (topic != MQTTTopic::CmdResetAll)
+      break;
     if (s == F("YES"))   {
       Serial.println(F("Speicherbereich wird gelöscht"));
       getPersistentConfig().factoryReset();
@@ -181,7 +298,10 @@ bool KWLControl::mqttReceiveMsg(const StringView& topic, const StringView& s)
       wdt_disable();
       asm volatile ("jmp 0");
     }
-  } else if (topic == MQTTTopic::CmdRestart) {
+    return true;
+  case MQTTTopic::CmdRestart.hash():
+    if (topic != MQTTTopic::CmdRestart)
+      break;
     if (s == F("YES"))   {
       // Reboot
       Serial.println(F("Reboot"));
@@ -190,153 +310,340 @@ bool KWLControl::mqttReceiveMsg(const StringView& topic, const StringView& s)
       wdt_disable();
       asm volatile ("jmp 0");
     }
-  } else if (topic == MQTTTopic::KwlDebugsetSchedulerResetvalues) {
+    return true;
+  case MQTTTopic::KwlDebugsetSchedulerResetvalues.hash():
+    if (topic != MQTTTopic::KwlDebugsetSchedulerResetvalues)
+      break;
     // reset maximum runtimes for all tasks
     for (auto i = Scheduler::TaskTimingStats::begin(); i != Scheduler::TaskTimingStats::end(); ++i)
       i->resetMaximum();
     for (auto i = Scheduler::TaskPollingStats::begin(); i != Scheduler::TaskPollingStats::end(); ++i)
       i->resetMaximum();
+    Scheduler::LatenessAttribution::reset();
+    Scheduler::TaskBudget::reset();
+    PublishTask::resetStatistics();
+    MessageHandler::resetStatistics();
+    return true;
   // Get Commands
-  } else if (topic == MQTTTopic::CmdGetvalues) {
+  case MQTTTopic::CmdGetvalues.hash():
+    if (topic != MQTTTopic::CmdGetvalues)
+      break;
     // Alle Values
     getTempSensors().forceSend();
     getAntifreeze().forceSend();
     getFanControl().forceSend();
     getBypass().forceSend();
     getAdditionalSensors().forceSend();
-  } else if (topic == MQTTTopic::KwlDebugsetSchedulerGetvalues) {
-    // send statistics for scheduler
-    auto i1 = Scheduler::TaskPollingStats::begin();
-    auto i2 = Scheduler::TaskTimingStats::begin();
-    scheduler_publish_.publish([i1, i2]() mutable {
-      char buffer[80];
-      char tbuffer[40];
-      MQTTTopic::KwlDebugstateScheduler.store(tbuffer);
-      char* p = tbuffer + MQTTTopic::KwlDebugstateScheduler.length();
-      static constexpr size_t rsize = sizeof(tbuffer) - MQTTTopic::KwlDebugstateScheduler.length() - 1;
-      while (i1 != Scheduler::TaskPollingStats::end()) {
-        strncpy_P(p, reinterpret_cast<const char*>(i1->getName()), rsize);
-        p[rsize] = 0;
-        i1->toString(buffer, sizeof(buffer));
-        if (publish(tbuffer, buffer, false))
-          ++i1;
-        return false;
-      }
-      while (i2 != Scheduler::TaskTimingStats::end()) {
-        strncpy_P(p, reinterpret_cast<const char*>(i2->getName()), rsize);
-        p[rsize] = 0;
-        i2->toString(buffer, sizeof(buffer));
-        if (publish(tbuffer, buffer, false))
-          ++i2;
-        return false;
+    return true;
+  case MQTTTopic::CmdSchedulerGetIntervals.hash():
+    if (topic != MQTTTopic::CmdSchedulerGetIntervals)
+      break;
+    {
+      // send intervals of all tunable tasks
+      auto i = Scheduler::TaskInterval::begin();
+      interval_publish_.publish([i]() mutable {
+        while (i != Scheduler::TaskInterval::end()) {
+          if (!publishInterval(*i))
+            return false; // continue next time
+          ++i;
+        }
+        return true;
+      });
+    }
+    return true;
+  case MQTTTopic::CmdSchedulerStoreIntervals.hash():
+    if (topic != MQTTTopic::CmdSchedulerStoreIntervals)
+      break;
+    if (s == F("YES")) {
+      // store changed intervals in EEPROM, remove those reset to default
+      MessageHandler::setCommandBudget(BUDGET_STORE_INTERVALS);
+      for (auto i = Scheduler::TaskInterval::begin(); i != Scheduler::TaskInterval::end(); ++i) {
+        auto interval = (i->get() == i->getDefault()) ? 0 : uint16_t(i->get() / 100000);
+        if (!persistent_config_.setTaskInterval(i->getName(), interval)) {
+          Serial.print(F("No space in EEPROM for interval "));
+          Serial.println(i->getName());
+        }
       }
-      return true;
-    });
-  } else if (topic == MQTTTopic::KwlDebugsetNTPTime) {
-    // set NTP time
-    unsigned long time = static_cast<unsigned long>(s.toInt());
-    ntp_.debugSetTime(time);
-    if (KWLConfig::serialDebug) {
-      Serial.print(F("Setting NTP time to "));
-      Serial.print(time);
-      Serial.print(F(", "));
-      Serial.println(PrintableHMS(ntp_.currentTimeHMS(persistent_config_.getTimezoneMin() * 60, persistent_config_.getDST())));
     }
-  } else if (topic == MQTTTopic::KwlDebugsetCrashGetvalues) {
-    // get crash information
-    unsigned index = 0;
-    scheduler_publish_.publish([this, index]() mutable {
-      while (index < KWLConfig::MaxCrashReportCount) {
-        auto& c = persistent_config_.getCrash(index);
-        if (c.crash_addr) {
-          char buffer[48], topic[MQTTTopic::KwlDebugstateCrash.length() + 3];
-          MQTTTopic::KwlDebugstateCrash.store(topic);
-          char* p = topic + MQTTTopic::KwlDebugstateCrash.length();
-          *p++ = char(index / 10) + '0';
-          *p++ = (index % 10) + '0';
-          *p = 0;
-          snprintf_P(buffer, sizeof(buffer), PSTR("ip %06lx sp %03lx ntp %lu ms %lu"),
-                   c.crash_addr * 2, c.crash_sp, c.real_time, c.millis);
-          if (MessageHandler::publish(topic, buffer))
-            ++index;
+    return true;
+  case MQTTTopic::KwlDebugsetSchedulerGetvalues.hash():
+    if (topic != MQTTTopic::KwlDebugsetSchedulerGetvalues)
+      break;
+    {
+      // send statistics for scheduler
+      auto i1 = Scheduler::TaskPollingStats::begin();
+      auto i2 = Scheduler::TaskTimingStats::begin();
+      auto i3 = PublishTask::begin();
+      uint8_t part = 0;
+      scheduler_publish_.publish([this, i1, i2, i3, part]() mutable {
+        // for each task, statistics, histogram and lateness (only timed tasks) are sent in turn
+        static constexpr bool has_hist = Scheduler::TimingHistogram::BUCKETS > 0;
+        char buffer[160];
+        char tbuffer[40];
+        while (i1 != Scheduler::TaskPollingStats::end()) {
+          if (part == 0) {
+            storeStatsTopic(tbuffer, MQTTTopic::KwlDebugstateScheduler, i1->getName());
+            i1->toString(buffer, sizeof(buffer));
+          } else {
+            storeStatsTopic(tbuffer, MQTTTopic::KwlDebugstateSchedulerHistogram, i1->getName());
+            i1->getHistogram().toString(buffer, sizeof(buffer));
+          }
+          if (publish(tbuffer, buffer, false)) {
+            if (++part > 1 || !has_hist) {
+              part = 0;
+              ++i1;
+            }
+          }
+          return false;
+        }
+        while (i2 != Scheduler::TaskTimingStats::end()) {
+          if (part == 0) {
+            storeStatsTopic(tbuffer, MQTTTopic::KwlDebugstateScheduler, i2->getName());
+            i2->toString(buffer, sizeof(buffer));
+          } else if (part == 1) {
+            storeStatsTopic(tbuffer, MQTTTopic::KwlDebugstateSchedulerHistogram, i2->getName());
+            i2->getHistogram()->toString(buffer, sizeof(buffer));
+          } else {
+            storeStatsTopic(tbuffer, MQTTTopic::KwlDebugstateSchedulerLateness, i2->getName());
+            i2->getLateness()->toString(buffer, sizeof(buffer));
+          }
+          if (publish(tbuffer, buffer, false)) {
+            // skip missing histogram (disabled or aggregate) and lateness (not kept or no timed task)
+            do {
+              ++part;
+            } while ((part == 1 && (!has_hist || !i2->getHistogram())) ||
+              (part == 2 && (!i2->getLateness() || !i2->getLateness()->getCount())));
+            if (part > 2) {
+              part = 0;
+              ++i2;
+            }
+          }
+          return false;
+        }
+        while (i3 != PublishTask::end()) {
+          // state and wait times of publish tasks (only named ones)
+          if (i3->getName()) {
+            storeStatsTopic(tbuffer, MQTTTopic::KwlDebugstateSchedulerPublish, i3->getName());
+            i3->toString(buffer, sizeof(buffer));
+            if (!publish(tbuffer, buffer, false))
+              return false;
+          }
+          ++i3;
+          return false;
+        }
+        // finally, priority classes, publish and command queues and worst lateness over all tasks
+        if (part == 0) {
+          scheduler_.priorityToString(buffer, sizeof(buffer));
+          if (publish(MQTTTopic::KwlDebugstateSchedulerPriority, buffer, false))
+            part = 1;
+          return false;
+        }
+        if (part == 1) {
+          PublishTask::queueToString(buffer, sizeof(buffer));
+          if (publish(MQTTTopic::KwlDebugstateSchedulerPublishQueue, buffer, false))
+            part = 2;
+          return false;
+        }
+        if (part == 2) {
+          MessageHandler::queueToString(buffer, sizeof(buffer));
+          if (publish(MQTTTopic::KwlDebugstateSchedulerCommandQueue, buffer, false))
+            part = 3;
+          return false;
+        }
+        Scheduler::LatenessAttribution::toString(buffer, sizeof(buffer));
+        return publish(MQTTTopic::KwlDebugstateSchedulerWorst, buffer, false);
+      });
+    }
+    return true;
+  case MQTTTopic::KwlDebugsetSchedulerTrace.hash():
+    if (topic != MQTTTopic::KwlDebugsetSchedulerTrace)
+      break;
+    // control scheduler trace
+    if (s == F("on")) {
+      Scheduler::SchedulerTrace::start();
+    } else if (s == F("off")) {
+      Scheduler::SchedulerTrace::stop();
+    } else if (s == F("dump") || s == F("serial")) {
+      // stop tracing to dump consistent data, send chunks of events
+      Scheduler::SchedulerTrace::stop();
+      bool to_serial = (s == F("serial"));
+      unsigned index = 0;
+      auto writer = [to_serial, index]() mutable {
+        char buffer[80];
+        auto next = index;
+        if (!Scheduler::SchedulerTrace::toString(buffer, to_serial ? 56 : sizeof(buffer), next))
+          return true;
+        if (to_serial) {
+          // don't block on serial output, wait until there is space in the send buffer
+          if (Serial.availableForWrite() < int(strlen(buffer)) + 8)
+            return false;
+          Serial.print(F("trace "));
+          Serial.println(buffer);
+        } else if (!publish(MQTTTopic::KwlDebugstateSchedulerTrace, buffer, false)) {
           return false;
         }
-        ++index;
+        index = next;
+        return false;
+      };
+      // serial output is not subject to MQTT rate limit
+      if (to_serial)
+        scheduler_publish_.publishLocal(static_cast<decltype(writer)&&>(writer));
+      else
+        scheduler_publish_.publish(static_cast<decltype(writer)&&>(writer));
+    }
+    return true;
+  case MQTTTopic::KwlDebugsetNTPTime.hash():
+    if (topic != MQTTTopic::KwlDebugsetNTPTime)
+      break;
+    {
+      // set NTP time
+      unsigned long time = static_cast<unsigned long>(s.toInt());
+      ntp_.debugSetTime(time);
+      if (KWLConfig::serialDebug) {
+        Serial.print(F("Setting NTP time to "));
+        Serial.print(time);
+        Serial.print(F(", "));
+        Serial.println(PrintableHMS(ntp_.currentTimeHMS(persistent_config_.getTimezoneMin() * 60, persistent_config_.getDST())));
       }
-      return true;
-    });
-  } else if (topic == MQTTTopic::KwlDebugsetCrashResetvalues) {
+    }
+    return true;
+  case MQTTTopic::KwlDebugsetCrashGetvalues.hash():
+    if (topic != MQTTTopic::KwlDebugsetCrashGetvalues)
+      break;
+    {
+      // get crash information
+      unsigned index = 0;
+      scheduler_publish_.publish([this, index]() mutable {
+        while (index < KWLConfig::MaxCrashReportCount) {
+          auto& c = persistent_config_.getCrash(index);
+          if (c.crash_addr) {
+            char buffer[48], topic[MQTTTopic::KwlDebugstateCrash.length() + 3];
+            MQTTTopic::KwlDebugstateCrash.store(topic);
+            char* p = topic + MQTTTopic::KwlDebugstateCrash.length();
+            *p++ = char(index / 10) + '0';
+            *p++ = (index % 10) + '0';
+            *p = 0;
+            snprintf_P(buffer, sizeof(buffer), PSTR("ip %06lx sp %03lx ntp %lu ms %lu"),
+                     c.crash_addr * 2, c.crash_sp, c.real_time, c.millis);
+            if (MessageHandler::publish(topic, buffer))
+              ++index;
+            return false;
+          }
+          ++index;
+        }
+        return true;
+      });
+    }
+    return true;
+  case MQTTTopic::KwlDebugsetCrashResetvalues.hash():
+    if (topic != MQTTTopic::KwlDebugsetCrashResetvalues)
+      break;
     // reset crash information
     persistent_config_.resetCrashes();
     errors_ &= ~ERROR_BIT_CRASH;
     mqttSendStatus();
-  } else if (topic == MQTTTopic::KwlDebugsetCrashProvoke) {
+    return true;
+  case MQTTTopic::KwlDebugsetEepromDump.hash():
+    if (topic != MQTTTopic::KwlDebugsetEepromDump)
+      break;
+    // dump EEPROM contents to serial port
+    if (!eeprom_dump_task_.isRunning()) {
+      eeprom_dump_addr_ = 0;
+      eeprom_dump_task_.start();
+    }
+    return true;
+  case MQTTTopic::KwlDebugsetCrashProvoke.hash():
+    if (topic != MQTTTopic::KwlDebugsetCrashProvoke)
+      break;
     if (s == F("YES"))   {
       // provoke a crash by making a deadlock
       Serial.println(F("CRASH: Deadlock provoked"));
       Serial.flush();
       while (true) {}
     }
-  } 
+    return true;
   #ifdef USE_TFT
-  else if (topic == MQTTTopic::CmdScreenshot) {
-    IPAddress ip;
-    uint16_t port = 4444;
+  case MQTTTopic::CmdScreenshot.hash():
+    if (topic != MQTTTopic::CmdScreenshot)
+      break;
     {
-      auto ip_str = s.c_str();
-      auto port_str = strchr(ip_str, ':');
-      if (port_str) {
-        *const_cast<char*>(port_str++) = 0;
-        port = uint16_t(atoi(port_str));
-      }
-      if (!ip.fromString(ip_str)) {
-        Serial.println(F("Screenshot: invalid IP address"));
-        return true;
-      }
-      if (!port) {
-        Serial.println(F("Screenshot: invalid port specified"));
-        return true;
+      IPAddress ip;
+      uint16_t port = 4444;
+      {
+        auto ip_str = s.c_str();
+        auto port_str = strchr(ip_str, ':');
+        if (port_str) {
+          *const_cast<char*>(port_str++) = 0;
+          port = uint16_t(atoi(port_str));
+        }
+        if (!ip.fromString(ip_str)) {
+          Serial.println(F("Screenshot: invalid IP address"));
+          return true;
+        }
+        if (!port) {
+          Serial.println(F("Screenshot: invalid port specified"));
+          return true;
+        }
       }
-    }
-    if (KWLConfig::serialDebug) {
-      Serial.print(F("Screenshot: trigger for "));
-      Serial.print(ip);
-      Serial.print(':');
-      Serial.print(port);
-      Serial.print(F(" received at "));
-      Serial.println(millis());
-    }
-    tft_.prepareForScreenshot();
-    EthernetClient client;
-    if (!client.connect(ip, port)) {
       if (KWLConfig::serialDebug) {
-        Serial.println(F("Screenshot: cannot connect"));
+        Serial.print(F("Screenshot: trigger for "));
+        Serial.print(ip);
+        Serial.print(':');
+        Serial.print(port);
+        Serial.print(F(" received at "));
+        Serial.println(millis());
+      }
+      if (screenshot_task_.isRunning()) {
+        Serial.println(F("Screenshot: previous screenshot still in progress"));
         return true;
       }
+      // connecting blocks until the receiver answers, so connect in the task
+      screenshot_ip_ = ip;
+      screenshot_port_ = port;
+      screenshot_connect_ = true;
+      screenshot_task_.start();
     }
-    if (KWLConfig::serialDebug)
-      Serial.println(F("Screenshot: connected"));
-    ScreenshotService::make(tft_.getTFT(), client);
-    client.flush();
-    client.stop();
-    if (KWLConfig::serialDebug) {
-      Serial.print(F("Screenshot: done at "));
-      Serial.println(millis());
-    }
-  } else if (topic == MQTTTopic::CmdScreen) {
+    return true;
+  case MQTTTopic::CmdScreen.hash():
+    if (topic != MQTTTopic::CmdScreen)
+      break;
     // switch to given screen by ID
     tft_.gotoScreen(s.toInt());
-  } else if (topic == MQTTTopic::CmdTouch) {
-    // simulate touch at x,y
-    int x, y;
-    if (sscanf_P(s.c_str(), PSTR("%d,%d"), &x, &y) == 2)
-      tft_.makeTouch(x, y);
-  } 
+    return true;
+  case MQTTTopic::CmdTouch.hash():
+    if (topic != MQTTTopic::CmdTouch)
+      break;
+    {
+      // simulate touch at x,y
+      int x, y;
+      if (sscanf_P(s.c_str(), PSTR("%d,%d"), &x, &y) == 2)
+        tft_.makeTouch(x, y);
+    }
+    return true;
   #endif // USE_TFT
-  else {
-    return false;
   }
-  return true;
+  if (topic.substr(0, MQTTTopic::CmdSchedulerInterval.length()) == MQTTTopic::CmdSchedulerInterval) {
+    // set interval of a task in ms, rounded to 100ms as stored in EEPROM
+    auto interval = Scheduler::TaskInterval::find(topic.c_str() + MQTTTopic::CmdSchedulerInterval.length());
+    if (!interval) {
+      if (KWLConfig::serialDebug)
+        Serial.println(F("Unknown task interval"));
+      return true;
+    }
+    if (s == F("default")) {
+      interval->reset();
+    } else {
+      auto ms = s.toInt();
+      if (ms <= 0 || static_cast<unsigned long>(ms) > Scheduler::TaskInterval::MAX_INTERVAL / 1000 ||
+          !interval->set((static_cast<unsigned long>(ms) + 50) / 100 * 100000UL)) {
+        if (KWLConfig::serialDebug)
+          Serial.println(F("Invalid task interval"));
+      }
+    }
+    interval_publish_.publish([interval]() { return publishInterval(*interval); });
+    return true;
+  }
+  return false;
 }
 
 void KWLControl::run()
@@ -344,6 +651,13 @@ void KWLControl::run()
   // In dieser Funktion wird auf verschiedene Fehler getestet und Felherbitmap gesets.
   // Fehlertext wird auf das Display geschrieben.
 
+  if (!listeners_connected_) {
+    // react to new measurements only after initialization, so startup errors are not reported
+    temp_listener_.connect(temp_sensors_.getUpdateSignal());
+    fan_listener_.connect(fan_control_.getStallSignal());
+    listeners_connected_ = true;
+  }
+
   unsigned local_err = errors_ & ERROR_BIT_CRASH;
   if (KWLConfig::StandardKwlModeFactor[fan_control_.getVentilationMode()] > 0.01) {
     if (fan_control_.getFan1().getSpeed() < 10 && antifreeze_.getState() == AntifreezeState::OFF)
@@ -361,6 +675,20 @@ void KWLControl::run()
     local_err |= ERROR_BIT_T3;
   if (temp_sensors_.get_t4_exhaust() <= TempSensors::INVALID)
     local_err |= ERROR_BIT_T4;
+  if (Scheduler::TaskBudget::isAlarmActive())
+    local_err |= ERROR_BIT_OVERRUN;
+
+  bool new_alarm = false;
+  if (overrun_alarms_ != Scheduler::TaskBudget::getAlarmCount()) {
+    // a task repeatedly overran its budget, report it
+    overrun_alarms_ = Scheduler::TaskBudget::getAlarmCount();
+    new_alarm = true;
+    overrun_publish_.publish([]() {
+      char buffer[80];
+      Scheduler::TaskBudget::alarmToString(buffer, sizeof(buffer));
+      return publish(MQTTTopic::KwlSchedulerOverrun, buffer, false);
+    });
+  }
 
   unsigned local_info = 0;
   if (fan_control_.getMode() == FanMode::Calibration)
@@ -374,7 +702,7 @@ void KWLControl::run()
   else if (bypass_.isRunning())
     local_info = INFO_BYPASS | ((bypass_.getTargetState() == SummerBypassFlapState::OPEN) ? 1 : 0);
 
-  if (errors_ != local_err || info_ != local_info) {
+  if (errors_ != local_err || info_ != local_info || new_alarm) {
     // publish status via MQTT
     errors_ = local_err;
     info_ = local_info;
@@ -384,13 +712,77 @@ void KWLControl::run()
 
 void KWLControl::mqttSendStatus()
 {
-  error_publish_.publish([this]() {
-    char buffer[11];
-    snprintf_P(buffer, sizeof(buffer), PSTR("0x%04X%04X"), errors_, info_);
-    return publish(MQTTTopic::StatusBits, buffer, KWLConfig::RetainStatusBits);
+  bool status_sent = false;
+  error_publish_.publish([this, status_sent]() mutable {
+    if (!status_sent) {
+      char buffer[11];
+      buffer[0] = '0';
+      buffer[1] = 'x';
+      NumberFormat::formatHex(buffer + 2, (uint32_t(errors_) << 16) | info_, 8);
+      if (!publish(MQTTTopic::StatusBits, buffer, KWLConfig::RetainStatusBits))
+        return false;
+      status_sent = true;
+    }
+    // report the task which overran its budget last separately
+    auto name = Scheduler::TaskBudget::getLastOverrunName();
+    if (!(errors_ & ERROR_BIT_OVERRUN) || !name)
+      return true;
+    return publish(MQTTTopic::KwlSchedulerOverrunTask, name, false);
+  });
+}
+
+void KWLControl::mqttSendSnapshot()
+{
+  snapshot_publish_.publish([this]() {
+    if (KWLConfig::MqttCbor)
+      return publishStream(MQTTTopic::KwlSnapshot, [this](Print& out) { writeSnapshot<CborWriter>(out); }, KWLConfig::RetainSnapshot);
+    return publishStream(MQTTTopic::KwlSnapshot, [this](Print& out) { writeSnapshot<JsonWriter>(out); }, KWLConfig::RetainSnapshot);
   });
 }
 
+template<typename Writer>
+void KWLControl::writeSnapshot(Print& out)
+{
+  // Keep the document deterministic, publishStream() writes it several times.
+  Writer writer(out);
+  const bool all = KWLConfig::SendErroneousMeasurement;
+  auto temp = [&writer, all](const __FlashStringHelper* key, double t) {
+    if (all || t > TempSensors::INVALID)
+      writer.member(key, t, 2);
+    else
+      writer.memberNull(key);
+  };
+  temp(F("t1"), temp_sensors_.get_t1_outside());
+  temp(F("t2"), temp_sensors_.get_t2_inlet());
+  temp(F("t3"), temp_sensors_.get_t3_outlet());
+  temp(F("t4"), temp_sensors_.get_t4_exhaust());
+  writer.member(F("eff"), long(temp_sensors_.getEfficiency()));
+  writer.member(F("mode"), long(fan_control_.getVentilationMode()));
+  writer.member(F("fan1"), long(fan_control_.getFan1().getSpeed()));
+  writer.member(F("fan2"), long(fan_control_.getFan2().getSpeed()));
+  writer.member(F("bypass"), SummerBypass::toString(bypass_.getState()));
+  writer.member(F("antifreeze"), (antifreeze_.getState() != AntifreezeState::OFF) ? F("on") : F("off"));
+  if (add_sensors_.hasDHT1()) {
+    writer.member(F("dht1t"), double(add_sensors_.getDHT1Temp()), 1);
+    writer.member(F("dht1h"), double(add_sensors_.getDHT1Hum()), 1);
+  }
+  if (add_sensors_.hasDHT2()) {
+    writer.member(F("dht2t"), double(add_sensors_.getDHT2Temp()), 1);
+    writer.member(F("dht2h"), double(add_sensors_.getDHT2Hum()), 1);
+  }
+  if (add_sensors_.hasCO2()) {
+    if (all || add_sensors_.getCO2() >= 0)
+      writer.member(F("co2"), long(add_sensors_.getCO2()));
+    else
+      writer.memberNull(F("co2"));
+  }
+  if (add_sensors_.hasVOC())
+    writer.member(F("voc"), long(add_sensors_.getVOC()));
+  writer.member(F("errors"), long(errors_));
+  writer.member(F("info"), long(info_));
+  writer.end();
+}
+
 void KWLControl::deadlockDetected(unsigned long pc, unsigned sp, void* arg)
 {
   auto instance = reinterpret_cast<KWLControl*>(arg);
@@ -35,6 +35,7 @@
 #include "AdditionalSensors.h"
 #ifdef USE_TFT
 #include "TFT.h"
+#include <ScreenshotService.h>
 #endif
 
 /*!
@@ -61,6 +62,8 @@ public:
   static constexpr unsigned ERROR_BIT_T3      = 0x0040;
   /// T4 sensor is not working.
   static constexpr unsigned ERROR_BIT_T4      = 0x0080;  
+  /// A task repeatedly exceeded its execution budget.
+  static constexpr unsigned ERROR_BIT_OVERRUN = 0x0100;
 
   /// Mask to extract information type from info bits.
   static constexpr unsigned INFO_TYPE_MASK    = 0xff00;
@@ -142,12 +145,30 @@ private:
 
   void run();
 
+  /// Dump next part of EEPROM contents to serial port.
+  void eepromDumpStep();
+
+#ifdef USE_TFT
+  /// Send next part of the screenshot.
+  void screenshotStep();
+#endif
+
   /// Send status bits.
   void mqttSendStatus();
 
+  /// Send snapshot of all measurements.
+  void mqttSendSnapshot();
+
+  /// Write snapshot of all measurements using JsonWriter or CborWriter.
+  template<typename Writer>
+  void writeSnapshot(Print& out);
+
   /// Called by watchdog to report deadlock.
   static void deadlockDetected(unsigned long pc, unsigned sp, void* arg);
 
+  /// Called by scheduler to sleep while no task has work to do.
+  static void idleSleep(unsigned long us);
+
   /// Scheduler for running tasks.
   Scheduler::PollingScheduler scheduler_;
   /// Persistent configuration.
@@ -178,12 +199,52 @@ private:
   PublishTask scheduler_publish_;
   /// Task to send errors.
   PublishTask error_publish_;
+  /// Task to send task intervals.
+  PublishTask interval_publish_;
+  /// Task to send execution budget overrun alarms.
+  PublishTask overrun_publish_;
+  /// Task to send measurement snapshots.
+  PublishTask snapshot_publish_;
   /// Current error state.
   unsigned errors_ = 0;
   /// Current info state.
   unsigned info_ = 0;
+  /// Count of execution budget overrun alarms already reported.
+  unsigned overrun_alarms_ = 0;
   /// Main control timing statistics.
-  Scheduler::TaskTimingStats control_stats_;
+  Scheduler::TimedTaskStats control_stats_;
   /// Timer firing checks.
   Scheduler::TimedTask<KWLControl> control_timer_;
+  /// Run checks as soon as new temperatures are available.
+  Scheduler::SignalListener temp_listener_;
+  /// Run checks as soon as a fan stalls or starts rotating again.
+  Scheduler::SignalListener fan_listener_;
+  /// Set when listeners are connected after initialization.
+  bool listeners_connected_ = false;
+  /// Snapshot timing statistics.
+  Scheduler::TaskHistogramStats snapshot_stats_;
+  /// Timer sending measurement snapshots.
+  Scheduler::TimedTask<KWLControl> snapshot_timer_;
+  /// EEPROM dump timing statistics.
+  Scheduler::TaskHistogramStats eeprom_dump_stats_;
+  /// Task dumping EEPROM contents in steps.
+  Scheduler::SteppedTask<KWLControl> eeprom_dump_task_;
+  /// Next EEPROM address to dump.
+  unsigned eeprom_dump_addr_ = 0;
+#ifdef USE_TFT
+  /// Screenshot timing statistics.
+  Scheduler::TaskHistogramStats screenshot_stats_;
+  /// Task sending screenshot in steps.
+  Scheduler::SteppedTask<KWLControl> screenshot_task_;
+  /// Screenshot being sent.
+  ScreenshotService screenshot_;
+  /// Connection to the receiver of the screenshot.
+  EthernetClient screenshot_client_;
+  /// Address of the receiver of the screenshot.
+  IPAddress screenshot_ip_;
+  /// Port of the receiver of the screenshot.
+  uint16_t screenshot_port_ = 0;
+  /// Set until the first step of the screenshot task connected to the receiver.
+  bool screenshot_connect_ = false;
+#endif
 };
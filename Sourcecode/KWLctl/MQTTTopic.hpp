@@ -77,6 +77,11 @@ namespace MQTTTopic
   constexpr auto CmdScreenshot              = makeFlashStringLiteral("screenshot");
   constexpr auto CmdScreen                  = makeFlashStringLiteral("screen");
   constexpr auto CmdTouch                   = makeFlashStringLiteral("touch");
+  // Intervalle der Tasks: scheduler/interval/<Name> setzt Intervall in ms ("default" für Standardwert),
+  // getintervals sendet alle Intervalle, storeintervals mit YES speichert die aktuellen Intervalle im EEPROM
+  constexpr auto CmdSchedulerInterval       = makeFlashStringLiteral("scheduler/interval/");
+  constexpr auto CmdSchedulerGetIntervals   = makeFlashStringLiteral("scheduler/getintervals");
+  constexpr auto CmdSchedulerStoreIntervals = makeFlashStringLiteral("scheduler/storeintervals");
 
   constexpr auto Heartbeat                  = makeFlashStringLiteral("heartbeat");
   constexpr auto StatusBits                 = makeFlashStringLiteral("statusbits");
@@ -99,6 +104,9 @@ namespace MQTTTopic
   constexpr auto KwlProgramIndex            = makeFlashStringLiteral("program/index");
   constexpr auto KwlProgramSet              = makeFlashStringLiteral("program/set");
   constexpr auto KwlProgramData             = makeFlashStringLiteral("program/");
+  constexpr auto KwlSchedulerInterval       = makeFlashStringLiteral("scheduler/interval/");
+  constexpr auto KwlSchedulerOverrun        = makeFlashStringLiteral("scheduler/overrun");
+  constexpr auto KwlSchedulerOverrunTask    = makeFlashStringLiteral("scheduler/overrun/task");
 
   constexpr auto KwlDHT1Temperatur          = makeFlashStringLiteral("dht1/temperatur");
   constexpr auto KwlDHT2Temperatur          = makeFlashStringLiteral("dht2/temperatur");
@@ -107,6 +115,9 @@ namespace MQTTTopic
   constexpr auto KwlCO2Abluft               = makeFlashStringLiteral("abluft/co2");
   constexpr auto KwlVOCAbluft               = makeFlashStringLiteral("abluft/voc");
 
+  // Alle Messwerte zusammengefasst als ein JSON-Dokument, siehe KWLConfig::SnapshotInterval
+  constexpr auto KwlSnapshot                = makeFlashStringLiteral("snapshot");
+
 
   // Die folgenden Topics sind nur für die SW-Entwicklung, und schalten Debugausgaben per mqtt ein und aus
   constexpr auto KwlDebugsetFan1Getvalues   = makeFlashStringLiteral("/fan1/getvalues");
@@ -125,6 +136,18 @@ namespace MQTTTopic
   constexpr auto KwlDebugsetSchedulerGetvalues   = makeFlashStringLiteral("/scheduler/getvalues");
   constexpr auto KwlDebugsetSchedulerResetvalues = makeFlashStringLiteral("/scheduler/resetvalues");
   constexpr auto KwlDebugstateScheduler    = makeFlashStringLiteral("/scheduler/");
+  constexpr auto KwlDebugstateSchedulerHistogram = makeFlashStringLiteral("/scheduler/hist/");
+  constexpr auto KwlDebugstateSchedulerLateness  = makeFlashStringLiteral("/scheduler/late/");
+  constexpr auto KwlDebugstateSchedulerWorst     = makeFlashStringLiteral("/scheduler/worst");
+  constexpr auto KwlDebugstateSchedulerPriority  = makeFlashStringLiteral("/scheduler/priority");
+  constexpr auto KwlDebugstateSchedulerLoad      = makeFlashStringLiteral("/scheduler/load");
+  constexpr auto KwlDebugstateSchedulerPublish   = makeFlashStringLiteral("/scheduler/publish/");
+  constexpr auto KwlDebugstateSchedulerPublishQueue = makeFlashStringLiteral("/scheduler/publishqueue");
+  constexpr auto KwlDebugstateSchedulerCommandQueue = makeFlashStringLiteral("/scheduler/commandqueue");
+  // Trace der Scheduler-Ereignisse: on/off zum Starten/Stoppen, dump zum Senden per mqtt, serial zur Ausgabe auf der seriellen Schnittstelle
+  // (nur mit Build-Flag SCHEDULER_TRACE_EVENTS > 0, z.B. -DSCHEDULER_TRACE_EVENTS=64)
+  constexpr auto KwlDebugsetSchedulerTrace       = makeFlashStringLiteral("/scheduler/trace");
+  constexpr auto KwlDebugstateSchedulerTrace     = makeFlashStringLiteral("/scheduler/trace");
 
   // Die folgenden Topics sind nur für die SW-Entwicklung, um Crash info auszulesen
   constexpr auto KwlDebugsetCrashGetvalues = makeFlashStringLiteral("/crash/getvalues");
@@ -132,6 +155,9 @@ namespace MQTTTopic
   constexpr auto KwlDebugsetCrashProvoke   = makeFlashStringLiteral("/crash/provoke_IKNOWWHATIMDOING");
   constexpr auto KwlDebugstateCrash        = makeFlashStringLiteral("/crash/");
 
+  // Die folgenden Topics sind nur für die SW-Entwicklung, um den EEPROM-Inhalt auf der seriellen Schnittstelle auszugeben
+  constexpr auto KwlDebugsetEepromDump     = makeFlashStringLiteral("/eeprom/dump");
+
   // Die folgenden Topics sind nur für die SW-Entwicklung, um NTP zu simulieren.
   constexpr auto KwlDebugsetNTPTime        = makeFlashStringLiteral("/ntp/time");
 
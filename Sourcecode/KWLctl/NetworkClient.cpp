@@ -20,6 +20,7 @@
 
 #include "NetworkClient.h"
 #include "MessageHandler.h"
+#include "TelemetryChannel.h"
 #include "KWLConfig.h"
 #include "MQTTTopic.hpp"
 
@@ -34,14 +35,74 @@ static constexpr unsigned long LAN_CHECK_INTERVAL = 10000000;
 /// Interval for reconnecting MQTT (15 seconds).
 static constexpr unsigned long MQTT_RECONNECT_INTERVAL = 15000000;
 
+/// Execution budget of the network check (100ms, covers a reconnect to a reachable broker).
+static constexpr unsigned long NETWORK_CHECK_BUDGET = 100000;
+
+/// Execution budget of one network poll (20ms).
+static constexpr unsigned long NETWORK_POLL_BUDGET = 20000;
+
+/// Interval for sampling telemetry channels (1s, unit of channel intervals).
+static constexpr unsigned long TELEMETRY_INTERVAL = 1000000;
+
+/// Execution budget of one telemetry sampling (5ms).
+static constexpr unsigned long TELEMETRY_BUDGET = 5000;
+
+/// Execution budget of handling queued commands (10ms, at least one command runs per poll).
+static constexpr unsigned long COMMAND_BUDGET = 10000;
+/// Execution budget of installing MQTT prefix (50ms, EEPROM write and disconnect).
+static constexpr unsigned long BUDGET_INSTALL_PREFIX = 50000;
+
 /// MQTT heartbeat period.
 static constexpr unsigned long MQTT_HEARTBEAT_PERIOD = KWLConfig::HeartbeatPeriod * 1000000UL;
 
+// Received packet contains at least 4B of fixed header and topic length, the rest
+// is topic and payload. A command of maximum packet size must fit into the queue.
+static_assert(MQTT_MAX_PACKET_SIZE - 4 + MessageHandler::QUEUE_ENTRY_OVERHEAD <= MESSAGE_HANDLER_QUEUE_SIZE,
+  "MESSAGE_HANDLER_QUEUE_SIZE too small for MQTT_MAX_PACKET_SIZE");
+
 namespace {
   /// MQTT prefix length.
   static uint8_t s_mqtt_prefix_len = 0;
   /// MQTT prefix.
   static const char* s_mqtt_prefix = nullptr;
+
+  /// Get size of the full topic of an outgoing message including terminating NUL.
+  size_t stateTopicSize(MessageTopic topic)
+  {
+    // debug topics start with '/', which replaces the trailing '/' of the debug state prefix
+    if (topic.front() == '/')
+      return s_mqtt_prefix_len + MQTTTopic::StateDebug.length() + topic.length();
+    return s_mqtt_prefix_len + MQTTTopic::State.length() + topic.length() + 1;
+  }
+
+  /// Store full topic of an outgoing message into a buffer of stateTopicSize() bytes.
+  void storeStateTopic(char* buffer, MessageTopic topic)
+  {
+    memcpy(buffer, s_mqtt_prefix, s_mqtt_prefix_len);
+    buffer += s_mqtt_prefix_len;
+    if (topic.front() == '/') {
+      // debug state
+      MQTTTopic::StateDebug.store(buffer);
+      buffer += MQTTTopic::StateDebug.length() - 1;
+    } else {
+      // normal state
+      MQTTTopic::State.store(buffer);
+      buffer += MQTTTopic::State.length();
+    }
+    topic.store(buffer);
+  }
+
+#ifdef NO_ETHERNET
+  /// Output discarding streamed messages.
+  class NullOutput : public Print
+  {
+  public:
+    virtual size_t write(uint8_t) override { return 1; }
+  };
+
+  /// Instance discarding streamed messages.
+  static NullOutput s_null_output;
+#endif
 }
 
 NetworkClient::NetworkClient(KWLPersistentConfig& config, MicroNTP& ntp) :
@@ -49,12 +110,26 @@ NetworkClient::NetworkClient(KWLPersistentConfig& config, MicroNTP& ntp) :
   mqtt_client_(eth_client_),
   config_(config),
   ntp_(ntp),
-  stats_(F("NetworkClient")),
-  timer_task_(stats_, &NetworkClient::run, *this),
-  poll_stats_(F("NetworkClientPoll")),
-  poll_task_(poll_stats_, &NetworkClient::loop, *this),
-  mqtt_send_poll_task_(poll_stats_, &NetworkClient::sendMQTT)
-{}
+  publish_task_(F("Heartbeat"), PublishPriority::STATUS),
+  stats_(F("NetworkClient"), NETWORK_CHECK_BUDGET),
+  timer_task_(Scheduler::TaskPriority::TELEMETRY, stats_, &NetworkClient::run, *this),
+  poll_stats_(F("NetworkClientPoll"), NETWORK_POLL_BUDGET),
+  poll_task_(Scheduler::TaskPriority::TELEMETRY, poll_stats_, &NetworkClient::loop, *this),
+  mqtt_send_poll_task_(Scheduler::TaskPriority::TELEMETRY, poll_stats_, &NetworkClient::sendMQTT, *this),
+  telemetry_stats_(F("Telemetry"), TELEMETRY_BUDGET),
+  telemetry_task_(Scheduler::TaskPriority::TELEMETRY, telemetry_stats_, &TelemetryChannelBase::loop),
+  command_stats_(F("Commands"), COMMAND_BUDGET),
+  command_poll_task_(Scheduler::TaskPriority::TELEMETRY, command_stats_, &NetworkClient::processCommands)
+{
+  // Serial input wakes up via UART interrupt. W5100 interrupt line is not wired
+  // on the Ethernet shield, so the network is polled periodically, faster after activity.
+  poll_task_.setWakeSource([]() { return Serial.available() > 0; });
+  poll_task_.setPollInterval(KWLConfig::NetworkPollIntervalMin, KWLConfig::NetworkPollIntervalMax);
+  // while rate limited, only local writers (e.g., serial trace dump) wake up the send task
+  mqtt_send_poll_task_.setWakeSource(&PublishTask::hasReadyTasks);
+  // commands received via MQTT or serial port are only queued in the receive callback
+  command_poll_task_.setWakeSource(&MessageHandler::hasQueuedMessages);
+}
 
 void NetworkClient::begin(Print& initTracer)
 {
@@ -76,11 +151,11 @@ void NetworkClient::begin(Print& initTracer)
       StringView t(topic + s_mqtt_prefix_len);
       if (t.substr(0, MQTTTopic::Command.length()) == MQTTTopic::Command) {
         // yes, it's our command, cut off the leading part
-        MessageHandler::mqttMessageReceived(topic + s_mqtt_prefix_len + MQTTTopic::Command.length(), payload, length);
+        MessageHandler::enqueueMessage(topic + s_mqtt_prefix_len + MQTTTopic::Command.length(), payload, length);
         return;
       } else if (t.substr(0, MQTTTopic::CommandDebug.length()) == MQTTTopic::CommandDebug) {
         // yes, it's our debug command, keep leading '/' to differentiate
-        MessageHandler::mqttMessageReceived(topic + s_mqtt_prefix_len + MQTTTopic::CommandDebug.length() - 1, payload, length);
+        MessageHandler::enqueueMessage(topic + s_mqtt_prefix_len + MQTTTopic::CommandDebug.length() - 1, payload, length);
         return;
       }
     }
@@ -93,33 +168,49 @@ void NetworkClient::begin(Print& initTracer)
     }
   });
 
-  MessageHandler::begin([](void* instance, const char* topic, const char* payload, bool retained) {
+  MessageHandler::begin([](void* instance, MessageTopic topic, const char* payload, bool retained) {
   #ifdef NO_ETHERNET
     return true;
   #else
-    // prefix name
+    // prefix name, topic fragments are assembled once directly from Flash
     PubSubClient* client = reinterpret_cast<PubSubClient*>(instance);
-    auto topiclen = strlen(topic);
-    if (topic[0] == '/') {
-      // debug state
-      char real_topic[topiclen + s_mqtt_prefix_len + MQTTTopic::StateDebug.length()];
-      memcpy(real_topic, s_mqtt_prefix, s_mqtt_prefix_len);
-      MQTTTopic::StateDebug.store(real_topic + s_mqtt_prefix_len);
-      memcpy(real_topic + MQTTTopic::StateDebug.length() + s_mqtt_prefix_len, topic + 1, topiclen);
-      return client->publish(real_topic, payload, retained);
-    } else {
-      // normal state
-      char real_topic[topiclen + s_mqtt_prefix_len + MQTTTopic::State.length() + 1];
-      memcpy(real_topic, s_mqtt_prefix, s_mqtt_prefix_len);
-      MQTTTopic::State.store(real_topic + s_mqtt_prefix_len);
-      memcpy(real_topic + MQTTTopic::State.length() + s_mqtt_prefix_len, topic, topiclen + 1);
-      return client->publish(real_topic, payload, retained);
-    }
+    char real_topic[stateTopicSize(topic)];
+    storeStateTopic(real_topic, topic);
+    bool sent = client->publish(real_topic, payload, retained);
+    Scheduler::SchedulerTrace::addValue(Scheduler::TraceEvent::PUBLISH, sent);
+    return sent;
+  #endif
+  }, [](void* instance, MessageTopic topic, size_t length, bool retained) -> Print* {
+  #ifdef NO_ETHERNET
+    return &s_null_output;
+  #else
+    // header and topic are sent right away, payload is written to the client directly
+    PubSubClient* client = reinterpret_cast<PubSubClient*>(instance);
+    char real_topic[stateTopicSize(topic)];
+    storeStateTopic(real_topic, topic);
+    if (client->beginPublish(real_topic, length, retained))
+      return client;
+    Scheduler::SchedulerTrace::addValue(Scheduler::TraceEvent::PUBLISH, false);
+    return nullptr;
+  #endif
+  }, [](void* instance) {
+  #ifdef NO_ETHERNET
+    return true;
+  #else
+    bool sent = reinterpret_cast<PubSubClient*>(instance)->endPublish() != 0;
+    Scheduler::SchedulerTrace::addValue(Scheduler::TraceEvent::PUBLISH, sent);
+    return sent;
   #endif
   }, &mqtt_client_, KWLConfig::serialDebug);
+  // smooth bursts, e.g., when all values are requested at once
+  MessageHandler::setRateLimit(KWLConfig::MqttRateMessages, KWLConfig::MqttRateBytes,
+                               KWLConfig::MqttBurstMessages, KWLConfig::MqttBurstBytes);
   last_mqtt_reconnect_attempt_time_ = micros();
   mqtt_ok_ = true;
   loop();  // first run call here to connect MQTT
+
+  // sample telemetry channels, they send on change or periodically
+  telemetry_task_.runRepeated(TELEMETRY_INTERVAL, TELEMETRY_INTERVAL, Scheduler::TimedTaskBase::AUTO_PHASE);
 }
 
 void NetworkClient::initEthernet(Print& initTracer)
@@ -187,6 +278,7 @@ void NetworkClient::loop()
 {
   if (Serial.available()) {
     // there is data on serial port, read command from there
+    poll_task_.markActive();
     char c = char(Serial.read());
     if (c == 10 || c == 13) {
       // process command in form <topic> <value>
@@ -196,7 +288,7 @@ void NetworkClient::loop()
         if (!delim) {
           static constexpr auto NO_VALUE = makeFlashStringLiteral("<no value>");
           char* p = NO_VALUE.load();
-          MessageHandler::mqttMessageReceived(
+          MessageHandler::enqueueMessage(
                 serial_data_,
                 reinterpret_cast<uint8_t*>(p),
                 NO_VALUE.length());
@@ -204,7 +296,7 @@ void NetworkClient::loop()
           *delim++ = 0;
           while (*delim == ' ' || *delim == '\t')
             ++delim;
-          MessageHandler::mqttMessageReceived(
+          MessageHandler::enqueueMessage(
                 serial_data_,
                 reinterpret_cast<uint8_t*>(delim),
                 unsigned(serial_data_size_ - (delim - serial_data_)));
@@ -274,6 +366,8 @@ void NetworkClient::loop()
   resubscribe();
 
   // now MQTT messages can be received
+  if (eth_client_.available())
+    poll_task_.markActive();
   mqtt_client_.loop();
 #endif
 }
@@ -299,44 +393,67 @@ void NetworkClient::resubscribe()
 
 void NetworkClient::sendMQTT()
 {
-  PublishTask::loop();
+  // if rate limited, don't poll again before the next token arrives
+  unsigned long wait = 0;
+  if (!PublishTask::loop() && PublishTask::hasTasks())
+    wait = MessageHandler::getTokenWait() * 1000UL;
+  mqtt_send_poll_task_.setPollInterval(wait, wait);
+}
+
+void NetworkClient::processCommands()
+{
+  MessageHandler::processQueue(COMMAND_BUDGET);
 }
 
 bool NetworkClient::mqttReceiveMsg(const StringView& topic, const StringView& s)
 {
-  if (topic == MQTTTopic::CmdInstallPrefix) {
-    // installation - install new prefix for MQTT communication
-    if (config_.setMQTTPrefix(s.c_str())) {
-      // success, restart MQTT connection
-      if (KWLConfig::serialDebug) {
-        Serial.print(F("Installation: new MQTT prefix: "));
-        Serial.println(s.c_str());
-      }
-      mqtt_client_.disconnect();
-    } else {
-      if (KWLConfig::serialDebug) {
-        Serial.print(F("Installation: too long MQTT prefix: "));
-        Serial.println(s.c_str());
-      }
+  if (topicHash() != MQTTTopic::CmdInstallPrefix.hash() || topic != MQTTTopic::CmdInstallPrefix)
+    return false;
+  // installation - install new prefix for MQTT communication
+  MessageHandler::setCommandBudget(BUDGET_INSTALL_PREFIX);
+  if (config_.setMQTTPrefix(s.c_str())) {
+    // success, restart MQTT connection
+    if (KWLConfig::serialDebug) {
+      Serial.print(F("Installation: new MQTT prefix: "));
+      Serial.println(s.c_str());
     }
+    mqtt_client_.disconnect();
   } else {
-    return false;
+    if (KWLConfig::serialDebug) {
+      Serial.print(F("Installation: too long MQTT prefix: "));
+      Serial.println(s.c_str());
+    }
   }
   return true;
 }
 
 void NetworkClient::run()
 {
-  // once connected or after timeout, publish an announcement
-  if (KWLConfig::HeartbeatTimestamp && ntp_.hasTime()) {
-    auto time = ntp_.currentTimeHMS(config_.getTimezoneMin() * 60, config_.getDST());
-    publish_task_.publish([time](){
-      char buffer[9];
-      time.writeHMS(buffer);
-      buffer[8] = 0;
-      return MessageHandler::publish(MQTTTopic::Heartbeat, buffer, true);
-    });
-  } else {
-    publish_task_.publish(MQTTTopic::Heartbeat, F("online"), true);
-  }
+  // once connected or after timeout, publish an announcement, followed by CPU load
+  bool with_time = KWLConfig::HeartbeatTimestamp && ntp_.hasTime();
+  HMS time;
+  if (with_time)
+    time = ntp_.currentTimeHMS(config_.getTimezoneMin() * 60, config_.getDST());
+  bool heartbeat_sent = false;
+  publish_task_.publish([with_time, time, heartbeat_sent]() mutable {
+    char buffer[96];
+    if (!heartbeat_sent) {
+      if (with_time) {
+        time.writeHMS(buffer);
+        buffer[8] = 0;
+      } else {
+        strcpy_P(buffer, PSTR("online"));
+      }
+      if (KWLConfig::HeartbeatLoad) {
+        auto len = strlen(buffer);
+        buffer[len++] = ' ';
+        Scheduler::LoadStatistics::averagesToString(buffer + len, sizeof(buffer) - len);
+      }
+      if (!MessageHandler::publish(MQTTTopic::Heartbeat, buffer, true))
+        return false;
+      heartbeat_sent = true;
+    }
+    Scheduler::LoadStatistics::toString(buffer, sizeof(buffer));
+    return MessageHandler::publish(MQTTTopic::KwlDebugstateSchedulerLoad, buffer, false);
+  });
 }
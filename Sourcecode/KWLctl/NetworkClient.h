@@ -71,8 +71,11 @@ private:
   /// (Re-)subscribe to topics, if not subscribed yet.
   void resubscribe();
 
-  /// Loop task to send MQTT messages.
-  static void sendMQTT();
+  /// Loop task to send MQTT messages, polled again at the next token while rate limited.
+  void sendMQTT();
+
+  /// Loop task to handle queued commands.
+  static void processCommands();
 
   virtual bool mqttReceiveMsg(const StringView& topic, const StringView& s) override;
 
@@ -106,7 +109,7 @@ private:
   /// Size of data received so far.
   uint8_t serial_data_size_ = 0;
   /// Task timing statistics.
-  Scheduler::TaskTimingStats stats_;
+  Scheduler::TimedTaskStats stats_;
   /// Timer tasks handling heartbeat.
   Scheduler::TimedTask<NetworkClient> timer_task_;
   /// Task polling statistics.
@@ -114,5 +117,13 @@ private:
   /// Poll tasks for maintaining network connection.
   Scheduler::PollTask<NetworkClient> poll_task_;
   /// Poll tasks for sending MQTT messages.
-  Scheduler::PollTask<> mqtt_send_poll_task_;
+  Scheduler::PollTask<NetworkClient> mqtt_send_poll_task_;
+  /// Telemetry sampling statistics.
+  Scheduler::TaskHistogramStats telemetry_stats_;
+  /// Timer task sampling telemetry channels of all modules.
+  Scheduler::TimedTask<> telemetry_task_;
+  /// Command handling statistics.
+  Scheduler::TaskPollingStats command_stats_;
+  /// Poll task handling queued commands.
+  Scheduler::PollTask<> command_poll_task_;
 };
@@ -25,21 +25,27 @@
 
 #include <MicroNTP.h>
 
-/// Check current program every 5s.
+/// Check current program every 5s by default.
 static constexpr unsigned long PROGRAM_INTERVAL = 5000000;
 
+/// Execution budget of one program check (10ms).
+static constexpr unsigned long PROGRAM_BUDGET = 10000;
+
 ProgramManager::ProgramManager(KWLPersistentConfig& config, FanControl& fan, const MicroNTP& ntp) :
   MessageHandler(F("ProgramManager")),
   config_(config),
   fan_(fan),
   ntp_(ntp),
-  stats_(F("ProgramManager")),
-  timer_task_(stats_, &ProgramManager::run, *this)
+  publisher_(F("Program")),
+  prognum_publisher_(F("ProgramIndex")),
+  stats_(F("ProgramManager"), PROGRAM_BUDGET),
+  timer_task_(stats_, &ProgramManager::run, *this),
+  interval_(stats_, timer_task_, PROGRAM_INTERVAL)
 {}
 
 void ProgramManager::begin()
 {
-  timer_task_.runRepeated(PROGRAM_INTERVAL);
+  timer_task_.runRepeated(interval_.get());
 }
 
 const ProgramData& ProgramManager::getProgram(unsigned index)
@@ -157,7 +163,7 @@ bool ProgramData::matches(HMS hms) const
 
 bool ProgramManager::mqttReceiveMsg(const StringView& topic, const StringView& s)
 {
-  if (topic == MQTTTopic::CmdSetProgramSet) {
+  if (topicHash() == MQTTTopic::CmdSetProgramSet.hash() && topic == MQTTTopic::CmdSetProgramSet) {
     // set program index
     auto set = s.toInt();
     if (set < 0 || set > 7) {
@@ -80,6 +80,7 @@ private:
   int8_t current_program_ = -2;     ///< Index of currently-running program (-2 to force communicating on first run).
   PublishTask publisher_;           ///< Task to publish program data.
   PublishTask prognum_publisher_;   ///< Task to publish program number.
-  Scheduler::TaskTimingStats stats_;///< Timing statistics.
+  Scheduler::TimedTaskStats stats_;///< Timing statistics.
   Scheduler::TimedTask<ProgramManager> timer_task_; ///< Timer to check programs.
+  Scheduler::TaskInterval interval_;  ///< Tunable interval of program checks.
 };
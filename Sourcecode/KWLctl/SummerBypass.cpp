@@ -24,12 +24,15 @@
 #include "TempSensors.h"
 #include "KWLConfig.h"
 
-/// Check bypass every 20s (also terminates motor running, if needed).
+/// Check bypass every 20s by default (also terminates motor running, if needed).
 static constexpr unsigned long INTERVAL_BYPASS_CHECK = 20000000;
 
 /// Interval for sending MQTT messages when nothing changes (15 min).
 static constexpr unsigned long INTERVAL_MQTT_BYPASS_STATE = 900000000UL;
 
+/// Execution budget of one bypass check (10ms).
+static constexpr unsigned long BUDGET_BYPASS_CHECK = 10000;
+
 /// Runtime of the bypass motor in ms (2 minutes).
 static constexpr unsigned long BYPASS_FLAPS_DRIVE_TIME = 120 * 1000000UL;
 
@@ -42,8 +45,12 @@ SummerBypass::SummerBypass(KWLPersistentConfig& config, const TempSensors& temp)
   temp_(temp),
   rel_bypass_power_(KWLConfig::PinBypassPower),
   rel_bypass_direction_(KWLConfig::PinBypassDirection),
-  stats_(F("SummerBypass")),
-  timer_task_(stats_, &SummerBypass::run, *this)
+  mqtt_time_millis_(0UL - INTERVAL_MQTT_BYPASS_STATE / 1000),
+  publish_task_(F("SummerBypass")),
+  stats_(F("SummerBypass"), BUDGET_BYPASS_CHECK),
+  timer_task_(stats_, &SummerBypass::run, *this),
+  interval_(stats_, timer_task_, INTERVAL_BYPASS_CHECK),
+  temp_listener_(timer_task_)
 {}
 
 void SummerBypass::begin(Print& initTrace)
@@ -54,7 +61,8 @@ void SummerBypass::begin(Print& initTrace)
   rel_bypass_power_.off();
   rel_bypass_direction_.off();
 
-  timer_task_.runRepeated(INTERVAL_BYPASS_CHECK);
+  timer_task_.runRepeated(interval_.get());
+  temp_listener_.connect(temp_.getUpdateSignal());
 
   if (KWLConfig::RetainBypassConfigState)
     sendMQTT(true);
@@ -62,7 +70,6 @@ void SummerBypass::begin(Print& initTrace)
 
 void SummerBypass::forceSend(bool all_values)
 {
-  mqtt_countdown_ = 0;
   sendMQTT(all_values);
 }
 
@@ -86,24 +93,28 @@ void SummerBypass::run()
     Serial.print(toString(flap_setpoint_));
   }
   if (bypass_motor_running_) {
-    // check whether we are done with running the motor (just to be on the safe side, should be)
-    if (millis() - last_change_time_millis_ >= (BYPASS_FLAPS_DRIVE_TIME / 1000) - 1000) {
-      // done moving, turn off relays
-      rel_bypass_power_.off();
-      rel_bypass_direction_.off();
-      state_ = flap_setpoint_;
-      if (KWLConfig::serialDebugSummerbypass)
-        Serial.print(F(" motor off; flap now "));
-      bypass_motor_running_ = false;
-    } else {
-      // should never get here, we'll retry
-      if (KWLConfig::serialDebugSummerbypass)
+    // check whether we are done with running the motor
+    auto motor_time = millis() - last_change_time_millis_;
+    if (motor_time < (BYPASS_FLAPS_DRIVE_TIME / 1000) - 1000) {
+      // woken up early (e.g., by new temperatures), check again when done
+      if (KWLConfig::serialDebugSummerbypass) {
         Serial.print(F(" motor running; flap going to "));
+        Serial.println(toString(flap_setpoint_));
+      }
+      timer_task_.runRepeated((BYPASS_FLAPS_DRIVE_TIME / 1000 - motor_time) * 1000, interval_.get());
+      return;
     }
-    if (KWLConfig::serialDebugSummerbypass)
+    // done moving, turn off relays
+    rel_bypass_power_.off();
+    rel_bypass_direction_.off();
+    state_ = flap_setpoint_;
+    if (KWLConfig::serialDebugSummerbypass) {
+      Serial.print(F(" motor off; flap now "));
       Serial.println(toString(flap_setpoint_));
+    }
+    bypass_motor_running_ = false;
     sendMQTT();
-    timer_task_.setInterval(INTERVAL_BYPASS_CHECK);
+    timer_task_.setInterval(interval_.get());
     return;
   }
 
@@ -176,27 +187,38 @@ void SummerBypass::run()
   } else {
     if (KWLConfig::serialDebugSummerbypass)
       Serial.println(F(" no change"));
-    timer_task_.setInterval(INTERVAL_BYPASS_CHECK);
+    timer_task_.setInterval(interval_.get());
   }
-  if (--mqtt_countdown_ <= 0 || mqtt_state_ != state_) {
+  if (millis() - mqtt_time_millis_ >= INTERVAL_MQTT_BYPASS_STATE / 1000 || mqtt_state_ != state_) {
     sendMQTT();
   }
 }
 
 bool SummerBypass::mqttReceiveMsg(const StringView& topic, const StringView& s)
 {
-  if (topic == MQTTTopic::CmdBypassGetValues) {
+  switch (topicHash()) {
+  case MQTTTopic::CmdBypassGetValues.hash():
+    if (topic != MQTTTopic::CmdBypassGetValues)
+      break;
     forceSend(true);
-  } else if (topic == MQTTTopic::CmdBypassHystereseMinutes) {
-    unsigned i = unsigned(s.toInt());
-    config_.setBypassHystereseMinutes(i);
-  } else if (topic == MQTTTopic::CmdBypassManualFlap) {
+    return true;
+  case MQTTTopic::CmdBypassHystereseMinutes.hash():
+    if (topic != MQTTTopic::CmdBypassHystereseMinutes)
+      break;
+    config_.setBypassHystereseMinutes(unsigned(s.toInt()));
+    return true;
+  case MQTTTopic::CmdBypassManualFlap.hash():
+    if (topic != MQTTTopic::CmdBypassManualFlap)
+      break;
+    // Stellung Bypassklappe bei manuellem Modus
     if (s == F("open"))
       config_.setBypassManualSetpoint(SummerBypassFlapState::OPEN);
     if (s == F("close"))
       config_.setBypassManualSetpoint(SummerBypassFlapState::CLOSED);
-    // Stellung Bypassklappe bei manuellem Modus
-  } else if (topic == MQTTTopic::CmdBypassMode) {
+    return true;
+  case MQTTTopic::CmdBypassMode.hash():
+    if (topic != MQTTTopic::CmdBypassMode)
+      break;
     // Auto oder manueller Modus
     if (s == F("auto"))   {
       config_.setBypassMode(SummerBypassMode::AUTO);
@@ -205,7 +227,11 @@ bool SummerBypass::mqttReceiveMsg(const StringView& topic, const StringView& s)
       config_.setBypassMode(SummerBypassMode::USER);
       forceSend();
     }
-  } else if (topic == MQTTTopic::CmdBypassHyst) {
+    return true;
+  case MQTTTopic::CmdBypassHyst.hash():
+    if (topic != MQTTTopic::CmdBypassHyst)
+      break;
+    {
       auto i = s.toInt();
       if (i < 0)
         i = 0;
@@ -213,22 +239,32 @@ bool SummerBypass::mqttReceiveMsg(const StringView& topic, const StringView& s)
         i = MAX_TEMP_HYSTERESIS;
       config_.setBypassHysteresisTemp(uint8_t(i));
       forceSend(true);
-  } else if (topic == MQTTTopic::CmdBypassTempAbluftMin) {
+    }
+    return true;
+  case MQTTTopic::CmdBypassTempAbluftMin.hash():
+    if (topic != MQTTTopic::CmdBypassTempAbluftMin)
+      break;
+    {
       auto i = s.toInt();
       if (i < 0)
         i = 0;
       config_.setBypassTempAbluftMin(unsigned(i));
       forceSend(true);
-  } else if (topic == MQTTTopic::CmdBypassTempAussenluftMin) {
+    }
+    return true;
+  case MQTTTopic::CmdBypassTempAussenluftMin.hash():
+    if (topic != MQTTTopic::CmdBypassTempAussenluftMin)
+      break;
+    {
       auto i = s.toInt();
       if (i < 0)
         i = 0;
       config_.setBypassTempAussenluftMin(unsigned(i));
       forceSend(true);
-  } else {
-    return false;
+    }
+    return true;
   }
-  return true;
+  return false;
 }
 
 void SummerBypass::startMoveFlap()
@@ -248,7 +284,7 @@ void SummerBypass::startMoveFlap()
 
 void SummerBypass::sendMQTT(bool all_values)
 {
-  mqtt_countdown_ = INTERVAL_MQTT_BYPASS_STATE / INTERVAL_BYPASS_CHECK;
+  mqtt_time_millis_ = millis();
   mqtt_state_ = state_;
 
   uint8_t bitmask = all_values ? 31 : 1;
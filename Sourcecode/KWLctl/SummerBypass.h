@@ -100,12 +100,16 @@ private:
   SummerBypassFlapState mqtt_state_ = SummerBypassFlapState::UNKNOWN;
   /// Set when motor is running and moving the flap.
   bool bypass_motor_running_ = false;
-  /// Countdown for MQTT send.
-  int8_t mqtt_countdown_ = 0;
+  /// Time of the last MQTT send (initially in the past to send at the first check).
+  unsigned long mqtt_time_millis_;
   /// Task to publish MQTT values.
   PublishTask publish_task_;
   /// Task runtime statistics.
-  Scheduler::TaskTimingStats stats_;
+  Scheduler::TimedTaskStats stats_;
   /// Task scheduling bypass check.
   Scheduler::TimedTask<SummerBypass> timer_task_;
+  /// Tunable interval of bypass checks.
+  Scheduler::TaskInterval interval_;
+  /// Check bypass as soon as new temperatures are available.
+  Scheduler::SignalListener temp_listener_;
 };
@@ -26,6 +26,7 @@
 
 #include <Adafruit_GFX.h>       // TFT
 #include <IPAddress.h>
+#include <NumberFormat.h>
 #include <avr/wdt.h>
 #include <alloca.h>
 
@@ -48,6 +49,10 @@ static constexpr int16_t MAXPRESSURE = 1000;
 
 /// Interval for updating displayed values (1s).
 static constexpr unsigned long INTERVAL_DISPLAY_UPDATE = 1000000;
+/// Execution budget of one display update (200ms, redrawing a screen takes long).
+static constexpr unsigned long BUDGET_DISPLAY_UPDATE = 200000;
+/// Execution budget of one touch processing (50ms).
+static constexpr unsigned long BUDGET_PROCESS_TOUCH = 50000;
 /// Interval for detecting second menu button press (500ms). At least this time must pass between two touches.
 static constexpr unsigned long INTERVAL_MENU_BTN = 500;
 /// Interval for returning back to main screen if nothing pressed (1m).
@@ -1777,8 +1782,7 @@ private:
           cur = -99.9;
         else if (cur > 99.9)
           cur = 99.9;
-        dtostrf(cur, 3, 1, buffer);
-        strcat_P(buffer, PSTR("*C"));
+        strcpy_P(NumberFormat::formatDecimal(buffer, cur, 1), PSTR("*C"));
       } else if (&last == &dht1t_ || &last == &dht2t_) {
         // for DHT not present, we just display n/a, not an error
         strcpy_P(buffer, PSTR("n/a *C"));
@@ -1805,7 +1809,7 @@ private:
       int16_t x1, y1;
       uint16_t w, h;
       tft_.fillRect(x, y, 59, HEIGHT_NUMBER_FIELD, colBackColor + DEBUG_HIGHLIGHT);
-      snprintf(buffer, sizeof(buffer), "%i", cur);
+      NumberFormat::formatInteger(buffer, cur);
       tft_.getTextBounds(buffer, 0, 0, &x1, &y1, &w, &h);
       tft_.setCursor(x + 55 - int(w), y + BASELINE_MIDDLE);
       tft_.setTextColor(colFontColor);
@@ -1824,7 +1828,7 @@ private:
       uint16_t w, h;
       tft_.fillRect(x, y, tw, HEIGHT_NUMBER_FIELD, colBackColor + DEBUG_HIGHLIGHT);
       if (cur >= 0 && cur <= 100)
-        snprintf(buffer, sizeof(buffer), "%d %%", cur);
+        strcpy_P(NumberFormat::formatInteger(buffer, cur), PSTR(" %"));
       else
         strcpy_P(buffer, PSTR("?? %"));
       tft_.getTextBounds(buffer, 0, 0, &x1, &y1, &w, &h);
@@ -1846,7 +1850,7 @@ private:
       uint16_t tw, th;
       tft_.fillRect(x, y + 24, 80, HEIGHT_NUMBER_FIELD, colBackColor + DEBUG_HIGHLIGHT);
       if (h >= 0 && h <= 100)
-        snprintf_P(buffer, sizeof(buffer), PSTR("%d %%"), h);
+        strcpy_P(NumberFormat::formatInteger(buffer, h), PSTR(" %"));
       else
         strcpy_P(buffer, PSTR("n/a %"));
       tft_.getTextBounds(buffer, 0, 0, &x1, &y1, &tw, &th);
@@ -1868,7 +1872,7 @@ private:
       uint16_t w, h;
       tft_.fillRect(x, y, 80, HEIGHT_NUMBER_FIELD, colBackColor + DEBUG_HIGHLIGHT);
       if (cur >= 0)
-        snprintf(buffer, sizeof(buffer), "%d/m", cur);
+        strcpy_P(NumberFormat::formatInteger(buffer, cur), PSTR("/m"));
       else
         strcpy_P(buffer, PSTR("n/a"));
       tft_.getTextBounds(buffer, 0, 0, &x1, &y1, &w, &h);
@@ -2141,15 +2145,15 @@ private:
     char buf[16];
     switch (row) {
       default:
-      case 1: snprintf_P(buf, sizeof(buf), PSTR("%u"), setpoint_l1_); break;
-      case 2: snprintf_P(buf, sizeof(buf), PSTR("%u"), setpoint_l2_); break;
+      case 1: NumberFormat::formatUnsigned(buf, setpoint_l1_); break;
+      case 2: NumberFormat::formatUnsigned(buf, setpoint_l2_); break;
       case 3: strcpy_P(buf, fanModeToString(calculate_speed_mode_)); break;
       case 4:
       {
         auto val = (col == 0) ? ipr_l1_ : ipr_l2_;
         auto cfg = IPR_CONFIGS[val];
         if (cfg.div == 1)
-          snprintf_P(buf, sizeof(buf), PSTR("%d"), cfg.mul);
+          NumberFormat::formatInteger(buf, cfg.mul);
         else
           snprintf_P(buf, sizeof(buf), PSTR("%d/%d"), cfg.mul, cfg.div);
         break;
@@ -2407,7 +2411,7 @@ private:
     if (ip)
       cur = (*ip)[col];
     if (getCurrentRow() != 7)
-      snprintf_P(buf, sizeof(buf), PSTR("%u"), cur);
+      NumberFormat::formatUnsigned(buf, cur);
     else
       snprintf_P(buf, sizeof(buf), PSTR("%02x"), cur);
     drawCurrentInputField(buf);
@@ -2475,7 +2479,7 @@ private:
     cur_ = new_value;
     char buf[8];
     if (getCurrentRow() != 7)
-      snprintf_P(buf, sizeof(buf), PSTR("%d"), new_value);
+      NumberFormat::formatUnsigned(buf, new_value);
     else
       snprintf_P(buf, sizeof(buf), PSTR("%02x"), new_value);
     drawCurrentInputField(buf);
@@ -2610,7 +2614,7 @@ private:
     *cur = unsigned(delta);
     if (getCurrentRow() != 5) {
       char buf[8];
-      snprintf_P(buf, sizeof(buf), PSTR("%u"), *cur);
+      NumberFormat::formatUnsigned(buf, *cur);
       drawCurrentInputField(buf, false);
     } else {
       drawCurrentInputField(bypassModeToString(SummerBypassFlapState(*cur)), false);
@@ -2630,7 +2634,7 @@ private:
     }
     if (row != 5) {
       char buf[8];
-      snprintf_P(buf, sizeof(buf), PSTR("%u"), cur);
+      NumberFormat::formatUnsigned(buf, cur);
       drawCurrentInputField(buf, false);
     } else {
       drawCurrentInputField(bypassModeToString(SummerBypassFlapState(cur)), false);
@@ -2842,7 +2846,7 @@ private:
     switch (row) {
       default:
       case 1:
-        snprintf_P(buf, sizeof(buf), PSTR("%d"), temp_hysteresis_);
+        NumberFormat::formatUnsigned(buf, temp_hysteresis_);
         break;
       case 2:
         strcpy_P(buf, heating_app_ ? PSTR("JA") : PSTR("NEIN"));
@@ -3052,20 +3056,20 @@ private:
       default:
       case 1:
         if (col == 0) {
-          snprintf_P(buf, sizeof(buf), PSTR("%02d"), index_);
+          NumberFormat::formatUnsigned(buf, index_, 2);
         } else {
           buf[0] = char('0' + program_set_);
           buf[1] = 0;
         }
         break;
       case 2:
-        snprintf_P(buf, sizeof(buf), PSTR("%d"), pgm_.fan_mode_);
+        NumberFormat::formatInteger(buf, pgm_.fan_mode_);
         break;
       case 3:
-        snprintf_P(buf, sizeof(buf), PSTR("%02d"), (col == 0) ? pgm_.start_h_ : pgm_.start_m_);
+        NumberFormat::formatUnsigned(buf, (col == 0) ? pgm_.start_h_ : pgm_.start_m_, 2);
         break;
       case 4:
-        snprintf_P(buf, sizeof(buf), PSTR("%02d"), (col == 0) ? pgm_.end_h_ : pgm_.end_m_);
+        NumberFormat::formatUnsigned(buf, (col == 0) ? pgm_.end_h_ : pgm_.end_m_, 2);
         break;
       case 5:
         format_flags(buf, F("MoDiMiDoFrSaSo"), 7, 2, pgm_.weekdays_);
@@ -3384,11 +3388,14 @@ TFT::TFT() noexcept :
   // between X+ and X- Use any multimeter to read it
   // For the one we're using, its 300 ohms across the X plate
   ts_(KWLConfig::XP, KWLConfig::YP, KWLConfig::XM, KWLConfig::YM, 300),
-  display_update_stats_(F("DisplayUpdate")),
-  display_update_task_(display_update_stats_, &TFT::displayUpdate, *this),
-  process_touch_stats_(F("ProcessTouch")),
-  process_touch_task_(process_touch_stats_, &TFT::loopTouch, *this)
-{}
+  display_update_stats_(F("DisplayUpdate"), BUDGET_DISPLAY_UPDATE),
+  display_update_task_(Scheduler::TaskPriority::UI, display_update_stats_, &TFT::displayUpdate, *this),
+  process_touch_stats_(F("ProcessTouch"), BUDGET_PROCESS_TOUCH),
+  process_touch_task_(Scheduler::TaskPriority::UI, process_touch_stats_, &TFT::loopTouch, *this)
+{
+  // resistive touch has no interrupt, poll it periodically, faster while touched
+  process_touch_task_.setPollInterval(KWLConfig::TouchPollIntervalMin, KWLConfig::TouchPollIntervalMax);
+}
 
 void TFT::begin(Print& /*initTracer*/, KWLControl& control) noexcept {
   control_ = &control;
@@ -3420,11 +3427,22 @@ void TFT::prepareForScreenshot() noexcept
     // wake up from screensaver
     gotoScreen<ScreenMain>();
     wdt_reset();
+  } else if (touch_in_progress_) {
+    // finish pending touch, its release will be ignored while frozen
+    touch_in_progress_ = false;
+    if (current_screen_)
+      current_screen_->release(millis());
   }
+  screenshot_active_ = true;
 }
 
 void TFT::gotoScreen(int id) noexcept
 {
+  if (screenshot_active_) {
+    if (KWLConfig::serialDebugDisplay)
+      Serial.println(F("TFT: screen switch ignored during screenshot"));
+    return;
+  }
   if (KWLConfig::serialDebugDisplay) {
     Serial.print(F("TFT: external screen switch to screen "));
     Serial.println(id);
@@ -3446,6 +3464,11 @@ void TFT::gotoScreen(int id) noexcept
 
 void TFT::makeTouch(int x, int y) noexcept
 {
+  if (screenshot_active_) {
+    if (KWLConfig::serialDebugDisplay)
+      Serial.println(F("TFT: external touch ignored during screenshot"));
+    return;
+  }
   auto time = millis();
   touch_in_progress_ = true;
   millis_last_touch_ = time;
@@ -3494,10 +3517,11 @@ void TFT::displayUpdate() noexcept
 
   // Das Update wird alle 1000mS durchlaufen
   // Bevor Werte ausgegeben werden, wird auf Änderungen der Werte überprüft, nur geänderte Werte werden auf das Display geschrieben
-  if (current_screen_)
+  // Während eines Screenshots bleibt die Anzeige eingefroren (auch kein Bildschirmschoner)
+  if (current_screen_ && !screenshot_active_)
     current_screen_->update();
 
-  display_update_task_.runRepeated(INTERVAL_DISPLAY_UPDATE);
+  display_update_task_.runRepeated(INTERVAL_DISPLAY_UPDATE, INTERVAL_DISPLAY_UPDATE, Scheduler::TimedTaskBase::AUTO_PHASE);
 }
 
 TSPoint TFT::getPoint() noexcept
@@ -3518,6 +3542,9 @@ TSPoint TFT::getPoint() noexcept
 
 void TFT::loopTouch() noexcept
 {
+  if (screenshot_active_)
+    return; // touch would change the screen while it's being read
+
   TSPoint tp = getPoint();
   auto time = millis();
   if (!time)
@@ -3525,6 +3552,7 @@ void TFT::loopTouch() noexcept
 
   if (tp.z > MINPRESSURE && tp.z < MAXPRESSURE) {
     // pressed
+    process_touch_task_.markActive();
 
     if (!cal_->calibrated_ && current_screen_id_ != ScreenCalibration::ID) {
       // cannot yet pass touch further, we need touch calibration
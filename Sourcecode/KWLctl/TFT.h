@@ -57,9 +57,18 @@ public:
   /// Start TFT component.
   void begin(Print& initTracer, KWLControl& control) noexcept;
 
-  /// Prepare for screenshot by waking from display off.
+  /*!
+   * @brief Prepare for screenshot by waking from display off.
+   *
+   * Until finishScreenshot() is called, display is frozen: it's not updated,
+   * screensaver doesn't start and touch input is ignored. This prevents torn
+   * screenshots, since the screen is read over many scheduler loops.
+   */
   void prepareForScreenshot() noexcept;
 
+  /// Unfreeze display after screenshot was sent.
+  void finishScreenshot() noexcept { screenshot_active_ = false; }
+
   /// Switch to given screen.
   void gotoScreen(int id) noexcept;
 
@@ -135,11 +144,14 @@ private:
   /// Last time a touch input was registered.
   unsigned long millis_last_touch_ = 0;
 
+  /// Set while screenshot is sent, display is frozen in the meantime.
+  bool screenshot_active_ = false;
+
   /// Space for screen and controls.
   char dynamic_space_[156];
 
   /// Statistics for display update.
-  Scheduler::TaskTimingStats display_update_stats_;
+  Scheduler::TimedTaskStats display_update_stats_;
   /// Task to update display.
   Scheduler::TimedTask<TFT> display_update_task_;
   /// Statistics for touch input.
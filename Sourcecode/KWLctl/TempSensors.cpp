@@ -24,9 +24,12 @@
 
 /// Precision of temperature reading (9-12 bits; 12 bits is 0.0625C, 9 bits is 0.5C).
 static constexpr uint8_t TEMPERATURE_PRECISION = 12;
-/// Scheduling interval for temperature sensor query (1s).
+/// Default scheduling interval for temperature sensor query (1s).
 static constexpr unsigned long SCHEDULING_INTERVAL = 1000000;
 
+/// Execution budget of one sensor step (50ms).
+static constexpr unsigned long SCHEDULING_BUDGET = 50000;
+
 TempSensors::TempSensor::TempSensor(uint8_t pin) :
   onewire_ifc_(pin),
   sensor_(&onewire_ifc_)
@@ -91,9 +94,27 @@ TempSensors::TempSensors() :
   t2_(KWLConfig::PinTemp2OneWireBus),
   t3_(KWLConfig::PinTemp3OneWireBus),
   t4_(KWLConfig::PinTemp4OneWireBus),
-  stats_(F("TempSensors")),
-  timer_task_(stats_, &TempSensors::run, *this)
-{}
+  t1_channel_(MQTTTopic::KwlTemperaturAussenluft, KWLConfig::MinDiffMqttTemp, KWLConfig::MinIntervalMqttTemp, KWLConfig::MaxIntervalMqttTemp, KWLConfig::RetainTemperature),
+  t2_channel_(MQTTTopic::KwlTemperaturZuluft, KWLConfig::MinDiffMqttTemp, KWLConfig::MinIntervalMqttTemp, KWLConfig::MaxIntervalMqttTemp, KWLConfig::RetainTemperature),
+  t3_channel_(MQTTTopic::KwlTemperaturAbluft, KWLConfig::MinDiffMqttTemp, KWLConfig::MinIntervalMqttTemp, KWLConfig::MaxIntervalMqttTemp, KWLConfig::RetainTemperature),
+  t4_channel_(MQTTTopic::KwlTemperaturFortluft, KWLConfig::MinDiffMqttTemp, KWLConfig::MinIntervalMqttTemp, KWLConfig::MaxIntervalMqttTemp, KWLConfig::RetainTemperature),
+  efficiency_channel_(MQTTTopic::KwlEffiency, KWLConfig::MinDiffMqttEfficiency, KWLConfig::MinIntervalMqttEfficiency, KWLConfig::MaxIntervalMqttEfficiency, KWLConfig::RetainTemperature),
+  stats_(F("TempSensors"), SCHEDULING_BUDGET),
+  timer_task_(Scheduler::TaskPriority::SENSING, stats_, &TempSensors::run, *this),
+  interval_(stats_, timer_task_, SCHEDULING_INTERVAL)
+{
+  // temperatures are reported only if they changed by more than MinDiffMqttTemp
+  t1_channel_.setStrictDeadband();
+  t2_channel_.setStrictDeadband();
+  t3_channel_.setStrictDeadband();
+  t4_channel_.setStrictDeadband();
+  if (!KWLConfig::SendErroneousMeasurement) {
+    t1_channel_.setErrorLimit(INVALID);
+    t2_channel_.setErrorLimit(INVALID);
+    t3_channel_.setErrorLimit(INVALID);
+    t4_channel_.setErrorLimit(INVALID);
+  }
+}
 
 void TempSensors::begin(Print& initTracer)
 {
@@ -106,7 +127,7 @@ void TempSensors::begin(Print& initTracer)
   t4_.begin();
 
   // call regularly to update
-  timer_task_.runRepeated(SCHEDULING_INTERVAL);
+  timer_task_.runRepeated(interval_.get(), interval_.get(), Scheduler::TimedTaskBase::AUTO_PHASE);
 }
 
 void TempSensors::run()
@@ -130,77 +151,67 @@ void TempSensors::run()
     } else {
       efficiency_ = 0;
     }
+    update_signal_.notify();
   }
 
-  // Send the temperatures via MQTT:
-  //   - if max time reached, send,
-  //   - if min time reached and min difference found, send,
-  //   - else wait for the next call.
-  ++mqtt_ticks_;
-  if (mqtt_ticks_ >= KWLConfig::MaxIntervalMqttTemp ||
-      (mqtt_ticks_ >= KWLConfig::MinIntervalMqttTemp && new_temp && (
-         (abs(get_t1_outside() - last_mqtt_t1_) > KWLConfig::MinDiffMqttTemp) ||
-         (abs(get_t2_inlet() - last_mqtt_t2_) > KWLConfig::MinDiffMqttTemp) ||
-         (abs(get_t3_outlet() - last_mqtt_t3_) > KWLConfig::MinDiffMqttTemp) ||
-         (abs(get_t4_exhaust() - last_mqtt_t4_) > KWLConfig::MinDiffMqttTemp)
-      ))
-     )
-    sendMQTT();
+  // pass measurements including INVALID of a failed sensor, channels decide when to send
+  updateChannels();
 }
 
 bool TempSensors::mqttReceiveMsg(const StringView& topic, const StringView& s)
 {
-  if (topic == MQTTTopic::CmdGetTemp) {
+  switch (topicHash()) {
+  case MQTTTopic::CmdGetTemp.hash():
+    if (topic != MQTTTopic::CmdGetTemp)
+      break;
     forceSend();
-  }
+    return true;
 #ifdef DEBUG
   // TODO this should also disable updating temperatures via sensors
-  else if (topic == MQTTTopic::KwlDebugsetTemperaturAussenluft) {
+  case MQTTTopic::KwlDebugsetTemperaturAussenluft.hash():
+    if (topic != MQTTTopic::KwlDebugsetTemperaturAussenluft)
+      break;
     get_t1_outside() = s.toDouble();
     forceSend();
-  }
-  else if (topic == MQTTTopic::KwlDebugsetTemperaturZuluft) {
+    return true;
+  case MQTTTopic::KwlDebugsetTemperaturZuluft.hash():
+    if (topic != MQTTTopic::KwlDebugsetTemperaturZuluft)
+      break;
     get_t2_inlet() = s.toDouble();
     forceSend();
-  }
-  else if (topic == MQTTTopic::KwlDebugsetTemperaturAbluft) {
+    return true;
+  case MQTTTopic::KwlDebugsetTemperaturAbluft.hash():
+    if (topic != MQTTTopic::KwlDebugsetTemperaturAbluft)
+      break;
     get_t3_outlet() = s.toDouble();
     forceSend();
-  }
-  else if (topic == MQTTTopic::KwlDebugsetTemperaturFortluft) {
+    return true;
+  case MQTTTopic::KwlDebugsetTemperaturFortluft.hash():
+    if (topic != MQTTTopic::KwlDebugsetTemperaturFortluft)
+      break;
     get_t4_exhaust() = s.toDouble();
     forceSend();
-  }
+    return true;
 #endif
-  else {
-    return false;
   }
-  return true;
+  return false;
 }
 
-void TempSensors::sendMQTT() {
-  last_mqtt_t1_ = get_t1_outside();
-  last_mqtt_t2_ = get_t2_inlet();
-  last_mqtt_t3_ = get_t3_outlet();
-  last_mqtt_t4_ = get_t4_exhaust();
-  mqtt_ticks_ = 0;
-
-  uint8_t bitmask = 31;
-  publish_task_.publish([this, bitmask]() mutable {
-    if (last_mqtt_t1_ > INVALID || KWLConfig::SendErroneousMeasurement)
-      if (!publish_if(bitmask, uint8_t(1), MQTTTopic::KwlTemperaturAussenluft, last_mqtt_t1_, 2, KWLConfig::RetainTemperature))
-        return false;
-    if (last_mqtt_t2_ > INVALID || KWLConfig::SendErroneousMeasurement)
-      if (!publish_if(bitmask, uint8_t(2), MQTTTopic::KwlTemperaturZuluft, last_mqtt_t2_, 2, KWLConfig::RetainTemperature))
-        return false;
-    if (last_mqtt_t3_ > INVALID || KWLConfig::SendErroneousMeasurement)
-      if (!publish_if(bitmask, uint8_t(4), MQTTTopic::KwlTemperaturAbluft, last_mqtt_t3_, 2, KWLConfig::RetainTemperature))
-        return false;
-    if (last_mqtt_t4_ > INVALID || KWLConfig::SendErroneousMeasurement)
-      if (!publish_if(bitmask, uint8_t(8), MQTTTopic::KwlTemperaturFortluft, last_mqtt_t4_, 2, KWLConfig::RetainTemperature))
-        return false;
-    if (!publish_if(bitmask, uint8_t(16), MQTTTopic::KwlEffiency, getEfficiency(), KWLConfig::RetainTemperature))
-      return false;
-    return true;
-  });
+void TempSensors::forceSend() noexcept
+{
+  updateChannels();
+  t1_channel_.forceSend();
+  t2_channel_.forceSend();
+  t3_channel_.forceSend();
+  t4_channel_.forceSend();
+  efficiency_channel_.forceSend();
+}
+
+void TempSensors::updateChannels() noexcept
+{
+  t1_channel_.update(get_t1_outside());
+  t2_channel_.update(get_t2_inlet());
+  t3_channel_.update(get_t3_outlet());
+  t4_channel_.update(get_t4_exhaust());
+  efficiency_channel_.update(efficiency_);
 }
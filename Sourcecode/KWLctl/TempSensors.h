@@ -24,7 +24,7 @@
 #pragma once
 
 #include "TimeScheduler.h"
-#include "MessageHandler.h"
+#include "TelemetryChannel.h"
 
 #include <OneWire.h>            // OneWire Temperatursensoren
 #include <DallasTemperature.h>  // https://www.milesburton.com/Dallas_Temperature_Control_Library
@@ -107,14 +107,17 @@ public:
   inline int getEfficiency() const { return efficiency_; }
 
   /// Force sending temperature messages via MQTT independent of timing.
-  inline void forceSend() { sendMQTT(); }
+  void forceSend() noexcept;
+
+  /// Get signal notified when a new temperature was measured.
+  const Scheduler::TaskSignal& getUpdateSignal() const { return update_signal_; }
 
 private:
   void run();
   virtual bool mqttReceiveMsg(const StringView& topic, const StringView& s) override;
 
-  /// Send messages via MQTT.
-  void sendMQTT();
+  /// Pass current measurements to telemetry channels.
+  void updateChannels() noexcept;
 
   TempSensor t1_; ///< Outside/intake temperature.
   TempSensor t2_; ///< Temperature of inlet air being pushed into the house.
@@ -122,12 +125,13 @@ private:
   TempSensor t4_; ///< Temperature of exhaust air being pushed to the outside.
   int efficiency_ = 0;        ///< Current efficiency of heat exchange.
   uint8_t next_sensor_ = 0;   ///< Next sensor to talk to.
-  uint8_t mqtt_ticks_ = 0;    ///< MQTT seconds ticks.
-  double last_mqtt_t1_ = INVALID; ///< Last T1 temperature sent via MQTT.
-  double last_mqtt_t2_ = INVALID; ///< Last T2 temperature sent via MQTT.
-  double last_mqtt_t3_ = INVALID; ///< Last T3 temperature sent via MQTT.
-  double last_mqtt_t4_ = INVALID; ///< Last T4 temperature sent via MQTT.
-  PublishTask publish_task_;      ///< Task to publish measurements.
-  Scheduler::TaskTimingStats stats_;              ///< Task runtime statistics.
+  TelemetryChannel<double> t1_channel_;     ///< Channel publishing T1 temperature.
+  TelemetryChannel<double> t2_channel_;     ///< Channel publishing T2 temperature.
+  TelemetryChannel<double> t3_channel_;     ///< Channel publishing T3 temperature.
+  TelemetryChannel<double> t4_channel_;     ///< Channel publishing T4 temperature.
+  TelemetryChannel<int> efficiency_channel_;///< Channel publishing efficiency.
+  Scheduler::TaskSignal update_signal_;           ///< Signal for tasks depending on temperatures.
+  Scheduler::TimedTaskStats stats_;               ///< Task runtime statistics.
   Scheduler::TimedTask<TempSensors> timer_task_;  ///< Task for reading sensors periodically.
+  Scheduler::TaskInterval interval_;              ///< Tunable interval of timer_task_.
 };
@@ -61,6 +61,19 @@ namespace FlashStringImpl
 
   template<unsigned N>
   using make_index_sequence = make_integer_sequence<unsigned, N>;
+
+  /// Initial value of string hash (lower 16 bits of FNV-1a offset basis).
+  constexpr uint16_t HASH_BASIS = 0x9dc5;
+
+  /// Add one character to string hash (FNV-1a, lower 16 bits are exact).
+  constexpr uint16_t hashStep(uint16_t hash, char c) noexcept {
+    return uint16_t((hash ^ uint8_t(c)) * 0x0193U);
+  }
+
+  /// Compute string hash at compile time.
+  constexpr uint16_t hash(const char* s, unsigned len, uint16_t value = HASH_BASIS) noexcept {
+    return len ? hash(s + 1, len - 1, hashStep(value, *s)) : value;
+  }
 }
 
 /*!
@@ -97,6 +110,14 @@ public:
   /// Get length of the string (without terminating NUL).
   constexpr size_t length() const noexcept { return len - 1; }
 
+  /*!
+   * @brief Get hash of the string.
+   *
+   * The hash is computed at compile time, so it can be used as a case label
+   * in a switch over StringView::hash() of a string to find.
+   */
+  constexpr uint16_t hash() const noexcept { return FlashStringImpl::hash(data_, len - 1); }
+
   /*!
    * @brief Load the string into memory and return it.
    *
@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2018 Ivan Schréter (schreter@gmx.net)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * This copyright notice MUST APPEAR in all copies of the software!
+ */
+
+#include "CborWriter.h"
+
+#include <NumberFormat.h>
+#include <math.h>
+#include <string.h>
+
+namespace
+{
+  /// Major type of unsigned integers.
+  static constexpr uint8_t MAJOR_UNSIGNED = 0;
+  /// Major type of negative integers.
+  static constexpr uint8_t MAJOR_NEGATIVE = 1;
+  /// Major type of text strings.
+  static constexpr uint8_t MAJOR_TEXT = 3;
+
+  /// Start of a map with indefinite length.
+  static constexpr uint8_t MAP_INDEFINITE = 0xbf;
+  /// End of an item with indefinite length.
+  static constexpr uint8_t BREAK = 0xff;
+  /// Simple value null.
+  static constexpr uint8_t SIMPLE_NULL = 0xf6;
+  /// Half precision float follows.
+  static constexpr uint8_t FLOAT16 = 0xf9;
+  /// Single precision float follows.
+  static constexpr uint8_t FLOAT32 = 0xfa;
+  /// Double precision float follows.
+  static constexpr uint8_t FLOAT64 = 0xfb;
+
+  /// Round scaled value half away from zero, same as NumberFormat.
+  inline int32_t roundFixed(double scaled) noexcept
+  {
+    return int32_t(scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+  }
+
+  /// Convert a float to half precision, return @c false if it's no normal half precision number.
+  bool toHalf(float value, uint16_t& half) noexcept
+  {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int exponent = int((bits >> 23) & 0xff) - 127 + 15;
+    if (exponent <= 0 || exponent >= 31)
+      return false;
+    uint32_t result = ((bits >> 16) & 0x8000) | (uint32_t(exponent) << 10) | ((bits >> 13) & 0x3ff);
+    if (bits & 0x1000)
+      ++result;   // round to nearest, carry into exponent is fine
+    if ((result & 0x7c00) == 0x7c00)
+      return false;
+    half = uint16_t(result);
+    return true;
+  }
+
+  /// Convert a normal half precision number to float.
+  float fromHalf(uint16_t half) noexcept
+  {
+    float value = ldexp(float(0x400 | (half & 0x3ff)), int((half >> 10) & 0x1f) - 25);
+    return (half & 0x8000) ? -value : value;
+  }
+
+  /// Write initial byte and big-endian value of given size.
+  void writeBigEndian(Print& out, uint8_t initial, uint32_t value, uint8_t size)
+  {
+    uint8_t buffer[5];
+    buffer[0] = initial;
+    for (uint8_t i = size; i > 0; --i, value >>= 8)
+      buffer[i] = uint8_t(value);
+    out.write(buffer, size_t(size) + 1);
+  }
+}
+
+CborWriter::CborWriter(Print& out) :
+  out_(out)
+{
+  out_.write(MAP_INDEFINITE);
+}
+
+void CborWriter::member(const __FlashStringHelper* key, long value)
+{
+  writeString(out_, key);
+  writeInteger(out_, value);
+}
+
+void CborWriter::member(const __FlashStringHelper* key, double value, uint8_t decimals)
+{
+  writeString(out_, key);
+  writeDecimal(out_, value, decimals);
+}
+
+void CborWriter::member(const __FlashStringHelper* key, const __FlashStringHelper* value)
+{
+  writeString(out_, key);
+  writeString(out_, value);
+}
+
+void CborWriter::memberNull(const __FlashStringHelper* key)
+{
+  writeString(out_, key);
+  writeNull(out_);
+}
+
+void CborWriter::end()
+{
+  out_.write(BREAK);
+}
+
+void CborWriter::writeInteger(Print& out, int32_t value)
+{
+  if (value < 0)
+    writeHead(out, MAJOR_NEGATIVE, ~uint32_t(value));  // -1 - value
+  else
+    writeHead(out, MAJOR_UNSIGNED, uint32_t(value));
+}
+
+void CborWriter::writeUnsigned(Print& out, uint32_t value)
+{
+  writeHead(out, MAJOR_UNSIGNED, value);
+}
+
+void CborWriter::writeDecimal(Print& out, double value, uint8_t decimals)
+{
+  if (isnan(value) || isinf(value)) {
+    writeNull(out);
+    return;
+  }
+  if (decimals > NumberFormat::MAX_DECIMALS)
+    decimals = NumberFormat::MAX_DECIMALS;
+  int32_t scale = 1;
+  for (uint8_t i = 0; i < decimals; ++i)
+    scale *= 10;
+  double scaled = value * double(scale);
+  if (scaled < 2147483647.0 && scaled > -2147483647.0) {
+    auto fixed = roundFixed(scaled);
+    if (fixed % scale == 0) {
+      writeInteger(out, fixed / scale);
+      return;
+    }
+    // use the shortest float which rounds back to the same decimal value
+    value = double(fixed) / double(scale);
+    uint16_t half;
+    if (toHalf(float(value), half) && roundFixed(double(fromHalf(half)) * double(scale)) == fixed) {
+      writeBigEndian(out, FLOAT16, half, 2);
+      return;
+    }
+    if (roundFixed(double(float(value)) * double(scale)) != fixed && sizeof(double) == sizeof(uint64_t)) {
+      // only reachable with 64-bit double, AVR double is a float
+      uint64_t bits = 0;
+      memcpy(&bits, &value, sizeof(value));
+      writeBigEndian(out, FLOAT64, uint32_t(bits >> 32), 4);
+      uint8_t low[4] = { uint8_t(bits >> 24), uint8_t(bits >> 16), uint8_t(bits >> 8), uint8_t(bits) };
+      out.write(low, sizeof(low));
+      return;
+    }
+  }
+  float single = float(value);
+  uint32_t bits;
+  memcpy(&bits, &single, sizeof(bits));
+  writeBigEndian(out, FLOAT32, bits, 4);
+}
+
+void CborWriter::writeString(Print& out, const __FlashStringHelper* value)
+{
+  writeHead(out, MAJOR_TEXT, uint32_t(strlen_P(reinterpret_cast<const char*>(value))));
+  out.print(value);
+}
+
+void CborWriter::writeNull(Print& out)
+{
+  out.write(SIMPLE_NULL);
+}
+
+void CborWriter::writeHead(Print& out, uint8_t major, uint32_t argument)
+{
+  major = uint8_t(major << 5);
+  if (argument < 24)
+    out.write(uint8_t(major | argument));
+  else if (argument <= 0xff)
+    writeBigEndian(out, uint8_t(major | 24), argument, 1);
+  else if (argument <= 0xffff)
+    writeBigEndian(out, uint8_t(major | 25), argument, 2);
+  else
+    writeBigEndian(out, uint8_t(major | 26), argument, 4);
+}
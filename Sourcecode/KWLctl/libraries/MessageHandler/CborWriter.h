@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2018 Ivan Schréter (schreter@gmx.net)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * This copyright notice MUST APPEAR in all copies of the software!
+ */
+
+/*!
+ * @file
+ * @brief Streaming writer of CBOR encoded values and flat maps.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+/*!
+ * @brief Writer of CBOR (RFC 8949) encoded data directly to a Print stream.
+ *
+ * The writer has the same interface as JsonWriter and writes a flat map
+ * with text keys. The map is written with indefinite length, so members
+ * are encoded one by one without counting them upfront and nothing is
+ * materialized in RAM. Static methods encode single values.
+ *
+ * Integers use the shortest encoding. Floating-point values are first
+ * rounded to the requested count of decimal places, then encoded as integer
+ * if integral, else as the shortest of half, single or double precision
+ * float which rounds back to the same decimal value. E.g., temperatures in
+ * DS18B20 resolution fit half precision, so they take 3 bytes instead of up
+ * to 6 characters of text. Values which are not finite are encoded as null.
+ *
+ * The output is the same for the same values, so the writer can be used
+ * with MessageHandler::publishStream().
+ */
+class CborWriter
+{
+public:
+  /// Construct the writer and start the map.
+  explicit CborWriter(Print& out);
+
+  CborWriter(const CborWriter&) = delete;
+  CborWriter& operator=(const CborWriter&) = delete;
+
+  /// Write an integer member.
+  void member(const __FlashStringHelper* key, long value);
+
+  /// Write a floating-point member rounded to given count of decimal places.
+  void member(const __FlashStringHelper* key, double value, uint8_t decimals);
+
+  /// Write a string member.
+  void member(const __FlashStringHelper* key, const __FlashStringHelper* value);
+
+  /// Write a member with @c null value.
+  void memberNull(const __FlashStringHelper* key);
+
+  /// Finish the map.
+  void end();
+
+  /// Encode a signed integer.
+  static void writeInteger(Print& out, int32_t value);
+
+  /// Encode an unsigned integer.
+  static void writeUnsigned(Print& out, uint32_t value);
+
+  /*!
+   * @brief Encode a floating-point number.
+   *
+   * @param out stream to write to.
+   * @param value value to encode.
+   * @param decimals count of decimal places to preserve (max. NumberFormat::MAX_DECIMALS).
+   */
+  static void writeDecimal(Print& out, double value, uint8_t decimals);
+
+  /// Encode a text string stored in Flash memory.
+  static void writeString(Print& out, const __FlashStringHelper* value);
+
+  /// Encode @c null.
+  static void writeNull(Print& out);
+
+private:
+  /// Write initial byte with major type and the argument in shortest form.
+  static void writeHead(Print& out, uint8_t major, uint32_t argument);
+
+  Print& out_;  ///< Output stream.
+};
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2018 Ivan Schréter (schreter@gmx.net)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * This copyright notice MUST APPEAR in all copies of the software!
+ */
+
+#include "JsonWriter.h"
+
+#include <NumberFormat.h>
+
+JsonWriter::JsonWriter(Print& out) :
+  out_(out)
+{
+  out_.write('{');
+}
+
+void JsonWriter::member(const __FlashStringHelper* key, long value)
+{
+  this->key(key);
+  NumberFormat::printInteger(out_, value);
+}
+
+void JsonWriter::member(const __FlashStringHelper* key, double value, uint8_t decimals)
+{
+  char buffer[NumberFormat::MAX_LENGTH];
+  auto end = NumberFormat::formatDecimal(buffer, value, decimals);
+  if (buffer[0] != '-' && (buffer[0] < '0' || buffer[0] > '9')) {
+    // "nan", "inf" or "ovf" is not valid JSON
+    memberNull(key);
+    return;
+  }
+  this->key(key);
+  out_.write(buffer, size_t(end - buffer));
+}
+
+void JsonWriter::member(const __FlashStringHelper* key, const __FlashStringHelper* value)
+{
+  this->key(key);
+  out_.write('"');
+  out_.print(value);
+  out_.write('"');
+}
+
+void JsonWriter::memberNull(const __FlashStringHelper* key)
+{
+  this->key(key);
+  out_.print(F("null"));
+}
+
+void JsonWriter::end()
+{
+  out_.write('}');
+}
+
+void JsonWriter::key(const __FlashStringHelper* key)
+{
+  if (!first_)
+    out_.write(',');
+  first_ = false;
+  out_.write('"');
+  out_.print(key);
+  out_.write('"');
+  out_.write(':');
+}
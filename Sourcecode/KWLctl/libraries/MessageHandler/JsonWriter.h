@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2018 Ivan Schréter (schreter@gmx.net)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * This copyright notice MUST APPEAR in all copies of the software!
+ */
+
+/*!
+ * @file
+ * @brief Streaming writer of flat JSON objects.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+/*!
+ * @brief Writer of a flat JSON object directly to a Print stream.
+ *
+ * The document is never materialized in RAM, members are formatted and
+ * written one by one. Keys and string values are taken from Flash memory
+ * and written verbatim, so they must not contain characters requiring
+ * escaping. Floating-point values which are not finite or which overflow
+ * 32 bits when scaled are written as @c null.
+ *
+ * As the writer produces the same output for the same values, it can be
+ * used with MessageHandler::publishStream(), which calls the payload writer
+ * several times.
+ */
+class JsonWriter
+{
+public:
+  /// Construct the writer and start the object.
+  explicit JsonWriter(Print& out);
+
+  JsonWriter(const JsonWriter&) = delete;
+  JsonWriter& operator=(const JsonWriter&) = delete;
+
+  /// Write an integer member.
+  void member(const __FlashStringHelper* key, long value);
+
+  /// Write a floating-point member with given count of decimal places.
+  void member(const __FlashStringHelper* key, double value, uint8_t decimals);
+
+  /// Write a string member.
+  void member(const __FlashStringHelper* key, const __FlashStringHelper* value);
+
+  /// Write a member with @c null value.
+  void memberNull(const __FlashStringHelper* key);
+
+  /// Finish the object.
+  void end();
+
+private:
+  /// Write separator and key of the next member.
+  void key(const __FlashStringHelper* key);
+
+  Print& out_;          ///< Output stream.
+  bool first_ = true;   ///< Set, if no member was written yet.
+};
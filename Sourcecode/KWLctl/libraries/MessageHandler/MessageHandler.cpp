@@ -19,39 +19,327 @@
  */
 
 #include "MessageHandler.h"
+#include "CborWriter.h"
 
 #include <Arduino.h>
+#include <NumberFormat.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 PublishTask* PublishTask::s_first_task_ = nullptr;
-bool PublishTask::s_has_tasks_ = false;
+PublishTask* PublishTask::s_ready_head_[PUBLISH_PRIORITY_COUNT] = {};
+PublishTask* PublishTask::s_ready_tail_[PUBLISH_PRIORITY_COUNT] = {};
+unsigned long PublishTask::s_coalesced_ = 0;
+unsigned long PublishTask::s_overwritten_ = 0;
+unsigned long PublishTask::s_retried_ = 0;
 
 MessageHandler* MessageHandler::s_first_handler = nullptr;
 MessageHandler::publish_callback MessageHandler::s_cb_ = nullptr;
+MessageHandler::begin_publish_callback MessageHandler::s_begin_cb_ = nullptr;
+MessageHandler::end_publish_callback MessageHandler::s_end_cb_ = nullptr;
 void *MessageHandler::s_cb_arg_ = nullptr;
 bool MessageHandler::s_debug_ = false;
+uint16_t MessageHandler::s_topic_hash_ = 0;
+uint16_t MessageHandler::s_rate_messages_ = 0;
+uint16_t MessageHandler::s_rate_bytes_ = 0;
+unsigned long MessageHandler::s_burst_messages_ = 0;
+unsigned long MessageHandler::s_burst_bytes_ = 0;
+unsigned long MessageHandler::s_message_tokens_ = 0;
+unsigned long MessageHandler::s_byte_tokens_ = 0;
+unsigned long MessageHandler::s_refill_time_ = 0;
+unsigned long MessageHandler::s_sent_count_ = 0;
+unsigned long MessageHandler::s_sent_bytes_ = 0;
+unsigned long MessageHandler::s_throttled_ = 0;
+size_t MessageHandler::s_throttled_size_ = 0;
+char MessageHandler::s_queue_[MESSAGE_HANDLER_QUEUE_SIZE];
+unsigned MessageHandler::s_queue_fill_ = 0;
+unsigned MessageHandler::s_queue_max_fill_ = 0;
+unsigned long MessageHandler::s_cmd_count_ = 0;
+unsigned long MessageHandler::s_cmd_dropped_ = 0;
+unsigned long MessageHandler::s_cmd_too_big_ = 0;
+unsigned long MessageHandler::s_cmd_over_budget_ = 0;
+unsigned long MessageHandler::s_cmd_budget_ = 0;
+unsigned long MessageHandler::s_cmd_max_runtime_ = 0;
+unsigned MessageHandler::s_cmd_max_latency_ = 0;
+unsigned MessageHandler::s_cmd_avg_latency_ = 0;
 
-PublishTask::PublishTask() :
-  next_(s_first_task_)
+namespace
+{
+  /// Maximum time in ms accounted for in one refill of token buckets (prevents overflow).
+  static constexpr unsigned long MAX_REFILL_TIME = 60000;
+
+  /// Add tokens to a bucket, up to its size.
+  inline void refillBucket(unsigned long& tokens, unsigned long size, unsigned long add) noexcept
+  {
+    tokens = (size - tokens > add) ? tokens + add : size;
+  }
+
+  /// Header of a message in the command queue, followed by NUL-terminated topic and payload.
+  struct QueuedMessage
+  {
+    unsigned long received; ///< Time in ms when the message was received.
+    uint16_t hash;          ///< Topic hash.
+    uint8_t topic_length;   ///< Topic length without NUL.
+    uint8_t payload_length; ///< Payload length without NUL.
+
+    /// Get size of the message in the queue.
+    unsigned size() const noexcept { return sizeof(QueuedMessage) + topic_length + payload_length + 2U; }
+  };
+
+  static_assert(sizeof(QueuedMessage) + 2 <= MessageHandler::QUEUE_ENTRY_OVERHEAD, "Queue entry overhead too small");
+
+  /// Output counting bytes written and detecting binary payloads.
+  class LengthCounter : public Print
+  {
+  public:
+    virtual size_t write(uint8_t c) override {
+      if (length_ < sizeof(head_))
+        head_[length_] = c;
+      if (c < 0x20 || c >= 0x7f)
+        binary_ = true;
+      ++length_;
+      return 1;
+    }
+
+    /// Get count of bytes written.
+    size_t length() const noexcept { return length_; }
+
+    /// Check whether a non-printable byte was written (e.g., CBOR).
+    bool isBinary() const noexcept { return binary_; }
+
+    /// Print byte count and hex dump of the first bytes.
+    void dump(Print& out) const {
+      NumberFormat::printUnsigned(out, length_);
+      out.print(F("B:"));
+      const size_t count = length_ < sizeof(head_) ? length_ : sizeof(head_);
+      for (size_t i = 0; i < count; ++i) {
+        char buffer[3];
+        out.write(' ');
+        auto end = NumberFormat::formatHex(buffer, head_[i], 2);
+        out.write(buffer, size_t(end - buffer));
+      }
+      if (length_ > count)
+        out.print(F(" ..."));
+    }
+
+  private:
+    size_t length_ = 0;
+    uint8_t head_[8];
+    bool binary_ = false;
+  };
+
+  /*!
+   * @brief Output collecting bytes in chunks before writing them to the target.
+   *
+   * Each write to the network client sends a packet, so writing single
+   * bytes directly would be very slow. The output is also bounded to the
+   * announced length to keep the MQTT stream consistent. Optionally, the
+   * bytes are echoed to another output (for debugging).
+   */
+  class ChunkedOutput : public Print
+  {
+  public:
+    ChunkedOutput(Print& out, size_t length, Print* echo = nullptr) noexcept :
+      out_(out), echo_(echo), remaining_(length)
+    {}
+
+    virtual size_t write(uint8_t c) override {
+      if (!remaining_) {
+        ok_ = false;  // writer produced more than counted
+        return 0;
+      }
+      --remaining_;
+      if (echo_)
+        echo_->write(c);
+      buffer_[fill_++] = c;
+      if (fill_ == sizeof(buffer_))
+        writeChunk();
+      return 1;
+    }
+
+    /*!
+     * @brief Write the rest of the message.
+     *
+     * @return @c true, if the writer produced exactly the counted length
+     *    and all bytes were written to the target.
+     */
+    bool finish() {
+      if (remaining_) {
+        // writer produced less than counted, pad to keep the stream consistent,
+        // but report failure, so the message is sent again
+        ok_ = false;
+        while (remaining_)
+          write(' ');
+      }
+      writeChunk();
+      return ok_;
+    }
+
+  private:
+    /// Write collected bytes to the target.
+    void writeChunk() {
+      if (fill_ && out_.write(buffer_, fill_) != fill_)
+        ok_ = false;
+      fill_ = 0;
+    }
+
+    Print& out_;
+    Print* echo_;
+    size_t remaining_;
+    uint8_t buffer_[MESSAGE_HANDLER_STREAM_CHUNK];
+    uint8_t fill_ = 0;
+    bool ok_ = true;
+  };
+}
+
+size_t MessageTopic::printTo(Print& out) const
+{
+  if (progmem_)
+    return out.print(reinterpret_cast<const __FlashStringHelper*>(topic_));
+  return out.print(topic_);
+}
+
+PublishTask::PublishTask(const __FlashStringHelper* name, PublishPriority priority) :
+  next_(s_first_task_),
+  name_(name),
+  priority_(static_cast<unsigned char>(priority)),
+  started_(0),
+  local_(0)
+#if MESSAGE_HANDLER_WAIT_STATS
+  , weight_(0)
+#endif
 {
   s_first_task_ = this;
 }
 
+bool PublishTask::hasTasks() noexcept
+{
+  for (unsigned char i = 0; i < PUBLISH_PRIORITY_COUNT; ++i)
+    if (s_ready_head_[i])
+      return true;
+  return false;
+}
+
+bool PublishTask::hasReadyTasks() noexcept
+{
+  if (!hasTasks())
+    return false;
+  if (MessageHandler::canPublish())
+    return true;
+  for (unsigned char i = 0; i < PUBLISH_PRIORITY_COUNT; ++i)
+    for (auto cur = s_ready_head_[i]; cur; cur = cur->ready_next_)
+      if (cur->local_)
+        return true;
+  return false;
+}
+
+void PublishTask::enqueue()
+{
+  if (isQueued()) {
+    // replaced pending message, keep position and wait time
+    if (started_)
+      ++s_overwritten_;
+    else
+      ++s_coalesced_;
+    return;
+  }
+#if MESSAGE_HANDLER_WAIT_STATS
+  queued_time_ = millis();
+#endif
+  started_ = false;
+  append();
+}
+
+void PublishTask::append() noexcept
+{
+  auto& tail = s_ready_tail_[priority_];
+  if (tail)
+    tail->ready_next_ = this;
+  else
+    s_ready_head_[priority_] = this;
+  tail = this;
+}
+
+void PublishTask::sent()
+{
+#if MESSAGE_HANDLER_WAIT_STATS
+  auto wait = millis() - queued_time_;
+  unsigned w = (wait > 0xffffU) ? 0xffffU : unsigned(wait);
+  if (w > max_wait_)
+    max_wait_ = w;
+  // average over the first few sends, then exponentially-weighted with 1/8
+  if (weight_ < 8)
+    ++weight_;
+  avg_wait_ = unsigned(long(avg_wait_) + (long(w) - long(avg_wait_)) / long(weight_));
+#endif
+}
+
 bool PublishTask::loop()
 {
-  bool retval = false;
-  auto cur = s_first_task_;
-  while (cur) {
-    if (cur->invoker_) {
-      retval = true;
-      auto res = cur->invoker_(cur->closure_space_);
-      if (res)
-        cur->invoker_ = nullptr;  // sent successfully
+  unsigned char budget = MESSAGE_HANDLER_LOOP_BUDGET;
+  for (unsigned char prio = 0; prio < PUBLISH_PRIORITY_COUNT && budget; ++prio) {
+    // run each task queued at the start at most once
+    auto& head = s_ready_head_[prio];
+    auto last = s_ready_tail_[prio];
+    while (auto cur = head) {
+      head = cur->ready_next_;
+      if (!head)
+        s_ready_tail_[prio] = nullptr;
+      cur->ready_next_ = nullptr;
+      if (!cur->local_ && !MessageHandler::canPublish()) {
+        // rate limited, keep the order of MQTT tasks, but let local writers run
+        cur->append();
+      } else if (cur->invoker_) {
+        // task is not queued while sending, so publish() from the writer re-queues it
+        --budget;
+        cur->started_ = true;
+        auto res = cur->invoker_(cur->closure_space_);
+        if (cur->isQueued()) {
+          // published again from the writer, keep the new message
+        } else if (res) {
+          cur->invoker_ = nullptr;  // sent successfully
+          cur->sent();
+        } else {
+          // not complete, retry after other tasks
+          ++s_retried_;
+          cur->append();
+        }
+      }
+      if (cur == last || !budget)
+        break;
     }
-    cur = cur->next_;
   }
-  s_has_tasks_ = retval;
-  return retval;
+  return hasReadyTasks();
+}
+
+void PublishTask::toString(char* buffer, unsigned size) const
+{
+#if MESSAGE_HANDLER_WAIT_STATS
+  auto len = snprintf_P(buffer, size, PSTR("prio %u wmax %u wavg %u"), unsigned(priority_), max_wait_, avg_wait_);
+#else
+  auto len = snprintf_P(buffer, size, PSTR("prio %u"), unsigned(priority_));
+#endif
+  if (isQueued() && len > 0 && unsigned(len) < size)
+    strlcpy_P(buffer + len, PSTR(" queued"), size - unsigned(len));
+}
+
+void PublishTask::queueToString(char* buffer, unsigned size)
+{
+  snprintf_P(buffer, size, PSTR("coalesced %lu overwritten %lu retried %lu throttled %lu sent %lu bytes %lu"),
+    s_coalesced_, s_overwritten_, s_retried_, MessageHandler::getThrottledCount(),
+    MessageHandler::getSentCount(), MessageHandler::getSentBytes());
+}
+
+void PublishTask::resetStatistics() noexcept
+{
+#if MESSAGE_HANDLER_WAIT_STATS
+  for (auto cur = s_first_task_; cur; cur = cur->next_) {
+    cur->max_wait_ = cur->avg_wait_ = 0;
+    cur->weight_ = 0;
+  }
+#endif
+  s_coalesced_ = s_overwritten_ = s_retried_ = 0;
 }
 
 MessageHandler::MessageHandler(const __FlashStringHelper* name) :
@@ -63,19 +351,99 @@ MessageHandler::MessageHandler(const __FlashStringHelper* name) :
 
 MessageHandler::~MessageHandler() {}
 
-void MessageHandler::begin(publish_callback cb, void *cb_arg, bool debug)
+void MessageHandler::begin(publish_callback cb, begin_publish_callback begin_cb, end_publish_callback end_cb,
+                           void *cb_arg, bool debug)
 {
   s_cb_ = cb;
+  s_begin_cb_ = begin_cb;
+  s_end_cb_ = end_cb;
   s_cb_arg_ = cb_arg;
   s_debug_ = debug;
 }
 
-bool MessageHandler::publish(const char* topic, const char* payload, bool retained)
+void MessageHandler::setRateLimit(uint16_t messages, uint16_t bytes, uint16_t burst_messages, uint16_t burst_bytes) noexcept
+{
+  s_rate_messages_ = messages;
+  s_rate_bytes_ = bytes;
+  s_burst_messages_ = (burst_messages ? burst_messages : 1) * 1000UL;
+  s_burst_bytes_ = (burst_bytes ? burst_bytes : 1) * 1000UL;
+  // start with full buckets
+  s_message_tokens_ = s_burst_messages_;
+  s_byte_tokens_ = s_burst_bytes_;
+  s_refill_time_ = millis();
+}
+
+bool MessageHandler::hasTokens(size_t size) noexcept
 {
+  auto now = millis();
+  auto elapsed = now - s_refill_time_;
+  if (elapsed) {
+    s_refill_time_ = now;
+    if (elapsed > MAX_REFILL_TIME)
+      elapsed = MAX_REFILL_TIME;
+    refillBucket(s_message_tokens_, s_burst_messages_, elapsed * s_rate_messages_);
+    refillBucket(s_byte_tokens_, s_burst_bytes_, elapsed * s_rate_bytes_);
+  }
+  if (s_rate_messages_ && s_message_tokens_ < 1000)
+    return false;
+  // a message bigger than the burst is sent with full bucket
+  return !s_rate_bytes_ || s_byte_tokens_ >= size * 1000UL || s_byte_tokens_ == s_burst_bytes_;
+}
+
+bool MessageHandler::acquire(size_t size) noexcept
+{
+  if (hasTokens(size))
+    return true;
+  ++s_throttled_;
+  s_throttled_size_ = size;
+  return false;
+}
+
+unsigned long MessageHandler::getTokenWait() noexcept
+{
+  if (hasTokens(s_throttled_size_))
+    return 0;
+  unsigned long wait = 0;
+  if (s_rate_messages_ && s_message_tokens_ < 1000)
+    wait = (1000 - s_message_tokens_ + s_rate_messages_ - 1) / s_rate_messages_;
+  if (s_rate_bytes_) {
+    // a message bigger than the burst waits for full bucket
+    unsigned long need = s_throttled_size_ * 1000UL;
+    if (need > s_burst_bytes_)
+      need = s_burst_bytes_;
+    if (s_byte_tokens_ < need) {
+      auto byte_wait = (need - s_byte_tokens_ + s_rate_bytes_ - 1) / s_rate_bytes_;
+      if (byte_wait > wait)
+        wait = byte_wait;
+    }
+  }
+  return wait ? wait : 1;
+}
+
+void MessageHandler::consume(size_t size) noexcept
+{
+  ++s_sent_count_;
+  s_sent_bytes_ += size;
+  s_throttled_size_ = 0;
+  if (s_rate_messages_)
+    s_message_tokens_ -= 1000;
+  if (s_rate_bytes_) {
+    unsigned long bytes = size * 1000UL;
+    s_byte_tokens_ = (s_byte_tokens_ > bytes) ? s_byte_tokens_ - bytes : 0;
+  }
+}
+
+bool MessageHandler::publish(MessageTopic topic, const char* payload, bool retained)
+{
+  auto size = topic.length() + strlen(payload);
+  if (!acquire(size))
+    return false;   // rate limited, retry later
   bool sent = s_cb_(s_cb_arg_, topic, payload, retained);
+  if (sent)
+    consume(size);
   if (s_debug_ && sent) {
     Serial.print(F("MQTT send "));
-    Serial.print(topic);
+    topic.printTo(Serial);
     Serial.print(':');
     Serial.print(' ');
     Serial.print(payload);
@@ -86,7 +454,7 @@ bool MessageHandler::publish(const char* topic, const char* payload, bool retain
   return sent;
 }
 
-bool MessageHandler::publish(const char* topic, const __FlashStringHelper* payload, bool retained)
+bool MessageHandler::publish(MessageTopic topic, const __FlashStringHelper* payload, bool retained)
 {
   auto len = strlen_P(reinterpret_cast<const char*>(payload));
   char buffer[len + 1];
@@ -94,32 +462,95 @@ bool MessageHandler::publish(const char* topic, const __FlashStringHelper* paylo
   return publish(topic, buffer, retained);
 }
 
-bool MessageHandler::publish(const char* topic, long payload, bool retained)
+bool MessageHandler::publish(MessageTopic topic, long payload, bool retained)
 {
-  char buffer[16];
-  ltoa(payload, buffer, 10);
+  char buffer[NumberFormat::MAX_LENGTH];
+  NumberFormat::formatInteger(buffer, payload);
   return publish(topic, buffer, retained);
 }
 
-bool MessageHandler::publish(const char* topic, unsigned long payload, bool retained)
+bool MessageHandler::publish(MessageTopic topic, unsigned long payload, bool retained)
 {
-  char buffer[16];
-  ultoa(payload, buffer, 10);
+  char buffer[NumberFormat::MAX_LENGTH];
+  NumberFormat::formatUnsigned(buffer, payload);
   return publish(topic, buffer, retained);
 }
 
-bool MessageHandler::publish(const char* topic, double payload, unsigned char precision, bool retained)
+bool MessageHandler::publish(MessageTopic topic, double payload, unsigned char precision, bool retained)
 {
-  char buffer[32];
-  dtostrf(payload, 1, precision, buffer);
+  char buffer[NumberFormat::MAX_LENGTH];
+  NumberFormat::formatDecimal(buffer, payload, precision);
   return publish(topic, buffer, retained);
 }
 
+bool MessageHandler::publishCbor(MessageTopic topic, long payload, bool retained)
+{
+  return publishStream(topic, [payload](Print& out) { CborWriter::writeInteger(out, payload); }, retained);
+}
+
+bool MessageHandler::publishCbor(MessageTopic topic, unsigned long payload, bool retained)
+{
+  return publishStream(topic, [payload](Print& out) { CborWriter::writeUnsigned(out, payload); }, retained);
+}
+
+bool MessageHandler::publishCbor(MessageTopic topic, double payload, unsigned char precision, bool retained)
+{
+  return publishStream(topic, [payload, precision](Print& out) { CborWriter::writeDecimal(out, payload, precision); }, retained);
+}
+
+bool MessageHandler::publishStream(MessageTopic topic, payload_writer writer, void* arg, bool retained)
+{
+  if (!s_begin_cb_)
+    return false;
+  LengthCounter counter;
+  writer(counter, arg);
+  auto size = topic.length() + counter.length();
+  if (!acquire(size))
+    return false;   // rate limited, retry later
+  auto out = s_begin_cb_(s_cb_arg_, topic, counter.length(), retained);
+  if (!out)
+    return false;
+  // in debug mode, echo text payloads while sending, binary ones (CBOR) are dumped afterwards
+  auto printPrefix = [&topic]() {
+    Serial.print(F("MQTT send "));
+    topic.printTo(Serial);
+    Serial.print(':');
+    Serial.print(' ');
+  };
+  const bool echo = s_debug_ && !counter.isBinary();
+  if (echo)
+    printPrefix();
+  ChunkedOutput chunked(*out, counter.length(), echo ? &Serial : nullptr);
+  writer(chunked, arg);
+  bool sent = chunked.finish();
+  sent = s_end_cb_(s_cb_arg_) && sent;
+  if (sent)
+    consume(size);
+  if (s_debug_ && (sent || echo)) {
+    if (!echo) {
+      printPrefix();
+      counter.dump(Serial);
+    }
+    if (retained)
+      Serial.print(F(" [retained]"));
+    if (!sent)
+      Serial.print(F(" [failed]"));
+    Serial.println();
+  }
+  return sent;
+}
+
 void MessageHandler::mqttMessageReceived(char* topic, uint8_t* payload, unsigned int length)
 {
   payload[length] = 0;  // ensure NUL termination
+  // hash the topic once, handlers dispatch on it
+  dispatch(topic, StringView(topic).hash(), reinterpret_cast<const char*>(payload), length);
+}
+
+void MessageHandler::dispatch(const char* topic, uint16_t hash, const char* payload, unsigned int length)
+{
   const StringView topicStr(topic);
-  const StringView s(reinterpret_cast<const char*>(payload), length);
+  const StringView s(payload, length);
   if (s_debug_) {
     Serial.print(F("MQTT receive ["));
     Serial.write(topicStr.c_str(), topicStr.length());
@@ -128,6 +559,7 @@ void MessageHandler::mqttMessageReceived(char* topic, uint8_t* payload, unsigned
     Serial.println(']');
   }
 
+  s_topic_hash_ = hash;
   auto handler = s_first_handler;
   while (handler) {
     if (s_debug_) {
@@ -148,3 +580,93 @@ void MessageHandler::mqttMessageReceived(char* topic, uint8_t* payload, unsigned
     Serial.println(F("Unexpected MQTT message received, no handler found"));
   }
 }
+
+bool MessageHandler::enqueueMessage(const char* topic, const uint8_t* payload, unsigned int length) noexcept
+{
+  auto topic_length = strlen(topic);
+  QueuedMessage msg;
+  msg.received = millis();
+  msg.hash = StringView(topic, unsigned(topic_length)).hash();
+  msg.topic_length = uint8_t(topic_length);
+  msg.payload_length = uint8_t(length);
+  auto size = msg.size();
+  if (topic_length > 0xff || length > 0xff || size > MESSAGE_HANDLER_QUEUE_SIZE) {
+    ++s_cmd_too_big_;
+    if (s_debug_)
+      Serial.println(F("MQTT command too big for command queue, message dropped"));
+    return false;
+  }
+  if (size > MESSAGE_HANDLER_QUEUE_SIZE - s_queue_fill_) {
+    ++s_cmd_dropped_;
+    if (s_debug_)
+      Serial.println(F("MQTT command queue full, message dropped"));
+    return false;
+  }
+  // append header, topic and payload, both NUL-terminated
+  char* p = s_queue_ + s_queue_fill_;
+  memcpy(p, &msg, sizeof(msg));
+  p += sizeof(msg);
+  memcpy(p, topic, topic_length);
+  p[topic_length] = 0;
+  p += topic_length + 1;
+  memcpy(p, payload, length);
+  p[length] = 0;
+  s_queue_fill_ += size;
+  if (s_queue_fill_ > s_queue_max_fill_)
+    s_queue_max_fill_ = s_queue_fill_;
+  return true;
+}
+
+void MessageHandler::processQueue(unsigned long budget)
+{
+  auto start = micros();
+  while (s_queue_fill_) {
+    QueuedMessage msg;
+    memcpy(&msg, s_queue_, sizeof(msg));
+    auto topic = s_queue_ + sizeof(msg);
+    auto payload = topic + msg.topic_length + 1;
+    // handle in place, messages queued meanwhile are appended after this one
+    auto cmd_start = micros();
+    s_cmd_budget_ = 0;
+    dispatch(topic, msg.hash, payload, msg.payload_length);
+    auto end = micros();
+    const bool heavy = s_cmd_budget_ != 0;
+
+    auto size = msg.size();
+    s_queue_fill_ -= size;
+    memmove(s_queue_, s_queue_ + size, s_queue_fill_);
+
+    // statistics
+    auto runtime = end - cmd_start;
+    if (runtime > s_cmd_max_runtime_)
+      s_cmd_max_runtime_ = runtime;
+    if (runtime > (heavy ? s_cmd_budget_ : budget))
+      ++s_cmd_over_budget_;
+    auto latency = millis() - msg.received;
+    unsigned l = (latency > 0xffffU) ? 0xffffU : unsigned(latency);
+    if (l > s_cmd_max_latency_)
+      s_cmd_max_latency_ = l;
+    ++s_cmd_count_;
+    // average over the first few commands, then exponentially-weighted with 1/8
+    long weight = (s_cmd_count_ < 8) ? long(s_cmd_count_) : 8L;
+    s_cmd_avg_latency_ = unsigned(long(s_cmd_avg_latency_) + (long(l) - long(s_cmd_avg_latency_)) / weight);
+
+    if (heavy || end - start >= budget)
+      break;  // continue next time
+  }
+}
+
+void MessageHandler::queueToString(char* buffer, unsigned size)
+{
+  snprintf_P(buffer, size, PSTR("cnt %lu drop %lu big %lu over %lu rmax %lu lmax %u lavg %u fill %u/%u max %u"),
+    s_cmd_count_, s_cmd_dropped_, s_cmd_too_big_, s_cmd_over_budget_, s_cmd_max_runtime_,
+    s_cmd_max_latency_, s_cmd_avg_latency_, s_queue_fill_, unsigned(MESSAGE_HANDLER_QUEUE_SIZE), s_queue_max_fill_);
+}
+
+void MessageHandler::resetStatistics() noexcept
+{
+  s_sent_count_ = s_sent_bytes_ = s_throttled_ = 0;
+  s_cmd_count_ = s_cmd_dropped_ = s_cmd_too_big_ = s_cmd_over_budget_ = s_cmd_max_runtime_ = 0;
+  s_cmd_max_latency_ = s_cmd_avg_latency_ = 0;
+  s_queue_max_fill_ = s_queue_fill_;
+}
@@ -21,7 +21,7 @@
  * @file
  * @brief Handler for incoming MQTT messages and asynchronous publishing task.
  *
- * This library requires StringView library and typically will be used with
+ * This library requires StringView and NumberFormat libraries and typically will be used with
  * PubSubClient MQTT library. Optionally, FlashStringLiteral library can be
  * used to define message topics as constexpr expressions in Flash memory.
  */
@@ -30,6 +30,8 @@
 #include <StringView.h>
 #include <avr/pgmspace.h>
 
+class Print;
+
 /*
  * NOTE: Messages are normally never published synchronously to save RAM. However,
  * you can define this macro before including the header to force trying to send
@@ -38,9 +40,57 @@
  */
 //#define MESSAGE_HANDLER_SYNC_PUBLISH
 
+#ifndef MESSAGE_HANDLER_LOOP_BUDGET
+/// Maximum count of writer calls per PublishTask::loop() call.
+#define MESSAGE_HANDLER_LOOP_BUDGET 4
+#endif
+
+#ifndef MESSAGE_HANDLER_WAIT_STATS
+/*!
+ * Set to 1 to record wait times of messages per publish task.
+ *
+ * NOTE: Off by default to save RAM (8B per task). Define to 1 before including
+ * the header to analyze delays in the outgoing queue (see PublishTask::toString()).
+ */
+#define MESSAGE_HANDLER_WAIT_STATS 0
+#endif
+
+#ifndef MESSAGE_HANDLER_QUEUE_SIZE
+/*!
+ * Size of the buffer holding received messages waiting for execution.
+ *
+ * Each message takes topic and payload length plus up to 18B (10B on AVR).
+ * Topic and payload are limited to 255B each. The default holds one message
+ * of the maximum MQTT packet size of PubSubClient (256B), which NetworkClient
+ * checks at compile time. Messages which don't fit are dropped and counted.
+ */
+#define MESSAGE_HANDLER_QUEUE_SIZE 272
+#endif
+
+#ifndef MESSAGE_HANDLER_STREAM_CHUNK
+/// Size of the stack buffer collecting streamed payload before writing it to the network.
+#define MESSAGE_HANDLER_STREAM_CHUNK 64
+#endif
+
 /// In-place new operator.
 inline void* operator new(size_t, void* ptr) { return ptr; }
 
+/*!
+ * @brief Priority class of a publish task.
+ *
+ * Pending messages of a higher class are always sent before messages of
+ * a lower class, e.g., after reconnecting to the broker.
+ */
+enum class PublishPriority : unsigned char
+{
+  STATUS, ///< Alarms and status.
+  STATE,  ///< Measurements and configuration values (default).
+  DEBUG   ///< Debugging information.
+};
+
+/// Count of publish priority classes.
+constexpr unsigned char PUBLISH_PRIORITY_COUNT = 3;
+
 /*!
  * @brief Task used to publish MQTT messages asynchronously.
  *
@@ -54,15 +104,55 @@ inline void* operator new(size_t, void* ptr) { return ptr; }
  * arguments in the closure. Normally, however, one would read the current
  * value from the class.
  *
- * @note Each task consumes 16B of memory.
+ * All publish tasks together form the outgoing queue. Each task is a slot for
+ * one kind of message (typically a topic or a group of topics of a module),
+ * so the queue is bounded by the count of tasks and a new message coalesces
+ * with the unsent one of the same task to the latest value.
+ *
+ * Pending tasks are kept in a ready list per priority class in the order of
+ * their first publish() call, so checking for work is O(1) and messages are
+ * sent in a deterministic order. A task which could not send completely is
+ * moved to the end of its list to give other tasks a chance. At most
+ * MESSAGE_HANDLER_LOOP_BUDGET writers are called per loop(). While the rate
+ * limiter of MessageHandler doesn't allow sending, tasks publishing via MQTT
+ * stay queued and only writers published by publishLocal() are called.
+ *
+ * With MESSAGE_HANDLER_WAIT_STATS, each task also records how long messages
+ * waited from the publish() call to the successful send.
+ *
+ * @note Each task consumes 21B of memory (29B with wait statistics).
  */
 class PublishTask
 {
 public:
+  /// Iterator over publish tasks.
+  class iterator
+  {
+  public:
+    PublishTask& operator*() noexcept { return *cur_; }
+    PublishTask* operator->() noexcept { return cur_; }
+
+    /// Move to the next task.
+    iterator& operator++() noexcept { cur_ = cur_->next_; return *this; }
+
+  private:
+    friend class PublishTask;
+    explicit iterator(PublishTask* ptr) noexcept : cur_(ptr) {}
+    friend bool operator==(const iterator& l, const iterator& r) noexcept { return l.cur_ == r.cur_; }
+    friend bool operator!=(const iterator& l, const iterator& r) noexcept { return l.cur_ != r.cur_; }
+    PublishTask* cur_;
+  };
+
   PublishTask(const PublishTask&) = delete;
   PublishTask& operator=(const PublishTask&) = delete;
 
-  PublishTask();
+  /*!
+   * @brief Create publish task.
+   *
+   * @param name task name (used for statistics).
+   * @param priority priority class of messages of this task.
+   */
+  explicit PublishTask(const __FlashStringHelper* name = nullptr, PublishPriority priority = PublishPriority::STATE);
 
   /*!
    * @brief Publish using a function.
@@ -89,7 +179,8 @@ public:
       return (*reinterpret_cast<Func*>(closure))();
     };
     invoker_ = tmp;
-    s_has_tasks_ = true;
+    local_ = false;
+    enqueue();
   }
 
   /*!
@@ -103,11 +194,75 @@ public:
   template<typename TopicType, typename PayloadType, typename... Args>
   void publish(const TopicType& topic, PayloadType payload, Args... args);
 
+  /*!
+   * @brief Publish using a function which doesn't send via MQTT.
+   *
+   * Same as publish(), but the writer only writes to a local output (e.g.,
+   * serial port), so it is called also while the rate limiter blocks MQTT.
+   *
+   * @param message_writer message writer returning bool indicating if the
+   *    output was complete.
+   */
+  template<typename Func>
+  void publishLocal(Func&& message_writer) {
+    publish(static_cast<Func&&>(message_writer));
+    local_ = true;
+  }
+
   /// Cancel pending send.
   void cancel() noexcept { invoker_ = nullptr; }
 
   /// Check if any tasks are pending.
-  static bool hasTasks() noexcept { return s_has_tasks_; }
+  static bool hasTasks() noexcept;
+
+  /// Check if any pending task can run now (a local one or any while not rate limited).
+  static bool hasReadyTasks() noexcept;
+
+  /// Get priority class of the task.
+  PublishPriority getPriority() const noexcept { return PublishPriority(priority_); }
+
+  /// Get task name (may be nullptr).
+  const __FlashStringHelper* getName() const noexcept { return name_; }
+
+#if MESSAGE_HANDLER_WAIT_STATS
+  /// Get maximum time in ms between publish() and successful send.
+  unsigned getMaxWait() const noexcept { return max_wait_; }
+
+  /// Get average time in ms between publish() and successful send.
+  unsigned getAvgWait() const noexcept { return avg_wait_; }
+#endif
+
+  /*!
+   * @brief Serialize priority class and wait statistics (if enabled) to a buffer.
+   *
+   * @param buffer,size buffer where to materialize the string (should be >=40B).
+   */
+  void toString(char* buffer, unsigned size) const;
+
+  /// Get count of unsent messages replaced by a newer one before sending started.
+  static unsigned long getCoalescedCount() noexcept { return s_coalesced_; }
+
+  /// Get count of messages replaced by a newer one while partially sent.
+  static unsigned long getOverwrittenCount() noexcept { return s_overwritten_; }
+
+  /// Get count of send attempts which did not complete and were retried.
+  static unsigned long getRetriedCount() noexcept { return s_retried_; }
+
+  /*!
+   * @brief Serialize queue counters to a buffer.
+   *
+   * @param buffer,size buffer where to materialize the string (should be >=128B).
+   */
+  static void queueToString(char* buffer, unsigned size);
+
+  /// Reset wait statistics of all tasks and queue counters.
+  static void resetStatistics() noexcept;
+
+  /// Get iterator to the first task.
+  static iterator begin() noexcept { return iterator(s_first_task_); }
+
+  /// Get iterator past the last task.
+  static iterator end() noexcept { return iterator(nullptr); }
 
   /*!
    * @brief Continue sending on all tasks with unsent data in loop().
@@ -117,17 +272,98 @@ public:
    * sleep and stop calling loop(). The scheduler can also query presence
    * of tasks using hasTasks() method.
    *
-   * @return @c true, if next loop() call is necessary, @c false otherwise.
+   * @return @c true, if next loop() call is necessary, @c false otherwise
+   *    (also while only rate-limited tasks are pending).
    */
   static bool loop();
 
 private:
+  /// Check if the task is in the ready list.
+  bool isQueued() const noexcept { return ready_next_ || s_ready_tail_[priority_] == this; }
+
+  /// Append the task to the ready list, if not yet there, else count coalesced message.
+  void enqueue();
+
+  /// Append the task to the ready list.
+  void append() noexcept;
+
+  /// Account for a successful send.
+  void sent();
+
   char closure_space_[12];            ///< Space for the closure of the writer.
   bool (*invoker_)(void*) = nullptr;  ///< Invoker of the writer, if active.
   PublishTask* next_;                 ///< Next registered publish task.
+  PublishTask* ready_next_ = nullptr; ///< Next task in the ready list.
+  const __FlashStringHelper* name_;   ///< Task name.
+#if MESSAGE_HANDLER_WAIT_STATS
+  unsigned long queued_time_ = 0;     ///< Time in ms when the task was queued.
+  unsigned max_wait_ = 0;             ///< Maximum wait time in ms (saturating).
+  unsigned avg_wait_ = 0;             ///< Exponentially-weighted average wait time in ms.
+#endif
+  unsigned char priority_ : 2;        ///< Priority class.
+  unsigned char started_ : 1;         ///< Set when the writer of the pending message was called.
+  unsigned char local_ : 1;           ///< Set when the pending writer doesn't send via MQTT.
+#if MESSAGE_HANDLER_WAIT_STATS
+  unsigned char weight_ : 4;          ///< Averaging weight of the next wait time (count of sends up to 8).
+#endif
 
-  static bool s_has_tasks_;           ///< Flag indicating if tasks are pending.
   static PublishTask* s_first_task_;  ///< First registered task.
+  static PublishTask* s_ready_head_[PUBLISH_PRIORITY_COUNT];  ///< First task in the ready list per class.
+  static PublishTask* s_ready_tail_[PUBLISH_PRIORITY_COUNT];  ///< Last task in the ready list per class.
+  static unsigned long s_coalesced_;  ///< Count of coalesced messages.
+  static unsigned long s_overwritten_;///< Count of overwritten partially sent messages.
+  static unsigned long s_retried_;    ///< Count of retried sends.
+};
+
+/*!
+ * @brief Topic of an outgoing message, stored either in RAM or in Flash memory.
+ *
+ * Topics are passed down to the publish callback without copying them to RAM.
+ */
+class MessageTopic
+{
+public:
+  /// Construct topic stored in RAM.
+  MessageTopic(const char* topic) noexcept : topic_(topic), progmem_(false) {}
+
+  /// Construct topic stored in Flash memory.
+  MessageTopic(const __FlashStringHelper* topic) noexcept :
+    topic_(reinterpret_cast<const char*>(topic)), progmem_(true)
+  {}
+
+  /// Construct topic from a string literal in Flash memory.
+  template<unsigned len>
+  MessageTopic(const FlashStringLiteral<len>& topic) noexcept :
+    MessageTopic(static_cast<const __FlashStringHelper*>(topic))
+  {}
+
+  /// Check whether the topic is stored in Flash memory.
+  bool isProgmem() const noexcept { return progmem_; }
+
+  /// Get the first character of the topic.
+  char front() const noexcept { return progmem_ ? char(pgm_read_byte(topic_)) : *topic_; }
+
+  /// Get the length of the topic.
+  size_t length() const noexcept { return progmem_ ? strlen_P(topic_) : strlen(topic_); }
+
+  /*!
+   * @brief Copy the topic including terminating NUL.
+   *
+   * @param buffer buffer of at least length() + 1 characters.
+   */
+  void store(char* buffer) const noexcept {
+    if (progmem_)
+      strcpy_P(buffer, topic_);
+    else
+      strcpy(buffer, topic_);
+  }
+
+  /// Print the topic.
+  size_t printTo(Print& out) const;
+
+private:
+  const char* topic_; ///< Topic string.
+  bool progmem_;      ///< Set, if the topic is stored in Flash memory.
 };
 
 /*!
@@ -138,6 +374,11 @@ private:
  * which processes the message wins.
  *
  * Derive from this class in your component to handle incoming messages.
+ * To find the command quickly, switch over topicHash() with topic hashes
+ * computed at compile time by FlashStringLiteral::hash() as case labels
+ * and verify the topic in the case, since different topics may share the
+ * hash. Colliding topics handled by one handler are reported by the
+ * compiler as duplicate case labels.
  *
  * To send outgoing messages reliably, use PublishTask::publish(), which in turn
  * calls MessageHandler::publish() as often as needed to ensure the message is
@@ -149,14 +390,38 @@ public:
   /*!
    * @brief Signature of a publishing method.
    *
-   * The signature is intentionally made compatible with PubSubClient, so it can be
-   * easily integrated with PubSubClient.
+   * The signature follows PubSubClient::publish(), so it can be easily
+   * integrated with PubSubClient.
    *
    * @param instance instance pointer as specified in begin().
    * @param topic,payload,retained parameters to publish() method.
    * @return @c true, if the message was sent, @c false, if not.
    */
-  using publish_callback = bool (*)(void* instance, const char* topic, const char* payload, bool retained);
+  using publish_callback = bool (*)(void* instance, MessageTopic topic, const char* payload, bool retained);
+
+  /*!
+   * @brief Signature of a method starting a streamed message.
+   *
+   * The signature follows PubSubClient::beginPublish().
+   *
+   * @param instance instance pointer as specified in begin().
+   * @param topic message topic.
+   * @param length exact length of the payload which will be written.
+   * @param retained if set, retain the message on the server.
+   * @return output to write the payload to or @c nullptr, if the message cannot be sent.
+   */
+  using begin_publish_callback = Print* (*)(void* instance, MessageTopic topic, size_t length, bool retained);
+
+  /*!
+   * @brief Signature of a method finishing a streamed message.
+   *
+   * @param instance instance pointer as specified in begin().
+   * @return @c true, if the message was sent, @c false, if not.
+   */
+  using end_publish_callback = bool (*)(void* instance);
+
+  /// Signature of a method writing the payload of a streamed message.
+  using payload_writer = void (*)(Print& out, void* arg);
 
   MessageHandler(const MessageHandler&) = delete;
   MessageHandler& operator=(const MessageHandler&) = delete;
@@ -170,10 +435,43 @@ public:
    * @brief Start sending and receiving messages.
    *
    * @param cb callback for sending messages.
+   * @param begin_cb,end_cb callbacks for sending streamed messages (may be @c nullptr).
    * @param cb_arg callback argument (instance of PubSubClient).
    * @param debug if set, print debugging messages to Serial output.
    */
-  static void begin(publish_callback cb, void *cb_arg, bool debug = false);
+  static void begin(publish_callback cb, begin_publish_callback begin_cb, end_publish_callback end_cb,
+                    void *cb_arg, bool debug = false);
+
+  /*!
+   * @brief Limit the rate of outgoing messages using token buckets.
+   *
+   * Each message takes one message token and one byte token per byte of
+   * topic and payload. Tokens are refilled continuously at the given rate
+   * up to the burst size. If there are not enough tokens, publish() fails
+   * without sending, so the publish task retries later with the latest value.
+   * A message bigger than the byte burst is sent when the byte bucket is full.
+   *
+   * @param messages sustained rate in messages per second (0 for no limit).
+   * @param bytes sustained rate in bytes per second (0 for no limit).
+   * @param burst_messages maximum count of messages sent in a burst.
+   * @param burst_bytes maximum count of bytes sent in a burst.
+   */
+  static void setRateLimit(uint16_t messages, uint16_t bytes, uint16_t burst_messages, uint16_t burst_bytes) noexcept;
+
+  /// Check if the rate limiter allows sending a message now (at least as big as the last throttled one).
+  static bool canPublish() noexcept { return hasTokens(s_throttled_size_); }
+
+  /// Get time in ms until the rate limiter allows sending the last throttled message (0 if now).
+  static unsigned long getTokenWait() noexcept;
+
+  /// Get count of messages sent.
+  static unsigned long getSentCount() noexcept { return s_sent_count_; }
+
+  /// Get count of bytes of topics and payloads sent.
+  static unsigned long getSentBytes() noexcept { return s_sent_bytes_; }
+
+  /// Get count of publish attempts delayed by the rate limiter.
+  static unsigned long getThrottledCount() noexcept { return s_throttled_; }
 
   /*!
    * @brief Publish a message.
@@ -183,7 +481,7 @@ public:
    * @param retained if set, retain the message on the server for quick read upon client connect.
    * @return @c true, if published successfully, @c false otherwise.
    */
-  static bool publish(const char* topic, const char* payload, bool retained = false);
+  static bool publish(MessageTopic topic, const char* payload, bool retained = false);
 
   /*!
    * @brief Publish a message.
@@ -193,7 +491,7 @@ public:
    * @param retained if set, retain the message on the server for quick read upon client connect.
    * @return @c true, if published successfully, @c false otherwise.
    */
-  static bool publish(const char* topic, const __FlashStringHelper* payload, bool retained = false);
+  static bool publish(MessageTopic topic, const __FlashStringHelper* payload, bool retained = false);
 
   /*!
    * @brief Publish a message.
@@ -203,7 +501,7 @@ public:
    * @param retained if set, retain the message on the server for quick read upon client connect.
    * @return @c true, if published successfully, @c false otherwise.
    */
-  static bool publish(const char* topic, long payload, bool retained = false);
+  static bool publish(MessageTopic topic, long payload, bool retained = false);
 
   /*!
    * @brief Publish a message.
@@ -213,7 +511,7 @@ public:
    * @param retained if set, retain the message on the server for quick read upon client connect.
    * @return @c true, if published successfully, @c false otherwise.
    */
-  static bool publish(const char* topic, int payload, bool retained = false) {
+  static bool publish(MessageTopic topic, int payload, bool retained = false) {
     return publish(topic, long(payload), retained);
   }
 
@@ -225,7 +523,7 @@ public:
    * @param retained if set, retain the message on the server for quick read upon client connect.
    * @return @c true, if published successfully, @c false otherwise.
    */
-  static bool publish(const char* topic, unsigned long payload, bool retained = false);
+  static bool publish(MessageTopic topic, unsigned long payload, bool retained = false);
 
   /*!
    * @brief Publish a message.
@@ -235,7 +533,7 @@ public:
    * @param retained if set, retain the message on the server for quick read upon client connect.
    * @return @c true, if published successfully, @c false otherwise.
    */
-  static bool publish(const char* topic, unsigned int payload, bool retained = false) {
+  static bool publish(MessageTopic topic, unsigned int payload, bool retained = false) {
     return publish(topic, static_cast<unsigned long>(payload), retained);
   }
 
@@ -244,29 +542,83 @@ public:
    *
    * @param topic message topic.
    * @param payload message payload (floating point).
-   * @param precision number of decimal places to display.
+   * @param precision number of decimal places to display (max. NumberFormat::MAX_DECIMALS).
    * @param retained if set, retain the message on the server for quick read upon client connect.
    * @return @c true, if published successfully, @c false otherwise.
    */
-  static bool publish(const char* topic, double payload, unsigned char precision = 2, bool retained = false);
+  static bool publish(MessageTopic topic, double payload, unsigned char precision = 2, bool retained = false);
 
   /*!
-   * @brief Publish a message to a topic string stored in Flash memory.
+   * @brief Publish a message with CBOR encoded payload.
    *
-   * @param topic message topic stored in Flash memory.
-   * @param payload message payload (any type supported by other publish() methods).
-   * @param args additional arguments to type-specific publish() method.
+   * @param topic message topic.
+   * @param payload message payload (integer).
+   * @param retained if set, retain the message on the server for quick read upon client connect.
+   * @return @c true, if published successfully, @c false otherwise.
+   */
+  static bool publishCbor(MessageTopic topic, long payload, bool retained = false);
+
+  /*!
+   * @brief Publish a message with CBOR encoded payload.
+   *
+   * @param topic message topic.
+   * @param payload message payload (unsigned integer).
+   * @param retained if set, retain the message on the server for quick read upon client connect.
+   * @return @c true, if published successfully, @c false otherwise.
+   */
+  static bool publishCbor(MessageTopic topic, unsigned long payload, bool retained = false);
+
+  /*!
+   * @brief Publish a message with CBOR encoded payload.
+   *
+   * See CborWriter::writeDecimal() for the encoding.
+   *
+   * @param topic message topic.
+   * @param payload message payload (floating point).
+   * @param precision number of decimal places to preserve (max. NumberFormat::MAX_DECIMALS).
+   * @param retained if set, retain the message on the server for quick read upon client connect.
    * @return @c true, if published successfully, @c false otherwise.
    */
-  template<typename PayloadType, typename... Args>
-  inline static bool publish(const __FlashStringHelper* topic, PayloadType payload, Args... args) {
-    auto ctopic = reinterpret_cast<const char*>(topic);
-    auto topic_len = strlen_P(ctopic) + 1;
-    char buffer[topic_len];
-    memcpy_P(buffer, ctopic, topic_len);
-    return publish(buffer, payload, args...);
+  static bool publishCbor(MessageTopic topic, double payload, unsigned char precision = 2, bool retained = false);
+
+  /*!
+   * @brief Publish a message streaming the payload to the network.
+   *
+   * The payload is written in chunks of MESSAGE_HANDLER_STREAM_CHUNK bytes
+   * directly to the network client, so it is never materialized in RAM and
+   * may be larger than the packet buffer of the MQTT client.
+   *
+   * Since MQTT requires the payload length upfront, the writer is called once
+   * to count the bytes and once more to send them. It must produce the same
+   * output each time. In debug mode, text payloads are echoed to Serial while
+   * sending, binary payloads (e.g., CBOR) are printed as byte count and hex
+   * dump of the first bytes.
+   *
+   * @param topic message topic.
+   * @param writer functor called with Print& to write the payload.
+   * @param retained if set, retain the message on the server for quick read upon client connect.
+   * @return @c true, if published successfully, @c false otherwise (also if
+   *    streaming callbacks were not passed to begin()).
+   */
+  template<typename Func>
+  static bool publishStream(MessageTopic topic, const Func& writer, bool retained = false) {
+    auto invoker = [](Print& out, void* arg) {
+      (*reinterpret_cast<const Func*>(arg))(out);
+    };
+    return publishStream(topic, invoker, const_cast<void*>(static_cast<const void*>(&writer)), retained);
   }
 
+  /*!
+   * @brief Publish a message streaming the payload to the network.
+   *
+   * @param topic message topic.
+   * @param writer method called with Print& and @p arg to write the payload.
+   * @param arg argument for the writer.
+   * @param retained if set, retain the message on the server for quick read upon client connect.
+   * @return @c true, if published successfully, @c false otherwise.
+   */
+  static bool publishStream(MessageTopic topic, payload_writer writer, void* arg, bool retained = false);
+
   /*!
    * @brief Publish a message conditionally.
    *
@@ -304,7 +656,96 @@ public:
    */
   static void mqttMessageReceived(char* topic, uint8_t* payload, unsigned int length);
 
+  /*!
+   * @brief Queue a new message for deferred handling.
+   *
+   * Topic and payload are copied to the bounded command queue together with
+   * the topic hash and handled later by processQueue(), so the receive
+   * callback of the MQTT client returns quickly even for commands running
+   * for a long time. If the queue is full, the message is dropped. Messages
+   * with topic or payload longer than 255B or which don't fit into the empty
+   * queue are dropped as too big.
+   *
+   * @param topic MQTT topic.
+   * @param payload payload of the MQTT message.
+   * @param length length of the payload.
+   * @return @c true, if queued, @c false if dropped.
+   */
+  static bool enqueueMessage(const char* topic, const uint8_t* payload, unsigned int length) noexcept;
+
+  /// Check if any messages wait in the command queue.
+  static bool hasQueuedMessages() noexcept { return s_queue_fill_ != 0; }
+
+  /*!
+   * @brief Handle queued messages in the order of arrival.
+   *
+   * At least one message is handled per call, further ones only while the
+   * budget is not used up. A message which alone takes longer than the
+   * budget (or than its own budget, see setCommandBudget()) is counted as
+   * over budget.
+   *
+   * @param budget time budget of one call in microseconds.
+   */
+  static void processQueue(unsigned long budget);
+
+  /*!
+   * @brief Declare the command being handled as heavy.
+   *
+   * Called from mqttReceiveMsg() of a command which takes longer than the
+   * budget of processQueue() (e.g., writing EEPROM). Its runtime is checked
+   * against the given budget instead and processQueue() yields after it,
+   * so no further command runs in the same call. Long-running work should
+   * rather be moved to a SteppedTask.
+   *
+   * @param budget expected maximum runtime of the command in microseconds.
+   */
+  static void setCommandBudget(unsigned long budget) noexcept { s_cmd_budget_ = budget; }
+
+  /// Get count of queued messages handled.
+  static unsigned long getCommandCount() noexcept { return s_cmd_count_; }
+
+  /// Get count of messages dropped because the command queue was full.
+  static unsigned long getDroppedCount() noexcept { return s_cmd_dropped_; }
+
+  /// Get count of messages dropped because they can never fit into the command queue.
+  static unsigned long getTooBigCount() noexcept { return s_cmd_too_big_; }
+
+  /// Upper bound of queue space taken by a message in addition to topic and payload.
+  static constexpr unsigned QUEUE_ENTRY_OVERHEAD = 2 * sizeof(unsigned long) + 2;
+
+  /// Get maximum time in ms between receiving a message and completing its handling.
+  static unsigned getMaxLatency() noexcept { return s_cmd_max_latency_; }
+
+  /// Get average time in ms between receiving a message and completing its handling.
+  static unsigned getAvgLatency() noexcept { return s_cmd_avg_latency_; }
+
+  /*!
+   * @brief Serialize command queue statistics to a buffer.
+   *
+   * @param buffer,size buffer where to materialize the string (should be >=96B).
+   */
+  static void queueToString(char* buffer, unsigned size);
+
+  /// Reset command queue statistics and counters of sent and throttled messages.
+  static void resetStatistics() noexcept;
+
+protected:
+  /// Get hash of the topic of the message being handled, see StringView::hash().
+  static uint16_t topicHash() noexcept { return s_topic_hash_; }
+
 private:
+  /// Refill token buckets and check whether a message of given size can be sent.
+  static bool hasTokens(size_t size) noexcept;
+
+  /// Check tokens for a message of given size, count it as throttled if not available.
+  static bool acquire(size_t size) noexcept;
+
+  /// Take tokens for a message of given size sent successfully.
+  static void consume(size_t size) noexcept;
+
+  /// Call registered handlers for a message with NUL-terminated topic and payload.
+  static void dispatch(const char* topic, uint16_t hash, const char* payload, unsigned int length);
+
   /*!
    * @brief Try to handle received message.
    *
@@ -318,8 +759,33 @@ private:
   const __FlashStringHelper* name_;
   static MessageHandler* s_first_handler;
   static publish_callback s_cb_;
+  static begin_publish_callback s_begin_cb_;
+  static end_publish_callback s_end_cb_;
   static void *s_cb_arg_;
   static bool s_debug_;
+  static uint16_t s_topic_hash_;
+  static uint16_t s_rate_messages_;       ///< Message rate per second (0 = unlimited).
+  static uint16_t s_rate_bytes_;          ///< Byte rate per second (0 = unlimited).
+  static unsigned long s_burst_messages_; ///< Message bucket size in 1/1000 messages.
+  static unsigned long s_burst_bytes_;    ///< Byte bucket size in 1/1000 bytes.
+  static unsigned long s_message_tokens_; ///< Message tokens in 1/1000 messages.
+  static unsigned long s_byte_tokens_;    ///< Byte tokens in 1/1000 bytes.
+  static unsigned long s_refill_time_;    ///< Time in ms of the last refill.
+  static unsigned long s_sent_count_;     ///< Count of messages sent.
+  static unsigned long s_sent_bytes_;     ///< Count of bytes sent.
+  static unsigned long s_throttled_;      ///< Count of throttled publish attempts.
+  static size_t s_throttled_size_;        ///< Size of the last throttled message (0 after a send).
+  static char s_queue_[MESSAGE_HANDLER_QUEUE_SIZE]; ///< Queued messages.
+  static unsigned s_queue_fill_;          ///< Bytes used in the command queue.
+  static unsigned s_queue_max_fill_;      ///< Maximum bytes used in the command queue.
+  static unsigned long s_cmd_count_;      ///< Count of queued messages handled.
+  static unsigned long s_cmd_dropped_;    ///< Count of dropped messages.
+  static unsigned long s_cmd_too_big_;    ///< Count of messages dropped as too big.
+  static unsigned long s_cmd_over_budget_;///< Count of messages handled over budget.
+  static unsigned long s_cmd_budget_;     ///< Own budget of the command being handled (0 if none).
+  static unsigned long s_cmd_max_runtime_;///< Maximum handling time in us.
+  static unsigned s_cmd_max_latency_;     ///< Maximum latency in ms (saturating).
+  static unsigned s_cmd_avg_latency_;     ///< Exponentially-weighted average latency in ms.
 };
 
 template<typename TopicType, typename PayloadType, typename... Args>
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2018 Ivan Schréter (schreter@gmx.net)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * This copyright notice MUST APPEAR in all copies of the software!
+ */
+
+#include "TelemetryChannel.h"
+
+/// Name of the shared publish task.
+static const char s_publish_task_name[] PROGMEM = "Telemetry";
+
+TelemetryChannelBase* TelemetryChannelBase::s_first_ = nullptr;
+PublishTask TelemetryChannelBase::s_publish_task_(reinterpret_cast<const __FlashStringHelper*>(s_publish_task_name));
+bool TelemetryChannelBase::s_publishing_ = true;
+bool TelemetryChannelBase::s_cbor_ = false;
+
+TelemetryChannelBase::TelemetryChannelBase(MessageTopic topic, uint16_t min_interval, uint16_t max_interval, bool retained) noexcept :
+  topic_(topic),
+  next_(s_first_),
+  min_interval_(min_interval),
+  max_interval_(max_interval),
+  flags_(uint8_t(FLAG_ENABLED | FLAG_FORCE | (retained ? FLAG_RETAINED : 0)))
+{
+  s_first_ = this;
+}
+
+void TelemetryChannelBase::setEnabled(bool enabled) noexcept
+{
+  if (enabled)
+    flags_ |= FLAG_ENABLED;
+  else
+    flags_ &= uint8_t(~(FLAG_ENABLED | FLAG_PENDING));
+}
+
+void TelemetryChannelBase::forceSendAll() noexcept
+{
+  for (auto cur = s_first_; cur; cur = cur->next_)
+    cur->flags_ |= FLAG_FORCE;
+}
+
+void TelemetryChannelBase::loop() noexcept
+{
+  if (!s_publishing_)
+    return;
+  bool publish = false;
+  for (auto cur = s_first_; cur; cur = cur->next_) {
+    if (!(cur->flags_ & FLAG_ENABLED))
+      continue;
+    if (cur->age_ != 0xffffU)
+      ++cur->age_;
+    if (cur->flags_ & FLAG_PENDING) {
+      // not sent yet (e.g., no connection), send the latest value instead
+      cur->sample(true);
+      continue;
+    }
+    bool force = (cur->flags_ & FLAG_FORCE) || cur->age_ >= cur->max_interval_;
+    if (!force && cur->age_ < cur->min_interval_)
+      continue;
+    if (cur->sample(force)) {
+      cur->flags_ = uint8_t((cur->flags_ & ~FLAG_FORCE) | FLAG_PENDING);
+      cur->age_ = 0;
+      publish = true;
+    }
+  }
+  if (publish)
+    s_publish_task_.publish([]() { return sendPending(); });
+}
+
+bool TelemetryChannelBase::sendPending()
+{
+  for (auto cur = s_first_; cur; cur = cur->next_) {
+    if (!(cur->flags_ & FLAG_PENDING))
+      continue;
+    if (!cur->send())
+      return false; // will retry later
+    cur->flags_ &= uint8_t(~FLAG_PENDING);
+  }
+  return true;  // all sent
+}
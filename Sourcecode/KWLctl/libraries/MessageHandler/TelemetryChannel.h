@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2018 Ivan Schréter (schreter@gmx.net)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * This copyright notice MUST APPEAR in all copies of the software!
+ */
+
+/*!
+ * @file
+ * @brief Telemetry values published on change or periodically.
+ */
+#pragma once
+
+#include "MessageHandler.h"
+
+/*!
+ * @brief Base class of a telemetry channel.
+ *
+ * A telemetry channel publishes one measured value to one topic. The value
+ * is sent when it changed by at least the deadband (by more than the deadband
+ * with setStrictDeadband()), but not more often than the minimum interval,
+ * and unconditionally after the maximum interval.
+ *
+ * All channels form a list sampled by loop(), which must be called once per
+ * second by a single task of the application. Channels due to send latch
+ * their value and are published by one shared publish task, so modules
+ * don't need own timers and publish tasks for their measurements. If the
+ * value cannot be sent right away, the channel stays pending and sends the
+ * latest value when the connection is back.
+ */
+class TelemetryChannelBase
+{
+public:
+  TelemetryChannelBase(const TelemetryChannelBase&) = delete;
+  TelemetryChannelBase& operator=(const TelemetryChannelBase&) = delete;
+
+  /// Send the value on the next loop() independent of timing and deadband.
+  void forceSend() noexcept { flags_ |= FLAG_FORCE; }
+
+  /// Enable or disable the channel (e.g., if the sensor is not present).
+  void setEnabled(bool enabled) noexcept;
+
+  /// Set minimum time between two sends in seconds (e.g., from a tunable interval).
+  void setMinInterval(uint16_t min_interval) noexcept { min_interval_ = min_interval; }
+
+  /// Send only values which changed by more than the deadband (default: at least the deadband).
+  void setStrictDeadband() noexcept { flags_ |= FLAG_STRICT; }
+
+  /// Check if the channel is enabled.
+  bool isEnabled() const noexcept { return (flags_ & FLAG_ENABLED) != 0; }
+
+  /// Get the topic of the channel.
+  const MessageTopic& getTopic() const noexcept { return topic_; }
+
+  /// Get seconds since the last send (saturating).
+  unsigned getAge() const noexcept { return age_; }
+
+  /// Force sending all enabled channels on the next loop().
+  static void forceSendAll() noexcept;
+
+  /*!
+   * @brief Enable or disable publishing of all channels.
+   *
+   * Used if the values are published aggregated in another form instead.
+   * Channels still receive values via update(), but loop() does nothing.
+   *
+   * @param publishing if set, channels are sampled and published (default).
+   */
+  static void setPublishing(bool publishing) noexcept { s_publishing_ = publishing; }
+
+  /// Publish values of all channels CBOR encoded instead of as text.
+  static void setCbor(bool cbor) noexcept { s_cbor_ = cbor; }
+
+  /*!
+   * @brief Sample all channels and publish due values.
+   *
+   * Must be called once per second. Intervals of the channels are counted
+   * in calls of this method.
+   */
+  static void loop() noexcept;
+
+protected:
+  /*!
+   * @brief Construct and register a channel.
+   *
+   * The first value is sent as soon as it's available.
+   *
+   * @param topic topic to publish the value to.
+   * @param min_interval minimum time between two sends in seconds.
+   * @param max_interval maximum time between two sends in seconds.
+   * @param retained publish retained messages.
+   */
+  TelemetryChannelBase(MessageTopic topic, uint16_t min_interval, uint16_t max_interval, bool retained) noexcept;
+
+  /*!
+   * @brief Latch the current value for sending, if it should be sent.
+   *
+   * @param force if set, send any valid value, else only one outside the deadband.
+   * @return @c true, if the value was latched, @c false if there is nothing to send.
+   */
+  virtual bool sample(bool force) noexcept = 0;
+
+  /// Publish the latched value, return @c true on success.
+  virtual bool send() = 0;
+
+  /// Check if messages of this channel are retained.
+  bool isRetained() const noexcept { return (flags_ & FLAG_RETAINED) != 0; }
+
+  /// Check if a value was set since the start.
+  bool hasValue() const noexcept { return (flags_ & FLAG_VALUE) != 0; }
+
+  /// Mark the value as set.
+  void setHasValue() noexcept { flags_ |= FLAG_VALUE; }
+
+  /// Check if a change equal to the deadband is still within the deadband.
+  bool isStrictDeadband() const noexcept { return (flags_ & FLAG_STRICT) != 0; }
+
+  /// Check if values are published CBOR encoded.
+  static bool isCbor() noexcept { return s_cbor_; }
+
+private:
+  static constexpr uint8_t FLAG_ENABLED = 1;  ///< Channel is sampled.
+  static constexpr uint8_t FLAG_RETAINED = 2; ///< Messages are retained.
+  static constexpr uint8_t FLAG_VALUE = 4;    ///< Value was set.
+  static constexpr uint8_t FLAG_FORCE = 8;    ///< Send on the next loop().
+  static constexpr uint8_t FLAG_PENDING = 16; ///< Latched value waits for sending.
+  static constexpr uint8_t FLAG_STRICT = 32;  ///< Send only changes exceeding the deadband.
+
+  /// Publish all pending channels, return @c true if all sent.
+  static bool sendPending();
+
+  MessageTopic topic_;            ///< Topic of the value.
+  TelemetryChannelBase* next_;    ///< Next registered channel.
+  uint16_t min_interval_;         ///< Minimum time between sends in seconds.
+  uint16_t max_interval_;         ///< Maximum time between sends in seconds.
+  uint16_t age_ = 0;              ///< Seconds since the last send.
+  uint8_t flags_;                 ///< Channel flags.
+
+  static TelemetryChannelBase* s_first_;  ///< First registered channel.
+  static PublishTask s_publish_task_;     ///< Task publishing pending channels.
+  static bool s_publishing_;              ///< Set, if channels are published.
+  static bool s_cbor_;                    ///< Set, if values are published CBOR encoded.
+};
+
+/*!
+ * @brief Telemetry channel for a value of a given type.
+ *
+ * The owning module calls update() whenever it has a new measurement.
+ * Integer values are published as integers, floating-point values with
+ * the configured count of decimal places, either as text or CBOR encoded
+ * (see setCbor()). NaN is never published.
+ *
+ * @tparam T value type (integer or floating-point).
+ */
+template<typename T>
+class TelemetryChannel : public TelemetryChannelBase
+{
+public:
+  /*!
+   * @brief Construct and register a channel.
+   *
+   * @param topic topic to publish the value to.
+   * @param deadband minimum change of the value to send it before the maximum interval.
+   * @param min_interval minimum time between two sends in seconds.
+   * @param max_interval maximum time between two sends in seconds.
+   * @param retained publish retained messages.
+   * @param decimals count of decimal places of floating-point values.
+   */
+  TelemetryChannel(MessageTopic topic, T deadband, uint16_t min_interval, uint16_t max_interval,
+                   bool retained = false, uint8_t decimals = 2) noexcept :
+    TelemetryChannelBase(topic, min_interval, max_interval, retained),
+    deadband_(deadband),
+    decimals_(decimals)
+  {}
+
+  /// Set new measured value.
+  void update(T value) noexcept { value_ = value; setHasValue(); }
+
+  /// Get the last measured value.
+  T get() const noexcept { return value_; }
+
+  /// Get the value sent last.
+  T getSent() const noexcept { return sent_; }
+
+  /*!
+   * @brief Set the limit for erroneous measurements.
+   *
+   * Values at or below the limit denote a sensor error and are not published.
+   *
+   * @param limit highest erroneous value.
+   */
+  void setErrorLimit(T limit) noexcept { error_limit_ = limit; has_error_limit_ = true; }
+
+private:
+  virtual bool sample(bool force) noexcept override
+  {
+    auto value = value_;
+    if (!hasValue() || value != value || (has_error_limit_ && value <= error_limit_))
+      return false;   // no valid measurement (NaN or sensor error)
+    if (!force && value == sent_)
+      return false;   // no change
+    auto diff = value > sent_ ? value - sent_ : sent_ - value;
+    if (!force && (diff < deadband_ || (diff == deadband_ && isStrictDeadband())))
+      return false;   // within deadband
+    sent_ = value;
+    return true;
+  }
+
+  virtual bool send() override
+  {
+    return publishValue(sent_);
+  }
+
+  bool publishValue(float value) { return publishValue(double(value)); }
+  bool publishValue(int value) { return publishValue(long(value)); }
+  bool publishValue(unsigned value) { return publishValue(static_cast<unsigned long>(value)); }
+
+  bool publishValue(double value) {
+    return isCbor() ? MessageHandler::publishCbor(getTopic(), value, decimals_, isRetained())
+                    : MessageHandler::publish(getTopic(), value, decimals_, isRetained());
+  }
+
+  bool publishValue(long value) {
+    return isCbor() ? MessageHandler::publishCbor(getTopic(), value, isRetained())
+                    : MessageHandler::publish(getTopic(), value, isRetained());
+  }
+
+  bool publishValue(unsigned long value) {
+    return isCbor() ? MessageHandler::publishCbor(getTopic(), value, isRetained())
+                    : MessageHandler::publish(getTopic(), value, isRetained());
+  }
+
+  T value_ = T();           ///< Last measured value.
+  T sent_ = T();            ///< Value sent last or latched for sending.
+  T deadband_;              ///< Minimum change to send.
+  T error_limit_ = T();     ///< Highest erroneous value.
+  uint8_t decimals_;        ///< Decimal places of floating-point values.
+  bool has_error_limit_ = false;  ///< Set, if error_limit_ applies.
+};
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2018 Ivan Schréter (schreter@gmx.net)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * This copyright notice MUST APPEAR in all copies of the software!
+ */
+
+#include "NumberFormat.h"
+
+#include <Arduino.h>
+#include <math.h>
+#include <string.h>
+
+namespace NumberFormat
+{
+  namespace
+  {
+    /// Maximum count of decimal digits of a 32-bit number.
+    static constexpr uint8_t MAX_DIGITS = 10;
+
+    /// Divide a 16-bit number by 10 using multiplication by reciprocal (exact for all 16-bit values).
+    inline uint16_t div10(uint16_t value) noexcept
+    {
+      return uint16_t((uint32_t(value) * 0xCCCDU) >> 19);
+    }
+
+    /// Powers of 10 to count digits of a 32-bit number.
+    const uint32_t POW10[MAX_DIGITS - 1] PROGMEM = {
+      10UL, 100UL, 1000UL, 10000UL, 100000UL, 1000000UL, 10000000UL, 100000000UL, 1000000000UL
+    };
+
+    /// Write zeroes for padding, return pointer after them.
+    inline char* pad(char* buffer, uint8_t count, uint8_t min_digits) noexcept
+    {
+      while (min_digits > count) {
+        *buffer++ = '0';
+        --min_digits;
+      }
+      return buffer;
+    }
+
+    /// Copy a string from Flash memory to the buffer, return pointer to the terminating NUL.
+    char* emit_P(char* buffer, const char* str) noexcept
+    {
+      strcpy_P(buffer, str);
+      return buffer + strlen(buffer);
+    }
+  }
+
+  char* formatUnsigned(char* buffer, uint32_t value, uint8_t min_digits) noexcept
+  {
+    // count digits to write them backwards directly into the buffer
+    uint8_t digits = 1;
+    while (digits < MAX_DIGITS && value >= pgm_read_dword(&POW10[digits - 1]))
+      ++digits;
+    if (min_digits > MAX_DIGITS)
+      min_digits = MAX_DIGITS;
+    char* end = pad(buffer, digits, min_digits) + digits;
+    *end = 0;
+    char* p = end;
+    // split off groups of 4 digits with one 32-bit division each
+    while (value > 0xffffU) {
+      uint32_t q = value / 10000U;
+      uint16_t group = uint16_t(value - q * 10000U);
+      value = q;
+      for (uint8_t i = 0; i < 4; ++i) {
+        uint16_t d = div10(group);
+        *--p = char('0' + (group - d * 10));
+        group = d;
+      }
+    }
+    // remaining digits fit 16 bits
+    uint16_t rest = uint16_t(value);
+    do {
+      uint16_t d = div10(rest);
+      *--p = char('0' + (rest - d * 10));
+      rest = d;
+    } while (rest);
+    return end;
+  }
+
+  char* formatInteger(char* buffer, int32_t value) noexcept
+  {
+    if (value < 0) {
+      *buffer++ = '-';
+      return formatUnsigned(buffer, 0U - uint32_t(value));
+    }
+    return formatUnsigned(buffer, uint32_t(value));
+  }
+
+  char* formatFixed(char* buffer, int32_t value, uint8_t decimals) noexcept
+  {
+    if (decimals > MAX_DECIMALS)
+      decimals = MAX_DECIMALS;
+    uint32_t magnitude = uint32_t(value);
+    if (value < 0) {
+      *buffer++ = '-';
+      magnitude = 0U - magnitude;
+    }
+    if (!decimals)
+      return formatUnsigned(buffer, magnitude);
+    // format with at least one integral digit, then insert decimal point
+    auto end = formatUnsigned(buffer, magnitude, uint8_t(decimals + 1));
+    memmove(end - decimals + 1, end - decimals, size_t(decimals) + 1);
+    end[-int(decimals)] = '.';
+    return end + 1;
+  }
+
+  char* formatDecimal(char* buffer, double value, uint8_t decimals) noexcept
+  {
+    if (isnan(value))
+      return emit_P(buffer, PSTR("nan"));
+    if (isinf(value))
+      return emit_P(buffer, PSTR("inf"));
+    if (decimals > MAX_DECIMALS)
+      decimals = MAX_DECIMALS;
+    uint32_t scale = 1;
+    for (uint8_t i = 0; i < decimals; ++i)
+      scale *= 10;
+    double scaled = value * double(scale);
+    if (scaled >= 2147483647.0 || scaled <= -2147483647.0)
+      return emit_P(buffer, PSTR("ovf"));
+    auto fixed = int32_t(scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+    return formatFixed(buffer, fixed, decimals);
+  }
+
+  char* formatHex(char* buffer, uint32_t value, uint8_t min_digits) noexcept
+  {
+    uint8_t digits = 1;
+    while (digits < 8 && (value >> (4 * digits)))
+      ++digits;
+    if (min_digits > 8)
+      min_digits = 8;
+    char* end = pad(buffer, digits, min_digits) + digits;
+    *end = 0;
+    char* p = end;
+    do {
+      uint8_t nibble = uint8_t(value & 15);
+      *--p = char(nibble < 10 ? '0' + nibble : 'A' - 10 + nibble);
+      value >>= 4;
+    } while (value);
+    return end;
+  }
+
+  size_t printUnsigned(Print& out, uint32_t value)
+  {
+    char buffer[MAX_LENGTH];
+    auto end = formatUnsigned(buffer, value);
+    return out.write(buffer, size_t(end - buffer));
+  }
+
+  size_t printInteger(Print& out, int32_t value)
+  {
+    char buffer[MAX_LENGTH];
+    auto end = formatInteger(buffer, value);
+    return out.write(buffer, size_t(end - buffer));
+  }
+
+  size_t printDecimal(Print& out, double value, uint8_t decimals)
+  {
+    char buffer[MAX_LENGTH];
+    auto end = formatDecimal(buffer, value, decimals);
+    return out.write(buffer, size_t(end - buffer));
+  }
+}
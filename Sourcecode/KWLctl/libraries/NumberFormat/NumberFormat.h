@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2018 Ivan Schréter (schreter@gmx.net)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * This copyright notice MUST APPEAR in all copies of the software!
+ */
+
+/*!
+ * @file
+ * @brief Fast formatting of integers and fixed-point decimals.
+ *
+ * The functions replace ltoa(), ultoa(), dtostrf() and printf-style
+ * formatting of single numbers. Digits are produced in groups of four using
+ * one 32-bit division per group and 16-bit multiplication by reciprocal
+ * within a group, which is several times faster on AVR than a 32-bit
+ * division per digit and does not pull in printf or float formatting code.
+ *
+ * All functions write a NUL-terminated string and return a pointer to the
+ * terminating NUL, so further text can be appended cheaply.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+class Print;
+
+namespace NumberFormat
+{
+  /// Buffer size sufficient for any formatted number including sign, decimal point and NUL.
+  static constexpr size_t MAX_LENGTH = 16;
+
+  /// Maximum count of decimal places supported by formatFixed() and formatDecimal().
+  static constexpr uint8_t MAX_DECIMALS = 6;
+
+  /*!
+   * @brief Format an unsigned integer.
+   *
+   * @param buffer buffer for the result (MAX_LENGTH bytes suffice for any value).
+   * @param value value to format.
+   * @param min_digits minimum count of digits, padded with leading zeroes (max. 10).
+   * @return pointer to the terminating NUL.
+   */
+  char* formatUnsigned(char* buffer, uint32_t value, uint8_t min_digits = 1) noexcept;
+
+  /*!
+   * @brief Format a signed integer.
+   *
+   * @param buffer buffer for the result (MAX_LENGTH bytes suffice for any value).
+   * @param value value to format.
+   * @return pointer to the terminating NUL.
+   */
+  char* formatInteger(char* buffer, int32_t value) noexcept;
+
+  /*!
+   * @brief Format a fixed-point decimal number.
+   *
+   * E.g., value 2156 with 2 decimals is formatted as "21.56".
+   *
+   * @param buffer buffer for the result (MAX_LENGTH bytes suffice for any value).
+   * @param value value scaled by 10^decimals.
+   * @param decimals count of decimal places (max. MAX_DECIMALS).
+   * @return pointer to the terminating NUL.
+   */
+  char* formatFixed(char* buffer, int32_t value, uint8_t decimals) noexcept;
+
+  /*!
+   * @brief Format a floating-point number with fixed count of decimal places.
+   *
+   * The value is rounded half away from zero. Values which don't fit
+   * 32 bits when scaled are formatted as "ovf", invalid values as "nan"
+   * or "inf", same as Print::print(double).
+   *
+   * @param buffer buffer for the result (MAX_LENGTH bytes suffice for any value).
+   * @param value value to format.
+   * @param decimals count of decimal places (max. MAX_DECIMALS).
+   * @return pointer to the terminating NUL.
+   */
+  char* formatDecimal(char* buffer, double value, uint8_t decimals) noexcept;
+
+  /*!
+   * @brief Format an unsigned integer as uppercase hexadecimal number.
+   *
+   * @param buffer buffer for the result (MAX_LENGTH bytes suffice for any value).
+   * @param value value to format.
+   * @param min_digits minimum count of digits, padded with leading zeroes (max. 8).
+   * @return pointer to the terminating NUL.
+   */
+  char* formatHex(char* buffer, uint32_t value, uint8_t min_digits = 1) noexcept;
+
+  /// Print an unsigned integer, see formatUnsigned().
+  size_t printUnsigned(Print& out, uint32_t value);
+
+  /// Print a signed integer, see formatInteger().
+  size_t printInteger(Print& out, int32_t value);
+
+  /// Print a floating-point number with fixed count of decimal places, see formatDecimal().
+  size_t printDecimal(Print& out, double value, uint8_t decimals);
+}
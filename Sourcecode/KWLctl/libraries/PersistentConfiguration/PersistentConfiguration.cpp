@@ -102,11 +102,17 @@ bool PersistentConfigurationBase::updateRange(const void* ptr, unsigned int size
 }
 
 void PersistentConfigurationBase::dumpRaw(Print& out, unsigned bytes_per_row)
+{
+  dumpRawRows(out, EEPROM_MIN_ADDR, unsigned(EEPROM_MAX_ADDR - EEPROM_MIN_ADDR), bytes_per_row);
+}
+
+unsigned PersistentConfigurationBase::dumpRawRows(Print& out, unsigned addr, unsigned rows, unsigned bytes_per_row)
 {
   unsigned j = 0;
   char buf[10];
 
-  for (int i = EEPROM_MIN_ADDR; i < EEPROM_MAX_ADDR; i++) {
+  int i = int(addr);
+  for (; i < EEPROM_MAX_ADDR && rows; i++) {
     if (j == 0) {
       sprintf(buf, "%03X:", i);
       out.print(buf);
@@ -116,6 +122,7 @@ void PersistentConfigurationBase::dumpRaw(Print& out, unsigned bytes_per_row)
     j++;
     if (j == bytes_per_row) {
       j = 0;
+      --rows;
       out.println(buf);
     } else {
       out.print(buf);
@@ -123,5 +130,5 @@ void PersistentConfigurationBase::dumpRaw(Print& out, unsigned bytes_per_row)
   }
   if (j)
     out.println();
+  return i < EEPROM_MAX_ADDR ? unsigned(i) : 0;
 }
-
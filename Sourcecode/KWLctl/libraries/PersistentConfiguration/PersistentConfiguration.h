@@ -33,6 +33,19 @@ class Print;
 class PersistentConfigurationBase
 {
 public:
+  /*!
+   * @brief Dump part of raw contents of the EEPROM to the specified stream.
+   *
+   * This can be used to dump EEPROM contents in several steps.
+   *
+   * @param out stream to which to print.
+   * @param addr address at which to start.
+   * @param rows how many rows to print.
+   * @param bytes_per_row how many bytes to print per row.
+   * @return address following the last dumped byte or 0 if the end of EEPROM was reached.
+   */
+  static unsigned dumpRawRows(Print& out, unsigned addr, unsigned rows, unsigned bytes_per_row = 16);
+
 protected:
   /// Function to load defaults.
   using LoadFnc = void (PersistentConfigurationBase::*)();
@@ -56,6 +56,17 @@ inline void* operator new(unsigned /*size*/, void* ptr) { return ptr; }
 
 void ScreenshotService::make(MCUFRIEND_kbv& tft, Print& client) noexcept
 {
+  ScreenshotService service;
+  service.begin(tft, client);
+  while (service.step())
+    wdt_reset();  // it takes long to write, make sure watchdog doesn't kill us
+}
+
+void ScreenshotService::begin(MCUFRIEND_kbv& tft, Print& client) noexcept
+{
+  tft_ = &tft;
+  client_ = &client;
+  row_ = column_ = 0;
   auto w = tft.width();
   auto h = tft.height();
   uint16_t buffer[STRIDE_SIZE / 2];
@@ -66,12 +77,20 @@ void ScreenshotService::make(MCUFRIEND_kbv& tft, Print& client) noexcept
   hdr->biHeight = -h;
   hdr->biSizeImage = uint32_t(w * h * 2);
   client.write(reinterpret_cast<const uint8_t*>(hdr), sizeof(bmp_header));
-  wdt_reset();
-  for (int16_t i = 0; i < h; ++i) {
-    for (int16_t j = 0; j < w / (STRIDE_SIZE / 2); ++j) {
-      tft.readGRAM(j * (STRIDE_SIZE / 2), i, buffer, STRIDE_SIZE / 2, 1);
-      client.write(reinterpret_cast<const uint8_t*>(&buffer), STRIDE_SIZE);
-    }
-    wdt_reset();  // it takes long to write, make sure watchdog doesn't kill us
+}
+
+bool ScreenshotService::step() noexcept
+{
+  if (!tft_ || row_ >= tft_->height())
+    return false;
+  // transfer one stride of the current row
+  uint16_t buffer[STRIDE_SIZE / 2];
+  tft_->readGRAM(column_, row_, buffer, STRIDE_SIZE / 2, 1);
+  client_->write(reinterpret_cast<const uint8_t*>(&buffer), STRIDE_SIZE);
+  column_ += STRIDE_SIZE / 2;
+  if (column_ + STRIDE_SIZE / 2 > tft_->width()) {
+    column_ = 0;
+    ++row_;
   }
+  return row_ < tft_->height();
 }
@@ -23,16 +23,41 @@
  */
 #pragma once
 
+#include <stdint.h>
+
 class MCUFRIEND_kbv;
 class Print;
 
 /*!
  * @brief Simple screenshot service writing bitmap with TFT contents.
+ *
+ * The screenshot can be either made at once using make() or in small
+ * steps using begin() and step(), e.g., from a Scheduler::SteppedTask.
  */
 class ScreenshotService
 {
 public:
-  /// Make screenshot and print it into the stream.
+  /// Make screenshot and print it into the stream (blocks for several seconds).
   static void make(MCUFRIEND_kbv& tft, Print& client) noexcept;
+
+  /// Start making screenshot into the stream, write bitmap header.
+  void begin(MCUFRIEND_kbv& tft, Print& client) noexcept;
+
+  /*!
+   * @brief Write next part of the screenshot into the stream.
+   *
+   * @return @c true, if there is more to write, @c false when done.
+   */
+  bool step() noexcept;
+
+private:
+  /// Display to read.
+  MCUFRIEND_kbv* tft_ = nullptr;
+  /// Stream to write to.
+  Print* client_ = nullptr;
+  /// Next row to write.
+  int16_t row_ = 0;
+  /// Next column to write.
+  int16_t column_ = 0;
 };
 
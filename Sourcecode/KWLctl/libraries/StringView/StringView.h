@@ -23,6 +23,7 @@
  */
 #pragma once
 
+#include <FlashStringLiteral.h>
 #include <WString.h>
 #include <stdlib.h>
 
@@ -63,6 +64,14 @@ public:
     return 0 == memcmp(data_, other.data_, length_);
   }
 
+  /// Compute hash of the string, compatible with FlashStringLiteral::hash().
+  uint16_t hash() const noexcept {
+    uint16_t result = FlashStringImpl::HASH_BASIS;
+    for (size_t i = 0; i < length_; ++i)
+      result = FlashStringImpl::hashStep(result, data_[i]);
+    return result;
+  }
+
   bool operator!=(const char* other) const noexcept { return !operator==(other); }
   bool operator!=(const __FlashStringHelper* other) const noexcept { return !operator==(other); }
   bool operator!=(const StringView& other) const noexcept { return !operator==(other); }
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2018 Ivan Schréter (schreter@gmx.net)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * This copyright notice MUST APPEAR in all copies of the software!
+ */
+
+#include "SchedulerTrace.h"
+
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace Scheduler
+{
+  SchedulerTrace::Event SchedulerTrace::s_events_[BUFFER_SIZE];
+  unsigned SchedulerTrace::s_next_ = 0;
+  unsigned SchedulerTrace::s_count_ = 0;
+  unsigned long SchedulerTrace::s_last_time_ = 0;
+  volatile uint8_t SchedulerTrace::s_interrupts_ = 0;
+  bool SchedulerTrace::s_active_ = false;
+
+  void SchedulerTrace::start() noexcept
+  {
+    if (!EVENTS)
+      return;
+    s_next_ = s_count_ = 0;
+    s_interrupts_ = 0;
+    s_last_time_ = micros();
+    s_active_ = true;
+  }
+
+  void SchedulerTrace::addValue(TraceEvent type, uint16_t value) noexcept
+  {
+    if (s_active_)
+      record(type, micros(), nullptr, value);
+  }
+
+  SchedulerTrace::Event& SchedulerTrace::push(TraceEvent type, uint16_t delta) noexcept
+  {
+    auto& event = s_events_[s_next_];
+    event.type = type;
+    event.delta = delta;
+    if (++s_next_ == BUFFER_SIZE)
+      s_next_ = 0;
+    if (s_count_ < BUFFER_SIZE)
+      ++s_count_;
+    return event;
+  }
+
+  void SchedulerTrace::record(TraceEvent type, unsigned long time, const __FlashStringHelper* name, uint16_t value) noexcept
+  {
+    unsigned long delta = time - s_last_time_;
+    if (long(delta) < 0)
+      delta = 0;  // event time taken before the previous event was recorded
+    else
+      s_last_time_ = time;
+    if (delta > 0xffff) {
+      // long pause, record high bits separately
+      push(TraceEvent::TIME, 0).value = uint16_t(delta >> 16);
+    }
+    // ISRs increment the counter, so take it atomically
+    noInterrupts();
+    uint8_t count = s_interrupts_;
+    s_interrupts_ = 0;
+    interrupts();
+    if (count) {
+      push(TraceEvent::INTERRUPTS, uint16_t(delta)).value = count;
+      delta = 0;
+    }
+    auto& event = push(type, uint16_t(delta));
+    if (type == TraceEvent::TASK_BEGIN || type == TraceEvent::TASK_END ||
+        type == TraceEvent::POLL_BEGIN || type == TraceEvent::POLL_END)
+      event.name = name;
+    else
+      event.value = value;
+  }
+
+  bool SchedulerTrace::toString(char* buffer, unsigned size, unsigned& index) noexcept
+  {
+    if (index >= s_count_)
+      return false;
+    auto len = unsigned(snprintf_P(buffer, size, PSTR("%u"), index));
+    const unsigned first = s_count_ < BUFFER_SIZE ? 0 : s_next_;
+    while (index < s_count_) {
+      const auto& event = s_events_[(first + index) % BUFFER_SIZE];
+      char item[48];
+      auto item_len = unsigned(snprintf_P(item, sizeof(item), PSTR(" %c%u"), char(event.type), event.delta));
+      switch (event.type) {
+        case TraceEvent::TASK_BEGIN:
+        case TraceEvent::TASK_END:
+        case TraceEvent::POLL_BEGIN:
+        case TraceEvent::POLL_END:
+          item[item_len++] = ':';
+          if (event.name)
+            strlcpy_P(item + item_len, reinterpret_cast<const char*>(event.name), sizeof(item) - item_len);
+          else
+            strlcpy_P(item + item_len, PSTR("-"), sizeof(item) - item_len);
+          item_len = unsigned(strlen(item));
+          break;
+        case TraceEvent::TIME:
+          item_len = unsigned(snprintf_P(item, sizeof(item), PSTR(" T%u"), event.value));
+          break;
+        default:
+          item_len += unsigned(snprintf_P(item + item_len, sizeof(item) - item_len, PSTR(":%u"), event.value));
+          break;
+      }
+      if (len + item_len >= size)
+        break;  // doesn't fit anymore
+      memcpy(buffer + len, item, item_len + 1);
+      len += item_len;
+      ++index;
+    }
+    return true;
+  }
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2018 Ivan Schréter (schreter@gmx.net)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * This copyright notice MUST APPEAR in all copies of the software!
+ */
+
+/*!
+ * @file
+ * @brief Trace of scheduler events in a RAM ring buffer.
+ */
+#pragma once
+
+#include <stdint.h>
+
+class __FlashStringHelper;
+
+/*
+ * NOTE: Each trace event costs 3B + size of a pointer of RAM. Tracing is
+ * off by default to save RAM. Define this macro in build flags to the number
+ * of events kept in the ring buffer (e.g., 64) to enable it.
+ */
+#ifndef SCHEDULER_TRACE_EVENTS
+#define SCHEDULER_TRACE_EVENTS 0
+#endif
+
+namespace Scheduler
+{
+  /// Type of a trace event, the value is the character used in the dump.
+  enum class TraceEvent : char
+  {
+    TASK_BEGIN = 'B',   ///< Timed task started (name of the task).
+    TASK_END = 'E',     ///< Timed task ended (name of the task).
+    POLL_BEGIN = 'b',   ///< Poll task started (name of the task).
+    POLL_END = 'e',     ///< Poll task ended (name of the task).
+    INTERRUPTS = 'I',   ///< Interrupts since the previous event (count).
+    PUBLISH = 'P',      ///< Publish attempt (1 if sent, 0 if failed).
+    TIME = 'T'          ///< High 16 bits of the time delta to the next event.
+  };
+
+  /*!
+   * @brief Trace of scheduler events in a fixed-size RAM ring buffer.
+   *
+   * When started, task runs, poll runs, publish attempts and interrupt
+   * counts are recorded with the time delta to the previous event. When
+   * the buffer is full, the oldest events are overwritten. The trace is
+   * stopped for dumping.
+   *
+   * The dump consists of chunks of text starting with the index of the
+   * first event in the chunk, followed by space-separated events in form
+   * <type><delta>[:<name or value>]. Use Docs/debug_scheduler/trace2json.py
+   * to convert the dump to Chrome trace format (chrome://tracing, Perfetto).
+   */
+  class SchedulerTrace
+  {
+  public:
+    /// Count of events kept in the ring buffer.
+    static constexpr unsigned EVENTS = SCHEDULER_TRACE_EVENTS;
+
+    SchedulerTrace() = delete;
+
+    /// Clear the buffer and start recording events.
+    static void start() noexcept;
+
+    /// Stop recording events.
+    static void stop() noexcept { s_active_ = false; }
+
+    /// Check whether events are being recorded.
+    static bool isActive() noexcept { return s_active_; }
+
+    /*!
+     * @brief Record an event for a task.
+     *
+     * @param type event type.
+     * @param time time of the event.
+     * @param name task name or nullptr for unaccounted tasks.
+     */
+    static void add(TraceEvent type, unsigned long time, const __FlashStringHelper* name) noexcept {
+      if (s_active_)
+        record(type, time, name, 0);
+    }
+
+    /*!
+     * @brief Record an event with a value at current time.
+     *
+     * @param type event type.
+     * @param value value to record.
+     */
+    static void addValue(TraceEvent type, uint16_t value) noexcept;
+
+    /// Count an interrupt, can be called from ISR.
+    static void interrupt() noexcept {
+      if (s_active_)
+        ++s_interrupts_;
+    }
+
+    /// Get count of recorded events in the buffer.
+    static unsigned getCount() noexcept { return s_count_; }
+
+    /*!
+     * @brief Serialize a chunk of recorded events to a buffer.
+     *
+     * @param buffer,size buffer where to materialize the string (should be >=64B).
+     * @param index index of the first event to serialize, updated to the index
+     *    of the first event not serialized.
+     * @return @c true, if some events were serialized, @c false if there are no more.
+     */
+    static bool toString(char* buffer, unsigned size, unsigned& index) noexcept;
+
+  private:
+    /// One recorded event.
+    struct Event
+    {
+      /// Event type.
+      TraceEvent type;
+      /// Time since the previous event in microseconds (low 16 bits).
+      uint16_t delta;
+      union {
+        /// Task name for task events.
+        const __FlashStringHelper* name;
+        /// Value for other events.
+        uint16_t value;
+      };
+    };
+
+    /// Record an event.
+    static void record(TraceEvent type, unsigned long time, const __FlashStringHelper* name, uint16_t value) noexcept;
+    /// Store an event into the ring buffer.
+    static Event& push(TraceEvent type, uint16_t delta) noexcept;
+
+    /// Size of the ring buffer (at least 1 to keep it valid with tracing off).
+    static constexpr unsigned BUFFER_SIZE = EVENTS > 0 ? EVENTS : 1;
+
+    /// Ring buffer of events.
+    static Event s_events_[BUFFER_SIZE];
+    /// Index of the next event to write.
+    static unsigned s_next_;
+    /// Count of valid events.
+    static unsigned s_count_;
+    /// Time of the last recorded event.
+    static unsigned long s_last_time_;
+    /// Interrupts counted since the last recorded event.
+    static volatile uint8_t s_interrupts_;
+    /// Set if recording.
+    static bool s_active_;
+  };
+}
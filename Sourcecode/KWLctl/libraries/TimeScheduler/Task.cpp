@@ -18,6 +18,10 @@
  */
 
 #include "TaskBase.h"
+#include "TaskSignal.h"
+#include "TaskInterval.h"
+
+#include <avr/pgmspace.h>
 
 namespace Scheduler
 {
@@ -25,9 +29,41 @@ namespace Scheduler
   unsigned long TaskBase::s_scheduler_current_time_ = 0;
   TimedTaskBase* TimedTaskBase::s_first_task_ = nullptr;
   PollTaskBase* PollTaskBase::s_first_task_ = nullptr;
+  TimedTaskBase* TimedTaskBase::s_queue_[SCHEDULER_MAX_TIMED_TASKS];
+  unsigned char TimedTaskBase::s_queue_size_ = 0;
+  unsigned char TimedTaskBase::s_overflow_count_ = 0;
+
+  bool PollTaskBase::isPollDue(unsigned long now) noexcept
+  {
+    if (!poll_interval_ || now - last_poll_time_ >= poll_interval_)
+      return true;
+    if (wake_check_ && wake_check_()) {
+      // new input, react immediately
+      active_ = true;
+      return true;
+    }
+    if (skipped_count_ != 0xffff)
+      ++skipped_count_;
+    return false;
+  }
+
+  void PollTaskBase::pollDone(unsigned long start) noexcept
+  {
+    last_poll_time_ = start;
+    if (active_) {
+      poll_interval_ = min_interval_;
+      active_ = false;
+    } else if (poll_interval_ < max_interval_) {
+      // idle, back off
+      poll_interval_ = poll_interval_ ? poll_interval_ << 1 : BACKOFF_START;
+      if (poll_interval_ < min_interval_ || poll_interval_ > max_interval_)
+        poll_interval_ = max_interval_;
+    }
+  }
 
   void TimedTaskBase::runRepeated(unsigned long timeout, unsigned long interval) noexcept
   {
+    dequeue();
     unsigned long new_time;
     if (s_is_in_loop_) {
       new_time = s_scheduler_current_time_ + timeout;
@@ -43,10 +79,200 @@ namespace Scheduler
       new_time = 1; // 0 is special for not scheduled
     next_time_ = new_time;
     interval_ = interval;
+    stagger_slot_ = STAGGER_NONE;
+    enqueue();
+  }
+
+  unsigned long TimedTaskBase::staggerOffset(unsigned long interval, unsigned char slot) noexcept
+  {
+    // bit-reversed slot index gives 0, 1/2, 1/4, 3/4, 1/8, ... of the interval
+    static_assert(STAGGER_SLOTS == 8, "Adjust bit reversal to stagger slot count");
+    unsigned char reversed = ((slot & 1) << 2) | (slot & 2) | ((slot & 4) >> 2);
+    return (interval / STAGGER_SLOTS) * reversed;
+  }
+
+  void TimedTaskBase::runRepeated(unsigned long timeout, unsigned long interval, unsigned long phase) noexcept
+  {
+    runRepeated(timeout, interval);
+    if (!interval || long(interval) < 0)
+      return; // not periodic or too long to align
+
+    unsigned long target;
+    unsigned char slot = STAGGER_NONE;
+    if (phase == AUTO_PHASE) {
+      // find the first free slot and reference time among auto-phased tasks with the same interval
+      unsigned char used = 0;
+      const TimedTaskBase* ref = nullptr;
+      for (auto cur = s_first_task_; cur; cur = cur->next_) {
+        if (cur != this && cur->stagger_slot_ != STAGGER_NONE && cur->interval_ == interval && cur->next_time_) {
+          used |= 1 << cur->stagger_slot_;
+          if (!ref)
+            ref = cur;
+        }
+      }
+      slot = 0;
+      while (slot < STAGGER_SLOTS - 1 && (used & (1 << slot)))
+        ++slot;
+      if (!ref) {
+        // first task of the group determines the phase
+        stagger_slot_ = slot;
+        return;
+      }
+      target = ref->next_time_ - staggerOffset(interval, ref->stagger_slot_) + staggerOffset(interval, slot);
+    } else {
+      target = phase;
+    }
+
+    // move to the closest time with requested phase, but not to the past
+    const auto now = s_is_in_loop_ ? s_scheduler_current_time_ : micros();
+    long delta = long(target - next_time_) % long(interval);
+    if (delta < 0)
+      delta += long(interval);
+    if (static_cast<unsigned long>(delta) > interval / 2 && long(next_time_ + static_cast<unsigned long>(delta) - interval - now) > 0)
+      delta -= long(interval);
+    dequeue();
+    next_time_ += static_cast<unsigned long>(delta);
+    if (!next_time_)
+      next_time_ = 1; // 0 is special for not scheduled
+    stagger_slot_ = slot;
+    enqueue();
   }
 
   void TimedTaskBase::cancel() noexcept
   {
+    dequeue();
     next_time_ = interval_ = 0;
   }
+
+  void TimedTaskBase::trigger(unsigned long delay) noexcept
+  {
+    if (queue_index_ == QUEUE_NONE || queue_index_ == QUEUE_DUE)
+      return; // not scheduled, running or runs in this loop anyway
+    const auto now = s_is_in_loop_ ? s_scheduler_current_time_ : micros();
+    auto new_time = now + delay;
+    if (!new_time)
+      new_time = 1; // 0 is special for not scheduled
+    if (long(next_time_ - new_time) <= 0)
+      return; // runs early enough
+    dequeue();
+    next_time_ = new_time;
+    enqueue();
+  }
+
+  void SignalListener::connect(const TaskSignal& signal) noexcept
+  {
+    next_ = signal.first_;
+    signal.first_ = this;
+  }
+
+  void TaskSignal::notify() noexcept
+  {
+    ++notify_count_;
+    for (auto cur = first_; cur; cur = cur->next_)
+      cur->task_.trigger(cur->delay_);
+  }
+
+  TaskInterval* TaskInterval::s_first_ = nullptr;
+
+  TaskInterval::TaskInterval(const __FlashStringHelper* name, unsigned long interval, apply_function apply, void* target) noexcept :
+    name_(name), apply_(apply), target_(target), interval_(interval), default_(interval), next_(s_first_)
+  {
+    s_first_ = this;
+  }
+
+  bool TaskInterval::set(unsigned long interval) noexcept
+  {
+    if (interval < MIN_INTERVAL || interval > MAX_INTERVAL)
+      return false;
+    apply(interval);
+    return true;
+  }
+
+  void TaskInterval::apply(unsigned long interval) noexcept
+  {
+    auto prev_interval = interval_;
+    interval_ = interval;
+    apply_(target_, prev_interval, interval);
+  }
+
+  void TaskInterval::applyToTask(void* task, unsigned long prev_interval, unsigned long interval) noexcept
+  {
+    auto& t = *static_cast<TimedTaskBase*>(task);
+    if (t.getInterval() == prev_interval && prev_interval != 0) {
+      // task runs with this interval, don't wait for the rest of a longer one
+      t.setInterval(interval);
+      t.trigger(interval);
+    }
+  }
+
+  TaskInterval* TaskInterval::find(const char* name) noexcept
+  {
+    for (auto cur = s_first_; cur; cur = cur->next_)
+      if (strcmp_P(name, reinterpret_cast<const char*>(cur->name_)) == 0)
+        return cur;
+    return nullptr;
+  }
+
+  void TimedTaskBase::enqueue() noexcept
+  {
+    if (s_queue_size_ >= SCHEDULER_MAX_TIMED_TASKS) {
+      // no space, scheduler will find the task by scanning
+      queue_index_ = QUEUE_OVERFLOW;
+      ++s_overflow_count_;
+      return;
+    }
+    auto index = s_queue_size_++;
+    place(this, index);
+    siftUp(index);
+  }
+
+  void TimedTaskBase::dequeue() noexcept
+  {
+    auto index = queue_index_;
+    queue_index_ = QUEUE_NONE;
+    if (index == QUEUE_OVERFLOW) {
+      --s_overflow_count_;
+      return;
+    }
+    if (index >= s_queue_size_)
+      return; // not in the queue or due
+    auto last = s_queue_[--s_queue_size_];
+    if (last == this)
+      return; // removed the tail
+    place(last, index);
+    if (index > 0 && last->isBefore(*s_queue_[(index - 1) / 2]))
+      siftUp(index);
+    else
+      siftDown(index);
+  }
+
+  void TimedTaskBase::siftUp(unsigned char index) noexcept
+  {
+    auto task = s_queue_[index];
+    while (index > 0) {
+      unsigned char parent = (index - 1) / 2;
+      if (!task->isBefore(*s_queue_[parent]))
+        break;
+      place(s_queue_[parent], index);
+      index = parent;
+    }
+    place(task, index);
+  }
+
+  void TimedTaskBase::siftDown(unsigned char index) noexcept
+  {
+    auto task = s_queue_[index];
+    for (;;) {
+      unsigned child = 2U * index + 1;
+      if (child >= s_queue_size_)
+        break;
+      if (child + 1 < s_queue_size_ && s_queue_[child + 1]->isBefore(*s_queue_[child]))
+        ++child;
+      if (!s_queue_[child]->isBefore(*task))
+        break;
+      place(s_queue_[child], index);
+      index = static_cast<unsigned char>(child);
+    }
+    place(task, index);
+  }
 }
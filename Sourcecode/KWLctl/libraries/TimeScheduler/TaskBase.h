@@ -29,8 +29,37 @@
 // forward to prevent including large headers
 extern "C" unsigned long micros(void);
 
+/*
+ * NOTE: Scheduled timed tasks are kept in a ready queue of fixed size to avoid
+ * walking over all registered tasks in each scheduler loop. If more tasks are
+ * scheduled at the same time, the surplus is handled by a (slower) linear scan.
+ * Define this macro in build flags to change the queue size.
+ */
+#ifndef SCHEDULER_MAX_TIMED_TASKS
+#define SCHEDULER_MAX_TIMED_TASKS 32
+#endif
+static_assert(SCHEDULER_MAX_TIMED_TASKS > 0 && SCHEDULER_MAX_TIMED_TASKS < 250, "Invalid ready queue size");
+
 namespace Scheduler
 {
+  /*!
+   * @brief Priority class of a task.
+   *
+   * Due tasks of a higher class always run before tasks of a lower class
+   * in each scheduler loop. Classes other than CONTROL can be limited by
+   * a time budget per loop (see TimeScheduler::setBudget()).
+   */
+  enum class TaskPriority : unsigned char
+  {
+    CONTROL,    ///< Real-time control (default), never deferred.
+    SENSING,    ///< Reading sensors.
+    TELEMETRY,  ///< Network communication.
+    UI          ///< User interface.
+  };
+
+  /// Count of task priority classes.
+  constexpr unsigned char TASK_PRIORITY_COUNT = 4;
+
   /*!
    * @brief Base class for all tasks.
    */
@@ -43,7 +72,9 @@ namespace Scheduler
     TaskBase(const TaskBase&) = delete;
     TaskBase& operator=(const TaskBase&) = delete;
 
-    explicit TaskBase(invoker_type invoker) noexcept : invoker_(invoker) {}
+    explicit TaskBase(invoker_type invoker, TaskPriority priority = TaskPriority::CONTROL) noexcept :
+      invoker_(invoker), priority_(priority)
+    {}
 
     /// Invoke this task.
     unsigned long invoke(unsigned long start) noexcept
@@ -51,12 +82,17 @@ namespace Scheduler
       return invoker_(*this, start);
     }
 
+    /// Get priority class of this task.
+    TaskPriority getPriority() const noexcept { return priority_; }
+
   protected:
     friend class TimeScheduler;
     friend class PollingScheduler;
 
     /// Invoker for this task, called with thisptr and current time, must return new time (micros()).
     invoker_type invoker_;
+    /// Priority class of this task.
+    TaskPriority priority_;
 
     /// Flag whether the scheduler is currently active.
     static bool s_is_in_loop_;
@@ -70,14 +106,16 @@ namespace Scheduler
   class TimedTaskBase : protected TaskBase
   {
   protected:
-    explicit TimedTaskBase(invoker_type invoker) noexcept :
-      TaskBase(invoker),
+    explicit TimedTaskBase(invoker_type invoker, TaskPriority priority = TaskPriority::CONTROL) noexcept :
+      TaskBase(invoker, priority),
       next_(s_first_task_)
     {
       s_first_task_ = this;
     }
 
   public:
+    using TaskBase::getPriority;
+
     /*!
      * @brief Run this task repeatedly.
      *
@@ -93,6 +131,33 @@ namespace Scheduler
      */
     void runRepeated(unsigned long interval) noexcept { runRepeated(interval, interval); }
 
+    /// Phase for runRepeated() to stagger the task automatically among tasks with the same interval.
+    static constexpr unsigned long AUTO_PHASE = ~0UL;
+
+    /*!
+     * @brief Run this task repeatedly with given phase.
+     *
+     * The first run is moved to the time closest to the requested timeout
+     * (but not before the current time), at which the time modulo interval
+     * equals the phase. Subsequent runs follow with the interval. Thus,
+     * tasks with the same interval and different phases never run in the
+     * same scheduler loop.
+     *
+     * With AUTO_PHASE, the phase is picked automatically relative to other
+     * auto-phased tasks with the same interval. The first task keeps its
+     * time, further tasks are placed at 1/2, 1/4, 3/4, 1/8, ... of the
+     * interval after it (up to STAGGER_SLOTS tasks).
+     *
+     * @note Explicit phases are relative to the time 0 of micros(), so
+     *    tasks scheduled after micros() overflow (~71 minutes) may get
+     *    a different alignment than those scheduled before.
+     *
+     * @param timeout timeout in microseconds.
+     * @param interval interval in microseconds (less than 2^31).
+     * @param phase phase offset in microseconds (less than interval) or AUTO_PHASE.
+     */
+    void runRepeated(unsigned long timeout, unsigned long interval, unsigned long phase) noexcept;
+
     /*!
      * @brief Run this task once after specified timeout passes.
      *
@@ -103,6 +168,19 @@ namespace Scheduler
     /// Cancel this task (it won't run anymore).
     void cancel() noexcept;
 
+    /*!
+     * @brief Run a scheduled task earlier, e.g., when new input data is available.
+     *
+     * If the task is scheduled later than after the delay, it is moved to
+     * run after the delay. A periodic task continues with its interval
+     * from this run. Tasks which are not scheduled (or cancelled) and tasks
+     * scheduled earlier are left alone.
+     *
+     * @param delay delay in microseconds (0 to run in the next scheduler loop).
+     * @see TaskSignal to trigger dependent tasks of other modules.
+     */
+    void trigger(unsigned long delay = 0) noexcept;
+
     /*!
      * @brief Set interval for the task inside run() method.
      *
@@ -132,14 +210,61 @@ namespace Scheduler
   private:
     friend class TimeScheduler;
 
+    /// Count of distinct phases assigned automatically to tasks with the same interval.
+    static constexpr unsigned char STAGGER_SLOTS = 8;
+    /// Value of stagger_slot_ for tasks without automatic phase.
+    static constexpr unsigned char STAGGER_NONE = 0xff;
+
+    /// Get offset of the automatic phase slot from the first slot.
+    static unsigned long staggerOffset(unsigned long interval, unsigned char slot) noexcept;
+
+    /// Special values for queue_index_ if the task is not in the ready queue.
+    enum : unsigned char
+    {
+      QUEUE_NONE = 0xff,      ///< Task is not scheduled.
+      QUEUE_DUE = 0xfe,       ///< Task is due and will run in current scheduler loop.
+      QUEUE_OVERFLOW = 0xfd   ///< Task is scheduled, but ready queue was full.
+    };
+
+    /// Check whether this task should run before the other task.
+    inline bool isBefore(const TimedTaskBase& other) const noexcept {
+      return long(next_time_ - other.next_time_) < 0;
+    }
+
+    /// Put this task into the ready queue (next_time_ must be set).
+    void enqueue() noexcept;
+    /// Remove this task from the ready queue, if it's there.
+    void dequeue() noexcept;
+    /// Move the task at given queue position towards the queue head.
+    static void siftUp(unsigned char index) noexcept;
+    /// Move the task at given queue position towards the queue tail.
+    static void siftDown(unsigned char index) noexcept;
+    /// Store a task at given queue position.
+    static inline void place(TimedTaskBase* task, unsigned char index) noexcept {
+      s_queue_[index] = task;
+      task->queue_index_ = index;
+    }
+
     /// Next time at which to react to this task.
     unsigned long next_time_ = 0;
     /// Interval with which to schedule this task.
     unsigned long interval_ = 0;
     /// Next registered task.
     TimedTaskBase* next_;
+    /// Next task to run in the list of due tasks of the current scheduler loop.
+    TimedTaskBase* next_due_ = nullptr;
+    /// Position of this task in the ready queue or one of QUEUE_* constants.
+    unsigned char queue_index_ = QUEUE_NONE;
+    /// Automatic phase slot or STAGGER_NONE.
+    unsigned char stagger_slot_ = STAGGER_NONE;
     /// First registered task.
     static TimedTaskBase* s_first_task_;
+    /// Ready queue of scheduled tasks (binary min-heap ordered by next_time_).
+    static TimedTaskBase* s_queue_[SCHEDULER_MAX_TIMED_TASKS];
+    /// Count of tasks in the ready queue.
+    static unsigned char s_queue_size_;
+    /// Count of scheduled tasks, which didn't fit into the ready queue.
+    static unsigned char s_overflow_count_;
   };
 
   /*!
@@ -148,12 +273,68 @@ namespace Scheduler
   class PollTaskBase : protected TaskBase
   {
   protected:
-    explicit PollTaskBase(invoker_type invoker) noexcept :
-      TaskBase(invoker), next_(s_first_task_)
+    explicit PollTaskBase(invoker_type invoker, TaskPriority priority = TaskPriority::CONTROL) noexcept :
+      TaskBase(invoker, priority), next_(s_first_task_)
     {
       s_first_task_ = this;
     }
 
+  public:
+    using TaskBase::getPriority;
+
+    /// Function checking whether the task has work to do.
+    using WakeCheck = bool (*)();
+
+    /// Maximum sleep time for tasks which only wake up by their wake check.
+    static constexpr unsigned long NO_SLEEP_LIMIT = ~0UL;
+
+    /// Poll interval to start backoff from, if minimum poll interval is 0.
+    static constexpr unsigned long BACKOFF_START = 1000;
+
+    /*!
+     * @brief Declare wake sources of the task, so the scheduler can sleep.
+     *
+     * By default, a poll task must be polled continuously, which prevents
+     * the scheduler from sleeping. A task which reacts to interrupt-driven
+     * events (UART, pin interrupt, ...) or which tolerates some latency
+     * declares it here. The MCU wakes up on any interrupt and the scheduler
+     * checks the wake check of each sleeping task. Polling resumes as soon
+     * as a check returns @c true or maximum sleep time elapses.
+     *
+     * @param check function returning @c true if the task has work to do (or nullptr).
+     * @param max_sleep maximum time in microseconds without polling the task.
+     */
+    void setWakeSource(WakeCheck check, unsigned long max_sleep = NO_SLEEP_LIMIT) noexcept {
+      wake_check_ = check;
+      max_sleep_ = max_sleep;
+    }
+
+    /*!
+     * @brief Limit poll rate of the task with adaptive backoff.
+     *
+     * The task is polled at most once per current poll interval. After
+     * a poll which reported activity (see markActive()), the interval drops
+     * to the minimum. Each poll without activity doubles it up to the maximum.
+     * Backoff starts at BACKOFF_START, if the minimum interval is 0. A wake
+     * check returning @c true polls the task regardless of the interval.
+     * While not polled, the task doesn't prevent the scheduler from sleeping.
+     *
+     * @param min_interval minimum poll interval in microseconds (0 to poll in each loop).
+     * @param max_interval maximum poll interval in microseconds when idle
+     *    (at least min_interval).
+     */
+    void setPollInterval(unsigned long min_interval, unsigned long max_interval) noexcept {
+      min_interval_ = poll_interval_ = min_interval;
+      max_interval_ = max_interval < min_interval ? min_interval : max_interval;
+    }
+
+    /// Report activity in the current poll, so the task is polled fast again.
+    void markActive() noexcept { active_ = true; }
+
+    /// Get current poll interval in microseconds.
+    unsigned long getPollInterval() const noexcept { return poll_interval_; }
+
+  protected:
     /// Check if the task is enabled.
     bool isEnabled() const noexcept { return enabled_; }
 
@@ -163,13 +344,48 @@ namespace Scheduler
     /// Enable this task.
     void enable() noexcept { enabled_ = true; }
 
+    /// Check whether the task reported activity in the current poll.
+    bool isActive() const noexcept { return active_; }
+
+    /// Get time of the previous poll.
+    unsigned long getLastPollTime() const noexcept { return last_poll_time_; }
+
+    /// Get count of polls skipped due to poll interval since the previous poll and reset it.
+    unsigned takeSkippedCount() noexcept {
+      auto count = skipped_count_;
+      skipped_count_ = 0;
+      return count;
+    }
+
   private:
     friend class PollingScheduler;
 
+    /// Check whether the task should be polled now, count a skip if not.
+    bool isPollDue(unsigned long now) noexcept;
+
+    /// Adapt poll interval after a poll which started at given time.
+    void pollDone(unsigned long start) noexcept;
+
     /// Next registered poll task.
     PollTaskBase* next_;
     /// Enabled flag.
     bool enabled_ = true;
+    /// Function checking whether the task has work to do while sleeping.
+    WakeCheck wake_check_ = nullptr;
+    /// Maximum sleep time without polling the task (0 if it must be polled continuously).
+    unsigned long max_sleep_ = 0;
+    /// Minimum poll interval (0 if the task is polled in each loop).
+    unsigned long min_interval_ = 0;
+    /// Maximum poll interval after backoff.
+    unsigned long max_interval_ = 0;
+    /// Current poll interval.
+    unsigned long poll_interval_ = 0;
+    /// Start time of the previous poll.
+    unsigned long last_poll_time_ = 0;
+    /// Count of polls skipped since the previous poll.
+    unsigned skipped_count_ = 0;
+    /// Activity reported in the current poll.
+    bool active_ = false;
     /// First registered poll task.
     static PollTaskBase* s_first_task_;
   };
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2018 Ivan Schréter (schreter@gmx.net)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * This copyright notice MUST APPEAR in all copies of the software!
+ */
+
+/*!
+ * @file
+ * @brief Named interval of a timed task, which can be changed at runtime.
+ */
+#pragma once
+
+#include "TaskBase.h"
+
+namespace Scheduler
+{
+  /*!
+   * @brief Named interval of a timed task, which can be changed at runtime.
+   *
+   * All intervals are registered in a global list, so they can be found by
+   * name and changed, e.g., via MQTT. The module owning the task declares
+   * the interval next to its task and uses get() instead of a constant when
+   * scheduling the task. Typically, the name of task statistics is reused.
+   *
+   * When the interval changes while the task runs with the previous interval,
+   * the task is rescheduled with the new interval right away. A task which
+   * currently runs with a different interval (e.g., a one-time timeout) picks
+   * up the new interval the next time the module schedules it.
+   *
+   * Intervals used other than by a timed task (e.g., send intervals of
+   * telemetry channels) are declared with a function applying the change.
+   */
+  class TaskInterval
+  {
+  public:
+    /// Minimum interval in microseconds which can be set (100ms).
+    static constexpr unsigned long MIN_INTERVAL = 100000UL;
+    /// Maximum interval in microseconds which can be set (30 minutes, so phases stay in range).
+    static constexpr unsigned long MAX_INTERVAL = 1800000000UL;
+
+    /// Iterator over intervals.
+    class iterator
+    {
+    public:
+      TaskInterval& operator*() noexcept { return *cur_; }
+      TaskInterval* operator->() noexcept { return cur_; }
+
+      /// Move to the next interval.
+      iterator& operator++() noexcept { cur_ = cur_->next_; return *this; }
+
+    private:
+      friend class TaskInterval;
+      explicit iterator(TaskInterval* ptr) noexcept : cur_(ptr) {}
+      friend bool operator==(const iterator& l, const iterator& r) noexcept { return l.cur_ == r.cur_; }
+      friend bool operator!=(const iterator& l, const iterator& r) noexcept { return l.cur_ != r.cur_; }
+      TaskInterval* cur_;
+    };
+
+    /// Function applying a changed interval (target, previous interval, new interval).
+    using apply_function = void (*)(void* target, unsigned long prev_interval, unsigned long interval);
+
+    TaskInterval(const TaskInterval&) = delete;
+    TaskInterval& operator=(const TaskInterval&) = delete;
+
+    /*!
+     * @brief Construct a named interval.
+     *
+     * @param name name of the interval (unique).
+     * @param task task running with this interval.
+     * @param interval default interval in microseconds.
+     */
+    TaskInterval(const __FlashStringHelper* name, TimedTaskBase& task, unsigned long interval) noexcept :
+      TaskInterval(name, interval, &applyToTask, &task)
+    {}
+
+    /*!
+     * @brief Construct a named interval not bound to a timed task.
+     *
+     * @param name name of the interval (unique).
+     * @param interval default interval in microseconds.
+     * @param apply function called with @p target when the interval changes.
+     * @param target target of the interval, e.g., the owning module.
+     */
+    TaskInterval(const __FlashStringHelper* name, unsigned long interval, apply_function apply, void* target) noexcept;
+
+    /*!
+     * @brief Construct an interval named after task statistics.
+     *
+     * @param stats statistics of the task, which provide the name.
+     * @param task task running with this interval.
+     * @param interval default interval in microseconds.
+     */
+    TaskInterval(const TaskTimingStats& stats, TimedTaskBase& task, unsigned long interval) noexcept :
+      TaskInterval(stats.getName(), task, interval)
+    {}
+
+    /// Get interval name.
+    const __FlashStringHelper* getName() const noexcept { return name_; }
+
+    /// Get current interval in microseconds.
+    unsigned long get() const noexcept { return interval_; }
+
+    /// Get default interval in microseconds.
+    unsigned long getDefault() const noexcept { return default_; }
+
+    /*!
+     * @brief Set new interval.
+     *
+     * @param interval new interval in microseconds (MIN_INTERVAL..MAX_INTERVAL).
+     * @return @c true, if set, @c false if out of range.
+     */
+    bool set(unsigned long interval) noexcept;
+
+    /// Reset interval to the default.
+    void reset() noexcept { apply(default_); }
+
+    /*!
+     * @brief Find interval by name.
+     *
+     * @param name name to look for.
+     * @return interval or nullptr, if not found.
+     */
+    static TaskInterval* find(const char* name) noexcept;
+
+    /// Get iterator to the first interval.
+    static iterator begin() noexcept { return iterator(s_first_); }
+
+    /// Get iterator past the last interval.
+    static iterator end() noexcept { return iterator(nullptr); }
+
+  private:
+    /// Change interval and apply it to the target.
+    void apply(unsigned long interval) noexcept;
+
+    /// Reschedule the task, if it runs with the previous interval.
+    static void applyToTask(void* task, unsigned long prev_interval, unsigned long interval) noexcept;
+
+    /// Interval name.
+    const __FlashStringHelper* name_;
+    /// Function applying the changed interval to the target.
+    apply_function apply_;
+    /// Target of the interval (e.g., task running with this interval).
+    void* target_;
+    /// Current interval.
+    unsigned long interval_;
+    /// Default interval.
+    unsigned long default_;
+    /// Next registered interval.
+    TaskInterval* next_;
+    /// First registered interval.
+    static TaskInterval* s_first_;
+  };
+}
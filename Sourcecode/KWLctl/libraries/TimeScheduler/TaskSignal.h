@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2018 Ivan Schréter (schreter@gmx.net)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * This copyright notice MUST APPEAR in all copies of the software!
+ */
+
+/*!
+ * @file
+ * @brief Signal to wake up dependent tasks when new data is available.
+ */
+#pragma once
+
+#include "TaskBase.h"
+
+namespace Scheduler
+{
+  class TaskSignal;
+
+  /*!
+   * @brief Connection of a timed task to a signal.
+   *
+   * Declare a listener in the consumer next to its task and connect it
+   * to the signal of the producer in begin(). Each listener can be
+   * connected to one signal, use several listeners to react to several
+   * signals.
+   */
+  class SignalListener
+  {
+  public:
+    SignalListener(const SignalListener&) = delete;
+    SignalListener& operator=(const SignalListener&) = delete;
+
+    /*!
+     * @brief Construct a listener.
+     *
+     * @param task task to trigger when the signal is notified.
+     * @param delay delay after notification in microseconds (0 to run
+     *    in the next scheduler loop).
+     */
+    explicit SignalListener(TimedTaskBase& task, unsigned long delay = 0) noexcept :
+      task_(task), delay_(delay)
+    {}
+
+    /// Connect the listener to a signal (only once).
+    void connect(const TaskSignal& signal) noexcept;
+
+  private:
+    friend class TaskSignal;
+
+    /// Task to trigger.
+    TimedTaskBase& task_;
+    /// Delay after notification.
+    unsigned long delay_;
+    /// Next listener of the same signal.
+    SignalListener* next_ = nullptr;
+  };
+
+  /*!
+   * @brief Signal to wake up dependent tasks when new data is available.
+   *
+   * The producer owns the signal and calls notify() when it produced new
+   * data. All connected tasks are triggered (see TimedTaskBase::trigger()),
+   * so they react in the next scheduler loop instead of waiting for their
+   * next periodic run. The consumers don't need to poll in short intervals.
+   *
+   * Connecting a listener doesn't change the state of the producer, so
+   * a const producer can hand out its signal.
+   *
+   * @note Don't call notify() from an interrupt routine.
+   */
+  class TaskSignal
+  {
+  public:
+    TaskSignal() noexcept = default;
+    TaskSignal(const TaskSignal&) = delete;
+    TaskSignal& operator=(const TaskSignal&) = delete;
+
+    /// Trigger all connected tasks.
+    void notify() noexcept;
+
+    /// Get count of notifications since start.
+    unsigned long getNotifyCount() const noexcept { return notify_count_; }
+
+  private:
+    friend class SignalListener;
+
+    /// First connected listener.
+    mutable SignalListener* first_ = nullptr;
+    /// Count of notifications.
+    unsigned long notify_count_ = 0;
+  };
+}
@@ -21,13 +21,243 @@
 
 #include <avr/pgmspace.h>
 #include <stdio.h>
+#include <string.h>
 
 using namespace Scheduler;
 
+void TimingHistogram::add(unsigned long value) noexcept
+{
+#if SCHEDULER_HISTOGRAM_BUCKETS > 0
+  value >>= SCHEDULER_HISTOGRAM_SHIFT;
+  unsigned char bucket = 0;
+  while (value && bucket < BUCKETS - 1) {
+    value >>= 1;
+    ++bucket;
+  }
+  if (count_[bucket] == 0xffffU) {
+    // overflow on counter, cut all in half (but keep rare values visible)
+    for (unsigned char i = 0; i < BUCKETS; ++i)
+      count_[i] = (count_[i] + 1U) >> 1;
+  }
+  ++count_[bucket];
+#else
+  (void) value;
+#endif
+}
+
+void TimingHistogram::reset() noexcept
+{
+#if SCHEDULER_HISTOGRAM_BUCKETS > 0
+  for (unsigned char i = 0; i < BUCKETS; ++i)
+    count_[i] = 0;
+#endif
+}
+
+unsigned long TimingHistogram::getPercentile(unsigned char percent, unsigned long max) const noexcept
+{
+#if SCHEDULER_HISTOGRAM_BUCKETS > 0
+  unsigned long total = 0;
+  for (unsigned char i = 0; i < BUCKETS; ++i)
+    total += count_[i];
+  if (!total)
+    return 0;
+  // find bucket containing the percentile
+  unsigned long rank = (total * percent + 99) / 100;
+  unsigned long sum = 0;
+  for (unsigned char i = 0; i < BUCKETS - 1; ++i) {
+    sum += count_[i];
+    if (sum >= rank) {
+      auto limit = getBucketLimit(i);
+      return limit < max ? limit : max;
+    }
+  }
+#else
+  (void) percent;
+#endif
+  return max;
+}
+
+void TimingHistogram::toString(char* buffer, unsigned size) const noexcept
+{
+  if (!size)
+    return;
+  *buffer = 0;
+#if SCHEDULER_HISTOGRAM_BUCKETS > 0
+  auto len = snprintf_P(buffer, size, PSTR("base %lu hist"), getBucketLimit(0));
+  for (unsigned char i = 0; i < BUCKETS && len > 0 && unsigned(len) < size; ++i)
+    len += snprintf_P(buffer + len, size - unsigned(len), i ? PSTR(",%u") : PSTR(" %u"), count_[i]);
+#endif
+}
+
+unsigned char RecentStats::s_epoch_ = 0;
+unsigned char RecentStats::s_seconds_ = 0;
+
+void RecentStats::add(unsigned long value) noexcept
+{
+  if (value > MAX_VALUE)
+    value = MAX_VALUE;
+
+  if (epoch_ != s_epoch_)
+    rotate();
+  if (value > max_)
+    max_ = value;
+
+  // Welford-style update, first with 1/n until there are enough samples
+  const long delta = long(value << SCHEDULER_EMA_SHIFT) - long(mean_);
+  // deviation in units of 2^SCHEDULER_EMA_SHIFT, capped so the square fits in 32 bits
+  unsigned long dev = ((delta < 0 ? 0UL - delta : delta) + (1UL << (2 * SCHEDULER_EMA_SHIFT) >> 1))
+      >> (2 * SCHEDULER_EMA_SHIFT);
+  if (dev > MAX_DEVIATION)
+    dev = MAX_DEVIATION;
+  unsigned char n = SAMPLES;
+  if (count_ < SAMPLES)
+    n = ++count_;
+  mean_ += delta / n;
+  // variance stays below the maximum square, so it cannot overflow
+  auto var = variance_ + dev * dev / n;
+  variance_ = var - var / n;
+}
+
+unsigned long RecentStats::getStdDev() const noexcept
+{
+  // integer square root, bit by bit, then back to units of measurement
+  unsigned long value = variance_, result = 0, bit = 1UL << 30;
+  while (bit > value)
+    bit >>= 2;
+  while (bit) {
+    if (value >= result + bit) {
+      value -= result + bit;
+      result = (result >> 1) + bit;
+    } else {
+      result >>= 1;
+    }
+    bit >>= 2;
+  }
+  return result << SCHEDULER_EMA_SHIFT;
+}
+
+unsigned long RecentStats::getRecentMax() const noexcept
+{
+  switch (static_cast<unsigned char>(s_epoch_ - epoch_)) {
+    case 0:
+      return max_ > prev_max_ ? max_ : prev_max_;
+    case 1:
+      return max_;
+    default:
+      return 0;
+  }
+}
+
+void RecentStats::rotate() noexcept
+{
+  prev_max_ = static_cast<unsigned char>(s_epoch_ - epoch_) == 1 ? max_ : 0;
+  max_ = 0;
+  epoch_ = s_epoch_;
+}
+
+void RecentStats::tick(unsigned long seconds) noexcept
+{
+  seconds += s_seconds_;
+  if (seconds >= SCHEDULER_RECENT_WINDOW) {
+    // after two windows, all maxima are outdated anyway
+    s_epoch_ += seconds >= 2 * SCHEDULER_RECENT_WINDOW ? 2 : 1;
+    seconds %= SCHEDULER_RECENT_WINDOW;
+  }
+  s_seconds_ = static_cast<unsigned char>(seconds);
+}
+
+const __FlashStringHelper* TaskBudget::s_last_name_ = nullptr;
+unsigned long TaskBudget::s_last_runtime_ = 0;
+const __FlashStringHelper* TaskBudget::s_alarm_name_ = nullptr;
+unsigned long TaskBudget::s_alarm_runtime_ = 0;
+unsigned long TaskBudget::s_alarm_budget_ = 0;
+unsigned TaskBudget::s_alarm_overruns_ = 0;
+unsigned TaskBudget::s_alarm_count_ = 0;
+unsigned char TaskBudget::s_active_alarms_ = 0;
+
+void TaskBudget::overrun(const __FlashStringHelper* name, unsigned long runtime) noexcept
+{
+  ++overruns_;
+  s_last_name_ = name;
+  s_last_runtime_ = runtime;
+  if (score_ < ALARM_SCORE)
+    score_ += ALARM_STEP;
+  if (score_ >= ALARM_SCORE && !alarmed_) {
+    alarmed_ = true;
+    s_alarm_name_ = name;
+    s_alarm_runtime_ = runtime;
+    s_alarm_budget_ = budget_;
+    s_alarm_overruns_ = overruns_;
+    ++s_alarm_count_;
+    ++s_active_alarms_;
+  }
+}
+
+void TaskBudget::alarmToString(char* buffer, unsigned size) noexcept
+{
+  if (!size)
+    return;
+  *buffer = 0;
+  if (!s_alarm_name_)
+    return;
+  strlcpy_P(buffer, reinterpret_cast<const char*>(s_alarm_name_), size);
+  auto len = strlen(buffer);
+  snprintf_P(buffer + len, size - len, PSTR(" runtime %lu budget %lu overruns %u"),
+    s_alarm_runtime_, s_alarm_budget_, s_alarm_overruns_);
+}
+
+void TaskBudget::reset() noexcept
+{
+  s_last_name_ = s_alarm_name_ = nullptr;
+  s_last_runtime_ = 0;
+}
+
+namespace
+{
+  /// Append budget and overrun count to the statistics string, if a budget is set.
+  void budgetToString(const TaskBudget& budget, char* buffer, unsigned size) noexcept
+  {
+    if (!budget.get())
+      return;
+    auto len = strlen(buffer);
+    if (len + 1 < size)
+      snprintf_P(buffer + len, size - len, PSTR(" bud %lu ovr %u"), budget.get(), budget.getOverrunCount());
+  }
+}
+
 TaskTimingStats* TaskTimingStats::s_first_stat_ = nullptr;
 
-TaskTimingStats::TaskTimingStats(const __FlashStringHelper* name) noexcept :
+void LatenessStats::add(unsigned long lateness) noexcept
+{
+  if (lateness > max_)
+    max_ = lateness;
+  histogram_.add(lateness);
+  recent_.add(lateness);
+  ++count_;
+}
+
+void LatenessStats::toString(char* buffer, unsigned size) const noexcept
+{
+  auto FORMAT = PSTR("lmax %lu lwmax %lu lavg %lu lsd %lu lcnt %lu lp50 %lu lp90 %lu lp99 %lu ");
+  auto len = snprintf_P(buffer, size, FORMAT,
+    max_, getRecentMax(), getAvg(), getStdDev(), count_,
+    getPercentile(50), getPercentile(90), getPercentile(99));
+  if (len > 0 && unsigned(len) < size)
+    histogram_.toString(buffer + len, size - unsigned(len));
+}
+
+void LatenessStats::resetMaximum() noexcept
+{
+  max_ = 0;
+  histogram_.reset();
+}
+
+TaskTimingStats::TaskTimingStats(const __FlashStringHelper* name, unsigned long budget,
+    TimingHistogram* histogram, LatenessStats* lateness) noexcept :
   name_(name),
+  histogram_(histogram),
+  lateness_(lateness),
+  budget_(budget),
   next_(s_first_stat_)
 {
   s_first_stat_ = this;
@@ -37,26 +267,13 @@ void TaskTimingStats::addRuntime(unsigned long runtime) noexcept
 {
   if (runtime > max_runtime_)
     max_runtime_ = runtime;
-  auto sum = sum_runtime_ + runtime;
-  if (sum < sum_runtime_) {
-    // overflow on sum of runtimes, cut in half
-    sum_runtime_ >>= 1;
-    // compute # of "eaten" measurements
-    adjust_count_runtime_ += (count_runtime_ - adjust_count_runtime_) >> 1;
-  }
-  sum_runtime_ += runtime;
+  if (histogram_)
+    histogram_->add(runtime);
+  runtime_.add(runtime);
+  budget_.check(name_, runtime);
   ++count_runtime_;
 }
 
-unsigned long TaskTimingStats::getAvgRuntime() const noexcept
-{
-  unsigned long count = (count_runtime_ - adjust_count_runtime_);
-  if (count)
-    return sum_runtime_ / count;
-  else
-    return 0;
-}
-
 unsigned long TaskTimingStats::getMaxRuntimeSinceStart() const noexcept
 {
   return max_runtime_ > max_runtime_since_start_ ? max_runtime_ : max_runtime_since_start_;
@@ -64,22 +281,177 @@ unsigned long TaskTimingStats::getMaxRuntimeSinceStart() const noexcept
 
 void TaskTimingStats::toString(char* buffer, unsigned size) const noexcept
 {
-  auto FORMAT = PSTR("max %lu smax %lu avg %lu cnt %lu adj %lu");
-  snprintf_P(buffer, size, FORMAT,
-    max_runtime_, getMaxRuntimeSinceStart(), getAvgRuntime(),
-    count_runtime_, adjust_count_runtime_);
+  auto FORMAT = PSTR("max %lu smax %lu wmax %lu avg %lu sd %lu cnt %lu");
+  auto len = snprintf_P(buffer, size, FORMAT,
+    max_runtime_, getMaxRuntimeSinceStart(), getRecentMaxRuntime(),
+    getAvgRuntime(), getRuntimeStdDev(), count_runtime_);
+#if SCHEDULER_HISTOGRAM_BUCKETS > 0
+  if (histogram_ && len > 0 && unsigned(len) < size) {
+    snprintf_P(buffer + len, size - unsigned(len), PSTR(" p50 %lu p90 %lu p99 %lu"),
+      getRuntimePercentile(50), getRuntimePercentile(90), getRuntimePercentile(99));
+  }
+#else
+  (void) len;
+#endif
+  budgetToString(budget_, buffer, size);
+}
+
+void TaskTimingStats::addLateness(unsigned long schedule_time, unsigned long start_time) noexcept
+{
+  auto lateness = start_time - schedule_time;
+  if (long(lateness) < 0)
+    lateness = 0; // started early, which can happen for tasks scheduled outside of the loop
+  LatenessAttribution::addLateness(name_, schedule_time, lateness);
+  if (lateness_)
+    lateness_->add(lateness);
 }
 
 void TaskTimingStats::resetMaximum() noexcept
 {
   max_runtime_since_start_ = getMaxRuntimeSinceStart();
   max_runtime_ = 0;
+  if (histogram_)
+    histogram_->reset();
+  if (lateness_)
+    lateness_->resetMaximum();
+}
+
+const __FlashStringHelper* LatenessAttribution::s_run_name_[HISTORY_SIZE];
+unsigned long LatenessAttribution::s_run_start_[HISTORY_SIZE];
+unsigned long LatenessAttribution::s_run_end_[HISTORY_SIZE];
+unsigned char LatenessAttribution::s_run_index_ = 0;
+unsigned long LatenessAttribution::s_max_lateness_ = 0;
+const __FlashStringHelper* LatenessAttribution::s_late_task_ = nullptr;
+const __FlashStringHelper* LatenessAttribution::s_blocking_task_ = nullptr;
+
+void LatenessAttribution::addRun(const __FlashStringHelper* name, unsigned long start, unsigned long end) noexcept
+{
+  auto index = s_run_index_;
+  s_run_name_[index] = name;
+  s_run_start_[index] = start;
+  s_run_end_[index] = end;
+  s_run_index_ = (index + 1) % HISTORY_SIZE;
+}
+
+void LatenessAttribution::addLateness(const __FlashStringHelper* name, unsigned long schedule_time, unsigned long lateness) noexcept
+{
+  if (lateness <= s_max_lateness_)
+    return;
+  s_max_lateness_ = lateness;
+  s_late_task_ = name;
+  s_blocking_task_ = nullptr;
+  // find the run during which the task should have started, newest first
+  auto index = s_run_index_;
+  for (unsigned char i = 0; i < HISTORY_SIZE; ++i) {
+    index = (index + HISTORY_SIZE - 1) % HISTORY_SIZE;
+    if (long(schedule_time - s_run_start_[index]) >= 0 && long(schedule_time - s_run_end_[index]) < 0) {
+      s_blocking_task_ = s_run_name_[index];
+      if (!s_blocking_task_)
+        s_blocking_task_ = reinterpret_cast<const __FlashStringHelper*>(PSTR("(unaccounted)"));
+      break;
+    }
+  }
+}
+
+void LatenessAttribution::toString(char* buffer, unsigned size) noexcept
+{
+  auto len = snprintf_P(buffer, size, PSTR("late %lu task "), s_max_lateness_);
+  if (len <= 0 || unsigned(len) >= size)
+    return;
+  if (s_late_task_)
+    strlcpy_P(buffer + len, reinterpret_cast<const char*>(s_late_task_), size - unsigned(len));
+  else
+    buffer[len] = 0;
+  strlcat_P(buffer, PSTR(" blocker "), size);
+  strlcat_P(buffer, s_blocking_task_ ? reinterpret_cast<const char*>(s_blocking_task_) : PSTR("-"), size);
+}
+
+void LatenessAttribution::reset() noexcept
+{
+  s_max_lateness_ = 0;
+  s_late_task_ = s_blocking_task_ = nullptr;
+}
+
+unsigned long LoadStatistics::s_window_start_ = 0;
+unsigned long LoadStatistics::s_busy_ = 0;
+unsigned long LoadStatistics::s_poll_ = 0;
+unsigned long LoadStatistics::s_sleep_ = 0;
+unsigned long LoadStatistics::s_loops_ = 0;
+unsigned LoadStatistics::s_load_ = 0;
+unsigned LoadStatistics::s_poll_load_ = 0;
+unsigned LoadStatistics::s_sleep_load_ = 0;
+unsigned long LoadStatistics::s_loops_per_second_ = 0;
+long LoadStatistics::s_avg_1m_ = -1;
+long LoadStatistics::s_avg_15m_ = -1;
+
+void LoadStatistics::update(unsigned long end) noexcept
+{
+  // Decay factors per one second for 1 and 15 minute averages, i.e.,
+  // (1 - exp(-1s/60s)) and (1 - exp(-1s/900s)) scaled by 65536.
+  static constexpr long DECAY_1M = 1083;
+  static constexpr long DECAY_15M = 73;
+  // Limit for catching up after long pauses (deep sleep), 15 minutes.
+  static constexpr unsigned MAX_CATCH_UP = 900;
+
+  const auto elapsed = end - s_window_start_;
+  const auto elapsed_ms = elapsed / 1000;
+  if (s_busy_ > elapsed)
+    s_busy_ = elapsed;
+  if (s_poll_ > s_busy_)
+    s_poll_ = s_busy_;
+  s_load_ = unsigned(s_busy_ / elapsed_ms);
+  if (s_load_ > 1000)
+    s_load_ = 1000;
+  s_poll_load_ = unsigned(s_poll_ / elapsed_ms);
+  if (s_poll_load_ > s_load_)
+    s_poll_load_ = s_load_;
+  s_sleep_load_ = unsigned(s_sleep_ / elapsed_ms);
+  if (s_sleep_load_ > getIdle())
+    s_sleep_load_ = getIdle();
+  s_loops_per_second_ = (s_loops_ * 1000 + elapsed_ms / 2) / elapsed_ms;
+
+  const long sample = long(s_load_) << FIXED_SHIFT;
+  if (s_avg_1m_ < 0) {
+    // first window, start averages with the current load
+    s_avg_1m_ = s_avg_15m_ = sample;
+  } else {
+    // fold in the sample once per elapsed second
+    auto seconds = elapsed / WINDOW;
+    if (seconds > MAX_CATCH_UP)
+      seconds = MAX_CATCH_UP;
+    while (seconds--) {
+      s_avg_1m_ += (sample - s_avg_1m_) * DECAY_1M / 65536L;
+      s_avg_15m_ += (sample - s_avg_15m_) * DECAY_15M / 65536L;
+    }
+  }
+
+  s_window_start_ = end;
+  s_busy_ = s_poll_ = s_sleep_ = s_loops_ = 0;
+
+  RecentStats::tick(elapsed / WINDOW);
+}
+
+void LoadStatistics::toString(char* buffer, unsigned size) noexcept
+{
+  const auto load1m = getLoad1m(), load15m = getLoad15m(), idle = getIdle();
+  snprintf_P(buffer, size, PSTR("load %u.%u 1m %u.%u 15m %u.%u poll %u.%u idle %u.%u sleep %u.%u loops %lu"),
+    s_load_ / 10, s_load_ % 10, load1m / 10, load1m % 10, load15m / 10, load15m % 10,
+    s_poll_load_ / 10, s_poll_load_ % 10, idle / 10, idle % 10,
+    s_sleep_load_ / 10, s_sleep_load_ % 10, s_loops_per_second_);
+}
+
+void LoadStatistics::averagesToString(char* buffer, unsigned size) noexcept
+{
+  const auto load1m = getLoad1m(), load15m = getLoad15m();
+  snprintf_P(buffer, size, PSTR("%u.%u %u.%u %u.%u"),
+    s_load_ / 10, s_load_ % 10, load1m / 10, load1m % 10, load15m / 10, load15m % 10);
 }
 
 TaskPollingStats* TaskPollingStats::s_first_stat_ = nullptr;
 
-TaskPollingStats::TaskPollingStats(const __FlashStringHelper* name) noexcept :
+TaskPollingStats::TaskPollingStats(const __FlashStringHelper* name, unsigned long budget) noexcept :
   name_(name),
+  budget_(budget),
   next_(s_first_stat_)
 {
   s_first_stat_ = this;
@@ -89,24 +461,17 @@ void TaskPollingStats::addPolltime(unsigned long polltime) noexcept
 {
   if (polltime > max_polltime_)
     max_polltime_ = polltime;
-  auto sum = sum_polltime_ + polltime;
-  if (sum < sum_polltime_) {
-    // overflow on sum of polltimes, cut in half
-    sum_polltime_ >>= 1;
-    count_polltime_ >>= 1;
-  }
-  sum_polltime_ += polltime;
-  if (++count_polltime_ == 0) {
-    sum_polltime_ >>= 1;
-    count_polltime_ = 0x8000U;
-  }
+  histogram_.add(polltime);
+  polltime_.add(polltime);
+  budget_.check(name_, polltime);
+  ++poll_count_;
 }
 
-unsigned long TaskPollingStats::getAvgPolltime() const noexcept {
-  if (count_polltime_)
-    return sum_polltime_ / count_polltime_;
-  else
-    return 0;
+void TaskPollingStats::addReaction(unsigned long latency) noexcept
+{
+  if (latency > max_reaction_)
+    max_reaction_ = latency;
+  reaction_.add(latency);
 }
 
 unsigned long TaskPollingStats::getMaxPolltimeSinceStart() const noexcept
@@ -116,13 +481,27 @@ unsigned long TaskPollingStats::getMaxPolltimeSinceStart() const noexcept
 
 void TaskPollingStats::toString(char* buffer, unsigned size) const noexcept
 {
-  auto FORMAT = PSTR("pmax %lu spmax %lu pavg %lu");
-  snprintf_P(buffer, size, FORMAT,
-    max_polltime_, getMaxPolltimeSinceStart(), getAvgPolltime());
+#if SCHEDULER_HISTOGRAM_BUCKETS > 0
+  auto FORMAT = PSTR("pmax %lu spmax %lu pwmax %lu pavg %lu psd %lu pp50 %lu pp90 %lu pp99 %lu ");
+  auto len = snprintf_P(buffer, size, FORMAT,
+    max_polltime_, getMaxPolltimeSinceStart(), getRecentMaxPolltime(), getAvgPolltime(), getPolltimeStdDev(),
+    getPolltimePercentile(50), getPolltimePercentile(90), getPolltimePercentile(99));
+#else
+  auto FORMAT = PSTR("pmax %lu spmax %lu pwmax %lu pavg %lu psd %lu ");
+  auto len = snprintf_P(buffer, size, FORMAT,
+    max_polltime_, getMaxPolltimeSinceStart(), getRecentMaxPolltime(), getAvgPolltime(), getPolltimeStdDev());
+#endif
+  if (len > 0 && unsigned(len) < size) {
+    snprintf_P(buffer + len, size - unsigned(len), PSTR("polls %lu skip %lu rmax %lu ravg %lu"),
+      poll_count_, skip_count_, max_reaction_, getAvgReaction());
+  }
+  budgetToString(budget_, buffer, size);
 }
 
 void TaskPollingStats::resetMaximum() noexcept
 {
   max_polltime_since_start_ = getMaxPolltimeSinceStart();
   max_polltime_ = 0;
+  max_reaction_ = 0;
+  histogram_.reset();
 }
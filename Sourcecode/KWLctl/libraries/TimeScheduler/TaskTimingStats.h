@@ -25,17 +25,345 @@
 
 class __FlashStringHelper;
 
+/*
+ * NOTE: Statistics of individual tasks keep a histogram of measurements in
+ * buckets of exponentially growing size to estimate percentiles (aggregates
+ * don't). Each bucket costs 2B of RAM per histogram. Define these macros in
+ * build flags to change the number of buckets (0 turns histograms off) and
+ * the upper limit of the first bucket (as power of 2, in microseconds).
+ */
+#ifndef SCHEDULER_HISTOGRAM_BUCKETS
+#define SCHEDULER_HISTOGRAM_BUCKETS 12
+#endif
+#ifndef SCHEDULER_HISTOGRAM_SHIFT
+#define SCHEDULER_HISTOGRAM_SHIFT 7
+#endif
+
+/*
+ * NOTE: Averages are exponentially-weighted with smoothing factor
+ * 1/2^SCHEDULER_EMA_SHIFT, i.e., they follow roughly the last
+ * 2^SCHEDULER_EMA_SHIFT measurements. Recent maximum covers the last one to
+ * two windows of SCHEDULER_RECENT_WINDOW seconds.
+ */
+#ifndef SCHEDULER_EMA_SHIFT
+#define SCHEDULER_EMA_SHIFT 4
+#endif
+#ifndef SCHEDULER_RECENT_WINDOW
+#define SCHEDULER_RECENT_WINDOW 60
+#endif
+
 namespace Scheduler
 {
+  /*!
+   * @brief Histogram of timing measurements with log2-sized buckets.
+   *
+   * Bucket 0 counts values below 2^SCHEDULER_HISTOGRAM_SHIFT, each following
+   * bucket covers values up to double the limit of the previous one and the
+   * last bucket counts all larger values. When a bucket counter would overflow,
+   * all counters are halved, so the distribution is retained.
+   */
+  class TimingHistogram
+  {
+  public:
+    /// Count of buckets in the histogram.
+    static constexpr unsigned char BUCKETS = SCHEDULER_HISTOGRAM_BUCKETS;
+
+    TimingHistogram() noexcept { reset(); }
+
+    /// Add one measurement.
+    void add(unsigned long value) noexcept;
+
+    /// Reset all counters.
+    void reset() noexcept;
+
+    /*!
+     * @brief Estimate percentile of measurements.
+     *
+     * @param percent percentile to compute (1-100).
+     * @param max maximum measured value to limit the estimate.
+     * @return upper limit of the bucket containing the percentile, at most max.
+     */
+    unsigned long getPercentile(unsigned char percent, unsigned long max) const noexcept;
+
+    /// Get upper limit (exclusive) of a bucket.
+    static unsigned long getBucketLimit(unsigned char bucket) noexcept {
+      return 1UL << (bucket + SCHEDULER_HISTOGRAM_SHIFT);
+    }
+
+    /// Get counter of a bucket.
+    unsigned getBucketCount(unsigned char bucket) const noexcept {
+  #if SCHEDULER_HISTOGRAM_BUCKETS > 0
+      return count_[bucket];
+  #else
+      return (void)bucket, 0;
+  #endif
+    }
+
+    /*!
+     * @brief Serialize histogram to a buffer.
+     *
+     * @param buffer,size buffer where to materialize the string (should be >=100B).
+     */
+    void toString(char* buffer, unsigned size) const noexcept;
+
+  private:
+  #if SCHEDULER_HISTOGRAM_BUCKETS > 0
+    /// Counters for each bucket.
+    unsigned count_[SCHEDULER_HISTOGRAM_BUCKETS];
+  #endif
+  };
+
+  /*!
+   * @brief Streaming statistics of recent measurements.
+   *
+   * Mean and variance are exponentially-weighted moving averages with
+   * smoothing factor 1/2^SCHEDULER_EMA_SHIFT, updated incrementally in the
+   * manner of Welford's algorithm. Until the first 2^SCHEDULER_EMA_SHIFT
+   * measurements are in, the smoothing factor is 1/n, so the first values
+   * produce plain average and variance instead of slowly rising from zero.
+   *
+   * Mean is kept in fixed point with SCHEDULER_EMA_SHIFT fractional bits,
+   * updates use only shifts, additions and one 16x16 bit multiplication.
+   * Variance is kept in units of 2^(2*SCHEDULER_EMA_SHIFT), i.e., standard
+   * deviation has a resolution of 2^SCHEDULER_EMA_SHIFT (16us by default)
+   * and single deviations are capped at 2^(16+SCHEDULER_EMA_SHIFT) (~1s).
+   * Measurements are limited to 2^(31-SCHEDULER_EMA_SHIFT).
+   *
+   * Additionally, maximum of the current and of the previous time window is
+   * kept. Windows are switched globally by tick() called once per second.
+   */
+  class RecentStats
+  {
+  public:
+    /// Largest measurement which can be recorded, larger ones are capped.
+    static constexpr unsigned long MAX_VALUE = (1UL << (31 - SCHEDULER_EMA_SHIFT)) - 1;
+
+    /// Add one measurement.
+    void add(unsigned long value) noexcept;
+
+    /// Get exponentially-weighted average.
+    unsigned long getAvg() const noexcept {
+      return (mean_ + (1UL << SCHEDULER_EMA_SHIFT >> 1)) >> SCHEDULER_EMA_SHIFT;
+    }
+
+    /// Get exponentially-weighted variance in units of 2^(2*SCHEDULER_EMA_SHIFT).
+    unsigned long getVariance() const noexcept { return variance_; }
+
+    /// Get exponentially-weighted standard deviation.
+    unsigned long getStdDev() const noexcept;
+
+    /// Get maximum in the last one to two windows.
+    unsigned long getRecentMax() const noexcept;
+
+    /*!
+     * @brief Advance time to switch windows of recent maximum.
+     *
+     * Called by LoadStatistics once per measurement window.
+     *
+     * @param seconds count of seconds elapsed since last call.
+     */
+    static void tick(unsigned long seconds) noexcept;
+
+  private:
+    /// Smoothing factor as a count of measurements.
+    static constexpr unsigned char SAMPLES = 1U << SCHEDULER_EMA_SHIFT;
+
+    /// Largest deviation in units of 2^SCHEDULER_EMA_SHIFT accounted in variance.
+    static constexpr unsigned long MAX_DEVIATION = 0xffffUL;
+
+    /// Drop maximum of old windows, if the window switched since last update.
+    void rotate() noexcept;
+
+    /// Average in fixed point with SCHEDULER_EMA_SHIFT fractional bits.
+    unsigned long mean_ = 0;
+    /// Variance in units of 2^(2*SCHEDULER_EMA_SHIFT).
+    unsigned long variance_ = 0;
+    /// Maximum in window epoch_.
+    unsigned long max_ = 0;
+    /// Maximum in window epoch_ - 1.
+    unsigned long prev_max_ = 0;
+    /// Count of measurements until SAMPLES.
+    unsigned char count_ = 0;
+    /// Window of max_.
+    unsigned char epoch_ = 0;
+    /// Current window.
+    static unsigned char s_epoch_;
+    /// Seconds elapsed in the current window.
+    static unsigned char s_seconds_;
+  };
+
+  /*!
+   * @brief Execution budget of a task with overrun accounting.
+   *
+   * A run taking longer than the budget is an overrun. Each overrun raises
+   * an alarm score by ALARM_STEP, each run within the budget lowers it by one.
+   * When the score reaches ALARM_SCORE, i.e., after 3 overruns in a row or
+   * with overruns in more than ~20% of runs, an alarm is raised. The alarm
+   * times out when the score dropped to 0 again, only then further alarms
+   * for the task are raised.
+   *
+   * The last overrun and the last alarm of all tasks are kept globally, so
+   * the application can report them.
+   */
+  class TaskBudget
+  {
+  public:
+    /// Increment of the alarm score per overrun.
+    static constexpr unsigned char ALARM_STEP = 4;
+    /// Alarm score at which to raise an alarm.
+    static constexpr unsigned char ALARM_SCORE = 3 * ALARM_STEP;
+
+    /// Construct budget (0 for no budget).
+    explicit TaskBudget(unsigned long budget = 0) noexcept : budget_(budget) {}
+
+    /// Set budget in microseconds (0 for no budget).
+    void set(unsigned long budget) noexcept { budget_ = budget; }
+
+    /// Get budget in microseconds (0 for no budget).
+    unsigned long get() const noexcept { return budget_; }
+
+    /// Get count of overruns.
+    unsigned getOverrunCount() const noexcept { return overruns_; }
+
+    /*!
+     * @brief Check one run against the budget.
+     *
+     * @param name name of the task.
+     * @param runtime runtime of the task in microseconds.
+     */
+    void check(const __FlashStringHelper* name, unsigned long runtime) noexcept {
+      if (runtime > budget_ && budget_)
+        overrun(name, runtime);
+      else if (score_ && --score_ == 0 && alarmed_) {
+        alarmed_ = false;
+        --s_active_alarms_;
+      }
+    }
+
+    /// Get name of the task which overran its budget last (nullptr if none).
+    static const __FlashStringHelper* getLastOverrunName() noexcept { return s_last_name_; }
+
+    /// Get runtime of the last overrun.
+    static unsigned long getLastOverrunTime() noexcept { return s_last_runtime_; }
+
+    /// Get name of the task which raised the last alarm (nullptr if none).
+    static const __FlashStringHelper* getAlarmName() noexcept { return s_alarm_name_; }
+
+    /// Get count of alarms raised since start, to detect new alarms.
+    static unsigned getAlarmCount() noexcept { return s_alarm_count_; }
+
+    /// Check whether an alarm is active, i.e., it didn't time out and wasn't reset.
+    static bool isAlarmActive() noexcept { return s_active_alarms_ && s_alarm_name_; }
+
+    /*!
+     * @brief Serialize the last alarm to a buffer.
+     *
+     * @param buffer,size buffer where to materialize the string (should be >=80B).
+     */
+    static void alarmToString(char* buffer, unsigned size) noexcept;
+
+    /// Reset last overrun and last alarm.
+    static void reset() noexcept;
+
+  private:
+    /// Account for an overrun and raise an alarm, if needed.
+    void overrun(const __FlashStringHelper* name, unsigned long runtime) noexcept;
+
+    /// Budget in microseconds.
+    unsigned long budget_;
+    /// Count of overruns.
+    unsigned overruns_ = 0;
+    /// Alarm score.
+    unsigned char score_ = 0;
+    /// Set when alarm was raised, until the score drops to 0.
+    bool alarmed_ = false;
+    /// Name of the task which overran its budget last.
+    static const __FlashStringHelper* s_last_name_;
+    /// Runtime of the last overrun.
+    static unsigned long s_last_runtime_;
+    /// Name of the task which raised the last alarm.
+    static const __FlashStringHelper* s_alarm_name_;
+    /// Runtime of the overrun which raised the last alarm.
+    static unsigned long s_alarm_runtime_;
+    /// Budget of the task which raised the last alarm.
+    static unsigned long s_alarm_budget_;
+    /// Overrun count of the task which raised the last alarm.
+    static unsigned s_alarm_overruns_;
+    /// Count of alarms.
+    static unsigned s_alarm_count_;
+    /// Count of tasks with alarm which didn't time out yet.
+    static unsigned char s_active_alarms_;
+  };
+
+  /*!
+   * @brief Statistics of scheduling lateness of a timed task.
+   *
+   * Lateness is the delay between the time at which the task was scheduled
+   * and the time at which it actually started.
+   */
+  class LatenessStats
+  {
+  public:
+    /// Add one lateness measurement.
+    void add(unsigned long lateness) noexcept;
+
+    /// Get maximum recorded lateness since last reset of maximum.
+    unsigned long getMax() const noexcept { return max_; }
+
+    /// Get exponentially-weighted average lateness.
+    unsigned long getAvg() const noexcept { return recent_.getAvg(); }
+
+    /// Get exponentially-weighted standard deviation of lateness.
+    unsigned long getStdDev() const noexcept { return recent_.getStdDev(); }
+
+    /// Get maximum lateness in the last one to two windows.
+    unsigned long getRecentMax() const noexcept { return recent_.getRecentMax(); }
+
+    /// Get count of lateness measurements.
+    unsigned long getCount() const noexcept { return count_; }
+
+    /// Get estimated lateness percentile since last reset of maximum.
+    unsigned long getPercentile(unsigned char percent) const noexcept {
+      return histogram_.getPercentile(percent, max_);
+    }
+
+    /// Get lateness histogram since last reset of maximum.
+    const TimingHistogram& getHistogram() const noexcept { return histogram_; }
+
+    /*!
+     * @brief Serialize lateness statistics and histogram to a buffer.
+     *
+     * @param buffer,size buffer where to materialize the string (should be >=160B).
+     */
+    void toString(char* buffer, unsigned size) const noexcept;
+
+    /// Reset maximum and histogram.
+    void resetMaximum() noexcept;
+
+  private:
+    /// Histogram of lateness since last reset of maximum.
+    TimingHistogram histogram_;
+    /// Maximum lateness in microseconds.
+    unsigned long max_ = 0;
+    /// Recent lateness in microseconds.
+    RecentStats recent_;
+    /// Count of lateness measurements.
+    unsigned long count_ = 0;
+  };
+
   /*!
    * @brief Statistics for timing operation duration.
    *
    * Typically, measurements are in microseconds, but the unit is not
    * important for the purpose of the statistics.
    *
-   * The implementation accounts for numeric overflows and consolidates
-   * sum and count appropriately, so a reliable average can be built over
-   * time.
+   * Averages and standard deviation are exponentially-weighted, so they
+   * reflect recent behavior and don't suffer from numeric overflows over
+   * long uptime (see RecentStats).
+   *
+   * This class doesn't keep a histogram nor lateness, so it's suitable for
+   * aggregates. Use TaskHistogramStats for individual tasks to get percentiles
+   * and TimedTaskStats for periodic timed tasks to get lateness as well.
    */
   class TaskTimingStats
   {
@@ -58,12 +386,25 @@ namespace Scheduler
       TaskTimingStats* cur_;
     };
 
-    /// Construct stats for a given task name.
-    explicit TaskTimingStats(const __FlashStringHelper* name) noexcept;
+    /*!
+     * @brief Construct stats for a given task name.
+     *
+     * @param name task name.
+     * @param budget execution budget of one run in microseconds (0 for none).
+     */
+    explicit TaskTimingStats(const __FlashStringHelper* name, unsigned long budget = 0) noexcept :
+      TaskTimingStats(name, budget, nullptr)
+    {}
 
     /// Get statistics name.
     const __FlashStringHelper* getName() const noexcept { return name_; }
 
+    /// Get execution budget.
+    TaskBudget& getBudget() noexcept { return budget_; }
+
+    /// Get execution budget.
+    const TaskBudget& getBudget() const noexcept { return budget_; }
+
     /// Add one runtime measurement.
     void addRuntime(unsigned long runtime) noexcept;
 
@@ -73,23 +414,50 @@ namespace Scheduler
     /// Get maximum recorded runtime since start.
     unsigned long getMaxRuntimeSinceStart() const noexcept;
 
-    /// Get average runtime.
-    unsigned long getAvgRuntime() const noexcept;
+    /// Get exponentially-weighted average runtime.
+    unsigned long getAvgRuntime() const noexcept { return runtime_.getAvg(); }
+
+    /// Get exponentially-weighted standard deviation of runtime.
+    unsigned long getRuntimeStdDev() const noexcept { return runtime_.getStdDev(); }
+
+    /// Get maximum runtime in the last one to two windows.
+    unsigned long getRecentMaxRuntime() const noexcept { return runtime_.getRecentMax(); }
 
     /// Get total measurement count.
     inline unsigned long getMeasurementCount() const noexcept { return count_runtime_; }
 
-    /// Get number of measurements consolidated in order not to overflow long counters.
-    unsigned long getConsolidatedMeasurementCount() const noexcept { return adjust_count_runtime_; }
+    /// Get estimated runtime percentile since last reset of maximum (maximum without histogram).
+    unsigned long getRuntimePercentile(unsigned char percent) const noexcept {
+      return histogram_ ? histogram_->getPercentile(percent, max_runtime_) : max_runtime_;
+    }
+
+    /// Get runtime histogram since last reset of maximum (nullptr if not kept).
+    const TimingHistogram* getHistogram() const noexcept { return histogram_; }
+
+    /*!
+     * @brief Add one lateness measurement of a timed task.
+     *
+     * Lateness is the delay between the time at which the task was scheduled
+     * and the time at which it actually started. The global worst lateness is
+     * attributed to the task which was running at the scheduled time. Lateness
+     * of the task itself is only kept by TimedTaskStats.
+     *
+     * @param schedule_time time at which the task was scheduled to run.
+     * @param start_time time at which the task started.
+     */
+    void addLateness(unsigned long schedule_time, unsigned long start_time) noexcept;
+
+    /// Get lateness statistics (nullptr if not kept).
+    const LatenessStats* getLateness() const noexcept { return lateness_; }
 
     /*!
      * @brief Serialize statistics to a buffer.
      *
-     * @param buffer,size buffer where to materialize the string (should be >=140B).
+     * @param buffer,size buffer where to materialize the string (should be >=160B).
      */
     void toString(char* buffer, unsigned size) const noexcept;
 
-    /// Reset maximum.
+    /// Reset maxima and histograms.
     void resetMaximum() noexcept;
 
     /// Get iterator to the first task.
@@ -98,34 +466,282 @@ namespace Scheduler
     /// Get iterator past the last task.
     static iterator end() noexcept { return iterator(nullptr); }
 
+  protected:
+    /*!
+     * @brief Construct stats for a given task name with histogram and lateness.
+     *
+     * @param name task name.
+     * @param budget execution budget of one run in microseconds (0 for none).
+     * @param histogram histogram of run times owned by derived class (or nullptr).
+     * @param lateness lateness statistics owned by derived class (or nullptr).
+     */
+    TaskTimingStats(const __FlashStringHelper* name, unsigned long budget,
+      TimingHistogram* histogram, LatenessStats* lateness = nullptr) noexcept;
+
   private:
     /// Task name.
     const __FlashStringHelper* name_;
+    /// Histogram of run times since last reset of maximum (nullptr if not kept).
+    TimingHistogram* histogram_;
+    /// Lateness of this task (nullptr if not kept).
+    LatenessStats* lateness_;
     /// Maximum run time of this task in microseconds.
     unsigned long max_runtime_ = 0;
     /// Maximum run time of this task since beginning at reset.
     unsigned long max_runtime_since_start_ = 0;
-    /// Sum of runtimes of this task in microseconds.
-    unsigned long sum_runtime_ = 0;
+    /// Recent run times of this task in microseconds.
+    RecentStats runtime_;
+    /// Execution budget of one run.
+    TaskBudget budget_;
     /// Count of runtime measurements for this task.
     unsigned long count_runtime_ = 0;
-    /// Count of runtime measurements "eaten out" to keep measurements in range.
-    unsigned long adjust_count_runtime_ = 0;
     /// Next task statistics in the list.
     TaskTimingStats* next_;
     /// First statistics.
     static TaskTimingStats* s_first_stat_;
   };
 
+  /*!
+   * @brief Statistics for timing operation duration of a task with histogram.
+   *
+   * In addition to TaskTimingStats, histogram of run times is kept to
+   * estimate percentiles.
+   */
+  class TaskHistogramStats : public TaskTimingStats
+  {
+  public:
+    /*!
+     * @brief Construct stats for a given task name.
+     *
+     * @param name task name.
+     * @param budget execution budget of one run in microseconds (0 for none).
+     */
+    explicit TaskHistogramStats(const __FlashStringHelper* name, unsigned long budget = 0) noexcept :
+      TaskTimingStats(name, budget, &runtime_histogram_)
+    {}
+
+  protected:
+    /// Construct stats with lateness statistics owned by derived class.
+    TaskHistogramStats(const __FlashStringHelper* name, unsigned long budget, LatenessStats* lateness) noexcept :
+      TaskTimingStats(name, budget, &runtime_histogram_, lateness)
+    {}
+
+  private:
+    /// Histogram of run times since last reset of maximum.
+    TimingHistogram runtime_histogram_;
+  };
+
+  /*!
+   * @brief Statistics for timing operation duration of a periodic timed task.
+   *
+   * In addition to TaskHistogramStats, scheduling lateness of the task is
+   * kept. This costs ~50B of RAM, so use it only where lateness matters.
+   */
+  class TimedTaskStats : public TaskHistogramStats
+  {
+  public:
+    /*!
+     * @brief Construct stats for a given task name.
+     *
+     * @param name task name.
+     * @param budget execution budget of one run in microseconds (0 for none).
+     */
+    explicit TimedTaskStats(const __FlashStringHelper* name, unsigned long budget = 0) noexcept :
+      TaskHistogramStats(name, budget, &lateness_stats_)
+    {}
+
+  private:
+    /// Lateness of this task.
+    LatenessStats lateness_stats_;
+  };
+
+  /*!
+   * @brief Attribution of the worst lateness of timed tasks.
+   *
+   * Last few task runs are recorded, so if a task starts later than its
+   * scheduled time, the task which was running at the scheduled time can be
+   * found. The worst case is remembered with the names of both tasks.
+   */
+  class LatenessAttribution
+  {
+  public:
+    /// Count of task runs to remember for attribution.
+    static constexpr unsigned char HISTORY_SIZE = 8;
+
+    LatenessAttribution() = delete;
+
+    /*!
+     * @brief Record one task run.
+     *
+     * @param name task name or nullptr for unaccounted tasks.
+     * @param start,end start and end time of the run.
+     */
+    static void addRun(const __FlashStringHelper* name, unsigned long start, unsigned long end) noexcept;
+
+    /*!
+     * @brief Record lateness of a task and attribute it, if it's the worst one.
+     *
+     * @param name name of the late task.
+     * @param schedule_time time at which the task was scheduled to run.
+     * @param lateness delay of the actual start after schedule time.
+     */
+    static void addLateness(const __FlashStringHelper* name, unsigned long schedule_time, unsigned long lateness) noexcept;
+
+    /// Get worst recorded lateness.
+    static unsigned long getMaxLateness() noexcept { return s_max_lateness_; }
+
+    /// Get name of the task which was late the most.
+    static const __FlashStringHelper* getLateTaskName() noexcept { return s_late_task_; }
+
+    /// Get name of the task which caused worst lateness (nullptr if unknown).
+    static const __FlashStringHelper* getBlockingTaskName() noexcept { return s_blocking_task_; }
+
+    /*!
+     * @brief Serialize worst lateness to a buffer.
+     *
+     * @param buffer,size buffer where to materialize the string (should be >=80B).
+     */
+    static void toString(char* buffer, unsigned size) noexcept;
+
+    /// Reset worst lateness.
+    static void reset() noexcept;
+
+  private:
+    /// Names of last task runs.
+    static const __FlashStringHelper* s_run_name_[HISTORY_SIZE];
+    /// Start times of last task runs.
+    static unsigned long s_run_start_[HISTORY_SIZE];
+    /// End times of last task runs.
+    static unsigned long s_run_end_[HISTORY_SIZE];
+    /// Index of the next run to record.
+    static unsigned char s_run_index_;
+    /// Worst lateness.
+    static unsigned long s_max_lateness_;
+    /// Name of the task which was late the most.
+    static const __FlashStringHelper* s_late_task_;
+    /// Name of the task which was running when the late task should have run.
+    static const __FlashStringHelper* s_blocking_task_;
+  };
+
+  /*!
+   * @brief CPU load accounting of the scheduler loop.
+   *
+   * Each scheduler loop which ran any task reports its whole runtime
+   * including scheduler overhead (busy) and, as a part of it, the time
+   * spent in polling tasks. Once per second, the load of the last second
+   * is computed and folded into rolling 1 minute and 15 minute averages
+   * (exponentially-weighted, similar to Unix load averages). The rest
+   * of the time, including time outside of the scheduler and deep sleep,
+   * is idle. Time asleep is additionally reported on its own.
+   *
+   * Load values are in per mille of the wall clock time.
+   */
+  class LoadStatistics
+  {
+  public:
+    /// Length of one measurement window in microseconds.
+    static constexpr unsigned long WINDOW = 1000000UL;
+
+    LoadStatistics() = delete;
+
+    /*!
+     * @brief Record one scheduler loop.
+     *
+     * @param end end time of the loop.
+     * @param busy time spent running timed and polling tasks, including scheduler overhead.
+     * @param poll time spent running polling tasks (part of busy time).
+     */
+    static void addLoop(unsigned long end, unsigned long busy, unsigned long poll) noexcept {
+      s_busy_ += busy;
+      s_poll_ += poll;
+      ++s_loops_;
+      if (end - s_window_start_ >= WINDOW)
+        update(end);
+    }
+
+    /*!
+     * @brief Record time spent in deep sleep.
+     *
+     * @param sleep time asleep in microseconds.
+     */
+    static void addSleep(unsigned long sleep) noexcept { s_sleep_ += sleep; }
+
+    /// Get busy time in the last second in per mille.
+    static unsigned getLoad() noexcept { return s_load_; }
+
+    /// Get polling time in the last second in per mille (part of busy time).
+    static unsigned getPollLoad() noexcept { return s_poll_load_; }
+
+    /// Get idle time in the last second in per mille.
+    static unsigned getIdle() noexcept { return 1000 - s_load_; }
+
+    /// Get time asleep in the last second in per mille (part of idle time).
+    static unsigned getSleep() noexcept { return s_sleep_load_; }
+
+    /// Get count of scheduler loops per second in the last second.
+    static unsigned long getLoopsPerSecond() noexcept { return s_loops_per_second_; }
+
+    /// Get rolling 1 minute average of busy time in per mille.
+    static unsigned getLoad1m() noexcept { return unsigned((s_avg_1m_ + FIXED_HALF) >> FIXED_SHIFT); }
+
+    /// Get rolling 15 minute average of busy time in per mille.
+    static unsigned getLoad15m() noexcept { return unsigned((s_avg_15m_ + FIXED_HALF) >> FIXED_SHIFT); }
+
+    /*!
+     * @brief Serialize load statistics to a buffer.
+     *
+     * @param buffer,size buffer where to materialize the string (should be >=96B).
+     */
+    static void toString(char* buffer, unsigned size) noexcept;
+
+    /*!
+     * @brief Serialize load averages (1s, 1min, 15min) in percent to a buffer.
+     *
+     * @param buffer,size buffer where to materialize the string (should be >=24B).
+     */
+    static void averagesToString(char* buffer, unsigned size) noexcept;
+
+  private:
+    /// Fractional bits of fixed-point load averages.
+    static constexpr unsigned char FIXED_SHIFT = 10;
+    /// One half in fixed-point representation.
+    static constexpr long FIXED_HALF = 1L << (FIXED_SHIFT - 1);
+
+    /// Compute load of the finished window and update averages.
+    static void update(unsigned long end) noexcept;
+
+    /// Start of the current window.
+    static unsigned long s_window_start_;
+    /// Busy time in the current window.
+    static unsigned long s_busy_;
+    /// Polling time in the current window (part of busy time).
+    static unsigned long s_poll_;
+    /// Time asleep in the current window.
+    static unsigned long s_sleep_;
+    /// Loop count in the current window.
+    static unsigned long s_loops_;
+    /// Busy time in the last window in per mille.
+    static unsigned s_load_;
+    /// Polling time in the last window in per mille (part of busy time).
+    static unsigned s_poll_load_;
+    /// Time asleep in the last window in per mille.
+    static unsigned s_sleep_load_;
+    /// Loops per second in the last window.
+    static unsigned long s_loops_per_second_;
+    /// 1 minute average of busy time in per mille (fixed point).
+    static long s_avg_1m_;
+    /// 15 minute average of busy time in per mille (fixed point).
+    static long s_avg_15m_;
+  };
+
   /*!
    * @brief Statistics for timing poll operation duration.
    *
    * Typically, measurements are in microseconds, but the unit is not
    * important for the purpose of the statistics.
    *
-   * The implementation accounts for numeric overflows and consolidates
-   * sum and count appropriately, so a reliable average can be built over
-   * time.
+   * Averages are exponentially-weighted, so they reflect recent behavior
+   * (see RecentStats).
    */
   class TaskPollingStats
   {
@@ -148,32 +764,80 @@ namespace Scheduler
       TaskPollingStats* cur_;
     };
 
-    /// Construct stats for a given task name.
-    explicit TaskPollingStats(const __FlashStringHelper* name) noexcept;
+    /*!
+     * @brief Construct stats for a given task name.
+     *
+     * @param name task name.
+     * @param budget execution budget of one poll in microseconds (0 for none).
+     */
+    explicit TaskPollingStats(const __FlashStringHelper* name, unsigned long budget = 0) noexcept;
 
     /// Get statistics name.
     const __FlashStringHelper* getName() const noexcept { return name_; }
 
+    /// Get execution budget.
+    TaskBudget& getBudget() noexcept { return budget_; }
+
+    /// Get execution budget.
+    const TaskBudget& getBudget() const noexcept { return budget_; }
+
     /// Add time spent in polling.
     void addPolltime(unsigned long polltime) noexcept;
 
+    /// Add count of polls skipped due to poll interval.
+    void addSkipped(unsigned count) noexcept { skip_count_ += count; }
+
+    /*!
+     * @brief Add reaction latency of a poll which found some activity.
+     *
+     * @param latency time since the previous poll, i.e., upper bound of
+     *    the delay between input and reaction to it.
+     */
+    void addReaction(unsigned long latency) noexcept;
+
     /// Get maximum recorded poll time.
     inline unsigned long getMaxPolltime() const noexcept { return max_polltime_; }
 
     /// Get maximum recorded polltime since start.
     unsigned long getMaxPolltimeSinceStart() const noexcept;
 
-    /// Get average poll time.
-    unsigned long getAvgPolltime() const noexcept;
+    /// Get exponentially-weighted average poll time.
+    unsigned long getAvgPolltime() const noexcept { return polltime_.getAvg(); }
+
+    /// Get exponentially-weighted standard deviation of poll time.
+    unsigned long getPolltimeStdDev() const noexcept { return polltime_.getStdDev(); }
+
+    /// Get maximum poll time in the last one to two windows.
+    unsigned long getRecentMaxPolltime() const noexcept { return polltime_.getRecentMax(); }
+
+    /// Get count of polls.
+    unsigned long getPollCount() const noexcept { return poll_count_; }
+
+    /// Get count of polls skipped due to poll interval.
+    unsigned long getSkipCount() const noexcept { return skip_count_; }
+
+    /// Get maximum recorded reaction latency.
+    unsigned long getMaxReaction() const noexcept { return max_reaction_; }
+
+    /// Get exponentially-weighted average reaction latency.
+    unsigned long getAvgReaction() const noexcept { return reaction_.getAvg(); }
+
+    /// Get estimated poll time percentile since last reset of maximum.
+    unsigned long getPolltimePercentile(unsigned char percent) const noexcept {
+      return histogram_.getPercentile(percent, max_polltime_);
+    }
+
+    /// Get poll time histogram since last reset of maximum.
+    const TimingHistogram& getHistogram() const noexcept { return histogram_; }
 
     /*!
      * @brief Serialize statistics to a buffer.
      *
-     * @param buffer,size buffer where to materialize the string (should be >=140B).
+     * @param buffer,size buffer where to materialize the string (should be >=160B).
      */
     void toString(char* buffer, unsigned size) const noexcept;
 
-    /// Reset maximum.
+    /// Reset maximum and histogram.
     void resetMaximum() noexcept;
 
     /// Get iterator to the first task.
@@ -185,14 +849,24 @@ namespace Scheduler
   private:
     /// Task name.
     const __FlashStringHelper* name_;
+    /// Histogram of poll times since last reset of maximum.
+    TimingHistogram histogram_;
     /// Maximum poll time of this task in microseconds.
     unsigned long max_polltime_ = 0;
     /// Maximum poll time of this task since beginning at reset.
     unsigned long max_polltime_since_start_ = 0;
-    /// Sum of polltimes of this task in microseconds.
-    unsigned long sum_polltime_ = 0;
-    /// Count of polltime measurements for this task.
-    unsigned count_polltime_ = 0;
+    /// Recent poll times of this task in microseconds.
+    RecentStats polltime_;
+    /// Execution budget of one poll.
+    TaskBudget budget_;
+    /// Count of polls of this task.
+    unsigned long poll_count_ = 0;
+    /// Count of polls skipped due to poll interval.
+    unsigned long skip_count_ = 0;
+    /// Maximum reaction latency in microseconds.
+    unsigned long max_reaction_ = 0;
+    /// Recent reaction latencies in microseconds.
+    RecentStats reaction_;
     /// Next task statistics in the list.
     TaskPollingStats* next_;
     /// First statistics.
@@ -21,79 +21,194 @@
 #include "TimeScheduler.h"
 
 #include <avr/pgmspace.h>
+#include <stdio.h>
 
 namespace
 {
   static const char SchedulerName[] PROGMEM = ("Scheduler");
   static const char AllTasksName[] PROGMEM = ("AllTasks");
+  static const char PrioControlName[] PROGMEM = ("PrioControl");
+  static const char PrioSensingName[] PROGMEM = ("PrioSensing");
+  static const char PrioTelemetryName[] PROGMEM = ("PrioTelemetry");
+  static const char PrioUIName[] PROGMEM = ("PrioUI");
 
   static Scheduler::TaskTimingStats s_scheduler_runtime_stats(reinterpret_cast<const __FlashStringHelper*>(&SchedulerName[0]));
   static Scheduler::TaskTimingStats s_total_runtime_stats(reinterpret_cast<const __FlashStringHelper*>(&AllTasksName[0]));
+  static Scheduler::TaskTimingStats s_control_runtime_stats(reinterpret_cast<const __FlashStringHelper*>(&PrioControlName[0]));
+  static Scheduler::TaskTimingStats s_sensing_runtime_stats(reinterpret_cast<const __FlashStringHelper*>(&PrioSensingName[0]));
+  static Scheduler::TaskTimingStats s_telemetry_runtime_stats(reinterpret_cast<const __FlashStringHelper*>(&PrioTelemetryName[0]));
+  static Scheduler::TaskTimingStats s_ui_runtime_stats(reinterpret_cast<const __FlashStringHelper*>(&PrioUIName[0]));
+
+  /// Runtime statistics per priority class.
+  static Scheduler::TaskTimingStats* const s_priority_runtime_stats[Scheduler::TASK_PRIORITY_COUNT] = {
+    &s_control_runtime_stats, &s_sensing_runtime_stats, &s_telemetry_runtime_stats, &s_ui_runtime_stats
+  };
+
+  /// Default time budget per loop and priority class.
+  static const unsigned long DEFAULT_BUDGET[Scheduler::TASK_PRIORITY_COUNT] PROGMEM = {
+    0,        // CONTROL: unlimited
+    20000,    // SENSING: 20ms
+    10000,    // TELEMETRY: 10ms
+    30000     // UI: 30ms
+  };
 }
 
-unsigned long Scheduler::TimeScheduler::runTimedTasks() noexcept
+Scheduler::TimeScheduler::TimeScheduler(DeepSleepCallback deep_sleep) noexcept :
+  deep_sleep_(deep_sleep)
 {
-  unsigned long all_task_times = 0;
+  for (unsigned char i = 0; i < TASK_PRIORITY_COUNT; ++i) {
+    due_list_[i] = nullptr;
+    budget_[i] = pgm_read_dword(&DEFAULT_BUDGET[i]);
+    class_runtime_[i] = 0;
+    deferred_count_[i] = 0;
+  }
+}
 
-  {
+void Scheduler::TimeScheduler::priorityToString(char* buffer, unsigned size) const noexcept
+{
+  snprintf_P(buffer, size, PSTR("budget %lu,%lu,%lu,%lu deferred %lu,%lu,%lu,%lu"),
+    budget_[0], budget_[1], budget_[2], budget_[3],
+    deferred_count_[0], deferred_count_[1], deferred_count_[2], deferred_count_[3]);
+}
+
+void Scheduler::TimeScheduler::collectDueTasks() noexcept
+{
+  // Collect all expired tasks first. Tasks which are re-added while running
+  // expired tasks will thus only run in the next scheduler loop.
+  TimedTaskBase** due_tail[TASK_PRIORITY_COUNT];
+  for (unsigned char i = 0; i < TASK_PRIORITY_COUNT; ++i)
+    due_tail[i] = &due_list_[i];
+  auto add_due = [&due_tail](TimedTaskBase* task) {
+    task->dequeue();
+    task->queue_index_ = TimedTaskBase::QUEUE_DUE;
+    auto& tail = due_tail[static_cast<unsigned char>(task->priority_)];
+    *tail = task;
+    tail = &task->next_due_;
+  };
+  while (TimedTaskBase::s_queue_size_) {
+    auto task = TimedTaskBase::s_queue_[0];
+    if (long(task->next_time_ - TaskBase::s_scheduler_current_time_) > 0)
+      break;  // all other tasks in the queue are later
+    add_due(task);
+  }
+  if (TimedTaskBase::s_overflow_count_) {
+    // ready queue too small, find remaining tasks by scanning
     auto cur_task = TimedTaskBase::s_first_task_;
     while (cur_task) {
-      auto task_time = cur_task->next_time_;
-      auto next = cur_task->next_;
-      if (task_time) {
-        unsigned long task_start_time = micros();
+      if (cur_task->queue_index_ == TimedTaskBase::QUEUE_OVERFLOW &&
+          long(cur_task->next_time_ - TaskBase::s_scheduler_current_time_) <= 0)
+        add_due(cur_task);
+      cur_task = cur_task->next_;
+    }
+  }
+  for (unsigned char i = 0; i < TASK_PRIORITY_COUNT; ++i)
+    *due_tail[i] = nullptr;
+}
+
+unsigned long Scheduler::TimeScheduler::runTimedTasks(TaskPriority priority) noexcept
+{
+  unsigned long all_task_times = 0;
+  auto prio = static_cast<unsigned char>(priority);
+
+  while (due_list_[prio]) {
+    auto cur_task = due_list_[prio];
+    due_list_[prio] = cur_task->next_due_;
+    if (cur_task->queue_index_ != TimedTaskBase::QUEUE_DUE)
+      continue; // rescheduled or cancelled by another task in the meantime
+    if (isOverBudget(prio)) {
+      // budget used up, run in the next loop
+      cur_task->enqueue();
+      ++deferred_count_[prio];
+      continue;
+    }
+    cur_task->queue_index_ = TimedTaskBase::QUEUE_NONE;
+
+    auto task_time = cur_task->next_time_;
+    unsigned long task_start_time = micros();
+    auto end_time = cur_task->invoke(task_start_time);
+    if (cur_task->queue_index_ == TimedTaskBase::QUEUE_NONE) {
+      // Task didn't reschedule itself. Checking the queue instead of the time
+      // also covers tasks rescheduled to the same time (e.g., SteppedTask).
+      auto interval = cur_task->interval_;
+      if (interval) {
+        // Interval task, compute next time to run the task. In case the next time would fall
+        // into this loop run, skip one call. This protects against runaway tasks that are
+        // scheduled too frequently.
+        task_time += interval;
         long delta = long(task_time - TaskBase::s_scheduler_current_time_);
-        if (delta <= 0) {
-          // OK, timer expired
-          auto end_time = cur_task->invoke(task_start_time);
-          if (cur_task->next_time_ == task_time) {
-            // task didn't reschedule itself
-            auto interval = cur_task->interval_;
-            if (interval) {
-              // Interval task, compute next time to run the task. In case the next time would fall
-              // into this loop run, skip one call. This protects against runaway tasks that are
-              // scheduled too frequently.
-              task_time += interval;
-              delta = long(task_time - TaskBase::s_scheduler_current_time_);
-              if (delta < 0) {
-                // task must be skipped, compute next time
-                task_time += ((static_cast<unsigned long>(-delta) / interval) + 1) * interval;
-              }
-              cur_task->next_time_ = task_time;
-            } else {
-              // Regular task, remove the task from the list.
-              cur_task->next_time_ = 0;
-            }
-          }
-          auto task_runtime = end_time - task_start_time;
-          all_task_times += task_runtime;
+        if (delta < 0) {
+          // task must be skipped, compute next time
+          task_time += ((static_cast<unsigned long>(-delta) / interval) + 1) * interval;
         }
+        cur_task->next_time_ = task_time;
+        cur_task->enqueue();
+      } else {
+        // Regular task, it's not scheduled anymore.
+        cur_task->next_time_ = 0;
       }
-      cur_task = next;
     }
+    auto task_runtime = end_time - task_start_time;
+    class_runtime_[prio] += task_runtime;
+    all_task_times += task_runtime;
   }
 
   return all_task_times;
 }
 
+unsigned long Scheduler::TimeScheduler::runTasks(TaskPriority priority) noexcept
+{
+  return runTimedTasks(priority);
+}
+
 void Scheduler::TimeScheduler::checkDeepSleep() noexcept
 {
-  if (!deep_sleep_)
-    return;
+  if (deep_sleep_)
+    sleep(1UL << 31);
+}
 
-  // TODO run over all tasks and collect next time
-  auto cur = TimedTaskBase::s_first_task_;
+bool Scheduler::TimeScheduler::isWakeupPending() noexcept
+{
+  return false;
+}
+
+void Scheduler::TimeScheduler::sleep(unsigned long max_sleep) noexcept
+{
   auto current_time = micros();
-  unsigned long min = 1UL << 31;
-  while (cur) {
-    auto delta = cur->next_time_ - current_time;
+  unsigned long min = max_sleep;
+  if (TimedTaskBase::s_queue_size_) {
+    // the head of the ready queue is the next task to run
+    auto delta = TimedTaskBase::s_queue_[0]->next_time_ - current_time;
     if (long(delta) < 1000)
       return; // less than 1ms to sleep - no point
     if (delta < min)
       min = delta;
-    cur = cur->next_;
   }
-  deep_sleep_(min);
+  if (TimedTaskBase::s_overflow_count_) {
+    auto cur = TimedTaskBase::s_first_task_;
+    while (cur) {
+      if (cur->queue_index_ == TimedTaskBase::QUEUE_OVERFLOW) {
+        auto delta = cur->next_time_ - current_time;
+        if (long(delta) < 1000)
+          return; // less than 1ms to sleep - no point
+        if (delta < min)
+          min = delta;
+      }
+      cur = cur->next_;
+    }
+  }
+  if (min < 1000)
+    return; // less than 1ms to sleep - no point
+
+  // Sleep callback may return early (e.g., on any interrupt), so sleep
+  // repeatedly until the deadline or until some task has work to do.
+  auto sleep_start = current_time;
+  auto slept = 0UL;
+  while (slept < min && !isWakeupPending()) {
+    deep_sleep_(min - slept);
+    current_time = micros();
+    slept = current_time - sleep_start;
+  }
+  LoadStatistics::addSleep(slept);
 }
 
 void Scheduler::TimeScheduler::loop() noexcept
@@ -105,74 +220,107 @@ void Scheduler::TimeScheduler::loop() noexcept
 
   TaskBase::s_scheduler_current_time_ = micros();
   unsigned long schedule_start_time = TaskBase::s_scheduler_current_time_;
-  auto all_task_times = runTimedTasks();
+  collectDueTasks();
+  unsigned long all_task_times = 0;
+  poll_runtime_ = 0;
+  for (unsigned char i = 0; i < TASK_PRIORITY_COUNT; ++i) {
+    class_runtime_[i] = 0;
+    all_task_times += runTasks(static_cast<TaskPriority>(i));
+  }
 
+  auto schedule_end_time = micros();
+  auto sched_runtime = schedule_end_time - schedule_start_time;
   if (all_task_times) {
     // at least one task was scheduled, record how long did scheduler take
-    auto sched_runtime = micros() - schedule_start_time;
     s_scheduler_runtime_stats.addRuntime(sched_runtime - all_task_times);
     s_total_runtime_stats.addRuntime(sched_runtime);
+    for (unsigned char i = 0; i < TASK_PRIORITY_COUNT; ++i) {
+      if (class_runtime_[i])
+        s_priority_runtime_stats[i]->addRuntime(class_runtime_[i]);
+    }
   }
 
+  // Loop is busy, if any task ran. Polls are rate-limited and the loop sleeps
+  // when idle, so poll runtime (e.g., a blocking reconnect) counts as busy.
+  // It is additionally reported separately as a breakdown.
+  LoadStatistics::addLoop(schedule_end_time, all_task_times ? sched_runtime : 0, poll_runtime_);
+
   checkDeepSleep();
 
   TaskBase::s_is_in_loop_ = false;
 }
 
-unsigned long Scheduler::PollingScheduler::runPollTasks() noexcept
+unsigned long Scheduler::PollingScheduler::runPollTasks(TaskPriority priority) noexcept
 {
   unsigned long all_task_times = 0;
+  auto prio = static_cast<unsigned char>(priority);
   {
     auto cur_task = PollTaskBase::s_first_task_;
     auto task_start_time = micros();
     const auto poll_start_time = task_start_time;
     while (cur_task) {
-      if (cur_task->isEnabled()) {
-        auto task_end_time = cur_task->invoke(task_start_time);
-        task_start_time = task_end_time;
+      if (cur_task->isEnabled() && cur_task->priority_ == priority && cur_task->isPollDue(task_start_time)) {
+        if (isOverBudget(prio)) {
+          // budget used up, skip polling in this loop
+          ++deferred_count_[prio];
+        } else {
+          auto task_end_time = cur_task->invoke(task_start_time);
+          cur_task->pollDone(task_start_time);
+          class_runtime_[prio] += task_end_time - task_start_time;
+          task_start_time = task_end_time;
+        }
       }
       cur_task = cur_task->next_;
     }
     all_task_times += task_start_time - poll_start_time;
   }
+  poll_runtime_ += all_task_times;
   return all_task_times;
 }
 
-void Scheduler::PollingScheduler::loop() noexcept
+unsigned long Scheduler::PollingScheduler::runTasks(TaskPriority priority) noexcept
 {
-  if (TaskBase::s_is_in_loop_)
-    return; // recursive call, ERROR
-
-  TaskBase::s_is_in_loop_ = true;
-
-  TaskBase::s_scheduler_current_time_ = micros();
-  unsigned long schedule_start_time = TaskBase::s_scheduler_current_time_;
-  auto all_task_times = runTimedTasks() + runPollTasks();
-
-  if (all_task_times) {
-    // at least one task was scheduled, record how long did scheduler take
-    auto sched_runtime = micros() - schedule_start_time;
-    s_scheduler_runtime_stats.addRuntime(sched_runtime - all_task_times);
-    s_total_runtime_stats.addRuntime(sched_runtime);
-  }
-
-  checkDeepSleep();
-
-  TaskBase::s_is_in_loop_ = false;
+  return runTimedTasks(priority) + runPollTasks(priority);
 }
 
 void Scheduler::PollingScheduler::checkDeepSleep() noexcept
 {
   if (deep_sleep_) {
+    unsigned long max_sleep = PollTaskBase::NO_SLEEP_LIMIT;
     auto cur = PollTaskBase::s_first_task_;
     while (cur) {
-      if (cur->isEnabled())
-        return; // there is still something polling
+      if (cur->isEnabled()) {
+        auto task_sleep = cur->max_sleep_;
+        if (cur->poll_interval_) {
+          // rate-limited task, sleep at most until the next poll
+          auto elapsed = micros() - cur->last_poll_time_;
+          auto remaining = elapsed < cur->poll_interval_ ? cur->poll_interval_ - elapsed : 0;
+          if (!task_sleep || remaining < task_sleep)
+            task_sleep = remaining;
+        }
+        if (!task_sleep)
+          return; // there is still something polling continuously
+        if (cur->wake_check_ && cur->wake_check_())
+          return; // task has work to do already
+        if (task_sleep < max_sleep)
+          max_sleep = task_sleep;
+      }
       cur = cur->next_;
     }
-    // nothing polling, check whether we can deep sleep
-    TimeScheduler::checkDeepSleep();
+    // nothing needs polling now, check whether we can deep sleep
+    sleep(max_sleep);
+  }
+}
+
+bool Scheduler::PollingScheduler::isWakeupPending() noexcept
+{
+  auto cur = PollTaskBase::s_first_task_;
+  while (cur) {
+    if (cur->isEnabled() && cur->wake_check_ && cur->wake_check_())
+      return true;
+    cur = cur->next_;
   }
+  return false;
 }
 
 #if 0
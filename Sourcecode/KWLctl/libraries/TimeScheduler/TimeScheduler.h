@@ -24,16 +24,21 @@
 #pragma once
 
 #include "TaskBase.h"
+#include "SchedulerTrace.h"
+#include "TaskSignal.h"
+#include "TaskInterval.h"
 
 /*!
  * @brief Simple scheduler for cooperative multitasking.
  *
- * The scheduler works by maintaining a task list. Each task has an associated
- * next schedule time and optionally interval time. When the scheduler runs one
- * loop, it picks any expired tasks from the task list, removes them and runs
- * them. Tasks can re-add themselves into the scheduler, but they will be only
- * executed in the next scheduler loop. If a task specified a scheduling interval,
- * then the scheduler will automatically re-add it after execution.
+ * The scheduler works by maintaining a ready queue of scheduled tasks, ordered
+ * by time. Each task has an associated next schedule time and optionally interval
+ * time. When the scheduler runs one loop, it picks any expired tasks from the head
+ * of the ready queue, removes them and runs them. Thus, the cost of a loop without
+ * expired tasks doesn't depend on the number of tasks. Tasks can re-add themselves
+ * into the scheduler, but they will be only executed in the next scheduler loop.
+ * If a task specified a scheduling interval, then the scheduler will automatically
+ * re-add it after execution.
  *
  * This way, it is guaranteed that all tasks get processed at some time, even if
  * there is a misbehaving task registering itself over and over with zero timeout.
@@ -41,15 +46,30 @@
  * tasks will get their chance to run.
  *
  * Additionally, polling tasks are supported. These tasks run in each run of
- * the scheduler's loop() method (and prevent deep sleep).
+ * the scheduler's loop() method (and prevent deep sleep, unless they declare
+ * their wake sources, see PollTaskBase::setWakeSource()).
+ *
+ * Timed tasks consuming data of other modules can be woken up by the producer
+ * via TaskSignal instead of polling for new data in short intervals.
+ *
+ * Intervals of timed tasks, which should be tunable per installation, are
+ * declared as TaskInterval. These can be found by name and changed at runtime.
+ *
+ * Each task belongs to a priority class (see TaskPriority). In each loop,
+ * expired timed tasks and polling tasks of a higher class run before those
+ * of a lower class. Classes can be assigned a time budget per loop. When the
+ * tasks of a class used up the budget, remaining expired tasks of this class
+ * are deferred to the next loop and polling tasks of this class are skipped.
  *
  * Each task maintains statistics about runtime of individual invocations.
  * This can be used for debugging purposes to see which task is consuming too
- * much time. There is also a possibility to create unaccounted tasks, but
- * this is discouraged.
+ * much time. Timed tasks with TimedTaskStats additionally maintain statistics
+ * about lateness, i.e., how much later than scheduled they started. There is
+ * also a possibility to create unaccounted tasks, but this is discouraged.
  *
  * Following classes are implemented by the scheduler:
  *    - TimedTask and UnaccountedTimedTask for regular tasks,
+ *    - SteppedTask for long-running jobs, which are executed in small steps,
  *    - PollTask and UnaccountedPollTask for polling tasks.
  *
  * There are also two types of schedulers:
@@ -68,6 +88,8 @@
  *      void voidfnc().
  *    - TimedTask<int> task(stats, &intfnc, intparam) - creates a task which runs
  *      plain function void intfnc(int) and passes the value intparam to it.
+ *    - TimedTask<X> task(TaskPriority::UI, stats, &X::timeout, x_instance) - creates
+ *      a task in priority class UI (tasks are in class CONTROL by default).
  *
  * Other types of tasks are created analogously.
  */
@@ -97,15 +119,33 @@ namespace Scheduler
       stats_(stats)
     {}
 
+    /*!
+     * @brief Construct the task in a given priority class.
+     *
+     * @param priority priority class of the task.
+     * @param stats statistics to update.
+     * @param args arguments for task invoker (function and parameters).
+     */
+    template<typename... CArgs>
+    TimedTask(TaskPriority priority, TaskTimingStats& stats, CArgs&&... args) noexcept :
+      TimedTaskBase(&invoke, priority),
+      call_invoker_(scheduler_cpp11_support::forward<CArgs>(args)...),
+      stats_(stats)
+    {}
+
     /// Get statistics for this task.
     inline TaskTimingStats& getStatistics() const noexcept { return stats_; }
 
   private:
     static unsigned long invoke(TaskBase& t, unsigned long start) noexcept {
       auto& instance = static_cast<TimedTask<Args...>&>(t);
+      instance.stats_.addLateness(instance.getScheduleTime(), start);
+      SchedulerTrace::add(TraceEvent::TASK_BEGIN, start, instance.stats_.getName());
       instance.call_invoker_.invoke();
       auto end = micros();
+      SchedulerTrace::add(TraceEvent::TASK_END, end, instance.stats_.getName());
       instance.stats_.addRuntime(end - start);
+      LatenessAttribution::addRun(instance.stats_.getName(), start, end);
       return end;
     }
 
@@ -138,13 +178,124 @@ namespace Scheduler
     {}
 
   private:
-    static unsigned long invoke(TaskBase& t, unsigned long /*start*/) {
+    static unsigned long invoke(TaskBase& t, unsigned long start) {
       auto& instance = static_cast<UnaccountedTimedTask<Args...>&>(t);
+      SchedulerTrace::add(TraceEvent::TASK_BEGIN, start, nullptr);
       instance.call_invoker_.invoke();
-      return micros();
+      auto end = micros();
+      SchedulerTrace::add(TraceEvent::TASK_END, end, nullptr);
+      LatenessAttribution::addRun(nullptr, start, end);
+      return end;
+    }
+
+    SchedulerImpl::call_invoker<Args...> call_invoker_;
+  };
+
+  /*!
+   * @brief Resumable task for long-running jobs split into steps.
+   *
+   * After start(), the task function is called repeatedly in the next
+   * scheduler loop, until the job calls finish() or the time slice of the
+   * task is used up. In the latter case, the job continues in the next
+   * loop. This way, jobs taking seconds don't block other tasks. The task
+   * function must keep the state of the job between the calls and do a
+   * small amount of work in each call.
+   *
+   * Runtime of all steps in one scheduler loop is accounted for in statistics.
+   *
+   * @see Scheduler namespace documentation for discussion about tasks.
+   */
+  template<typename... Args>
+  class SteppedTask : public TimedTaskBase
+  {
+  public:
+    /// Default time slice in microseconds.
+    static constexpr unsigned long DEFAULT_SLICE = 5000;
+
+    /*!
+     * @brief Construct the task.
+     *
+     * @param stats statistics to update.
+     * @param args arguments for task invoker (function and parameters).
+     */
+    template<typename... CArgs>
+    SteppedTask(TaskTimingStats& stats, CArgs&&... args) noexcept :
+      TimedTaskBase(&invoke),
+      call_invoker_(scheduler_cpp11_support::forward<CArgs>(args)...),
+      stats_(stats)
+    {}
+
+    /*!
+     * @brief Construct the task in a given priority class.
+     *
+     * @param priority priority class of the task.
+     * @param stats statistics to update.
+     * @param args arguments for task invoker (function and parameters).
+     */
+    template<typename... CArgs>
+    SteppedTask(TaskPriority priority, TaskTimingStats& stats, CArgs&&... args) noexcept :
+      TimedTaskBase(&invoke, priority),
+      call_invoker_(scheduler_cpp11_support::forward<CArgs>(args)...),
+      stats_(stats)
+    {}
+
+    /*!
+     * @brief Start the job.
+     *
+     * @param slice maximum time in microseconds to spend in steps per loop.
+     *    At least one step is executed per loop.
+     */
+    void start(unsigned long slice = DEFAULT_SLICE) noexcept {
+      slice_ = slice;
+      running_ = true;
+      first_step_ = true;
+      runOnce(0);
+    }
+
+    /// Finish the job (call from the task function when done or to abort the job).
+    void finish() noexcept {
+      running_ = false;
+      cancel();
+    }
+
+    /// Stop calling the task function in this loop, continue in the next loop (call from the task function).
+    void continueNextLoop() noexcept { next_loop_ = true; }
+
+    /// Check whether the job is still running.
+    bool isRunning() const noexcept { return running_; }
+
+    /// Get statistics for this task.
+    inline TaskTimingStats& getStatistics() const noexcept { return stats_; }
+
+  private:
+    static unsigned long invoke(TaskBase& t, unsigned long start) noexcept {
+      auto& instance = static_cast<SteppedTask<Args...>&>(t);
+      if (instance.first_step_) {
+        // only the start of the job is scheduled, continuation steps are not late
+        instance.stats_.addLateness(instance.getScheduleTime(), start);
+        instance.first_step_ = false;
+      }
+      unsigned long end;
+      instance.next_loop_ = false;
+      SchedulerTrace::add(TraceEvent::TASK_BEGIN, start, instance.stats_.getName());
+      do {
+        instance.call_invoker_.invoke();
+        end = micros();
+      } while (instance.running_ && !instance.next_loop_ && end - start < instance.slice_);
+      SchedulerTrace::add(TraceEvent::TASK_END, end, instance.stats_.getName());
+      if (instance.running_)
+        instance.runOnce(0);  // continue in the next loop
+      instance.stats_.addRuntime(end - start);
+      LatenessAttribution::addRun(instance.stats_.getName(), start, end);
+      return end;
     }
 
     SchedulerImpl::call_invoker<Args...> call_invoker_;
+    TaskTimingStats& stats_;
+    unsigned long slice_ = DEFAULT_SLICE;
+    bool running_ = false;
+    bool first_step_ = false;
+    bool next_loop_ = false;
   };
 
   /*!
@@ -171,15 +322,35 @@ namespace Scheduler
       stats_(stats)
     {}
 
+    /*!
+     * @brief Construct the task in a given priority class.
+     *
+     * @param priority priority class of the task.
+     * @param stats statistics to update.
+     * @param args arguments for task invoker (function and parameters).
+     */
+    template<typename... CArgs>
+    PollTask(TaskPriority priority, TaskPollingStats& stats, CArgs&&... args) noexcept :
+      PollTaskBase(&invoke, priority),
+      call_invoker_(scheduler_cpp11_support::forward<CArgs>(args)...),
+      stats_(stats)
+    {}
+
     /// Get statistics for this task.
     inline TaskPollingStats& getStatistics() const noexcept { return stats_; }
 
   private:
     static unsigned long invoke(TaskBase& t, unsigned long start) noexcept {
       auto& instance = static_cast<PollTask<Args...>&>(t);
+      SchedulerTrace::add(TraceEvent::POLL_BEGIN, start, instance.stats_.getName());
       instance.call_invoker_.invoke();
       auto end = micros();
+      SchedulerTrace::add(TraceEvent::POLL_END, end, instance.stats_.getName());
       instance.stats_.addPolltime(end - start);
+      instance.stats_.addSkipped(instance.takeSkippedCount());
+      if (instance.isActive() && instance.getLastPollTime())
+        instance.stats_.addReaction(start - instance.getLastPollTime());
+      LatenessAttribution::addRun(instance.stats_.getName(), start, end);
       return end;
     }
 
@@ -212,10 +383,14 @@ namespace Scheduler
     {}
 
   private:
-    static unsigned long invoke(TaskBase& t, unsigned long /*start*/) noexcept {
+    static unsigned long invoke(TaskBase& t, unsigned long start) noexcept {
       auto& instance = static_cast<UnaccountedPollTask<Args...>&>(t);
+      SchedulerTrace::add(TraceEvent::POLL_BEGIN, start, nullptr);
       instance.call_invoker_.invoke();
-      return micros();
+      auto end = micros();
+      SchedulerTrace::add(TraceEvent::POLL_END, end, nullptr);
+      LatenessAttribution::addRun(nullptr, start, end);
+      return end;
     }
 
     SchedulerImpl::call_invoker<Args...> call_invoker_;
@@ -224,6 +399,10 @@ namespace Scheduler
   /*!
    * @brief Function for deep sleep, if there are no tasks to run.
    *
+   * The function may return earlier, e.g., when woken up by an interrupt.
+   * The scheduler then checks wake sources of polling tasks and calls
+   * the function again for the remaining time, if there is nothing to do.
+   *
    * @param us number of microseconds to deep sleep.
    */
   using DeepSleepCallback = void(*)(unsigned long us);
@@ -245,21 +424,76 @@ namespace Scheduler
      * @param deep_sleep (optional) function to enter deep sleep if
      *    there are no tasks to run.
      */
-    TimeScheduler(DeepSleepCallback deep_sleep = nullptr) noexcept :
-      deep_sleep_(deep_sleep)
-    {}
+    TimeScheduler(DeepSleepCallback deep_sleep = nullptr) noexcept;
 
     /// Method to call in loop() to process tasks.
     void loop() noexcept;
 
+    /*!
+     * @brief Set time budget per loop for a priority class.
+     *
+     * When tasks of the class ran at least for this time in the current loop,
+     * remaining tasks of the class are deferred to the next loop. At least one
+     * task of each class runs in each loop, if any is due.
+     *
+     * @param priority priority class.
+     * @param budget time budget in microseconds, 0 for unlimited.
+     */
+    void setBudget(TaskPriority priority, unsigned long budget) noexcept {
+      budget_[static_cast<unsigned char>(priority)] = budget;
+    }
+
+    /// Get time budget per loop for a priority class (0 for unlimited).
+    unsigned long getBudget(TaskPriority priority) const noexcept {
+      return budget_[static_cast<unsigned char>(priority)];
+    }
+
+    /// Get count of task runs deferred due to exhausted budget of a priority class.
+    unsigned long getDeferredCount(TaskPriority priority) const noexcept {
+      return deferred_count_[static_cast<unsigned char>(priority)];
+    }
+
+    /*!
+     * @brief Serialize budgets and deferred task counts of all priority classes.
+     *
+     * @param buffer,size buffer where to materialize the string (should be >=100B).
+     */
+    void priorityToString(char* buffer, unsigned size) const noexcept;
+
   protected:
-    /// Run normal timed tasks.
-    unsigned long runTimedTasks() noexcept;
+    /// Collect expired timed tasks for running them in this loop.
+    void collectDueTasks() noexcept;
+    /// Run expired timed tasks of one priority class.
+    unsigned long runTimedTasks(TaskPriority priority) noexcept;
+    /// Run all tasks of one priority class.
+    virtual unsigned long runTasks(TaskPriority priority) noexcept;
     /// Check whether deep sleep is necessary and do deep sleep.
     virtual void checkDeepSleep() noexcept;
+    /// Check whether some task has work to do, which ends the sleep.
+    virtual bool isWakeupPending() noexcept;
+    /*!
+     * @brief Sleep until the next timed task is due.
+     *
+     * @param max_sleep maximum time to sleep in microseconds.
+     */
+    void sleep(unsigned long max_sleep) noexcept;
+    /// Check whether the budget of a priority class is used up in this loop.
+    bool isOverBudget(unsigned char priority) const noexcept {
+      return budget_[priority] && class_runtime_[priority] >= budget_[priority];
+    }
 
     /// Function for deep sleep, if there are no tasks to run.
     DeepSleepCallback deep_sleep_;
+    /// Expired timed tasks to run in this loop per priority class.
+    TimedTaskBase* due_list_[TASK_PRIORITY_COUNT];
+    /// Time budget per loop per priority class.
+    unsigned long budget_[TASK_PRIORITY_COUNT];
+    /// Time used by each priority class in this loop.
+    unsigned long class_runtime_[TASK_PRIORITY_COUNT];
+    /// Count of deferred task runs per priority class.
+    unsigned long deferred_count_[TASK_PRIORITY_COUNT];
+    /// Time used by polling tasks in this loop.
+    unsigned long poll_runtime_ = 0;
   };
 
   /*!
@@ -280,13 +514,18 @@ namespace Scheduler
       TimeScheduler(deep_sleep)
     {}
 
-    /// Method to call in loop() to process tasks.
-    void loop() noexcept;
+    using TimeScheduler::loop;
+    using TimeScheduler::setBudget;
+    using TimeScheduler::getBudget;
+    using TimeScheduler::getDeferredCount;
+    using TimeScheduler::priorityToString;
 
   protected:
-    /// Run polling tasks.
-    unsigned long runPollTasks() noexcept;
+    /// Run polling tasks of one priority class.
+    unsigned long runPollTasks(TaskPriority priority) noexcept;
 
+    virtual unsigned long runTasks(TaskPriority priority) noexcept override;
     virtual void checkDeepSleep() noexcept override;
+    virtual bool isWakeupPending() noexcept override;
   };
 }
@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) 2018 Ivan Schréter (schreter@gmx.net)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * This copyright notice MUST APPEAR in all copies of the software!
+ */
+
+#include "CborDecoder.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+  /// Maximum nesting depth, protects against malicious input.
+  static constexpr unsigned MAX_DEPTH = 16;
+
+  /// Round a value to the nearest half precision number (normal range only).
+  double roundToHalf(double value)
+  {
+    if (value == 0 || !isfinite(value))
+      return value;
+    int exponent;
+    frexp(fabs(value), &exponent);
+    double ulp = ldexp(1.0, exponent - 11);
+    return nearbyint(value / ulp) * ulp;
+  }
+
+  /// Check if the text converts back to the same value in the encoded precision.
+  bool sameFloat(const char* text, double value, uint8_t float_size)
+  {
+    double parsed = strtod(text, nullptr);
+    switch (float_size) {
+      case 2:  return roundToHalf(parsed) == value;
+      case 4:  return float(parsed) == float(value);
+      default: return parsed == value;
+    }
+  }
+
+  /// Append a string as JSON string literal.
+  void appendString(std::string& out, const std::string& str)
+  {
+    out += '"';
+    for (unsigned char c : str) {
+      if (c == '"' || c == '\\') {
+        out += '\\';
+        out += char(c);
+      } else if (c < 0x20) {
+        char buffer[8];
+        snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+        out += buffer;
+      } else {
+        out += char(c);
+      }
+    }
+    out += '"';
+  }
+
+  class Decoder
+  {
+  public:
+    Decoder(const uint8_t* data, size_t size) : begin_(data), cur_(data), end_(data + size) {}
+
+    bool decode(CborItem& item, unsigned depth = 0)
+    {
+      if (depth > MAX_DEPTH)
+        return fail("nesting too deep");
+      uint8_t initial;
+      if (!read(initial))
+        return false;
+      uint8_t major = initial >> 5, info = initial & 0x1f;
+      if (major == 7)
+        return decodeSimple(item, info);
+      bool indefinite = info == 31;
+      uint64_t arg = 0;
+      if (!indefinite && !argument(info, arg))
+        return false;
+      switch (major) {
+        case 0:
+          item.kind = CborItem::Kind::INTEGER;
+          item.integer = int64_t(arg);
+          item.number = double(arg);
+          return arg <= uint64_t(INT64_MAX) || fail("integer out of range");
+        case 1:
+          item.kind = CborItem::Kind::INTEGER;
+          item.integer = -1 - int64_t(arg);
+          item.number = double(item.integer);
+          return arg <= uint64_t(INT64_MAX) || fail("integer out of range");
+        case 2:
+        case 3:
+          item.kind = major == 2 ? CborItem::Kind::BYTES : CborItem::Kind::TEXT;
+          return indefinite ? decodeChunks(item, major) : readString(item.text, arg);
+        case 4:
+        case 5: {
+          item.kind = major == 4 ? CborItem::Kind::ARRAY : CborItem::Kind::MAP;
+          uint64_t count = major == 5 ? arg * 2 : arg;
+          for (uint64_t i = 0; indefinite || i < count; ++i) {
+            if (indefinite && atBreak())
+              return (major == 4 || item.items.size() % 2 == 0) || fail("map without value");
+            if (!indefinite && count > size_t(end_ - cur_))
+              return fail("truncated container");
+            item.items.emplace_back();
+            if (!decode(item.items.back(), depth + 1))
+              return false;
+          }
+          return true;
+        }
+        default:
+          // tag, decode the content
+          if (indefinite)
+            return fail("indefinite tag");
+          return decode(item, depth + 1);
+      }
+    }
+
+    size_t consumed() const { return size_t(cur_ - begin_); }
+
+    const std::string& error() const { return error_; }
+
+  private:
+    bool fail(const char* message)
+    {
+      char buffer[80];
+      snprintf(buffer, sizeof(buffer), "%s at offset %zu", message, consumed());
+      error_ = buffer;
+      return false;
+    }
+
+    bool read(uint8_t& byte)
+    {
+      if (cur_ == end_)
+        return fail("unexpected end");
+      byte = *cur_++;
+      return true;
+    }
+
+    bool readBigEndian(uint8_t size, uint64_t& value)
+    {
+      if (size_t(end_ - cur_) < size)
+        return fail("unexpected end");
+      value = 0;
+      for (uint8_t i = 0; i < size; ++i)
+        value = (value << 8) | *cur_++;
+      return true;
+    }
+
+    bool argument(uint8_t info, uint64_t& value)
+    {
+      if (info < 24) {
+        value = info;
+        return true;
+      }
+      if (info > 27)
+        return fail("invalid additional information");
+      return readBigEndian(uint8_t(1 << (info - 24)), value);
+    }
+
+    bool atBreak()
+    {
+      if (cur_ != end_ && *cur_ == 0xff) {
+        ++cur_;
+        return true;
+      }
+      return false;
+    }
+
+    bool readString(std::string& str, uint64_t length)
+    {
+      if (uint64_t(end_ - cur_) < length)
+        return fail("truncated string");
+      str.append(reinterpret_cast<const char*>(cur_), size_t(length));
+      cur_ += length;
+      return true;
+    }
+
+    bool decodeChunks(CborItem& item, uint8_t major)
+    {
+      while (!atBreak()) {
+        uint8_t initial;
+        uint64_t length;
+        if (!read(initial))
+          return false;
+        if ((initial >> 5) != major || (initial & 0x1f) == 31)
+          return fail("invalid string chunk");
+        if (!argument(initial & 0x1f, length) || !readString(item.text, length))
+          return false;
+      }
+      return true;
+    }
+
+    bool decodeSimple(CborItem& item, uint8_t info)
+    {
+      uint64_t bits;
+      switch (info) {
+        case 20: item.kind = CborItem::Kind::FALSE; return true;
+        case 21: item.kind = CborItem::Kind::TRUE; return true;
+        case 22: item.kind = CborItem::Kind::NUL; return true;
+        case 23: item.kind = CborItem::Kind::UNDEFINED; return true;
+        case 25: {
+          if (!readBigEndian(2, bits))
+            return false;
+          int exponent = int((bits >> 10) & 0x1f);
+          double mantissa = double(bits & 0x3ff);
+          double value;
+          if (exponent == 0)
+            value = ldexp(mantissa, -24);
+          else if (exponent == 31)
+            value = mantissa ? NAN : INFINITY;
+          else
+            value = ldexp(mantissa + 1024, exponent - 25);
+          return setFloat(item, (bits & 0x8000) ? -value : value, 2);
+        }
+        case 26: {
+          if (!readBigEndian(4, bits))
+            return false;
+          uint32_t b = uint32_t(bits);
+          float value;
+          memcpy(&value, &b, sizeof(value));
+          return setFloat(item, value, 4);
+        }
+        case 27: {
+          if (!readBigEndian(8, bits))
+            return false;
+          double value;
+          memcpy(&value, &bits, sizeof(value));
+          return setFloat(item, value, 8);
+        }
+        default:
+          return fail("unsupported simple value");
+      }
+    }
+
+    bool setFloat(CborItem& item, double value, uint8_t size)
+    {
+      item.kind = CborItem::Kind::FLOAT;
+      item.number = value;
+      item.float_size = size;
+      return true;
+    }
+
+    const uint8_t* begin_;
+    const uint8_t* cur_;
+    const uint8_t* end_;
+    std::string error_;
+  };
+}
+
+void CborItem::toJson(std::string& out) const
+{
+  char buffer[40];
+  switch (kind) {
+    case Kind::INTEGER:
+      snprintf(buffer, sizeof(buffer), "%lld", static_cast<long long>(integer));
+      out += buffer;
+      break;
+    case Kind::FLOAT:
+      if (!isfinite(number)) {
+        out += "null";   // JSON has no NaN and infinity
+        break;
+      }
+      for (int precision = 1; precision <= 17; ++precision) {
+        snprintf(buffer, sizeof(buffer), "%.*g", precision, number);
+        if (sameFloat(buffer, number, float_size))
+          break;
+      }
+      out += buffer;
+      break;
+    case Kind::TEXT:
+    case Kind::BYTES:
+      appendString(out, text);
+      break;
+    case Kind::ARRAY:
+      out += '[';
+      for (size_t i = 0; i < items.size(); ++i) {
+        if (i)
+          out += ',';
+        items[i].toJson(out);
+      }
+      out += ']';
+      break;
+    case Kind::MAP:
+      out += '{';
+      for (size_t i = 0; i + 1 < items.size(); i += 2) {
+        if (i)
+          out += ',';
+        if (items[i].kind == Kind::TEXT) {
+          items[i].toJson(out);
+        } else {
+          std::string key;
+          items[i].toJson(key);
+          appendString(out, key);
+        }
+        out += ':';
+        items[i + 1].toJson(out);
+      }
+      out += '}';
+      break;
+    case Kind::FALSE:     out += "false"; break;
+    case Kind::TRUE:      out += "true"; break;
+    case Kind::NUL:       out += "null"; break;
+    case Kind::UNDEFINED: out += "null"; break;
+  }
+}
+
+const CborItem* CborItem::find(const char* key) const
+{
+  if (kind != Kind::MAP)
+    return nullptr;
+  for (size_t i = 0; i + 1 < items.size(); i += 2) {
+    if (items[i].kind == Kind::TEXT && items[i].text == key)
+      return &items[i + 1];
+  }
+  return nullptr;
+}
+
+size_t cborDecode(const uint8_t* data, size_t size, CborItem& item, std::string& error)
+{
+  Decoder decoder(data, size);
+  item = CborItem();
+  if (!decoder.decode(item)) {
+    error = decoder.error();
+    return 0;
+  }
+  return decoder.consumed();
+}
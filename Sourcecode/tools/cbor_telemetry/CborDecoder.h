@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2018 Ivan Schréter (schreter@gmx.net)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * This copyright notice MUST APPEAR in all copies of the software!
+ */
+
+/*!
+ * @file
+ * @brief Host-side decoder of CBOR telemetry payloads.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*!
+ * @brief Decoded CBOR data item.
+ *
+ * Supports all major types produced by CborWriter and the common rest of
+ * RFC 8949 (byte strings, arrays, definite and indefinite lengths). Tags
+ * are skipped, their content is decoded.
+ */
+struct CborItem
+{
+  enum class Kind { INTEGER, FLOAT, TEXT, BYTES, ARRAY, MAP, FALSE, TRUE, NUL, UNDEFINED };
+
+  Kind kind = Kind::UNDEFINED;
+  int64_t integer = 0;        ///< Value of an integer (also negative ones).
+  double number = 0;          ///< Value of a float or integer.
+  uint8_t float_size = 0;     ///< Encoded size of a float (2, 4 or 8 bytes).
+  std::string text;           ///< Content of a text or byte string.
+  std::vector<CborItem> items;  ///< Array elements or map keys and values alternating.
+
+  /// Format the item as JSON, floats with the shortest text converting back to the same float.
+  void toJson(std::string& out) const;
+
+  /// Find a member of a map by text key, return @c nullptr if not found.
+  const CborItem* find(const char* key) const;
+};
+
+/*!
+ * @brief Decode one data item.
+ *
+ * @param data,size input buffer.
+ * @param[out] item decoded item.
+ * @param[out] error description of the error, if any.
+ * @return count of bytes consumed or 0 on error.
+ */
+size_t cborDecode(const uint8_t* data, size_t size, CborItem& item, std::string& error);
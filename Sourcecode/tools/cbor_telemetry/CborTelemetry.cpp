@@ -0,0 +1,622 @@
+/*
+ * Copyright (C) 2018 Ivan Schréter (schreter@gmx.net)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * This copyright notice MUST APPEAR in all copies of the software!
+ */
+
+/*!
+ * @file
+ * @brief CBOR telemetry decoder and comparison with text payloads.
+ *
+ * Without options, encodes telemetry values mirroring the controller once
+ * as text (NumberFormat, as MessageHandler::publish() does) and once CBOR
+ * encoded (CborWriter, as MessageHandler::publishCbor() does), as well as
+ * snapshot documents by JsonWriter and CborWriter. It verifies that both
+ * forms decode to the same values and reports payload sizes and the time
+ * to encode and decode them on the host.
+ *
+ * With --decode, it decodes CBOR payloads received from the controller and
+ * prints them as JSON.
+ */
+
+#include "CborDecoder.h"
+
+#include <CborWriter.h>
+#include <JsonWriter.h>
+#include <NumberFormat.h>
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC
+#endif
+
+namespace
+{
+  /// Count of measurement rounds, best one is reported.
+  static constexpr unsigned ROUNDS = 5;
+
+  /// Count of generated samples per workload.
+  static constexpr unsigned SAMPLES = 1000;
+
+  /// Topic prefix of state messages of the default configuration.
+  static constexpr const char* STATE_PREFIX = "d15/state/kwl/";
+
+  /// Get timestamp in cycles or ns.
+  inline unsigned long long timestamp()
+  {
+  #ifdef HAVE_RDTSC
+    return __rdtsc();
+  #else
+    return static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+  #endif
+  }
+
+  /// Size of a MQTT PUBLISH packet (QoS 0) with given topic and payload size.
+  size_t packetSize(const char* topic, size_t payload)
+  {
+    size_t remaining = 2 + strlen(STATE_PREFIX) + strlen(topic) + payload;
+    size_t length_bytes = 1;
+    for (size_t r = remaining; r >= 128; r /= 128)
+      ++length_bytes;
+    return 1 + length_bytes + remaining;
+  }
+
+  /// Output into a fixed buffer.
+  class Buffer : public Print
+  {
+  public:
+    using Print::write;
+
+    virtual size_t write(uint8_t c) override
+    {
+      if (size_ >= sizeof(data_) - 1)
+        return 0;
+      data_[size_++] = c;
+      data_[size_] = 0;
+      return 1;
+    }
+
+    void clear() { size_ = 0; data_[0] = 0; }
+    const uint8_t* data() const { return data_; }
+    const char* text() const { return reinterpret_cast<const char*>(data_); }
+    size_t size() const { return size_; }
+
+  private:
+    uint8_t data_[512];
+    size_t size_ = 0;
+  };
+
+  /// Simple deterministic random generator.
+  class Random
+  {
+  public:
+    uint32_t next() { state_ = state_ * 1103515245U + 12345U; return state_ >> 8; }
+    /// Get random value in range [low, high].
+    int32_t range(int32_t low, int32_t high) { return low + int32_t(next() % uint32_t(high - low + 1)); }
+  private:
+    uint32_t state_ = 42;
+  };
+
+  /// Measurements of the controller, same members as KWLControl::writeSnapshot().
+  struct Snapshot
+  {
+    double t[4];
+    int eff, mode, fan1, fan2;
+    const char* bypass;
+    const char* antifreeze;
+    bool has_sensors;
+    float dht1t, dht1h, dht2t, dht2h;
+    int co2, voc;
+    unsigned errors, info;
+  };
+
+  /// Write the snapshot same as KWLControl::writeSnapshot().
+  template<typename Writer>
+  void writeSnapshot(Print& out, const Snapshot& s)
+  {
+    Writer writer(out);
+    static const char* const keys[] = { "t1", "t2", "t3", "t4" };
+    for (unsigned i = 0; i < 4; ++i) {
+      if (s.t[i] != -127.0)
+        writer.member(F(keys[i]), s.t[i], 2);
+      else
+        writer.memberNull(F(keys[i]));
+    }
+    writer.member(F("eff"), long(s.eff));
+    writer.member(F("mode"), long(s.mode));
+    writer.member(F("fan1"), long(s.fan1));
+    writer.member(F("fan2"), long(s.fan2));
+    writer.member(F("bypass"), F(s.bypass));
+    writer.member(F("antifreeze"), F(s.antifreeze));
+    if (s.has_sensors) {
+      writer.member(F("dht1t"), double(s.dht1t), 1);
+      writer.member(F("dht1h"), double(s.dht1h), 1);
+      writer.member(F("dht2t"), double(s.dht2t), 1);
+      writer.member(F("dht2h"), double(s.dht2h), 1);
+      writer.member(F("co2"), long(s.co2));
+      writer.member(F("voc"), long(s.voc));
+    }
+    writer.member(F("errors"), long(s.errors));
+    writer.member(F("info"), long(s.info));
+    writer.end();
+  }
+
+  /// Member of a parsed flat JSON object.
+  struct Field
+  {
+    std::string key;
+    bool is_null = false;
+    bool is_text = false;
+    double number = 0;
+    uint8_t decimals = 0;   ///< Decimal places of the number in the text.
+    std::string text;
+  };
+
+  /// Parse a flat JSON object as produced by JsonWriter, return @c false on error.
+  bool parseJson(const char* p, std::vector<Field>& fields)
+  {
+    fields.clear();
+    if (*p++ != '{')
+      return false;
+    while (*p != '}') {
+      if (!fields.empty() && *p++ != ',')
+        return false;
+      if (*p++ != '"')
+        return false;
+      Field f;
+      while (*p && *p != '"')
+        f.key += *p++;
+      if (*p++ != '"' || *p++ != ':')
+        return false;
+      if (*p == '"') {
+        f.is_text = true;
+        for (++p; *p && *p != '"'; )
+          f.text += *p++;
+        if (*p++ != '"')
+          return false;
+      } else if (!strncmp(p, "null", 4)) {
+        f.is_null = true;
+        p += 4;
+      } else {
+        char* end;
+        f.number = strtod(p, &end);
+        if (end == p)
+          return false;
+        auto dot = static_cast<const char*>(memchr(p, '.', size_t(end - p)));
+        if (dot)
+          f.decimals = uint8_t(end - dot - 1);
+        p = end;
+      }
+      fields.push_back(std::move(f));
+    }
+    return true;
+  }
+
+  /// Check if two numbers are equal when rounded to given decimals.
+  bool sameValue(double a, double b, uint8_t decimals)
+  {
+    double scale = pow(10.0, decimals);
+    return llround(a * scale) == llround(b * scale);
+  }
+
+  /// Verify that the CBOR map contains the same members as the JSON object.
+  bool sameSnapshot(const std::vector<Field>& fields, const CborItem& map)
+  {
+    if (map.kind != CborItem::Kind::MAP || map.items.size() != fields.size() * 2)
+      return false;
+    for (auto& f : fields) {
+      auto v = map.find(f.key.c_str());
+      if (!v)
+        return false;
+      if (f.is_null) {
+        if (v->kind != CborItem::Kind::NUL)
+          return false;
+      } else if (f.is_text) {
+        if (v->kind != CborItem::Kind::TEXT || v->text != f.text)
+          return false;
+      } else if ((v->kind != CborItem::Kind::INTEGER && v->kind != CborItem::Kind::FLOAT) ||
+                 !sameValue(f.number, v->number, f.decimals)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// Single numeric telemetry value as published by a telemetry channel.
+  struct Value
+  {
+    double value;
+    uint8_t decimals;
+    bool integer;
+  };
+
+  /// Workload of single values published to one topic.
+  struct Workload
+  {
+    const char* name;
+    const char* topic;
+    unsigned topics;      ///< Count of topics with such values.
+    std::vector<Value> values;
+  };
+
+  /// Write the value as text, same as MessageHandler::publish().
+  void writeText(Buffer& out, const Value& v)
+  {
+    char buffer[NumberFormat::MAX_LENGTH];
+    auto end = v.integer ? NumberFormat::formatInteger(buffer, int32_t(v.value)) :
+                           NumberFormat::formatDecimal(buffer, v.value, v.decimals);
+    out.write(buffer, size_t(end - buffer));
+  }
+
+  /// Write the value CBOR encoded, same as MessageHandler::publishCbor().
+  void writeCbor(Buffer& out, const Value& v)
+  {
+    if (v.integer)
+      CborWriter::writeInteger(out, int32_t(v.value));
+    else
+      CborWriter::writeDecimal(out, v.value, v.decimals);
+  }
+
+  /// Measure average time per call of the function over all samples, best of ROUNDS.
+  template<typename Func>
+  double measure(size_t samples, unsigned iterations, Func&& func)
+  {
+    double best = 1e30;
+    for (unsigned round = 0; round < ROUNDS; ++round) {
+      auto start = timestamp();
+      for (unsigned it = 0; it < iterations; ++it)
+        func(it % samples);
+      auto ticks = double(timestamp() - start) / iterations;
+      if (ticks < best)
+        best = ticks;
+    }
+    return best;
+  }
+
+  /// Sink to prevent optimizing measured code away.
+  volatile double s_sink;
+
+  /// Sizes and times of one workload.
+  struct Result
+  {
+    double text_bytes = 0, cbor_bytes = 0;          ///< Average payload size.
+    double text_packet = 0, cbor_packet = 0;        ///< Average MQTT packet size.
+    double text_encode = 0, cbor_encode = 0;        ///< Time to encode.
+    double text_decode = 0, cbor_decode = 0;        ///< Time to decode.
+  };
+
+  void printResult(const char* name, const Result& r)
+  {
+    printf("  %-14s %7.1f %7.1f %6.0f%% %9.1f %9.1f %9.1f %9.1f\n", name, r.text_bytes, r.cbor_bytes,
+      100.0 * (1.0 - r.cbor_bytes / r.text_bytes), r.text_encode, r.cbor_encode, r.text_decode, r.cbor_decode);
+  }
+
+  /// Run workload of single values, return @c false if values differ.
+  bool runValues(const Workload& w, unsigned iterations, Result& r)
+  {
+    Buffer text, cbor;
+    CborItem item;
+    std::string error;
+    for (auto& v : w.values) {
+      text.clear();
+      cbor.clear();
+      writeText(text, v);
+      writeCbor(cbor, v);
+      if (!cborDecode(cbor.data(), cbor.size(), item, error) ||
+          (item.kind != CborItem::Kind::INTEGER && item.kind != CborItem::Kind::FLOAT) ||
+          !sameValue(strtod(text.text(), nullptr), item.number, v.decimals)) {
+        printf("ERROR: %s: text %s, CBOR decoded differently %s\n", w.name, text.text(), error.c_str());
+        return false;
+      }
+      r.text_bytes += double(text.size());
+      r.cbor_bytes += double(cbor.size());
+      r.text_packet += double(packetSize(w.topic, text.size()));
+      r.cbor_packet += double(packetSize(w.topic, cbor.size()));
+    }
+    auto n = w.values.size();
+    r.text_bytes /= double(n);
+    r.cbor_bytes /= double(n);
+    r.text_packet /= double(n);
+    r.cbor_packet /= double(n);
+
+    r.text_encode = measure(n, iterations, [&](size_t i) { text.clear(); writeText(text, w.values[i]); });
+    r.cbor_encode = measure(n, iterations, [&](size_t i) { cbor.clear(); writeCbor(cbor, w.values[i]); });
+    // encode all payloads upfront to measure decoding alone
+    std::vector<Buffer> texts(n), cbors(n);
+    for (size_t i = 0; i < n; ++i) {
+      writeText(texts[i], w.values[i]);
+      writeCbor(cbors[i], w.values[i]);
+    }
+    r.text_decode = measure(n, iterations, [&](size_t i) { s_sink = strtod(texts[i].text(), nullptr); });
+    r.cbor_decode = measure(n, iterations, [&](size_t i) {
+      cborDecode(cbors[i].data(), cbors[i].size(), item, error);
+      s_sink = item.number;
+    });
+    return true;
+  }
+
+  /// Run workload of snapshots, return @c false if documents differ.
+  bool runSnapshots(const std::vector<Snapshot>& snapshots, unsigned iterations, Result& r)
+  {
+    auto n = snapshots.size();
+    std::vector<Buffer> texts(n), cbors(n);
+    std::vector<Field> fields;
+    CborItem item;
+    std::string error;
+    for (size_t i = 0; i < n; ++i) {
+      writeSnapshot<JsonWriter>(texts[i], snapshots[i]);
+      writeSnapshot<CborWriter>(cbors[i], snapshots[i]);
+      if (!parseJson(texts[i].text(), fields)) {
+        printf("ERROR: cannot parse JSON %s\n", texts[i].text());
+        return false;
+      }
+      if (!cborDecode(cbors[i].data(), cbors[i].size(), item, error) || !sameSnapshot(fields, item)) {
+        std::string json;
+        item.toJson(json);
+        printf("ERROR: snapshot differs:\n  JSON %s\n  CBOR %s %s\n", texts[i].text(), json.c_str(), error.c_str());
+        return false;
+      }
+      r.text_bytes += double(texts[i].size());
+      r.cbor_bytes += double(cbors[i].size());
+      r.text_packet += double(packetSize("snapshot", texts[i].size()));
+      r.cbor_packet += double(packetSize("snapshot", cbors[i].size()));
+    }
+    r.text_bytes /= double(n);
+    r.cbor_bytes /= double(n);
+    r.text_packet /= double(n);
+    r.cbor_packet /= double(n);
+
+    Buffer out;
+    r.text_encode = measure(n, iterations, [&](size_t i) { out.clear(); writeSnapshot<JsonWriter>(out, snapshots[i]); });
+    r.cbor_encode = measure(n, iterations, [&](size_t i) { out.clear(); writeSnapshot<CborWriter>(out, snapshots[i]); });
+    r.text_decode = measure(n, iterations, [&](size_t i) {
+      parseJson(texts[i].text(), fields);
+      s_sink = fields[0].number;
+    });
+    r.cbor_decode = measure(n, iterations, [&](size_t i) {
+      cborDecode(cbors[i].data(), cbors[i].size(), item, error);
+      s_sink = item.items[1].number;
+    });
+    return true;
+  }
+
+  /// Generate snapshots with random walk of measurements.
+  std::vector<Snapshot> makeSnapshots(bool has_sensors)
+  {
+    static const char* const bypass[] = { "closed", "open", "unknown" };
+    Random rnd;
+    std::vector<Snapshot> result;
+    for (unsigned i = 0; i < SAMPLES; ++i) {
+      Snapshot s;
+      s.t[0] = rnd.range(-20 * 16, 35 * 16) * 0.0625;   // DS18B20 resolution
+      for (unsigned j = 1; j < 4; ++j)
+        s.t[j] = rnd.range(15 * 16, 28 * 16) * 0.0625;
+      if (rnd.range(0, 99) == 0)
+        s.t[rnd.range(0, 3)] = -127.0;  // sensor error
+      s.eff = rnd.range(50, 95);
+      s.mode = rnd.range(0, 3);
+      s.fan1 = rnd.range(0, 3000);
+      s.fan2 = rnd.range(0, 3000);
+      s.bypass = bypass[rnd.range(0, 2)];
+      s.antifreeze = rnd.range(0, 9) ? "off" : "on";
+      s.has_sensors = has_sensors;
+      s.dht1t = float(rnd.range(150, 300) * 0.1);
+      s.dht1h = float(rnd.range(200, 900) * 0.1);
+      s.dht2t = float(rnd.range(-200, 350) * 0.1);
+      s.dht2h = float(rnd.range(200, 990) * 0.1);
+      s.co2 = rnd.range(400, 2000);
+      s.voc = rnd.range(0, 1000);
+      s.errors = rnd.range(0, 49) ? 0 : 8;
+      s.info = rnd.range(0, 9) ? 0 : 0x200 + unsigned(rnd.range(0, 100));
+      result.push_back(s);
+    }
+    return result;
+  }
+
+  /// Build single value workloads with the numeric telemetry topics.
+  std::vector<Workload> makeWorkloads()
+  {
+    Random rnd;
+    std::vector<Workload> result;
+    auto add = [&](const char* name, const char* topic, unsigned topics, int32_t low, int32_t high,
+                   double scale, uint8_t decimals, bool integer) {
+      Workload w{name, topic, topics, {}};
+      for (unsigned i = 0; i < SAMPLES; ++i)
+        w.values.push_back(Value{double(float(rnd.range(low, high) * scale)), decimals, integer});
+      result.push_back(w);
+    };
+    add("temperature", "aussenluft/temperatur", 4, -20 * 16, 35 * 16, 0.0625, 2, false);
+    add("efficiency", "effiencyKwl", 1, 50, 95, 1, 0, true);
+    add("fan speed", "fan1/speed", 2, 0, 3000, 1, 0, true);
+    add("mode", "lueftungsstufe", 1, 0, 3, 1, 0, true);
+    add("DHT temp.", "dht1/temperatur", 2, -200, 350, 0.1, 1, false);
+    add("DHT humidity", "dht1/humidity", 2, 200, 990, 0.1, 1, false);
+    add("CO2", "abluft/co2", 1, 400, 2000, 1, 0, true);
+    add("VOC", "abluft/voc", 1, 0, 1000, 1, 0, true);
+    return result;
+  }
+
+  /// Parse a hexadecimal string, return @c false on invalid characters.
+  bool parseHex(const char* p, std::vector<uint8_t>& data)
+  {
+    data.clear();
+    int high = -1;
+    for (; *p; ++p) {
+      int digit;
+      if (*p >= '0' && *p <= '9')
+        digit = *p - '0';
+      else if (*p >= 'a' && *p <= 'f')
+        digit = *p - 'a' + 10;
+      else if (*p >= 'A' && *p <= 'F')
+        digit = *p - 'A' + 10;
+      else if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+        continue;
+      else
+        return false;
+      if (high < 0) {
+        high = digit;
+      } else {
+        data.push_back(uint8_t(high * 16 + digit));
+        high = -1;
+      }
+    }
+    return high < 0;
+  }
+
+  /// Decode all items in the buffer and print them as JSON, one per line.
+  bool printDecoded(const std::vector<uint8_t>& data)
+  {
+    size_t offset = 0;
+    while (offset < data.size()) {
+      CborItem item;
+      std::string error, json;
+      auto used = cborDecode(data.data() + offset, data.size() - offset, item, error);
+      if (!used) {
+        fprintf(stderr, "ERROR: %s\n", error.c_str());
+        return false;
+      }
+      item.toJson(json);
+      puts(json.c_str());
+      offset += used;
+    }
+    return true;
+  }
+
+  /// Decode binary CBOR payloads or hex-encoded payloads (one per line) from the file.
+  int decode(FILE* in, bool hex)
+  {
+    std::vector<uint8_t> data;
+    if (hex) {
+      char line[4096];
+      int rc = 0;
+      while (fgets(line, sizeof(line), in)) {
+        if (!parseHex(line, data)) {
+          fprintf(stderr, "ERROR: invalid hex input: %s", line);
+          rc = 1;
+        } else if (!printDecoded(data)) {
+          rc = 1;
+        }
+      }
+      return rc;
+    }
+    int c;
+    while ((c = fgetc(in)) != EOF)
+      data.push_back(uint8_t(c));
+    return printDecoded(data) ? 0 : 1;
+  }
+
+  void usage()
+  {
+    printf("Usage: cbor_telemetry [--iterations N] [--verbose]\n"
+           "       cbor_telemetry --decode [--hex] [file]\n");
+  }
+}
+
+int main(int argc, char** argv)
+{
+  unsigned iterations = 100000;
+  bool verbose = false, decode_mode = false, hex = false;
+  const char* file = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--iterations") && i + 1 < argc) {
+      iterations = unsigned(atol(argv[++i]));
+    } else if (!strcmp(argv[i], "--verbose")) {
+      verbose = true;
+    } else if (!strcmp(argv[i], "--decode")) {
+      decode_mode = true;
+    } else if (!strcmp(argv[i], "--hex")) {
+      hex = true;
+    } else if (decode_mode && !file && argv[i][0] != '-') {
+      file = argv[i];
+    } else {
+      usage();
+      return strcmp(argv[i], "--help") ? 1 : 0;
+    }
+  }
+
+  if (decode_mode) {
+    FILE* in = file ? fopen(file, "rb") : stdin;
+    if (!in) {
+      perror(file);
+      return 1;
+    }
+    int rc = decode(in, hex);
+    if (file)
+      fclose(in);
+    return rc;
+  }
+  if (!iterations)
+    iterations = 1;
+
+#ifdef HAVE_RDTSC
+  const char* unit = "cycles";
+#else
+  const char* unit = "ns";
+#endif
+  printf("Text vs. CBOR payloads, %u samples each, best of %u x %u iterations (%s per payload on the host):\n",
+    SAMPLES, ROUNDS, iterations, unit);
+  printf("  %-14s %7s %7s %7s %9s %9s %9s %9s\n",
+    "workload", "text B", "CBOR B", "saving", "enc text", "enc CBOR", "dec text", "dec CBOR");
+
+  // sum of MQTT packet sizes of all numeric topics sent individually per reporting interval
+  double text_total = 0, cbor_total = 0;
+  unsigned messages = 0;
+  int rc = 0;
+  for (auto& w : makeWorkloads()) {
+    Result r;
+    if (!runValues(w, iterations, r)) {
+      rc = 2;
+      continue;
+    }
+    printResult(w.name, r);
+    text_total += r.text_packet * w.topics;
+    cbor_total += r.cbor_packet * w.topics;
+    messages += w.topics;
+  }
+
+  Result base, full;
+  if (!runSnapshots(makeSnapshots(false), iterations, base) || !runSnapshots(makeSnapshots(true), iterations, full))
+    return 2;
+  printResult("snapshot", base);
+  printResult("snap. sensors", full);
+
+  printf("\nMQTT bytes per reporting interval with all sensors (PUBLISH packets, QoS 0, topic prefix %s):\n",
+    STATE_PREFIX);
+  printf("  %2u messages, text  %7.1f\n", messages, text_total);
+  printf("  %2u messages, CBOR  %7.1f\n", messages, cbor_total);
+  printf("  snapshot, JSON     %7.1f\n", full.text_packet);
+  printf("  snapshot, CBOR     %7.1f\n", full.cbor_packet);
+
+  if (verbose) {
+    auto snapshots = makeSnapshots(true);
+    Buffer json, cbor;
+    writeSnapshot<JsonWriter>(json, snapshots[0]);
+    writeSnapshot<CborWriter>(cbor, snapshots[0]);
+    printf("\nExample snapshot:\n  JSON %s\n  CBOR ", json.text());
+    for (size_t i = 0; i < cbor.size(); ++i)
+      printf("%02x", cbor.data()[i]);
+    printf("\n");
+  }
+  return rc;
+}
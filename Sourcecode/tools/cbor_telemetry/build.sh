@@ -0,0 +1,29 @@
+#!/bin/sh
+
+# Build the CBOR telemetry tool and optionally run it.
+#
+# Usage: build.sh [options]
+#   Without arguments, only builds the tool. With arguments, builds
+#   it and runs it with the given arguments (see README.md).
+#   Set CXX to use another compiler, BUILD_DIR to change output directory.
+
+cd `dirname $0`
+ROOT=`pwd`
+LIB="$ROOT/../../KWLctl/libraries"
+BUILD_DIR=${BUILD_DIR:-$ROOT/build}
+CXX=${CXX:-g++}
+
+mkdir -p "$BUILD_DIR" || exit 1
+if ! $CXX -std=gnu++11 -O2 -g -Wall -Wextra \
+    -I"$ROOT/host" -I"$LIB/NumberFormat" -I"$LIB/MessageHandler" \
+    "$ROOT/CborTelemetry.cpp" "$ROOT/CborDecoder.cpp" \
+    "$LIB/MessageHandler/CborWriter.cpp" "$LIB/MessageHandler/JsonWriter.cpp" \
+    "$LIB/NumberFormat/NumberFormat.cpp" \
+    -o "$BUILD_DIR/cbor_telemetry"; then
+    echo "ERROR: cannot build CBOR telemetry tool"
+    exit 1
+fi
+
+if [ $# -gt 0 ]; then
+    exec "$BUILD_DIR/cbor_telemetry" "$@"
+fi
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2018 Ivan Schréter (schreter@gmx.net)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * This copyright notice MUST APPEAR in all copies of the software!
+ */
+
+/*!
+ * @file
+ * @brief Minimum Arduino API needed to build NumberFormat and payload writers on the host.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) reinterpret_cast<const __FlashStringHelper*>(s)
+
+class __FlashStringHelper;
+
+inline char* strcpy_P(char* dest, const char* src) { return strcpy(dest, src); }
+inline size_t strlen_P(const char* str) { return strlen(str); }
+inline uint32_t pgm_read_dword(const uint32_t* addr) { return *addr; }
+
+/// Output interface as in Arduino core.
+class Print
+{
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (size--)
+      n += write(*buffer++);
+    return n;
+  }
+  size_t write(const char* buffer, size_t size) { return write(reinterpret_cast<const uint8_t*>(buffer), size); }
+  size_t print(const __FlashStringHelper* str) {
+    auto s = reinterpret_cast<const char*>(str);
+    return write(s, strlen(s));
+  }
+};
@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2018 Ivan Schréter (schreter@gmx.net)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * This copyright notice MUST APPEAR in all copies of the software!
+ */
+
+/*!
+ * @file
+ * @brief Microbenchmark of MQTT command dispatch.
+ *
+ * Compares the former dispatch (each handler compares the topic with each of
+ * its commands in turn) with dispatch via topic hash (each handler switches
+ * over the hash computed once by MessageHandler and verifies the topic in
+ * the matching case). Handlers, their order and their commands mirror the
+ * controller, so the cost per message is representative.
+ */
+
+#include <StringView.h>
+#include "../../KWLctl/MQTTTopic.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC
+#endif
+
+unsigned long host_flash_compares = 0;
+unsigned long host_flash_compare_bytes = 0;
+
+namespace
+{
+  /// Command handled by a handler.
+  struct Command
+  {
+    const __FlashStringHelper* topic;
+    unsigned length;
+    uint16_t hash;
+    bool prefix;    ///< Topic is a prefix followed by parameters.
+  };
+
+  #define EXACT(name) { MQTTTopic::name, MQTTTopic::name.length(), MQTTTopic::name.hash(), false }
+  #define PREFIX(name) { MQTTTopic::name, MQTTTopic::name.length(), MQTTTopic::name.hash(), true }
+
+  // Commands in the order of comparisons in the former handlers.
+  const Command program_manager[] = { EXACT(CmdSetProgramSet), PREFIX(CmdSetProgram) };
+  const Command antifreeze[] = { EXACT(CmdAntiFreezeHyst), EXACT(CmdHeatingAppCombUse) };
+  const Command summer_bypass[] = {
+    EXACT(CmdBypassGetValues), EXACT(CmdBypassHystereseMinutes), EXACT(CmdBypassManualFlap),
+    EXACT(CmdBypassMode), EXACT(CmdBypassHyst), EXACT(CmdBypassTempAbluftMin),
+    EXACT(CmdBypassTempAussenluftMin)
+  };
+  const Command fan_control[] = {
+    EXACT(CmdFan1Speed), EXACT(CmdFan2Speed), EXACT(CmdMode), EXACT(CmdFansCalculateSpeedMode),
+    EXACT(CmdCalibrateFans), EXACT(CmdGetSpeed), EXACT(KwlDebugsetFan1Getvalues),
+    EXACT(KwlDebugsetFan2Getvalues), EXACT(KwlDebugsetFan1PWM), EXACT(KwlDebugsetFan2PWM),
+    EXACT(KwlDebugsetFanPWMStore)
+  };
+  const Command temp_sensors[] = {
+    EXACT(CmdGetTemp), EXACT(KwlDebugsetTemperaturAussenluft), EXACT(KwlDebugsetTemperaturZuluft),
+    EXACT(KwlDebugsetTemperaturAbluft), EXACT(KwlDebugsetTemperaturFortluft)
+  };
+  const Command network_client[] = { EXACT(CmdInstallPrefix) };
+  const Command kwl_control[] = {
+    EXACT(CmdResetAll), EXACT(CmdRestart), EXACT(KwlDebugsetSchedulerResetvalues),
+    EXACT(CmdGetvalues), EXACT(CmdSchedulerGetIntervals), EXACT(CmdSchedulerStoreIntervals),
+    PREFIX(CmdSchedulerInterval), EXACT(KwlDebugsetSchedulerGetvalues),
+    EXACT(KwlDebugsetSchedulerTrace), EXACT(KwlDebugsetNTPTime), EXACT(KwlDebugsetCrashGetvalues),
+    EXACT(KwlDebugsetCrashResetvalues), EXACT(KwlDebugsetEepromDump), EXACT(KwlDebugsetCrashProvoke)
+  };
+
+  #undef EXACT
+  #undef PREFIX
+
+  /// Message handler with its commands.
+  struct Handler
+  {
+    const char* name;
+    const Command* commands;
+    unsigned count;
+    std::vector<const Command*> by_hash;  ///< Exact commands sorted by hash (as compiled from switch).
+  };
+
+  /// Handlers in the order of registration list (last constructed first).
+  Handler handlers[] = {
+    { "ProgramManager", program_manager, sizeof(program_manager) / sizeof(Command), {} },
+    { "Antifreeze", antifreeze, sizeof(antifreeze) / sizeof(Command), {} },
+    { "SummerBypass", summer_bypass, sizeof(summer_bypass) / sizeof(Command), {} },
+    { "FanControl", fan_control, sizeof(fan_control) / sizeof(Command), {} },
+    { "TempSensors", temp_sensors, sizeof(temp_sensors) / sizeof(Command), {} },
+    { "NetworkClient", network_client, sizeof(network_client) / sizeof(Command), {} },
+    { "KWLControl", kwl_control, sizeof(kwl_control) / sizeof(Command), {} },
+  };
+  constexpr unsigned HANDLER_COUNT = sizeof(handlers) / sizeof(Handler);
+
+  /// Check prefix command like the handlers do.
+  bool matchPrefix(const StringView& topic, const Command& cmd)
+  {
+    return topic.substr(0, cmd.length) == cmd.topic;
+  }
+
+  /// Former dispatch, returns index of the handler or HANDLER_COUNT if none.
+  unsigned dispatchLinear(const StringView& topic)
+  {
+    for (unsigned h = 0; h < HANDLER_COUNT; ++h) {
+      auto& handler = handlers[h];
+      for (unsigned i = 0; i < handler.count; ++i) {
+        auto& cmd = handler.commands[i];
+        if (cmd.prefix ? matchPrefix(topic, cmd) : topic == cmd.topic)
+          return h;
+      }
+    }
+    return HANDLER_COUNT;
+  }
+
+  /// Dispatch via topic hash, returns index of the handler or HANDLER_COUNT if none.
+  unsigned dispatchHash(const StringView& topic)
+  {
+    const auto hash = topic.hash();
+    for (unsigned h = 0; h < HANDLER_COUNT; ++h) {
+      auto& handler = handlers[h];
+      // switch over hash, compiled as a tree of comparisons
+      auto it = std::lower_bound(handler.by_hash.begin(), handler.by_hash.end(), hash,
+        [](const Command* cmd, uint16_t value) { return cmd->hash < value; });
+      if (it != handler.by_hash.end() && (*it)->hash == hash && topic == (*it)->topic)
+        return h;
+      // prefix commands are still checked after the switch
+      for (unsigned i = 0; i < handler.count; ++i) {
+        auto& cmd = handler.commands[i];
+        if (cmd.prefix && matchPrefix(topic, cmd))
+          return h;
+      }
+    }
+    return HANDLER_COUNT;
+  }
+
+  /// Read a time stamp in cycles (or nanoseconds, if cycles are not available).
+  inline unsigned long long timestamp()
+  {
+#ifdef HAVE_RDTSC
+    return __rdtsc();
+#else
+    return static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+  }
+
+  /// Result of measuring one topic with one dispatch method.
+  struct Measurement
+  {
+    double ticks;         ///< Time stamp ticks per message.
+    double compares;      ///< Flash compares per message.
+    double bytes;         ///< Bytes compared in Flash per message.
+    unsigned handler;     ///< Handler found.
+  };
+
+  /// Count of measurement rounds per topic.
+  constexpr unsigned ROUNDS = 5;
+
+  template<typename Func>
+  Measurement measure(const StringView& topic, unsigned iterations, Func&& dispatch)
+  {
+    Measurement m;
+    host_flash_compares = host_flash_compare_bytes = 0;
+    m.handler = dispatch(topic);
+    m.compares = double(host_flash_compares);
+    m.bytes = double(host_flash_compare_bytes);
+    // take the best of several rounds to filter out interference
+    volatile unsigned sink = 0;
+    m.ticks = 0;
+    for (unsigned round = 0; round < ROUNDS; ++round) {
+      auto start = timestamp();
+      for (unsigned i = 0; i < iterations; ++i)
+        sink = sink + dispatch(topic);
+      auto ticks = double(timestamp() - start) / iterations;
+      if (round == 0 || ticks < m.ticks)
+        m.ticks = ticks;
+    }
+    return m;
+  }
+
+  void usage()
+  {
+    printf("Usage: mqtt_dispatch_bench [--iterations N] [--verbose]\n");
+  }
+}
+
+int main(int argc, char** argv)
+{
+  unsigned iterations = 50000;
+  bool verbose = false;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--iterations") && i + 1 < argc) {
+      iterations = unsigned(atol(argv[++i]));
+    } else if (!strcmp(argv[i], "--verbose")) {
+      verbose = true;
+    } else {
+      usage();
+      return strcmp(argv[i], "--help") ? 1 : 0;
+    }
+  }
+
+  // build hash tables and collect messages: each command plus an unknown topic
+  std::vector<const char*> messages;
+  for (auto& handler : handlers) {
+    for (unsigned i = 0; i < handler.count; ++i) {
+      auto& cmd = handler.commands[i];
+      if (cmd.prefix)
+        continue;
+      for (auto other : handler.by_hash) {
+        if (other->hash == cmd.hash) {
+          printf("ERROR: hash collision in %s: %s and %s\n", handler.name,
+            reinterpret_cast<const char*>(cmd.topic), reinterpret_cast<const char*>(other->topic));
+          return 2;
+        }
+      }
+      handler.by_hash.push_back(&cmd);
+      messages.push_back(reinterpret_cast<const char*>(cmd.topic));
+    }
+    std::sort(handler.by_hash.begin(), handler.by_hash.end(),
+      [](const Command* l, const Command* r) { return l->hash < r->hash; });
+  }
+  messages.push_back("program/3/get");
+  messages.push_back("scheduler/interval/FanControl");
+  messages.push_back("unknown/topic");
+
+#ifdef HAVE_RDTSC
+  const char* unit = "cycles";
+#else
+  const char* unit = "ns";
+#endif
+  if (verbose)
+    printf("%-36s %-15s %9s %9s %7s %7s %7s %7s\n", "topic", "handler", "before", "after", "cmp", "cmp", "bytes", "bytes");
+
+  double sum_linear = 0, sum_hash = 0, cmp_linear = 0, cmp_hash = 0, bytes_linear = 0, bytes_hash = 0;
+  double max_linear = 0, max_hash = 0, max_cmp_linear = 0, max_cmp_hash = 0;
+  for (auto msg : messages) {
+    StringView topic(msg);
+    auto linear = measure(topic, iterations, dispatchLinear);
+    auto hashed = measure(topic, iterations, dispatchHash);
+    if (linear.handler != hashed.handler) {
+      printf("ERROR: topic %s dispatched differently\n", msg);
+      return 2;
+    }
+    if (verbose) {
+      printf("%-36s %-15s %9.1f %9.1f %7.0f %7.0f %7.0f %7.0f\n", msg,
+        linear.handler < HANDLER_COUNT ? handlers[linear.handler].name : "-",
+        linear.ticks, hashed.ticks, linear.compares, hashed.compares, linear.bytes, hashed.bytes);
+    }
+    sum_linear += linear.ticks;
+    sum_hash += hashed.ticks;
+    cmp_linear += linear.compares;
+    cmp_hash += hashed.compares;
+    bytes_linear += linear.bytes;
+    bytes_hash += hashed.bytes;
+    max_linear = std::max(max_linear, linear.ticks);
+    max_hash = std::max(max_hash, hashed.ticks);
+    max_cmp_linear = std::max(max_cmp_linear, linear.compares);
+    max_cmp_hash = std::max(max_cmp_hash, hashed.compares);
+  }
+
+  const double n = double(messages.size());
+  printf("MQTT dispatch of %u topics, best of %u x %u iterations each (%s per message on the host):\n",
+    unsigned(messages.size()), ROUNDS, iterations, unit);
+  printf("  %-8s %10s %10s %14s %14s %16s\n", "method", "avg", "max", "avg Flash cmp", "max Flash cmp", "avg bytes cmp");
+  printf("  %-8s %10.1f %10.1f %14.1f %14.0f %16.1f\n", "before", sum_linear / n, max_linear, cmp_linear / n, max_cmp_linear, bytes_linear / n);
+  printf("  %-8s %10.1f %10.1f %14.1f %14.0f %16.1f\n", "after", sum_hash / n, max_hash, cmp_hash / n, max_cmp_hash, bytes_hash / n);
+  return 0;
+}
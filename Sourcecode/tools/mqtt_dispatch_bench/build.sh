@@ -0,0 +1,27 @@
+#!/bin/sh
+
+# Build the MQTT dispatch microbenchmark and optionally run it.
+#
+# Usage: build.sh [options]
+#   Without arguments, only builds the benchmark. With arguments, builds
+#   it and runs it with the given arguments (see README.md).
+#   Set CXX to use another compiler, BUILD_DIR to change output directory.
+
+cd `dirname $0`
+ROOT=`pwd`
+LIB="$ROOT/../../KWLctl/libraries"
+BUILD_DIR=${BUILD_DIR:-$ROOT/build}
+CXX=${CXX:-g++}
+
+mkdir -p "$BUILD_DIR" || exit 1
+if ! $CXX -std=gnu++11 -O2 -g -Wall -Wextra \
+    -I"$ROOT/host" -I"$LIB/StringView" -I"$LIB/FlashStringLiteral" \
+    "$ROOT/MqttDispatchBench.cpp" \
+    -o "$BUILD_DIR/mqtt_dispatch_bench"; then
+    echo "ERROR: cannot build MQTT dispatch benchmark"
+    exit 1
+fi
+
+if [ $# -gt 0 ]; then
+    exec "$BUILD_DIR/mqtt_dispatch_bench" "$@"
+fi
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2018 Ivan Schréter (schreter@gmx.net)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * This copyright notice MUST APPEAR in all copies of the software!
+ */
+
+/*!
+ * @file
+ * @brief PROGMEM helpers mapped to plain RAM functions on the host.
+ *
+ * Comparisons against Flash strings are counted, since they dominate the cost
+ * of topic dispatch on the controller (each memcmp_P() call and each byte read
+ * from Flash is comparatively expensive on AVR).
+ */
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+
+/// Count of memcmp_P() calls.
+extern unsigned long host_flash_compares;
+/// Count of bytes compared by memcmp_P() calls.
+extern unsigned long host_flash_compare_bytes;
+
+/// Compare RAM with "program memory" and count the comparison.
+inline int host_memcmp_P(const void* ram, const void* flash, size_t len)
+{
+  ++host_flash_compares;
+  auto a = static_cast<const unsigned char*>(ram);
+  auto b = static_cast<const unsigned char*>(flash);
+  for (size_t i = 0; i < len; ++i) {
+    ++host_flash_compare_bytes;
+    if (a[i] != b[i])
+      return a[i] < b[i] ? -1 : 1;
+  }
+  return 0;
+}
+
+/// Read a value of given type from "program memory" (little endian, like AVR).
+template<typename T>
+inline T host_pgm_read(const void* addr)
+{
+  T value;
+  memcpy(&value, addr, sizeof(value));
+  return value;
+}
+
+#define pgm_read_byte(addr) host_pgm_read<uint8_t>(addr)
+#define memcmp_P(ram, flash, len) host_memcmp_P(ram, flash, len)
+#define memcpy_P memcpy
+#define strlen_P strlen
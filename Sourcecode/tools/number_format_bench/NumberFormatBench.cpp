@@ -0,0 +1,333 @@
+/*
+ * Copyright (C) 2018 Ivan Schréter (schreter@gmx.net)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * This copyright notice MUST APPEAR in all copies of the software!
+ */
+
+/*!
+ * @file
+ * @brief Microbenchmark of number formatting for telemetry payloads.
+ *
+ * Compares NumberFormat with the functions formerly used by the publish
+ * overloads, fan debug messages, status bits and TFT number fields:
+ * printf-style formatting, dtostrf() (printf float formatting on the host)
+ * and ltoa()/ultoa() (modeled by one 32-bit division per digit, as in
+ * avr-libc). Values mirror the telemetry of the controller.
+ */
+
+#include <NumberFormat.h>
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC
+#endif
+
+namespace
+{
+  /// Count of measurement rounds, best one is reported.
+  static constexpr unsigned ROUNDS = 5;
+
+  /// Kind of formatted value.
+  enum class Kind { DECIMAL, INTEGER, UNSIGNED, HEX };
+
+  /// Set of values formatted the same way.
+  struct Workload
+  {
+    const char* name;
+    Kind kind;
+    uint8_t decimals;     ///< Decimal places or minimum hex digits.
+    std::vector<double> decimals_values;
+    std::vector<int32_t> integer_values;
+    std::vector<uint32_t> unsigned_values;
+  };
+
+  /// Get timestamp in cycles or ns.
+  inline unsigned long long timestamp()
+  {
+  #ifdef HAVE_RDTSC
+    return __rdtsc();
+  #else
+    return static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+  #endif
+  }
+
+  /// Former ultoa(): one 32-bit division per digit.
+  char* perDigitUltoa(char* buffer, uint32_t value)
+  {
+    char tmp[10];
+    char* p = tmp + sizeof(tmp);
+    do {
+      *--p = char('0' + value % 10);
+      value /= 10;
+    } while (value);
+    auto len = size_t(tmp + sizeof(tmp) - p);
+    memcpy(buffer, p, len);
+    buffer[len] = 0;
+    return buffer + len;
+  }
+
+  /// Former ltoa(): sign and one 32-bit division per digit.
+  char* perDigitLtoa(char* buffer, int32_t value)
+  {
+    if (value < 0) {
+      *buffer++ = '-';
+      return perDigitUltoa(buffer, 0U - uint32_t(value));
+    }
+    return perDigitUltoa(buffer, uint32_t(value));
+  }
+
+  /// Count of 32-bit divisions needed by NumberFormat::formatUnsigned().
+  unsigned groupDivisions(uint32_t value)
+  {
+    unsigned count = 0;
+    for (; value > 0xffffU; value /= 10000)
+      ++count;
+    return count;
+  }
+
+  /// Count of 32-bit divisions needed by per-digit conversion.
+  unsigned digitDivisions(uint32_t value)
+  {
+    unsigned count = 0;
+    do {
+      ++count;
+      value /= 10;
+    } while (value);
+    return count;
+  }
+
+  /// Format value of the workload by former method.
+  void formatFormer(const Workload& w, size_t i, char* buffer, bool printf_style)
+  {
+    switch (w.kind) {
+      case Kind::DECIMAL:
+        snprintf(buffer, NumberFormat::MAX_LENGTH, "%.*f", int(w.decimals), w.decimals_values[i]);
+        break;
+      case Kind::INTEGER:
+        if (printf_style)
+          snprintf(buffer, NumberFormat::MAX_LENGTH, "%d", int(w.integer_values[i]));
+        else
+          perDigitLtoa(buffer, w.integer_values[i]);
+        break;
+      case Kind::UNSIGNED:
+        if (printf_style)
+          snprintf(buffer, NumberFormat::MAX_LENGTH, "%u", unsigned(w.unsigned_values[i]));
+        else
+          perDigitUltoa(buffer, w.unsigned_values[i]);
+        break;
+      case Kind::HEX:
+        snprintf(buffer, NumberFormat::MAX_LENGTH, "%0*X", int(w.decimals), unsigned(w.unsigned_values[i]));
+        break;
+    }
+  }
+
+  /// Format value of the workload by NumberFormat.
+  void formatNew(const Workload& w, size_t i, char* buffer)
+  {
+    switch (w.kind) {
+      case Kind::DECIMAL:  NumberFormat::formatDecimal(buffer, w.decimals_values[i], w.decimals); break;
+      case Kind::INTEGER:  NumberFormat::formatInteger(buffer, w.integer_values[i]); break;
+      case Kind::UNSIGNED: NumberFormat::formatUnsigned(buffer, w.unsigned_values[i]); break;
+      case Kind::HEX:      NumberFormat::formatHex(buffer, w.unsigned_values[i], w.decimals); break;
+    }
+  }
+
+  /// Get count of values of the workload.
+  size_t count(const Workload& w)
+  {
+    switch (w.kind) {
+      case Kind::DECIMAL: return w.decimals_values.size();
+      case Kind::INTEGER: return w.integer_values.size();
+      default:            return w.unsigned_values.size();
+    }
+  }
+
+  /// Measure average time per value of the formatting function, best of ROUNDS.
+  template<typename Func>
+  double measure(const Workload& w, unsigned iterations, Func&& format)
+  {
+    char buffer[NumberFormat::MAX_LENGTH];
+    unsigned long long sink = 0;
+    double best = 1e30;
+    auto n = count(w);
+    for (unsigned round = 0; round < ROUNDS; ++round) {
+      auto start = timestamp();
+      for (unsigned it = 0; it < iterations; ++it) {
+        format(w, it % n, buffer);
+        sink += uint8_t(buffer[0]);
+      }
+      auto ticks = double(timestamp() - start) / iterations;
+      if (ticks < best)
+        best = ticks;
+    }
+    if (sink == 42)
+      puts("");   // prevent optimizing the loop away
+    return best;
+  }
+
+  /*!
+   * @brief Verify NumberFormat against printf-style formatting.
+   *
+   * Decimals may differ only in rounding of exact ties (printf rounds half
+   * to even, NumberFormat half away from zero) and in the sign of zero.
+   *
+   * @return count of values differing only in rounding, or -1 on error.
+   */
+  long verify(const Workload& w, bool verbose)
+  {
+    long ties = 0;
+    char expected[64], actual[NumberFormat::MAX_LENGTH];
+    for (size_t i = 0; i < count(w); ++i) {
+      formatFormer(w, i, expected, true);
+      formatNew(w, i, actual);
+      if (!strcmp(expected, actual))
+        continue;
+      if (w.kind == Kind::DECIMAL) {
+        auto diff = fabs(strtod(expected, nullptr) - strtod(actual, nullptr));
+        if (diff <= pow(10.0, -w.decimals) * 1.001) {
+          if (verbose)
+            printf("  %s: rounding %s vs. %s\n", w.name, expected, actual);
+          ++ties;
+          continue;
+        }
+      }
+      printf("ERROR: %s: expected %s, got %s\n", w.name, expected, actual);
+      return -1;
+    }
+    return ties;
+  }
+
+  void usage()
+  {
+    printf("Usage: number_format_bench [--iterations N] [--verbose]\n");
+  }
+}
+
+int main(int argc, char** argv)
+{
+  unsigned iterations = 200000;
+  bool verbose = false;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--iterations") && i + 1 < argc) {
+      iterations = unsigned(atol(argv[++i]));
+    } else if (!strcmp(argv[i], "--verbose")) {
+      verbose = true;
+    } else {
+      usage();
+      return strcmp(argv[i], "--help") ? 1 : 0;
+    }
+  }
+  if (!iterations)
+    iterations = 1;
+
+  // workloads mirroring the telemetry
+  std::vector<Workload> workloads;
+  {
+    Workload w{"temperature", Kind::DECIMAL, 2, {}, {}, {}};
+    for (int i = -30 * 16; i <= 60 * 16; ++i)
+      w.decimals_values.push_back(i * 0.0625);  // DS18B20 resolution
+    workloads.push_back(w);
+  }
+  {
+    Workload w{"humidity/VOC", Kind::DECIMAL, 1, {}, {}, {}};
+    for (int i = 0; i <= 1000; ++i)
+      w.decimals_values.push_back(i * 0.1 + 0.03);
+    workloads.push_back(w);
+  }
+  {
+    Workload w{"fan speed", Kind::INTEGER, 0, {}, {}, {}};
+    for (int32_t i = -500; i <= 3500; i += 7)
+      w.integer_values.push_back(i);
+    workloads.push_back(w);
+  }
+  {
+    Workload w{"timestamp", Kind::UNSIGNED, 0, {}, {}, {}};
+    for (uint32_t i = 0, v = 1; i < 1000; ++i, v = v * 1103515245U + 12345U)
+      w.unsigned_values.push_back(v);
+    workloads.push_back(w);
+  }
+  {
+    Workload w{"status bits", Kind::HEX, 8, {}, {}, {}};
+    for (uint32_t i = 0; i < 512; ++i)
+      w.unsigned_values.push_back(((i & 0x1ff) << 16) | ((i & 3) << 8) | (i & 0x7f));
+    workloads.push_back(w);
+  }
+
+#ifdef HAVE_RDTSC
+  const char* unit = "cycles";
+#else
+  const char* unit = "ns";
+#endif
+  printf("Number formatting, best of %u x %u iterations each (%s per value on the host):\n",
+    ROUNDS, iterations, unit);
+  printf("  %-14s %10s %10s %10s %8s %10s %10s\n",
+    "workload", "printf", "per-digit", "new", "speedup", "div32 old", "div32 new");
+  int rc = 0;
+  for (auto& w : workloads) {
+    auto ties = verify(w, verbose);
+    if (ties < 0) {
+      rc = 2;
+      continue;
+    }
+    auto printf_time = measure(w, iterations, [](const Workload& w, size_t i, char* b) { formatFormer(w, i, b, true); });
+    double digit_time = 0;
+    if (w.kind == Kind::INTEGER || w.kind == Kind::UNSIGNED)
+      digit_time = measure(w, iterations, [](const Workload& w, size_t i, char* b) { formatFormer(w, i, b, false); });
+    auto new_time = measure(w, iterations, formatNew);
+
+    // 32-bit divisions per value, which dominate the cost on AVR
+    double div_old = 0, div_new = 0;
+    for (size_t i = 0; i < count(w); ++i) {
+      uint32_t magnitude;
+      switch (w.kind) {
+        case Kind::DECIMAL: magnitude = uint32_t(fabs(w.decimals_values[i]) * pow(10.0, w.decimals) + 0.5); break;
+        case Kind::INTEGER: magnitude = uint32_t(labs(w.integer_values[i])); break;
+        default:            magnitude = w.unsigned_values[i]; break;
+      }
+      if (w.kind != Kind::HEX) {
+        div_old += digitDivisions(magnitude);
+        div_new += groupDivisions(magnitude);
+      }
+    }
+    div_old /= double(count(w));
+    div_new /= double(count(w));
+
+    // former ltoa()/ultoa() for integers, printf-style formatting or dtostrf() otherwise
+    auto former = digit_time > 0 ? digit_time : printf_time;
+    char digit_str[16], div_old_str[16];
+    if (digit_time > 0) {
+      snprintf(digit_str, sizeof(digit_str), "%10.1f", digit_time);
+      snprintf(div_old_str, sizeof(div_old_str), "%10.1f", div_old);
+    } else {
+      snprintf(digit_str, sizeof(digit_str), "%10s", "-");
+      snprintf(div_old_str, sizeof(div_old_str), "%10s", "-");
+    }
+    printf("  %-14s %10.1f %s %10.1f %7.1fx %s %10.1f", w.name, printf_time, digit_str, new_time,
+      former / new_time, div_old_str, div_new);
+    if (ties)
+      printf("  (%ld ties rounded differently)", ties);
+    printf("\n");
+  }
+  return rc;
+}
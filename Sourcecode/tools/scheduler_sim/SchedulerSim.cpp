@@ -0,0 +1,626 @@
+/*
+ * Copyright (C) 2018 Ivan Schréter (schreter@gmx.net)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * This copyright notice MUST APPEAR in all copies of the software!
+ */
+
+/*!
+ * @file
+ * @brief Host simulation and benchmark of TimeScheduler with a virtual clock.
+ *
+ * Each scenario registers a set of timed and polling tasks with a cost model
+ * (simulated runtime of the task) and runs the scheduler loop on a virtual
+ * clock. Since tasks can't be unregistered from the scheduler, each run of
+ * the simulator executes exactly one scenario. See README.md for usage.
+ */
+
+#include <Arduino.h>
+#include <TimeScheduler.h>
+
+#include "VirtualClock.h"
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace Scheduler;
+
+namespace
+{
+  /// Command-line options.
+  struct Options
+  {
+    const char* scenario = "kwl";
+    double seconds = 0;               ///< Simulated time (0 for scenario default).
+    unsigned long seed = 1;           ///< Seed for random cost model.
+    unsigned tasks = 24;              ///< Count of timed tasks (overhead scenario).
+    unsigned polls = 4;               ///< Count of poll tasks (overhead scenario).
+    unsigned long loop_cost = 20;     ///< Cost of the main loop outside of the scheduler (us).
+    unsigned long timer_tick = 1024;  ///< Period of the timer interrupt ending sleep (us, 0 = none).
+    bool sleep = true;                ///< Use sleep callback.
+    bool wrap = false;                ///< Start shortly before overflow of micros().
+    bool verbose = false;             ///< Print scheduler statistics strings.
+  };
+
+  Options s_options;
+
+  /// Index of the current scheduler loop.
+  unsigned long s_loop_index = 0;
+  /// Time slept in the current scheduler loop.
+  unsigned long s_slept = 0;
+
+  /// Simple deterministic pseudo-random generator (xorshift32).
+  class Random
+  {
+  public:
+    void seed(unsigned long seed) noexcept { state_ = uint32_t(seed * 2654435761UL) | 1; }
+
+    uint32_t next() noexcept {
+      state_ ^= state_ << 13;
+      state_ ^= state_ >> 17;
+      state_ ^= state_ << 5;
+      return state_;
+    }
+
+    /// Uniformly distributed value in [0, max].
+    unsigned long uniform(unsigned long max) noexcept { return max ? next() % (max + 1) : 0; }
+
+    /// Return true with probability 1/n.
+    bool chance(unsigned long n) noexcept { return n && next() % n == 0; }
+
+    /// Exponentially distributed value with given mean (for event arrivals).
+    unsigned long exponential(unsigned long mean) noexcept {
+      double u = (next() + 1.0) / 4294967297.0;
+      return static_cast<unsigned long>(-log(u) * double(mean)) + 1;
+    }
+
+  private:
+    uint32_t state_ = 1;
+  };
+
+  Random s_random;
+
+  /*!
+   * @brief Distribution of measured values with ~1.5% relative precision.
+   *
+   * Values below 64 are counted exactly, larger values in 64 sub-buckets
+   * per power of two.
+   */
+  class Distribution
+  {
+  public:
+    Distribution() : counts_(BUCKETS) {}
+
+    void add(unsigned long value) {
+      ++counts_[index(value)];
+      ++count_;
+      sum_ += value;
+      if (value > max_)
+        max_ = value;
+    }
+
+    unsigned long long getCount() const { return count_; }
+    unsigned long getMax() const { return max_; }
+    unsigned long getAvg() const { return count_ ? static_cast<unsigned long>(sum_ / count_) : 0; }
+
+    /// Get value at given percentile (upper limit of the bucket, at most maximum).
+    unsigned long getPercentile(double percent) const {
+      if (!count_)
+        return 0;
+      auto limit = static_cast<unsigned long long>(ceil(double(count_) * percent / 100.0));
+      unsigned long long seen = 0;
+      for (unsigned i = 0; i < BUCKETS; ++i) {
+        seen += counts_[i];
+        if (seen >= limit && seen)
+          return std::min(upper(i), max_);
+      }
+      return max_;
+    }
+
+  private:
+    static constexpr unsigned SUB_BITS = 6;
+    static constexpr unsigned SUB = 1U << SUB_BITS;
+    static constexpr unsigned BUCKETS = (sizeof(unsigned long) * 8 - SUB_BITS + 1) * SUB;
+
+    static unsigned index(unsigned long value) {
+      if (value < SUB)
+        return unsigned(value);
+      unsigned exp = unsigned(sizeof(unsigned long) * 8 - 1 - __builtin_clzl(value));
+      return (exp - SUB_BITS + 1) * SUB + unsigned((value >> (exp - SUB_BITS)) & (SUB - 1));
+    }
+
+    static unsigned long upper(unsigned index) {
+      if (index < SUB)
+        return index;
+      unsigned shift = index / SUB - 1;
+      unsigned long lower = (SUB + index % SUB) * (1UL << shift);
+      return lower + (1UL << shift) - 1;
+    }
+
+    std::vector<unsigned long long> counts_;
+    unsigned long long count_ = 0;
+    unsigned long long sum_ = 0;
+    unsigned long max_ = 0;
+  };
+
+  void printDistribution(const char* name, const Distribution& d)
+  {
+    printf("  %-14s %10llu %8lu %8lu %8lu %8lu %8lu %8lu\n", name, d.getCount(), d.getAvg(),
+      d.getPercentile(50), d.getPercentile(90), d.getPercentile(99), d.getPercentile(99.9), d.getMax());
+  }
+
+  void printDistributionHeader(const char* title)
+  {
+    printf("\n%s [us]:\n  %-14s %10s %8s %8s %8s %8s %8s %8s\n", title,
+      "task", "count", "avg", "p50", "p90", "p99", "p99.9", "max");
+  }
+
+  /*!
+   * @brief Cost model of simulated work.
+   *
+   * Each run takes base time plus uniformly distributed jitter. Once in
+   * a while (with probability 1/spike_one_in), the run takes spike time
+   * instead (e.g., blocking network operation).
+   */
+  struct Cost
+  {
+    unsigned long base;
+    unsigned long jitter;
+    unsigned long spike_one_in;
+    unsigned long spike;
+
+    unsigned long sample() const noexcept {
+      if (s_random.chance(spike_one_in))
+        return spike;
+      return base + s_random.uniform(jitter);
+    }
+  };
+
+  /// Simulated timed task.
+  class SimTask
+  {
+  public:
+    SimTask(const char* name, TaskPriority priority, Cost cost) :
+      name_(name),
+      cost_(cost),
+      stats_(reinterpret_cast<const __FlashStringHelper*>(name)),
+      task_(priority, stats_, &SimTask::run, *this)
+    {}
+
+    /// Schedule the task with given interval and phase.
+    void start(unsigned long interval, unsigned long phase = 0) {
+      interval_ = interval;
+      if (phase)
+        task_.runRepeated(interval, interval, phase);
+      else
+        task_.runRepeated(interval);
+    }
+
+    /// Make the task reschedule itself in each run (runaway task).
+    void setRunaway() { runaway_ = true; task_.runOnce(0); }
+
+    const char* getName() const { return name_; }
+    unsigned long getInterval() const { return interval_; }
+    unsigned long getMaxRunsPerLoop() const { return max_runs_per_loop_; }
+    unsigned long getMaxGap() const { return max_gap_; }
+    const Distribution& getLateness() const { return lateness_; }
+    const TaskTimingStats& getStatistics() const { return stats_; }
+
+  private:
+    void run() {
+      auto now = micros();
+      lateness_.add(now - task_.getScheduleTime());
+      if (last_loop_ == s_loop_index) {
+        if (++runs_in_loop_ > max_runs_per_loop_)
+          max_runs_per_loop_ = runs_in_loop_;
+      } else {
+        last_loop_ = s_loop_index;
+        runs_in_loop_ = 1;
+        if (!max_runs_per_loop_)
+          max_runs_per_loop_ = 1;
+      }
+      if (runs_ && now - last_run_ > max_gap_)
+        max_gap_ = now - last_run_;
+      last_run_ = now;
+      ++runs_;
+      VirtualClock::advance(cost_.sample());
+      if (runaway_)
+        task_.runOnce(0);
+    }
+
+    const char* name_;
+    Cost cost_;
+    TimedTaskStats stats_;
+    TimedTask<SimTask> task_;
+    unsigned long interval_ = 0;
+    bool runaway_ = false;
+    unsigned long runs_ = 0;
+    unsigned long last_run_ = 0;
+    unsigned long last_loop_ = ~0UL;
+    unsigned long runs_in_loop_ = 0;
+    unsigned long max_runs_per_loop_ = 0;
+    unsigned long max_gap_ = 0;
+    Distribution lateness_;
+  };
+
+  /// Kind of simulated poll task.
+  enum class PollKind
+  {
+    CONTINUOUS,   ///< Polled in each loop, prevents sleep.
+    RATE_LIMITED, ///< Polled with adaptive backoff, events are only seen by polling.
+    WAKE_SOURCE   ///< Sleeps until its event arrives (interrupt-driven).
+  };
+
+  /// Simulated poll task, which handles randomly arriving events.
+  class SimPoll
+  {
+  public:
+    SimPoll(const char* name, TaskPriority priority, PollKind kind, unsigned long mean_event_interval, Cost idle, Cost active);
+
+    /// Check whether an event is waiting to be handled.
+    bool isPending() const noexcept { return mean_event_interval_ && long(micros() - next_event_) >= 0; }
+
+    /// Check whether the task wakes up the MCU on its event.
+    bool isWakeSource() const noexcept { return kind_ == PollKind::WAKE_SOURCE; }
+
+    /// Get time of the next event.
+    unsigned long getNextEvent() const noexcept { return next_event_; }
+
+    const char* getName() const { return name_; }
+    const Distribution& getReaction() const { return reaction_; }
+    const TaskPollingStats& getStatistics() const { return stats_; }
+
+    /// Simulated poll tasks, for wake checks.
+    static std::vector<SimPoll*> s_polls;
+
+  private:
+    void run() {
+      if (isPending()) {
+        reaction_.add(micros() - next_event_);
+        VirtualClock::advance(active_.sample());
+        next_event_ = micros() + s_random.exponential(mean_event_interval_);
+        task_.markActive();
+      } else {
+        VirtualClock::advance(idle_.sample());
+      }
+    }
+
+    const char* name_;
+    PollKind kind_;
+    unsigned long mean_event_interval_;
+    Cost idle_;
+    Cost active_;
+    TaskPollingStats stats_;
+    PollTask<SimPoll> task_;
+    unsigned long next_event_ = 0;
+    Distribution reaction_;
+  };
+
+  std::vector<SimPoll*> SimPoll::s_polls;
+
+  template<unsigned N>
+  bool wakeCheck() { return SimPoll::s_polls[N]->isPending(); }
+
+  /// Wake checks for poll tasks (wake check function has no context).
+  const PollTaskBase::WakeCheck WAKE_CHECKS[] = {
+    &wakeCheck<0>, &wakeCheck<1>, &wakeCheck<2>, &wakeCheck<3>,
+    &wakeCheck<4>, &wakeCheck<5>, &wakeCheck<6>, &wakeCheck<7>
+  };
+
+  SimPoll::SimPoll(const char* name, TaskPriority priority, PollKind kind, unsigned long mean_event_interval, Cost idle, Cost active) :
+    name_(name),
+    kind_(kind),
+    mean_event_interval_(mean_event_interval),
+    idle_(idle),
+    active_(active),
+    stats_(reinterpret_cast<const __FlashStringHelper*>(name)),
+    task_(priority, stats_, &SimPoll::run, *this)
+  {
+    if (mean_event_interval_)
+      next_event_ = micros() + s_random.exponential(mean_event_interval_);
+    switch (kind) {
+      case PollKind::CONTINUOUS:
+        break;
+      case PollKind::RATE_LIMITED:
+        task_.setPollInterval(1000, 5000);
+        break;
+      case PollKind::WAKE_SOURCE:
+        if (s_polls.size() >= sizeof(WAKE_CHECKS) / sizeof(WAKE_CHECKS[0])) {
+          fprintf(stderr, "Too many poll tasks with wake source\n");
+          exit(2);
+        }
+        task_.setWakeSource(WAKE_CHECKS[s_polls.size()]);
+        break;
+    }
+    s_polls.push_back(this);
+  }
+
+  std::vector<SimTask*> s_tasks;
+
+  SimTask& addTask(const char* name, TaskPriority priority, Cost cost, unsigned long interval, unsigned long phase = 0)
+  {
+    auto task = new SimTask(name, priority, cost);
+    if (interval)
+      task->start(interval, phase);
+    s_tasks.push_back(task);
+    return *task;
+  }
+
+  /*!
+   * @brief Simulated sleep (idle mode of the MCU).
+   *
+   * Sleep ends on timer interrupt, on an event of a poll task with wake
+   * source (interrupt) or after the requested time, whichever is first.
+   */
+  void simSleep(unsigned long us)
+  {
+    if (s_options.timer_tick && us > s_options.timer_tick)
+      us = s_options.timer_tick;
+    auto now = micros();
+    for (auto poll : SimPoll::s_polls) {
+      if (poll->isWakeSource()) {
+        auto delta = poll->getNextEvent() - now;
+        if (long(delta) > 0 && delta < us)
+          us = delta;
+      }
+    }
+    VirtualClock::advance(us);
+    s_slept += us;
+  }
+
+  /// Realistic task set of the ventilation controller (timings are estimates for ATmega2560).
+  void setupKWL()
+  {
+    const auto AUTO = TimedTaskBase::AUTO_PHASE;
+    // task                    priority                  base  jitter spike 1/n  spike    interval    phase
+    addTask("FanControl",     TaskPriority::CONTROL,   {2500,  1000,       0,      0}, 1000000,   AUTO);
+    addTask("TempSensors",    TaskPriority::SENSING,   {3000,  2000,     600,  30000}, 1000000,   AUTO);
+    addTask("KWLControl",     TaskPriority::CONTROL,   { 800,   400,       0,      0}, 1000000,   AUTO);
+    addTask("DisplayUpdate",  TaskPriority::UI,        {12000, 6000,       0,      0}, 1000000,   AUTO);
+    addTask("ProgramManager", TaskPriority::CONTROL,   { 400,   200,       0,      0}, 5000000);
+    addTask("SummerBypass",   TaskPriority::CONTROL,   { 300,   100,       0,      0}, 20000000);
+    addTask("Antifreeze",     TaskPriority::CONTROL,   { 300,   100,       0,      0}, 60000000);
+    addTask("AddSensors",     TaskPriority::SENSING,   {5000,   500,       0,      0}, 10000000);
+    addTask("NetworkClient",  TaskPriority::TELEMETRY, {1500,  1000,     100, 300000}, 10000000);
+    addTask("Heartbeat",      TaskPriority::TELEMETRY, {2000,   500,       0,      0}, 30000000);
+    addTask("FanMQTT",        TaskPriority::TELEMETRY, {1500,   500,       0,      0}, 5000000);
+    // poll task                                                              mean event   idle cost         active cost
+    new SimPoll("NetworkPoll", TaskPriority::TELEMETRY, PollKind::RATE_LIMITED,   500000, { 150,  50, 0, 0}, {2500, 1000, 0, 0});
+    new SimPoll("MQTTSend",    TaskPriority::TELEMETRY, PollKind::WAKE_SOURCE,   1000000, {  20,   0, 0, 0}, {1200,  400, 0, 0});
+    new SimPoll("Touch",       TaskPriority::UI,        PollKind::RATE_LIMITED,  60000000, { 300, 100, 0, 0}, {8000, 4000, 0, 0});
+    new SimPoll("Serial",      TaskPriority::CONTROL,   PollKind::WAKE_SOURCE, 600000000, {  20,   0, 0, 0}, { 500,  200, 0, 0});
+  }
+
+  /// Misbehaving tasks on top of the realistic set.
+  void setupRunaway()
+  {
+    setupKWL();
+    addTask("Runaway", TaskPriority::CONTROL, {500, 200, 0, 0}, 0).setRunaway();
+    addTask("Overrun", TaskPriority::SENSING, {15000, 20000, 0, 0}, 10000);
+  }
+
+  /// Many cheap tasks to measure overhead of the scheduler itself.
+  void setupOverhead()
+  {
+    static std::vector<std::vector<char>> names;
+    for (unsigned i = 0; i < s_options.tasks; ++i) {
+      names.emplace_back(16);
+      snprintf(names.back().data(), 16, "Task%u", i);
+      addTask(names.back().data(), static_cast<TaskPriority>(i % TASK_PRIORITY_COUNT), {5, 5, 0, 0},
+        1000 * (1 + s_random.uniform(49)));
+    }
+    for (unsigned i = 0; i < s_options.polls; ++i) {
+      names.emplace_back(16);
+      snprintf(names.back().data(), 16, "Poll%u", i);
+      new SimPoll(names.back().data(), static_cast<TaskPriority>(i % TASK_PRIORITY_COUNT), PollKind::CONTINUOUS,
+        0, {2, 2, 0, 0}, {0, 0, 0, 0});
+    }
+  }
+
+  struct Scenario
+  {
+    const char* name;
+    void (*setup)();
+    double default_seconds;
+    const char* description;
+  };
+
+  const Scenario SCENARIOS[] = {
+    { "kwl",      &setupKWL,      86400, "realistic task set of the controller" },
+    { "runaway",  &setupRunaway,  3600,  "realistic task set plus runaway and overrunning task" },
+    { "overhead", &setupOverhead, 600,   "many cheap tasks to benchmark scheduler overhead" },
+  };
+
+  void usage(const char* prog)
+  {
+    printf("Usage: %s [scenario] [options]\n\nScenarios:\n", prog);
+    for (const auto& s : SCENARIOS)
+      printf("  %-10s %s (default %.0f s)\n", s.name, s.description, s.default_seconds);
+    printf("\nOptions:\n"
+      "  --seconds N     simulated time in seconds\n"
+      "  --hours N       simulated time in hours\n"
+      "  --days N        simulated time in days\n"
+      "  --seed N        seed of the random cost model (default 1)\n"
+      "  --tasks N       count of timed tasks in overhead scenario (default 24)\n"
+      "  --polls N       count of poll tasks in overhead scenario (default 4)\n"
+      "  --loop-cost N   time spent in main loop outside of scheduler in us (default 20)\n"
+      "  --timer-tick N  period of timer interrupt ending sleep in us, 0 for none (default 1024)\n"
+      "  --no-sleep      don't use sleep callback\n"
+      "  --wrap          start 10 minutes before overflow of micros()\n"
+      "  --verbose       print statistics strings of the scheduler\n");
+  }
+
+  bool parseOptions(int argc, char** argv)
+  {
+    for (int i = 1; i < argc; ++i) {
+      const char* arg = argv[i];
+      const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+      auto numeric = [&](double& out) {
+        if (!value)
+          return false;
+        out = atof(value);
+        ++i;
+        return true;
+      };
+      double number = 0;
+      if (arg[0] != '-') {
+        s_options.scenario = arg;
+      } else if (!strcmp(arg, "--seconds") && numeric(number)) {
+        s_options.seconds = number;
+      } else if (!strcmp(arg, "--hours") && numeric(number)) {
+        s_options.seconds = number * 3600;
+      } else if (!strcmp(arg, "--days") && numeric(number)) {
+        s_options.seconds = number * 86400;
+      } else if (!strcmp(arg, "--seed") && numeric(number)) {
+        s_options.seed = static_cast<unsigned long>(number);
+      } else if (!strcmp(arg, "--tasks") && numeric(number)) {
+        s_options.tasks = static_cast<unsigned>(number);
+      } else if (!strcmp(arg, "--polls") && numeric(number)) {
+        s_options.polls = static_cast<unsigned>(number);
+      } else if (!strcmp(arg, "--loop-cost") && numeric(number)) {
+        s_options.loop_cost = static_cast<unsigned long>(number);
+      } else if (!strcmp(arg, "--timer-tick") && numeric(number)) {
+        s_options.timer_tick = static_cast<unsigned long>(number);
+      } else if (!strcmp(arg, "--no-sleep")) {
+        s_options.sleep = false;
+      } else if (!strcmp(arg, "--wrap")) {
+        s_options.wrap = true;
+      } else if (!strcmp(arg, "--verbose")) {
+        s_options.verbose = true;
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// Print results, return false if anti-runaway protection failed.
+  bool report(const Distribution& loop_busy, double wall_seconds, double simulated_seconds, unsigned long long dispatches)
+  {
+    auto loops = loop_busy.getCount();
+    printf("\nSimulated %.0f s in %.2f s wall time (%.0fx), %llu loops, %llu task runs\n",
+      simulated_seconds, wall_seconds, simulated_seconds / wall_seconds, loops, dispatches);
+    printf("Host time per loop %.1f ns, per task run %.1f ns (includes cost model)\n",
+      wall_seconds * 1e9 / double(loops), dispatches ? wall_seconds * 1e9 / double(dispatches) : 0.0);
+
+    char buffer[256];
+    LoadStatistics::toString(buffer, sizeof(buffer));
+    printf("Load (last second, per cent): %s\n", buffer);
+
+    printDistributionHeader("Busy time per loop (excluding sleep)");
+    printDistribution("loop", loop_busy);
+
+    printDistributionHeader("Lateness of timed tasks");
+    for (auto task : s_tasks)
+      printDistribution(task->getName(), task->getLateness());
+
+    printf("\nTimed tasks [us]:\n  %-14s %10s %8s %8s %8s %10s %10s %6s\n",
+      "task", "runs", "avg", "sd", "max", "interval", "max gap", "r/loop");
+    bool ok = true;
+    for (auto task : s_tasks) {
+      const auto& stats = task->getStatistics();
+      printf("  %-14s %10lu %8lu %8lu %8lu %10lu %10lu %6lu\n", task->getName(),
+        stats.getMeasurementCount(), stats.getAvgRuntime(), stats.getRuntimeStdDev(), stats.getMaxRuntimeSinceStart(),
+        task->getInterval(), task->getMaxGap(), task->getMaxRunsPerLoop());
+      if (task->getMaxRunsPerLoop() > 1)
+        ok = false;
+    }
+
+    if (!SimPoll::s_polls.empty()) {
+      printDistributionHeader("Reaction time of poll tasks to events");
+      for (auto poll : SimPoll::s_polls)
+        printDistribution(poll->getName(), poll->getReaction());
+      printf("\nPoll tasks:\n  %-14s %10s %10s %8s %8s\n", "task", "polls", "skipped", "avg", "max");
+      for (auto poll : SimPoll::s_polls) {
+        const auto& stats = poll->getStatistics();
+        printf("  %-14s %10lu %10lu %8lu %8lu\n", poll->getName(),
+          stats.getPollCount(), stats.getSkipCount(), stats.getAvgPolltime(), stats.getMaxPolltimeSinceStart());
+      }
+    }
+
+    if (s_options.verbose) {
+      printf("\nScheduler statistics:\n");
+      for (auto i = TaskTimingStats::begin(); i != TaskTimingStats::end(); ++i) {
+        i->toString(buffer, sizeof(buffer));
+        printf("  %s %s\n", reinterpret_cast<const char*>(i->getName()), buffer);
+      }
+      for (auto i = TaskPollingStats::begin(); i != TaskPollingStats::end(); ++i) {
+        i->toString(buffer, sizeof(buffer));
+        printf("  %s %s\n", reinterpret_cast<const char*>(i->getName()), buffer);
+      }
+      LatenessAttribution::toString(buffer, sizeof(buffer));
+      printf("  %s\n", buffer);
+    }
+
+    printf("\nAnti-runaway: %s\n", ok ? "OK, each task ran at most once per loop" : "FAILED, task ran more than once per loop");
+    return ok;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  if (!parseOptions(argc, argv)) {
+    usage(argv[0]);
+    return 1;
+  }
+  const Scenario* scenario = nullptr;
+  for (const auto& s : SCENARIOS) {
+    if (!strcmp(s.name, s_options.scenario))
+      scenario = &s;
+  }
+  if (!scenario) {
+    usage(argv[0]);
+    return 1;
+  }
+  double seconds = s_options.seconds > 0 ? s_options.seconds : scenario->default_seconds;
+
+  s_random.seed(s_options.seed);
+  if (s_options.wrap)
+    VirtualClock::set(0UL - 600000000UL);
+  printf("Scenario %s: %s, %zu-bit micros()%s\n", scenario->name, scenario->description,
+    sizeof(unsigned long) * 8, s_options.wrap ? ", starting before overflow" : "");
+
+  PollingScheduler scheduler(s_options.sleep ? &simSleep : nullptr);
+  scenario->setup();
+
+  Distribution loop_busy;
+  const auto duration = static_cast<unsigned long long>(seconds * 1e6);
+  unsigned long long elapsed = 0;
+  auto wall_start = std::chrono::steady_clock::now();
+  while (elapsed < duration) {
+    ++s_loop_index;
+    s_slept = 0;
+    auto loop_start = VirtualClock::now();
+    scheduler.loop();
+    VirtualClock::advance(s_options.loop_cost);
+    auto loop_time = VirtualClock::now() - loop_start;
+    loop_busy.add(loop_time - s_slept);
+    elapsed += loop_time;
+  }
+  std::chrono::duration<double> wall = std::chrono::steady_clock::now() - wall_start;
+
+  unsigned long long dispatches = 0;
+  for (auto task : s_tasks)
+    dispatches += task->getStatistics().getMeasurementCount();
+  for (auto poll : SimPoll::s_polls)
+    dispatches += poll->getStatistics().getPollCount();
+
+  return report(loop_busy, wall.count(), double(elapsed) / 1e6, dispatches) ? 0 : 3;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2018 Ivan Schréter (schreter@gmx.net)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * This copyright notice MUST APPEAR in all copies of the software!
+ */
+
+/*!
+ * @file
+ * @brief Virtual clock driving micros() and millis() in the simulator.
+ */
+#pragma once
+
+/*!
+ * @brief Virtual clock for host simulation of the scheduler.
+ *
+ * Time only advances explicitly, by simulated work of tasks and of the main
+ * loop and by simulated sleep. This makes simulation results deterministic
+ * and lets the simulator run days of simulated time in seconds.
+ */
+class VirtualClock
+{
+public:
+  VirtualClock() = delete;
+
+  /// Get current virtual time in microseconds.
+  static unsigned long now() noexcept { return s_now_; }
+
+  /// Set current virtual time (e.g., shortly before overflow of micros()).
+  static void set(unsigned long time) noexcept { s_now_ = time; }
+
+  /// Advance virtual time by a given amount of microseconds.
+  static void advance(unsigned long us) noexcept { s_now_ += us; }
+
+private:
+  static unsigned long s_now_;
+};
@@ -0,0 +1,28 @@
+#!/bin/sh
+
+# Build the host simulator of TimeScheduler and optionally run it.
+#
+# Usage: build.sh [scenario] [options]
+#   Without arguments, only builds the simulator. With arguments, builds
+#   it and runs it with the given arguments (see README.md).
+#   Set CXX to use another compiler, BUILD_DIR to change output directory.
+
+cd `dirname $0`
+ROOT=`pwd`
+LIB="$ROOT/../../KWLctl/libraries/TimeScheduler"
+BUILD_DIR=${BUILD_DIR:-$ROOT/build}
+CXX=${CXX:-g++}
+
+mkdir -p "$BUILD_DIR" || exit 1
+if ! $CXX -std=gnu++11 -O2 -g -Wall -Wextra -Wno-unused-parameter \
+    -I"$ROOT/host" -I"$LIB" \
+    "$ROOT/SchedulerSim.cpp" "$ROOT/VirtualClock.cpp" \
+    "$LIB/TimeScheduler.cpp" "$LIB/Task.cpp" "$LIB/TaskTimingStats.cpp" "$LIB/SchedulerTrace.cpp" \
+    -o "$BUILD_DIR/scheduler_sim"; then
+    echo "ERROR: cannot build scheduler simulator"
+    exit 1
+fi
+
+if [ $# -gt 0 ]; then
+    exec "$BUILD_DIR/scheduler_sim" "$@"
+fi
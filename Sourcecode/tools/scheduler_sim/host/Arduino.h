@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2018 Ivan Schréter (schreter@gmx.net)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * This copyright notice MUST APPEAR in all copies of the software!
+ */
+
+/*!
+ * @file
+ * @brief Minimal Arduino API for building TimeScheduler on the host.
+ *
+ * Only what the scheduler library needs is provided. Time is driven by
+ * the virtual clock of the simulator (see VirtualClock.h).
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <avr/pgmspace.h>
+
+extern "C" unsigned long micros(void);
+extern "C" unsigned long millis(void);
+
+/// No interrupts in the simulator.
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+/// Flash strings are ordinary strings on the host.
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper*>(PSTR(string_literal)))
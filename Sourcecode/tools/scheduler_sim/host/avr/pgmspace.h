@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2018 Ivan Schréter (schreter@gmx.net)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * This copyright notice MUST APPEAR in all copies of the software!
+ */
+
+/*!
+ * @file
+ * @brief PROGMEM helpers mapped to plain RAM functions on the host.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+
+/// Read a value of given type from "program memory" (little endian, like AVR).
+template<typename T>
+inline T host_pgm_read(const void* addr)
+{
+  T value;
+  memcpy(&value, addr, sizeof(value));
+  return value;
+}
+
+#define pgm_read_byte(addr) host_pgm_read<uint8_t>(addr)
+#define pgm_read_word(addr) host_pgm_read<uint16_t>(addr)
+#define pgm_read_dword(addr) host_pgm_read<uint32_t>(addr)
+#define pgm_read_ptr(addr) host_pgm_read<void*>(addr)
+
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define snprintf_P snprintf
+#define sprintf_P sprintf
+
+/// BSD strlcpy, not available in all C libraries.
+inline size_t host_strlcpy(char* dst, const char* src, size_t size)
+{
+  size_t len = strlen(src);
+  if (size) {
+    size_t copy = len < size - 1 ? len : size - 1;
+    memcpy(dst, src, copy);
+    dst[copy] = 0;
+  }
+  return len;
+}
+
+/// BSD strlcat, not available in all C libraries.
+inline size_t host_strlcat(char* dst, const char* src, size_t size)
+{
+  size_t len = strnlen(dst, size);
+  return len + host_strlcpy(dst + len, src, size - len);
+}
+
+#define strlcpy_P host_strlcpy
+#define strlcat_P host_strlcat